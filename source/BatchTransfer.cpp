@@ -0,0 +1,50 @@
+#include "BatchTransfer.h"
+
+
+BatchTransfer::BatchTransfer(void) {
+	patchCount = 0;
+}
+
+
+void BatchTransfer::begin(unsigned int patchCount) {
+	this->patchCount = patchCount;
+	sources.clear();
+}
+
+void BatchTransfer::addRow(const FormFactorCache::Row& row, const Vector3f& energy) {
+	if (row.empty())
+		return;
+
+	Source s = { &row[0], row.size(), energy };
+	sources.push_back(s);
+}
+
+size_t BatchTransfer::getEntriesCount() const {
+	size_t n = 0;
+	for (unsigned int s = 0; s < sources.size(); s++)
+		n += sources[s].size;
+	return n;
+}
+
+
+bool BatchTransfer::idLess(const FormFactorCache::Entry& a, unsigned int id) {
+	return a.id < id;
+}
+
+
+/**
+ * Hranice bloku v kazdem radku binarnim vyhledanim; posledni blok konci koncem radku
+ */
+void BatchTransfer::split(unsigned int blockCount, unsigned int blockSize) {
+	unsigned int sourceCount = sources.size();
+	starts.resize((blockCount + 1) * sourceCount);
+
+	for (unsigned int s = 0; s < sourceCount; s++) {
+		const FormFactorCache::Entry* first = sources[s].entries;
+		const FormFactorCache::Entry* last = first + sources[s].size;
+
+		for (unsigned int b = 0; b < blockCount; b++)
+			starts[b * sourceCount + s] = lower_bound(first, last, b * blockSize, idLess) - first;
+		starts[blockCount * sourceCount + s] = sources[s].size;
+	}
+}
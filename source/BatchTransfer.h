@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "FormFactorCache.h"
+#include "EnergyAccumulator.h"
+#include "Vector.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+
+/**
+ * Prenos energie davky zdroju jako soucin ridke a huste matice: radky form factoru zdroju (serazene podle
+ * cisla patche) krat RGB energie zdroju. Prijemci se rozdeli na souvisle bloky a kazdy blok zpracuje jedno
+ * vlakno sloucenim useku vsech radku, ktere do bloku padnou - energie vsech zdroju pro jeden patch se
+ * sectou a prijemce ji dostane jednou za davku, bez pomocnych poli po patchich a bez atomickych operaci.
+ */
+class BatchTransfer {
+
+	public:
+		BatchTransfer(void);
+
+		void begin(unsigned int patchCount);
+		void addRow(const FormFactorCache::Row& row, const Vector3f& energy);	// radek musi zit do konce execute
+
+		template <class Sink>
+		void execute(Sink& sink);	// preda energie: sink(unsigned int id, const Vector3f& energy), kazdy patch jednou
+
+		size_t getEntriesCount() const;	// nenulove prvky matice davky
+
+	private:
+		struct Source {
+			const FormFactorCache::Entry* entries;
+			size_t size;
+			Vector3f energy;
+		};
+
+		static bool idLess(const FormFactorCache::Entry& a, unsigned int id);
+		void split(unsigned int blockCount, unsigned int blockSize);	// zacatky bloku v radcich
+
+		unsigned int patchCount;
+		vector<Source> sources;
+		vector<size_t> starts;	// (blok, zdroj) -> prvni polozka radku v bloku; blockCount + 1 radku
+};
+
+
+// bloku prijemcu na vlakno - vyrovnava nerovnomerne rozlozene radky
+static const unsigned int BATCH_BLOCKS_PER_THREAD = 4;
+
+
+/**
+ * Blok slucuje useky radku jako pri slevani serazenych posloupnosti - nejmensi cislo patche mezi cely
+ * useku, soucet pres zdroje, ktere jej maji, a posun techto useku. Zdroju je v davce malo (HEMICUBES_CNT),
+ * nejmensi cislo se proto hleda linearne
+ */
+template <class Sink>
+void BatchTransfer::execute(Sink& sink) {
+	unsigned int sourceCount = sources.size();
+	if (sourceCount == 0 || patchCount == 0)
+		return;
+
+	unsigned int blockCount = min(patchCount, EnergyAccumulator::maxThreads() * BATCH_BLOCKS_PER_THREAD);
+	unsigned int blockSize = (patchCount + blockCount - 1) / blockCount;
+	split(blockCount, blockSize);
+
+	#pragma omp parallel
+	{
+		vector<size_t> heads(sourceCount);
+
+		#pragma omp for schedule(dynamic, 1)
+		for (int b = 0; b < int(blockCount); b++) {
+			const size_t* from = &starts[b * sourceCount];
+			const size_t* to = &starts[(b + 1) * sourceCount];
+			for (unsigned int s = 0; s < sourceCount; s++)
+				heads[s] = from[s];
+
+			while (true) {
+				unsigned int id = 0xFFFFFFFF;
+				for (unsigned int s = 0; s < sourceCount; s++) {
+					if (heads[s] < to[s])
+						id = min(id, (unsigned int)sources[s].entries[heads[s]].id);
+				}
+				if (id == 0xFFFFFFFF)
+					break;
+
+				Vector3f energy(0, 0, 0);
+				for (unsigned int s = 0; s < sourceCount; s++) {
+					if (heads[s] < to[s] && sources[s].entries[heads[s]].id == id) {
+						energy += sources[s].energy * sources[s].entries[heads[s]].factor;
+						heads[s]++;
+					}
+				}
+
+				sink(id, energy);
+			}
+		}
+	}
+}
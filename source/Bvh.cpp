@@ -0,0 +1,256 @@
+#include "Bvh.h"
+#include <algorithm>
+#include <math.h>
+
+
+// pocet binu pro odhad SAH a nejvetsi hloubka stromu (omezuje zasobnik pri pruchodu)
+static const unsigned int SAH_BINS = 12;
+static const unsigned int MAX_DEPTH = 48;
+
+
+Aabb::Aabb(void)
+	: min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {
+}
+
+
+void Aabb::extend(const Vector3f& p) {
+	min.x = std::min(min.x, p.x); min.y = std::min(min.y, p.y); min.z = std::min(min.z, p.z);
+	max.x = std::max(max.x, p.x); max.y = std::max(max.y, p.y); max.z = std::max(max.z, p.z);
+}
+
+
+void Aabb::extend(const Aabb& b) {
+	if (b.isEmpty())
+		return;
+	extend(b.min);
+	extend(b.max);
+}
+
+
+bool Aabb::isEmpty() const {
+	return min.x > max.x;
+}
+
+
+Vector3f Aabb::getCenter() const {
+	return (min + max) * 0.5f;
+}
+
+
+float Aabb::getArea() const {
+	if (isEmpty())
+		return 0;
+	Vector3f d = max - min;
+	return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+
+/**
+ * Transformuje vsech 8 rohu a vraci jejich obalovy kvadr
+ */
+Aabb Aabb::transformed(const Matrix4f& m) const {
+	Aabb result;
+	if (isEmpty())
+		return result;
+
+	for (unsigned int i = 0; i < 8; i++) {
+		Vector3f corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+		result.extend(m.v_Transform_Pos(corner));
+	}
+	return result;
+}
+
+
+/**
+ * Slab test; nulove slozky smeru davaji v invDir nekonecna, ktera test zvlada
+ */
+bool Aabb::intersectRay(const Vector3f& origin, const Vector3f& invDir, float tmax, float& tmin) const {
+	float t0 = 0, t1 = tmax;
+
+	for (int a = 0; a < 3; a++) {
+		float tNear = (min[a] - origin[a]) * invDir[a];
+		float tFar = (max[a] - origin[a]) * invDir[a];
+		if (tNear > tFar)
+			std::swap(tNear, tFar);
+
+		// NaN (0 * nekonecno) porovnani neprojde a interval nezmeni
+		if (tNear > t0) t0 = tNear;
+		if (tFar < t1) t1 = tFar;
+		if (t0 > t1)
+			return false;
+	}
+
+	tmin = t0;
+	return true;
+}
+
+
+/**
+ * Postavi strom; prvky s prazdnym kvadrem se do stromu nezaradi
+ */
+void Bvh::build(const vector<Aabb>& boxes) {
+	clear();
+
+	vector<Vector3f> centers(boxes.size());
+	items.reserve(boxes.size());
+	for (unsigned int i = 0; i < boxes.size(); i++) {
+		if (boxes[i].isEmpty())
+			continue;
+		centers[i] = boxes[i].getCenter();
+		items.push_back(i);
+	}
+
+	if (items.empty())
+		return;
+
+	nodes.reserve(2 * items.size() / MAX_LEAF_SIZE + 1);
+	nodes.push_back(Node());
+	buildNode(0, 0, items.size(), 0, boxes, centers);
+}
+
+
+/**
+ * Rozdeleni prvku podle binu stredu na ose
+ */
+struct SplitPredicate {
+	const vector<Vector3f>& centers;
+	int axis;
+	float origin, scale;
+	unsigned int split;
+
+	SplitPredicate(const vector<Vector3f>& centers, int axis, float origin, float scale, unsigned int split)
+		: centers(centers), axis(axis), origin(origin), scale(scale), split(split) {
+	}
+
+	bool operator()(unsigned int item) const {
+		return (unsigned int)((centers[item][axis] - origin) * scale) < split;
+	}
+};
+
+
+/**
+ * Rekurzivne rozdeli prvky items[from, to) uzlu 'node'
+ */
+void Bvh::buildNode(unsigned int node, unsigned int from, unsigned int to, unsigned int depth, const vector<Aabb>& boxes, const vector<Vector3f>& centers) {
+	Aabb box, centerBox;
+	for (unsigned int i = from; i < to; i++) {
+		box.extend(boxes[items[i]]);
+		centerBox.extend(centers[items[i]]);
+	}
+
+	nodes[node].box = box;
+	nodes[node].first = from;
+	nodes[node].count = to - from;
+
+	if (to - from <= MAX_LEAF_SIZE || depth >= MAX_DEPTH)
+		return;
+
+	// deli se podle osy s nejvetsim rozptylem stredu
+	Vector3f extent = centerBox.max - centerBox.min;
+	int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	if (extent[axis] <= 0)
+		return;	// vsechny stredy splyvaji, nelze delit
+
+	// binovani stredu a vyber rezu s nejmensi cenou
+	Aabb binBoxes[SAH_BINS];
+	unsigned int binCounts[SAH_BINS] = {0};
+	float scale = SAH_BINS / extent[axis];
+
+	for (unsigned int i = from; i < to; i++) {
+		unsigned int b = std::min(SAH_BINS - 1, (unsigned int)((centers[items[i]][axis] - centerBox.min[axis]) * scale));
+		binCounts[b]++;
+		binBoxes[b].extend(boxes[items[i]]);
+	}
+
+	float rightArea[SAH_BINS];
+	unsigned int rightCount[SAH_BINS];
+	Aabb acc;
+	unsigned int cnt = 0;
+	for (int b = SAH_BINS - 1; b > 0; b--) {
+		acc.extend(binBoxes[b]);
+		cnt += binCounts[b];
+		rightArea[b] = acc.getArea();
+		rightCount[b] = cnt;
+	}
+
+	float bestCost = FLT_MAX;
+	unsigned int bestSplit = 0;
+	acc = Aabb();
+	cnt = 0;
+	for (unsigned int b = 1; b < SAH_BINS; b++) {
+		acc.extend(binBoxes[b - 1]);
+		cnt += binCounts[b - 1];
+		float cost = acc.getArea() * cnt + rightArea[b] * rightCount[b];
+		if (cnt > 0 && rightCount[b] > 0 && cost < bestCost) {
+			bestCost = cost;
+			bestSplit = b;
+		}
+	}
+
+	// maly list je levnejsi nez deleni
+	if (bestSplit == 0 || (to - from <= 16 && bestCost >= box.getArea() * (to - from)))
+		return;
+
+	unsigned int* middle = std::partition(&items[0] + from, &items[0] + to, SplitPredicate(centers, axis, centerBox.min[axis], scale, bestSplit));
+	unsigned int mid = (unsigned int)(middle - &items[0]);
+
+	unsigned int left = nodes.size();
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+
+	nodes[node].first = left;
+	nodes[node].count = 0;
+
+	buildNode(left, from, mid, depth + 1, boxes, centers);
+	buildNode(left + 1, mid, to, depth + 1, boxes, centers);
+}
+
+
+void Bvh::clear() {
+	nodes.clear();
+	items.clear();
+}
+
+
+bool Bvh::isEmpty() const {
+	return nodes.empty();
+}
+
+
+const Aabb& Bvh::getBounds() const {
+	static const Aabb empty;
+	return nodes.empty() ? empty : nodes[0].box;
+}
+
+
+const vector<Bvh::Node>& Bvh::getNodes() const {
+	return nodes;
+}
+
+
+const vector<unsigned int>& Bvh::getItems() const {
+	return items;
+}
+
+
+float intersectTriangle(const Vector3f& origin, const Vector3f& dir, const Vector3f& a, const Vector3f& b, const Vector3f& c) {
+	Vector3f e1 = b - a;
+	Vector3f e2 = c - a;
+	Vector3f p = dir.v_Cross(e2);
+	float det = e1.f_Dot(p);
+	if (fabs(det) < 1e-12f)
+		return -1;
+
+	float inv = 1.0f / det;
+	Vector3f s = origin - a;
+	float u = s.f_Dot(p) * inv;
+	if (u < 0 || u > 1)
+		return -1;
+
+	Vector3f q = s.v_Cross(e1);
+	float v = dir.f_Dot(q) * inv;
+	if (v < 0 || u + v > 1)
+		return -1;
+
+	return e2.f_Dot(q) * inv;
+}
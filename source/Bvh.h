@@ -0,0 +1,166 @@
+#pragma once
+
+#include <vector>
+#include <float.h>
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Osove zarovnany kvadr
+ */
+struct Aabb {
+	Vector3f min, max;
+
+	Aabb(void);	// prazdny kvadr (min > max)
+
+	void extend(const Vector3f& p);	// rozsiri kvadr o bod
+	void extend(const Aabb& b);		// rozsiri kvadr o jiny kvadr
+	bool isEmpty() const;
+	Vector3f getCenter() const;
+	float getArea() const;			// povrch kvadru (cena uzlu pro SAH)
+
+	Aabb transformed(const Matrix4f& m) const;	// kvadr obalujici transformovany kvadr
+	bool intersectRay(const Vector3f& origin, const Vector3f& invDir, float tmax, float& tmin) const;	// pruseciku s paprskem v intervalu <0, tmax>; tmin = vstup do kvadru
+};
+
+
+/**
+ * Hierarchie obalovych kvadru nad obecnou mnozinou prvku zadanych svymi kvadry. Stavi se binovanou
+ * SAH heuristikou; uzly lezi v jednom poli, potomci vnitrniho uzlu jsou vzdy vedle sebe.
+ * Prvky se v listech odkazuji pres pole getItems (poradi cisel prvku podle listu).
+ */
+class Bvh {
+
+	public:
+		struct Node {
+			Aabb box;
+			unsigned int first;	// list: prvni polozka v poli items; vnitrni uzel: levy potomek (pravy je first + 1)
+			unsigned int count;	// list: pocet prvku; 0 = vnitrni uzel
+		};
+
+		static const unsigned int MAX_LEAF_SIZE = 4;
+
+		void build(const vector<Aabb>& boxes);	// postavi strom nad danymi kvadry (cislo prvku = index v poli)
+		void clear();
+
+		bool isEmpty() const;
+		const Aabb& getBounds() const;			// kvadr celeho stromu
+		const vector<Node>& getNodes() const;
+		const vector<unsigned int>& getItems() const;
+
+		/**
+		 * Projde listy zasazene paprskem, blizsi potomky driv. Navstevnik: bool visitor(unsigned int item, float& tmax) -
+		 * pri zasahu zkrati tmax, vraci true pro ukonceni pruchodu (staci libovolny zasah)
+		 */
+		template <class Visitor>
+		bool traverseRay(const Vector3f& origin, const Vector3f& dir, float& tmax, Visitor& visitor) const;
+
+		/**
+		 * Totez nad poli uzlu a polozek ulozenymi mimo strom (kopie getNodes a getItems, napr. v namapovanem souboru)
+		 */
+		template <class Visitor>
+		static bool traverseRay(const Node* nodes, const unsigned int* items, const Vector3f& origin, const Vector3f& dir, float& tmax, Visitor& visitor);
+
+		/**
+		 * Projde listy, jejichz kvadry prijme test: bool test(const Aabb& box); kazdy prvek techto listu preda
+		 * navstevnikovi: void visitor(unsigned int item)
+		 */
+		template <class Test, class Visitor>
+		void traverse(Test& test, Visitor& visitor) const;
+
+	private:
+		void buildNode(unsigned int node, unsigned int from, unsigned int to, unsigned int depth, const vector<Aabb>& boxes, const vector<Vector3f>& centers);
+
+		vector<Node> nodes;
+		vector<unsigned int> items;
+};
+
+
+/**
+ * Prusecik paprsku s trojuhelnikem (Moller-Trumbore); vraci vzdalenost v jednotkach delky 'dir' nebo zaporne cislo
+ */
+float intersectTriangle(const Vector3f& origin, const Vector3f& dir, const Vector3f& a, const Vector3f& b, const Vector3f& c);
+
+
+
+template <class Visitor>
+bool Bvh::traverseRay(const Vector3f& origin, const Vector3f& dir, float& tmax, Visitor& visitor) const {
+	if (nodes.empty())
+		return false;
+
+	return traverseRay(&nodes[0], &items[0], origin, dir, tmax, visitor);
+}
+
+
+template <class Visitor>
+bool Bvh::traverseRay(const Node* nodes, const unsigned int* items, const Vector3f& origin, const Vector3f& dir, float& tmax, Visitor& visitor) {
+	Vector3f invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+
+	unsigned int stack[64];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	float t;
+	if (!nodes[0].box.intersectRay(origin, invDir, tmax, t))
+		return false;
+
+	while (stackSize > 0) {
+		const Node& n = nodes[stack[--stackSize]];
+
+		if (n.count > 0) {
+			for (unsigned int i = n.first; i < n.first + n.count; i++) {
+				if (visitor(items[i], tmax))
+					return true;
+			}
+			continue;
+		}
+
+		// blizsiho potomka dat na zasobnik posledniho, aby se zpracoval driv
+		float tl, tr;
+		bool hl = nodes[n.first].box.intersectRay(origin, invDir, tmax, tl);
+		bool hr = nodes[n.first + 1].box.intersectRay(origin, invDir, tmax, tr);
+
+		if (hl && hr && stackSize + 2 <= 64) {
+			if (tl < tr) {
+				stack[stackSize++] = n.first + 1;
+				stack[stackSize++] = n.first;
+			} else {
+				stack[stackSize++] = n.first;
+				stack[stackSize++] = n.first + 1;
+			}
+		} else if (hl && stackSize < 64) {
+			stack[stackSize++] = n.first;
+		} else if (hr && stackSize < 64) {
+			stack[stackSize++] = n.first + 1;
+		}
+	}
+
+	return false;
+}
+
+
+template <class Test, class Visitor>
+void Bvh::traverse(Test& test, Visitor& visitor) const {
+	if (nodes.empty())
+		return;
+
+	unsigned int stack[64];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const Node& n = nodes[stack[--stackSize]];
+		if (!test(n.box))
+			continue;
+
+		if (n.count > 0) {
+			for (unsigned int i = n.first; i < n.first + n.count; i++)
+				visitor(items[i]);
+		} else if (stackSize + 2 <= 64) {
+			stack[stackSize++] = n.first + 1;
+			stack[stackSize++] = n.first;
+		}
+	}
+}
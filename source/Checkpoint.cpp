@@ -0,0 +1,137 @@
+#include "Checkpoint.h"
+
+
+Checkpoint::Checkpoint(void) {
+	thread = NULL;
+	requestEvent = NULL;
+	doneEvent = NULL;
+	quit = false;
+
+	patches = NULL;
+	count = 0;
+}
+
+
+Checkpoint::~Checkpoint(void) {
+	stop();
+}
+
+
+/**
+ * Spusti vlakno; zapisy zacnou az s prvnim pozadavkem
+ */
+bool Checkpoint::start(const char* filename) {
+	stop();
+
+	this->filename = filename;
+	quit = false;
+
+	requestEvent = CreateEvent(NULL, FALSE, FALSE, NULL);	// automaticky reset - jeden pozadavek = jeden zapis
+	doneEvent = CreateEvent(NULL, TRUE, TRUE, NULL);		// rucni reset, na zacatku nic neprobiha
+	if (requestEvent != NULL && doneEvent != NULL)
+		thread = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+
+	if (thread == NULL) {
+		cerr << "Unable to start the checkpoint thread" << endl;
+		stop();
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Pocka na rozpracovany zapis, ukonci vlakno a uvolni snapshot
+ */
+void Checkpoint::stop() {
+	if (thread != NULL) {
+		wait();
+		quit = true;
+		SetEvent(requestEvent);
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+	if (requestEvent != NULL)
+		CloseHandle(requestEvent);
+	if (doneEvent != NULL)
+		CloseHandle(doneEvent);
+
+	thread = NULL;
+	requestEvent = NULL;
+	doneEvent = NULL;
+
+	vector<float>().swap(energies);
+	patches = NULL;
+	count = 0;
+}
+
+
+bool Checkpoint::isBusy() const {
+	return thread != NULL && WaitForSingleObject(doneEvent, 0) != WAIT_OBJECT_0;
+}
+
+
+void Checkpoint::wait() {
+	if (thread != NULL)
+		WaitForSingleObject(doneEvent, INFINITE);
+}
+
+
+/**
+ * Zkopiruje energie patchu do snapshotu a probudi vlakno. Kopie je jediny okamzik, kdy se hlavni
+ * vlakno zdrzi - jde o linearni pruchod patchy, zanedbatelny proti jednomu cyklu vyzarovani
+ */
+bool Checkpoint::request(Patch** patches, unsigned int count, const SceneFile::SceneMetadata& meta) {
+	if (thread == NULL || isBusy())
+		return false;
+
+	energies.resize(size_t(count) * 6);
+
+	#pragma omp parallel for
+	for (int i = 0; i < int(count); i++) {
+		float* e = &energies[size_t(i) * 6];
+		Patch* p = patches[i];
+		e[0] = p->illumination.x; e[1] = p->illumination.y; e[2] = p->illumination.z;
+		e[3] = p->radiosity.x; e[4] = p->radiosity.y; e[5] = p->radiosity.z;
+	}
+
+	this->patches = patches;
+	this->count = count;
+	this->meta = meta;
+
+	ResetEvent(doneEvent);
+	SetEvent(requestEvent);
+	return true;
+}
+
+
+DWORD WINAPI Checkpoint::threadProc(LPVOID param) {
+	((Checkpoint*)param)->run();
+	return 0;
+}
+
+
+/**
+ * Smycka vlakna - ceka na snapshot a zapisuje jej
+ */
+void Checkpoint::run() {
+	// zapis nesmi brzdit vykreslovani ani vypocet
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+	while (true) {
+		WaitForSingleObject(requestEvent, INFINITE);
+		if (quit)
+			break;
+
+		string tmp = filename + ".tmp";
+		bool ok = SceneFile::save(tmp.c_str(), patches, count, meta, count > 0 ? &energies[0] : NULL);
+		if (ok)
+			ok = MoveFileExA(tmp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+
+		if (!ok)
+			cerr << "Unable to write the checkpoint " << filename << endl;
+
+		SetEvent(doneEvent);
+	}
+}
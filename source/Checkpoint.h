@@ -0,0 +1,51 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "Patch.h"
+#include "SceneFile.h"
+
+using namespace std;
+
+
+/**
+ * Prubezne ukladani stavu vypoctu (checkpoint) ve vlaknu na pozadi.
+ * Hlavni vlakno pri pozadavku pouze zkopiruje energie patchu do snapshotu (6 floatu na patch) a pokracuje
+ * ve vypoctu; vlakno pak zapise celou scenu ve formatu SceneFile, energie bere ze snapshotu. Geometrie, barvy
+ * a sousedi se behem vypoctu nemeni, ctou se primo z patchu - scenu proto nelze menit, dokud zapis probiha (wait).
+ *
+ * Soubor se nejdriv zapise pod docasnym jmenem a az pak prejmenuje, padek behem zapisu tedy nepokazi
+ * predchozi checkpoint.
+ */
+class Checkpoint {
+
+	public:
+		Checkpoint(void);
+		~Checkpoint(void);
+
+		bool start(const char* filename);	// spusti vlakno zapisujici do daneho souboru
+		void stop();						// dokonci rozpracovany zapis a ukonci vlakno
+
+		bool request(Patch** patches, unsigned int count, const SceneFile::SceneMetadata& meta);	// vytvori snapshot a preda jej vlaknu; false, pokud predchozi zapis jeste bezi
+		bool isBusy() const;				// probiha zapis?
+		void wait();						// pocka na dokonceni rozpracovaneho zapisu
+
+	private:
+		static DWORD WINAPI threadProc(LPVOID param);
+		void run();
+
+		HANDLE thread;
+		HANDLE requestEvent;	// signalizuje novy snapshot
+		HANDLE doneEvent;		// signalizuje, ze zadny zapis neprobiha
+		volatile bool quit;
+
+		string filename;
+
+		// snapshot predany vlaknu
+		vector<float> energies;
+		Patch** patches;
+		unsigned int count;
+		SceneFile::SceneMetadata meta;
+};
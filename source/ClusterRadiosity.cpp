@@ -0,0 +1,416 @@
+#include "ClusterRadiosity.h"
+#include <algorithm>
+#include <float.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// pocet uzlu rezu stromem, jehoz dvojice se zpracuji paralelne
+static const unsigned int CUT_SIZE = 64;
+
+// paprsky mezi patchi dvojice pro odhad viditelnosti vazby
+static const unsigned int VISIBILITY_SAMPLES = 4;
+
+// paprsek konci kousek pred cilovym patchem, aby jej nezasahl
+static const float VISIBILITY_EPSILON = 1e-3f;
+
+// shluk je orientovany, pokud je velikost souctu normal (vazenych obsahem) aspon tato cast obsahu
+static const float ORIENTED_RATIO = 0.9f;
+
+// nejmensi dulezitost prijemce pri deleni vazeb - i nedulezite casti sceny dostanou aspon hrube vazby
+static const float IMPORTANCE_FLOOR = 0.05f;
+
+
+ClusterRadiosity::ClusterRadiosity(void) {
+	patches = NULL;
+	count = 0;
+	scene = NULL;
+	tolerance = 0;
+	importance = NULL;
+}
+
+
+/**
+ * Vazby se hledaji paralelne pro dvojice uzlu rezu stromem (dvojice shluku nad rezem se tedy nevytvori,
+ * pri CUT_SIZE uzlech to je zanedbatelne). Nakonec se omezi vyzarovani patchu, u kterych odhady
+ * form factoru jejich vazeb (i vazeb jejich shluku) daji v souctu vic nez 1
+ */
+void ClusterRadiosity::build(Patch** patches, unsigned int count, const SceneBvh& visibility, float tolerance, const float* importance) {
+	clear();
+
+	if (count == 0)
+		return;
+
+	this->patches = patches;
+	this->count = count;
+	this->scene = &visibility;
+	this->tolerance = tolerance;
+	this->importance = importance;
+
+	// uzly BVH nad patchi sceny jsou shluky
+	Bvh bvh;
+	SceneBvh::buildPatchBvh(bvh, patches, count);
+	order = bvh.getItems();
+	buildNodes(bvh);
+
+	// rez - opakovane nahradit nejvetsi shluk jeho potomky
+	vector<unsigned int> cut(1, 0);
+	while (cut.size() < CUT_SIZE) {
+		int largest = -1;
+		for (unsigned int i = 0; i < cut.size(); i++) {
+			if (nodes[cut[i]].childCount > 0 && (largest < 0 || nodes[cut[i]].radius > nodes[cut[largest]].radius))
+				largest = i;
+		}
+		if (largest < 0)
+			break;
+
+		const Node& n = nodes[cut[largest]];
+		cut.erase(cut.begin() + largest);
+		for (unsigned int c = 0; c < n.childCount; c++)
+			cut.push_back(n.firstChild + c);
+	}
+
+#ifdef _OPENMP
+	vector<vector<Link> > threadLinks(omp_get_max_threads());
+#else
+	vector<vector<Link> > threadLinks(1);
+#endif
+
+	int pairs = int(cut.size() * cut.size());
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < pairs; i++) {
+#ifdef _OPENMP
+		vector<Link>& out = threadLinks[omp_get_thread_num()];
+#else
+		vector<Link>& out = threadLinks[0];
+#endif
+		refine(cut[i / cut.size()], cut[i % cut.size()], out);
+	}
+
+	for (unsigned int t = 0; t < threadLinks.size(); t++)
+		links.insert(links.end(), threadLinks[t].begin(), threadLinks[t].end());
+	sort(links.begin(), links.end(), receiverLess);
+
+	for (unsigned int l = 0; l < links.size(); l++) {
+		if (receivers.empty() || receivers.back() != links[l].receiver) {
+			receivers.push_back(links[l].receiver);
+			linkStarts.push_back(l);
+		}
+	}
+	linkStarts.push_back(links.size());
+
+	// soucet form factoru vazeb kazdeho patche a jeho shluku
+	vector<float> outgoing(nodes.size(), 0.0f);
+	for (unsigned int l = 0; l < links.size(); l++)
+		outgoing[links[l].source] += links[l].factor;
+
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		for (unsigned int c = 0; c < nodes[i].childCount; c++)
+			outgoing[nodes[i].firstChild + c] += outgoing[i];
+	}
+
+	emitScale.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		float total = outgoing[patchNodes[i]];
+		emitScale[i] = (total > 1) ? 1 / total : 1;
+	}
+}
+
+
+void ClusterRadiosity::clear() {
+	nodes.clear();
+	order.clear();
+	patchNodes.clear();
+	emitScale.clear();
+	links.clear();
+	receivers.clear();
+	linkStarts.clear();
+
+	patches = NULL;
+	count = 0;
+	scene = NULL;
+	importance = NULL;
+}
+
+
+bool ClusterRadiosity::isBuilt() const {
+	return !nodes.empty();
+}
+
+
+/**
+ * Kazdy patch vyzari svou nevystrelenou energii; odrazena cast prijate energie bude vyzarena v dalsim kroku
+ */
+float ClusterRadiosity::step() {
+	if (nodes.empty())
+		return 0;
+
+	int n = int(count);
+
+	// vyzarovana energie patchu, patch si ji zapocita do iluminativni
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		Node& node = nodes[patchNodes[i]];
+		Patch* p = patches[order[i]];
+
+		node.power = p->radiosity * p->getColor() * emitScale[i];
+		node.received = Vector3f(0, 0, 0);
+
+		p->illumination += p->radiosity;
+		p->radiosity = Vector3f(0, 0, 0);
+	}
+
+	// pull - potomci maji vetsi cisla nez rodice
+	for (int i = int(nodes.size()) - 1; i >= 0; i--) {
+		Node& node = nodes[i];
+		if (node.childCount == 0)
+			continue;
+
+		node.power = Vector3f(0, 0, 0);
+		node.received = Vector3f(0, 0, 0);
+		for (unsigned int c = 0; c < node.childCount; c++)
+			node.power += nodes[node.firstChild + c].power;
+	}
+
+	// prenos po vazbach - kazdeho prijemce zpracuje jedno vlakno
+	#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < int(receivers.size()); i++) {
+		Vector3f sum(0, 0, 0);
+		for (unsigned int l = linkStarts[i]; l < linkStarts[i + 1]; l++)
+			sum += nodes[links[l].source].power * links[l].factor;
+		nodes[receivers[i]].received = sum;
+	}
+
+	// push - energie shluku se rozdeli potomkum podle obsahu
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		const Node& node = nodes[i];
+		if (node.childCount == 0 || node.area <= 0)
+			continue;
+
+		for (unsigned int c = 0; c < node.childCount; c++) {
+			Node& child = nodes[node.firstChild + c];
+			child.received += node.received * (child.area / node.area);
+		}
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		Patch* p = patches[order[i]];
+		p->radiosity += nodes[patchNodes[i]].received * p->getReflectivity();
+	}
+
+	float maxEnergy = 0;
+	for (int i = 0; i < n; i++)
+		maxEnergy = max(maxEnergy, patches[i]->radiosity.f_Length2());
+
+	return sqrt(maxEnergy);
+}
+
+
+unsigned int ClusterRadiosity::getNodesCount() const {
+	return nodes.size();
+}
+
+
+unsigned int ClusterRadiosity::getLinksCount() const {
+	return links.size();
+}
+
+
+bool ClusterRadiosity::receiverLess(const Link& a, const Link& b) {
+	return a.receiver < b.receiver;
+}
+
+
+/**
+ * Uzly se cisluji do sirky: vnitrni uzel BVH ma za potomky sve dva potomky, list BVH sve patche.
+ * Vlastnosti shluku se pak spocitaji od konce pole (od patchu nahoru)
+ */
+void ClusterRadiosity::buildNodes(const Bvh& bvh) {
+	const vector<Bvh::Node>& bvhNodes = bvh.getNodes();
+
+	// co uzel predstavuje: uzel BVH (>= 0) nebo -(polozka order + 1)
+	vector<int> source(1, 0);
+	nodes.resize(1);
+
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		nodes[i].firstChild = nodes.size();
+		nodes[i].childCount = 0;
+
+		if (source[i] < 0) {
+			nodes[i].firstPatch = (unsigned int)(-source[i] - 1);
+			nodes[i].patchCount = 1;
+			continue;
+		}
+
+		const Bvh::Node& b = bvhNodes[source[i]];
+		if (b.count == 0) {
+			nodes[i].childCount = 2;
+			source.push_back(b.first);
+			source.push_back(b.first + 1);
+		} else {
+			nodes[i].childCount = b.count;
+			for (unsigned int k = 0; k < b.count; k++)
+				source.push_back(-int(b.first + k) - 1);
+		}
+		nodes.resize(source.size());
+	}
+
+	patchNodes.resize(count);
+	for (int i = int(nodes.size()) - 1; i >= 0; i--) {
+		Node& node = nodes[i];
+
+		if (node.childCount == 0) {
+			Patch* p = patches[order[node.firstPatch]];
+			patchNodes[node.firstPatch] = i;
+
+			const Vector3f* vertices = p->getVertices();
+			for (unsigned int v = 0; v < 4; v++)
+				node.box.extend(vertices[v]);
+
+			// ctyruhelnik - polovina velikosti soucinu uhlopricek
+			Vector3f d1 = vertices[2] - vertices[0];
+			Vector3f d2 = vertices[3] - vertices[1];
+			node.area = d1.v_Cross(d2).f_Length() / 2;
+
+			node.normal = p->getNormal();
+			float length = node.normal.f_Length();
+			if (length > 0)
+				node.normal *= 1 / length;
+			node.oriented = true;
+			node.center = p->getCenter();
+			node.importance = (importance != NULL) ? max(importance[order[node.firstPatch]], IMPORTANCE_FLOOR) : 1;
+		} else {
+			Vector3f normalSum(0, 0, 0);
+			node.area = 0;
+			node.firstPatch = nodes[node.firstChild].firstPatch;
+			node.patchCount = 0;
+			node.importance = 0;
+
+			for (unsigned int c = 0; c < node.childCount; c++) {
+				const Node& child = nodes[node.firstChild + c];
+				node.box.extend(child.box);
+				node.area += child.area;
+				node.patchCount += child.patchCount;
+				node.importance = max(node.importance, child.importance);
+				normalSum += child.normal * child.area;
+			}
+
+			float length = normalSum.f_Length();
+			node.normal = (length > 0) ? normalSum * (1 / length) : Vector3f(0, 0, 1);
+			node.oriented = length >= ORIENTED_RATIO * node.area && length > 0;
+			node.center = node.box.getCenter();
+		}
+
+		node.radius = (node.box.max - node.box.min).f_Length() / 2;
+		node.power = Vector3f(0, 0, 0);
+		node.received = Vector3f(0, 0, 0);
+	}
+}
+
+
+/**
+ * Vazba zdroj -> prijemce vznikne, pokud je horni odhad form factoru (nasobeny dulezitosti prijemce) pod
+ * toleranci nebo jde o dvojici patchu; jinak se deli vetsi z dvojice. Dvojice uzlu se sebou sama se rozlozi
+ * na vsechny dvojice potomku
+ */
+void ClusterRadiosity::refine(unsigned int si, unsigned int ri, vector<Link>& out) {
+	const Node& s = nodes[si];
+	const Node& r = nodes[ri];
+
+	if (si == ri) {
+		for (unsigned int a = 0; a < s.childCount; a++) {
+			for (unsigned int b = 0; b < s.childCount; b++)
+				refine(s.firstChild + a, s.firstChild + b, out);
+		}
+		return;
+	}
+
+	// patch nevyzaruje dozadu a zezadu nic neprijme
+	if (s.childCount == 0 && isBehind(s, r))
+		return;
+	if (r.childCount == 0 && isBehind(r, s))
+		return;
+
+	if ((s.childCount == 0 && r.childCount == 0) || formFactorBound(s, r) * r.importance <= tolerance) {
+		float f = formFactor(s, r);
+		if (f > 0)
+			f *= visibility(s, r);
+		if (f > 0) {
+			Link l = { si, ri, f };
+			out.push_back(l);
+		}
+		return;
+	}
+
+	if (r.childCount == 0 || (s.childCount > 0 && s.radius >= r.radius)) {
+		for (unsigned int c = 0; c < s.childCount; c++)
+			refine(s.firstChild + c, ri, out);
+	} else {
+		for (unsigned int c = 0; c < r.childCount; c++)
+			refine(si, r.firstChild + c, out);
+	}
+}
+
+
+/**
+ * Odhad podilu energie zdroje, ktera dopadne na prijemce - oba uzly jako body ve svych stredech
+ */
+float ClusterRadiosity::formFactor(const Node& s, const Node& r) const {
+	Vector3f d = r.center - s.center;
+	float dist2 = d.f_Length2();
+	if (dist2 <= 0)
+		return 0;
+
+	Vector3f dir = d * (1 / sqrt(dist2));
+
+	float intensity = s.oriented ? max(s.normal.f_Dot(dir), 0.0f) / f_pi : 1 / (4 * f_pi);
+	float projected = r.oriented ? r.area * max(-r.normal.f_Dot(dir), 0.0f) : r.area / 4;
+
+	return min(intensity * projected / dist2, 1.0f);
+}
+
+
+/**
+ * Horni odhad pres nejmensi vzdalenost obalovych kouli; prekryvajici se uzly se musi delit
+ */
+float ClusterRadiosity::formFactorBound(const Node& s, const Node& r) const {
+	float dist = (r.center - s.center).f_Length() - s.radius - r.radius;
+	if (dist <= 0)
+		return FLT_MAX;
+
+	return r.area / (f_pi * dist * dist);
+}
+
+
+/**
+ * Podil neblokovanych paprsku mezi stredy patchu rovnomerne vybranych z obou uzlu
+ */
+float ClusterRadiosity::visibility(const Node& s, const Node& r) const {
+	unsigned int samples = min(VISIBILITY_SAMPLES, max(s.patchCount, r.patchCount));
+	unsigned int visible = 0;
+
+	for (unsigned int k = 0; k < samples; k++) {
+		Patch* a = patches[order[s.firstPatch + k * s.patchCount / samples]];
+		Patch* b = patches[order[r.firstPatch + k * r.patchCount / samples]];
+
+		Vector3f from = a->getCenter();
+		if (!scene->occluded(from, b->getCenter() - from, 1 - VISIBILITY_EPSILON))
+			visible++;
+	}
+
+	return float(visible) / samples;
+}
+
+
+bool ClusterRadiosity::isBehind(const Node& plane, const Node& n) const {
+	for (unsigned int c = 0; c < 8; c++) {
+		Vector3f corner((c & 1) ? n.box.max.x : n.box.min.x, (c & 2) ? n.box.max.y : n.box.min.y, (c & 4) ? n.box.max.z : n.box.min.z);
+		if ((corner - plane.center).f_Dot(plane.normal) > 0)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include "Bvh.h"
+#include "SceneBvh.h"
+#include "Patch.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Radiozita se shluky (Smits, Sillion). Nad patchi sceny se postavi hierarchie shluku - uzly BVH, pod
+ * jejimi listy jednotlive patche - a energie se prenasi vazbami mezi dvojicemi uzlu, jejichz horni odhad
+ * form factoru je maly; vzdalene skupiny patchu si tak vymeni energii jedinou vazbou. Dvojice s velkym
+ * odhadem se deli (vetsi z dvojice), nejvys az na dvojice patchu. Pocet vazeb roste s poctem patchu
+ * zhruba linearne i tam, kde je kazdy patch videt z mnoha jinych.
+ *
+ * Shluk s temer rovnobeznymi patchi je orientovany (vyzaruje a prijima podle kosinu sve normaly),
+ * ostatni jsou izotropni (vyzaruji do vsech smeru stejne, prumet je ctvrtina obsahu).
+ *
+ * S dulezitosti patchu (Importance) se tolerance vazby deli dulezitosti prijemce - vazby do shluku, ktere
+ * jsou videt z pohledu, se deli jemneji nez vazby do zbytku sceny.
+ *
+ * Vazby se sestavi jednou, krok pak vyzari nevystrelenou energii vsech patchu najednou: energie patchu
+ * se secte do shluku, prenese se po vazbach a energie prijata shlukem se rozdeli jeho patchum podle obsahu.
+ */
+class ClusterRadiosity {
+
+	public:
+		ClusterRadiosity(void);
+
+		void build(Patch** patches, unsigned int count, const SceneBvh& visibility, float tolerance = 0.03f, const float* importance = NULL);	// postavi hierarchii a vazby; tolerance = nejvetsi form factor vazby mezi shluky (u dulezitosti 1)
+		void clear();
+		bool isBuilt() const;
+
+		float step();	// vyzari energii vsech patchu; vraci nejvetsi zbyvajici radiativni energii patchu
+
+		unsigned int getNodesCount() const;
+		unsigned int getLinksCount() const;
+
+	private:
+		struct Node {
+			Aabb box;
+			Vector3f center;
+			float radius;
+			float area;
+			Vector3f normal;		// prumerna normala (jednotkova)
+			bool oriented;			// patch nebo shluk temer rovnobeznych patchu
+			unsigned int firstChild, childCount;	// potomci lezi v poli vedle sebe; patch nema potomky
+			unsigned int firstPatch, patchCount;	// patche uzlu - souvisly usek pole order
+			Vector3f power;			// vyzarovana energie
+			Vector3f received;		// prijata energie (pred odrazivosti)
+			float importance;		// nejvetsi dulezitost patchu uzlu (1 bez dulezitosti)
+		};
+
+		struct Link {
+			unsigned int source, receiver;
+			float factor;			// form factor * viditelnost
+		};
+
+		static bool receiverLess(const Link& a, const Link& b);
+
+		void buildNodes(const Bvh& bvh);
+		void refine(unsigned int s, unsigned int r, vector<Link>& links);
+		float formFactor(const Node& s, const Node& r) const;
+		float formFactorBound(const Node& s, const Node& r) const;
+		float visibility(const Node& s, const Node& r) const;
+		bool isBehind(const Node& plane, const Node& n) const;	// lezi kvadr n cely za rovinou patche?
+
+		Patch** patches;
+		unsigned int count;
+		const SceneBvh* scene;
+		float tolerance;
+		const float* importance;	// dulezitost po patchich sceny pri sestavovani; NULL = vsude 1
+
+		vector<Node> nodes;				// poradi do sirky - potomci maji vetsi cisla nez rodice
+		vector<unsigned int> order;		// cisla patchu sceny v poradi listu
+		vector<unsigned int> patchNodes;	// uzel kazde polozky order
+		vector<float> emitScale;		// po polozkach order; omezuje soucet form factoru zdroje na 1
+
+		vector<Link> links;				// serazene podle prijemce
+		vector<unsigned int> receivers;	// uzly, ktere maji vazby
+		vector<unsigned int> linkStarts;	// prvni vazba kazdeho prijemce (a konec posledniho)
+};
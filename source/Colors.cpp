@@ -136,6 +136,46 @@ Vector3f Colors::unpackColor(uint32_t color) {
 }
 
 
+/**
+ * Zabali barvu do formatu RGB9E5 - tri 9bitove mantisy a spolecny 5bitovy exponent
+ * (podle EXT_texture_shared_exponent). Zaporne slozky se orezou na 0, prilis velke na maximum
+ */
+uint32_t Colors::packRGB9E5(Vector3f color) {
+	const int N = 9;		// bitu mantisy
+	const int B = 15;		// bias exponentu
+	const float maxValue = 65408.0f; // (2^9 - 1) / 2^9 * 2^(31 - 15)
+
+	float r = min(max(color.x, 0.0f), maxValue);
+	float g = min(max(color.y, 0.0f), maxValue);
+	float b = min(max(color.z, 0.0f), maxValue);
+	float maxc = max(r, max(g, b));
+
+	int exp = max(-B - 1, int(floor(log(max(maxc, 1e-30f)) / log(2.0f)))) + 1 + B;
+	if (int(floor(maxc / pow(2.0f, float(exp - B - N)) + 0.5f)) == (1 << N))
+		exp++;
+
+	float scale = pow(2.0f, float(exp - B - N));
+	uint32_t rs = uint32_t(floor(r / scale + 0.5f));
+	uint32_t gs = uint32_t(floor(g / scale + 0.5f));
+	uint32_t bs = uint32_t(floor(b / scale + 0.5f));
+
+	return rs | (gs << 9) | (bs << 18) | (uint32_t(exp) << 27);
+}
+
+/**
+ * Rozbali barvu z formatu RGB9E5
+ */
+Vector3f Colors::unpackRGB9E5(uint32_t color) {
+	float scale = pow(2.0f, float(int(color >> 27) - 15 - 9));
+
+	return Vector3f(
+		float(color & 0x1FF) * scale,
+		float((color >> 9) & 0x1FF) * scale,
+		float((color >> 18) & 0x1FF) * scale
+	);
+}
+
+
 /**
  * Vraci pole int-u kde kazdy int obsahuje 'zabalene' tri slozky jedne barvy
  * Pocet barev (prvku pole) odpovida getColorRange()
@@ -199,58 +239,58 @@ void Colors::smoothShadePatch(float* colors, Patch* p) {
 #if 1
 	// levy horni vrchol
 	Vector3f color_lt = p->getColor() * (p->illumination + p->radiosity);
-	color_lt += p->neighbours[7]->getColor() * (p->neighbours[7]->illumination + p->neighbours[7]->radiosity);	
-	color_lt += p->neighbours[0]->getColor() * (p->neighbours[0]->illumination + p->neighbours[0]->radiosity);
-	color_lt += p->neighbours[1]->getColor() * (p->neighbours[1]->illumination + p->neighbours[1]->radiosity);
+	color_lt += p->getNeighbour(7)->getColor() * (p->getNeighbour(7)->illumination + p->getNeighbour(7)->radiosity);	
+	color_lt += p->getNeighbour(0)->getColor() * (p->getNeighbour(0)->illumination + p->getNeighbour(0)->radiosity);
+	color_lt += p->getNeighbour(1)->getColor() * (p->getNeighbour(1)->illumination + p->getNeighbour(1)->radiosity);
 	color_lt = color_lt / 4;
 	
 	// pravy horni vrchol
 	Vector3f color_rt = p->getColor() * (p->illumination + p->radiosity);
-	color_rt += p->neighbours[1]->getColor() * (p->neighbours[1]->illumination + p->neighbours[1]->radiosity);
-	color_rt += p->neighbours[2]->getColor() * (p->neighbours[2]->illumination + p->neighbours[2]->radiosity);
-	color_rt += p->neighbours[3]->getColor() * (p->neighbours[3]->illumination + p->neighbours[3]->radiosity);
+	color_rt += p->getNeighbour(1)->getColor() * (p->getNeighbour(1)->illumination + p->getNeighbour(1)->radiosity);
+	color_rt += p->getNeighbour(2)->getColor() * (p->getNeighbour(2)->illumination + p->getNeighbour(2)->radiosity);
+	color_rt += p->getNeighbour(3)->getColor() * (p->getNeighbour(3)->illumination + p->getNeighbour(3)->radiosity);
 	color_rt = color_rt / 4;
 	
 	// pravy dolni vrchol
 	Vector3f color_rb = p->getColor() * (p->illumination + p->radiosity);
-	color_rb += p->neighbours[3]->getColor() * (p->neighbours[3]->illumination + p->neighbours[3]->radiosity);
-	color_rb += p->neighbours[4]->getColor() * (p->neighbours[4]->illumination + p->neighbours[4]->radiosity);
-	color_rb += p->neighbours[5]->getColor() * (p->neighbours[5]->illumination + p->neighbours[5]->radiosity);
+	color_rb += p->getNeighbour(3)->getColor() * (p->getNeighbour(3)->illumination + p->getNeighbour(3)->radiosity);
+	color_rb += p->getNeighbour(4)->getColor() * (p->getNeighbour(4)->illumination + p->getNeighbour(4)->radiosity);
+	color_rb += p->getNeighbour(5)->getColor() * (p->getNeighbour(5)->illumination + p->getNeighbour(5)->radiosity);
 	color_rb = color_rb / 4;												  
 																			  
 	// levy dolni vrchol													  
 	Vector3f color_lb = p->getColor() * (p->illumination + p->radiosity);	  
-	color_lb += p->neighbours[5]->getColor() * (p->neighbours[5]->illumination + p->neighbours[5]->radiosity);
-	color_lb += p->neighbours[6]->getColor() * (p->neighbours[6]->illumination + p->neighbours[6]->radiosity);
-	color_lb += p->neighbours[7]->getColor() * (p->neighbours[7]->illumination + p->neighbours[7]->radiosity);
+	color_lb += p->getNeighbour(5)->getColor() * (p->getNeighbour(5)->illumination + p->getNeighbour(5)->radiosity);
+	color_lb += p->getNeighbour(6)->getColor() * (p->getNeighbour(6)->illumination + p->getNeighbour(6)->radiosity);
+	color_lb += p->getNeighbour(7)->getColor() * (p->getNeighbour(7)->illumination + p->getNeighbour(7)->radiosity);
 	color_lb = color_lb / 4;
 #else
 	// levy horni vrchol
 	Vector3f color_lt = p->getColor() * p->illumination;
-	color_lt += p->neighbours[7]->getColor() * p->neighbours[7]->illumination;	
-	color_lt += p->neighbours[0]->getColor() * p->neighbours[0]->illumination;
-	color_lt += p->neighbours[1]->getColor() * p->neighbours[1]->illumination;
+	color_lt += p->getNeighbour(7)->getColor() * p->getNeighbour(7)->illumination;	
+	color_lt += p->getNeighbour(0)->getColor() * p->getNeighbour(0)->illumination;
+	color_lt += p->getNeighbour(1)->getColor() * p->getNeighbour(1)->illumination;
 	color_lt = color_lt / 4;
 	
 	// pravy horni vrchol
 	Vector3f color_rt = p->getColor() * p->illumination;
-	color_rt += p->neighbours[1]->getColor() * p->neighbours[1]->illumination;
-	color_rt += p->neighbours[2]->getColor() * p->neighbours[2]->illumination;
-	color_rt += p->neighbours[3]->getColor() * p->neighbours[3]->illumination;
+	color_rt += p->getNeighbour(1)->getColor() * p->getNeighbour(1)->illumination;
+	color_rt += p->getNeighbour(2)->getColor() * p->getNeighbour(2)->illumination;
+	color_rt += p->getNeighbour(3)->getColor() * p->getNeighbour(3)->illumination;
 	color_rt = color_rt / 4;
 	
 	// pravy dolni vrchol
 	Vector3f color_rb = p->getColor() * p->illumination;
-	color_rb += p->neighbours[3]->getColor() * p->neighbours[3]->illumination;
-	color_rb += p->neighbours[4]->getColor() * p->neighbours[4]->illumination;
-	color_rb += p->neighbours[5]->getColor() * p->neighbours[5]->illumination;
+	color_rb += p->getNeighbour(3)->getColor() * p->getNeighbour(3)->illumination;
+	color_rb += p->getNeighbour(4)->getColor() * p->getNeighbour(4)->illumination;
+	color_rb += p->getNeighbour(5)->getColor() * p->getNeighbour(5)->illumination;
 	color_rb = color_rb / 4;
 	
 	// levy dolni vrchol
 	Vector3f color_lb = p->getColor() * p->illumination;
-	color_lb += p->neighbours[5]->getColor() * p->neighbours[5]->illumination;
-	color_lb += p->neighbours[6]->getColor() * p->neighbours[6]->illumination;
-	color_lb += p->neighbours[7]->getColor() * p->neighbours[7]->illumination;
+	color_lb += p->getNeighbour(5)->getColor() * p->getNeighbour(5)->illumination;
+	color_lb += p->getNeighbour(6)->getColor() * p->getNeighbour(6)->illumination;
+	color_lb += p->getNeighbour(7)->getColor() * p->getNeighbour(7)->illumination;
 	color_lb = color_lb / 4;
 #endif
 
@@ -46,6 +46,9 @@ class Colors {
 		static uint32_t packColor(Vector3f color);	// vygeneruje barvu z indexu do GL_UNSIGNED_INT_2_10_10_10_REV
 		static Vector3f unpackColor(uint32_t color); // prevede barvu z GL_UNSIGNED_INT_2_10_10_10_REV do vektoru
 
+		static uint32_t packRGB9E5(Vector3f color);	// zabali nezapornou (HDR) barvu do 32b se sdilenym exponentem (GL_UNSIGNED_INT_5_9_9_9_REV)
+		static Vector3f unpackRGB9E5(uint32_t color);	// rozbali barvu RGB9E5
+
 		static uint32_t color(size_t colorIndex); // vraci GL_UNSIGNED_INT_2_10_10_10_REV barvu odpovidajici indexu
 		static size_t index(uint32_t color); // vraci index odpovidajici GL_UNSIGNED_INT_2_10_10_10_REV zabalene barve
 
@@ -1,4 +1,5 @@
 #include "Config.h"
+#include "EnergyAccumulator.h"
 
 bool Config::frozen = false;
 
@@ -6,8 +7,23 @@ bool Config::frozen = false;
 unsigned int	Config::hemicubeSide = 16;
 unsigned int	Config::oclWorkitemsX = 4;
 unsigned int	Config::shootsPerCycle = 500;
+double			Config::frameBudget = 33;
+bool			Config::maxThroughput = false;
 double			Config::maxPatchArea = 0.5;
 unsigned int	Config::hemicubesCount = 10;
+unsigned int	Config::checkpointInterval = 600;
+int				Config::accumulation = EnergyAccumulator::SHARDED;
+double			Config::clustering = 0;
+unsigned int	Config::stochastic = 0;
+unsigned int	Config::multigrid = 1;
+unsigned int	Config::formFactorCache = 64;
+bool			Config::importance = false;
+unsigned int	Config::directLighting = 0;
+unsigned int	Config::workers = 0;
+unsigned int	Config::finalGather = 0;
+double			Config::emitterGroups = 0;
+bool			Config::spatialOrder = false;
+unsigned int	Config::outOfCoreMemory = 1024;
 
 
 // nastavovano vnitrne
@@ -99,6 +115,32 @@ void Config::setShootsPerCycle(unsigned int n) {
 }
 
 
+/**
+ * @brief nastavuje cilovou dobu jednoho kroku vypoctu v ms; pocet vystrelu se voli podle zmerene ceny vystrelu
+ */
+void Config::setFrameBudget(double ms) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	frameBudget = ms;
+}
+
+
+/**
+ * @brief zapina rezim maximalni propustnosti pro vypocet bez obsluhy
+ */
+void Config::setMaxThroughput(bool enable) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	maxThroughput = enable;
+}
+
+
 /**
  * @brief nastavuje pocet 'vystrelu' radiosity behem jednoho kresliciho cyklu
  */
@@ -112,6 +154,186 @@ void Config::setHemicubesCount(unsigned int n) {
 }
 
 
+/**
+ * @brief nastavuje interval ukladani stavu vypoctu (checkpointu) v sekundach; 0 checkpointy vypne
+ */
+void Config::setCheckpointInterval(unsigned int n) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	checkpointInterval = n;
+}
+
+
+/**
+ * @brief nastavuje strategii soubezneho scitani energie prenesene z hemicube do patchu
+ */
+void Config::setAccumulation(int n) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	accumulation = n;
+}
+
+
+/**
+ * @brief zapina vypocet se shluky patchu; tolerance je nejvetsi form factor vazby mezi shluky, 0 vypocet vypne
+ */
+void Config::setClustering(double tolerance) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	clustering = tolerance;
+}
+
+
+/**
+ * @brief zapina stochastickou Jacobiho iteraci misto vystrelu z hemicube; rays je pocet paprsku prvniho kroku, 0 ji vypne
+ */
+void Config::setStochastic(unsigned int rays) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	stochastic = rays;
+}
+
+
+/**
+ * @brief nastavuje pocet urovni vicerovnoveho vypoctu - scena se vyresi nejdriv s hrubymi patchi a zbytek energie
+ *	se dopocita na jemnejsim deleni; nejjemnejsi uroven ma MAX_PATCH_AREA
+ */
+void Config::setMultigrid(unsigned int levels) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	if (levels < 1) {
+		cerr << "Error: Multigrid needs at least one level" << endl;
+		return;
+	}
+
+	multigrid = levels;
+}
+
+
+/**
+ * @brief nastavuje velikost cache radku form factoru v MB - opakovany zdroj se pak nekresli; 0 cache vypne
+ */
+void Config::setFormFactorCache(unsigned int mb) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	formFactorCache = mb;
+}
+
+
+/**
+ * @brief zapina vypocet podle dulezitosti patchu pro pohledy kamery (pohledy lze pridavat i za behu)
+ */
+void Config::setImportance(bool enable) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	importance = enable;
+}
+
+
+/**
+ * @brief zapina prime osvetleni spocitane analyticky se stinovymi paprsky; hemicube pak strili jen neprime odrazy
+ */
+void Config::setDirectLighting(unsigned int rays) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	directLighting = rays;
+}
+
+
+/**
+ * @brief nastavuje pocet pracovnich procesu, ktere pocitaji radky form factoru vybranych zdroju; 0 = kresli se hemicube
+ */
+void Config::setWorkers(unsigned int n) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	workers = n;
+}
+
+
+/**
+ * @brief zapina zaverecny sber - po dokonceni vypoctu se zobrazene barvy rohu patchu ziskaji paprsky z vysledne sceny
+ */
+void Config::setFinalGather(unsigned int rays) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	finalGather = rays;
+}
+
+
+/**
+ * @brief nastavuje prah energie zdroje, pod kterym se s nim vystreli i slabe patche jeho skupiny; 0 skupiny vypne
+ */
+void Config::setEmitterGroups(double threshold) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	if (threshold < 0) {
+		cerr << "Error: Emitter group threshold cannot be negative" << endl;
+		return;
+	}
+
+	emitterGroups = threshold;
+}
+
+
+/**
+ * @brief zapina razeni patchu podle polohy; checkpoint je nutne obnovit se stejnym nastavenim
+ */
+void Config::setSpatialOrder(bool enable) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	spatialOrder = enable;
+}
+
+
+/**
+ * @brief nastavuje pamet vypoctu mimo pamet (OutOfCoreSolver) v MB - namapovane energie shluku a odlozene prenosy
+ */
+void Config::setOutOfCoreMemory(unsigned int mb) {
+	if (frozen) {
+		cerr << "Error: Trying to modify frozen configuration" << endl;
+		return;
+	}
+
+	outOfCoreMemory = mb;
+}
+
+
 unsigned int Config::HEMICUBE_W() {
 	return _HEMICUBE_W;
 }
@@ -148,6 +370,66 @@ unsigned int Config::SHOOTS_PER_CYCLE() {
 	return shootsPerCycle;
 }
 
+double Config::FRAME_BUDGET() {
+	return frameBudget;
+}
+
+bool Config::MAX_THROUGHPUT() {
+	return maxThroughput;
+}
+
 unsigned int Config::HEMICUBES_CNT() {
 	return hemicubesCount;
-}
\ No newline at end of file
+}
+
+unsigned int Config::CHECKPOINT_INTERVAL() {
+	return checkpointInterval;
+}
+
+int Config::ACCUMULATION() {
+	return accumulation;
+}
+
+double Config::CLUSTERING() {
+	return clustering;
+}
+
+unsigned int Config::STOCHASTIC() {
+	return stochastic;
+}
+
+unsigned int Config::MULTIGRID() {
+	return multigrid;
+}
+
+unsigned int Config::FORM_FACTOR_CACHE() {
+	return formFactorCache;
+}
+
+bool Config::IMPORTANCE() {
+	return importance;
+}
+
+unsigned int Config::DIRECT_LIGHTING() {
+	return directLighting;
+}
+
+unsigned int Config::WORKERS() {
+	return workers;
+}
+
+unsigned int Config::FINAL_GATHER() {
+	return finalGather;
+}
+
+double Config::EMITTER_GROUPS() {
+	return emitterGroups;
+}
+
+bool Config::SPATIAL_ORDER() {
+	return spatialOrder;
+}
+
+unsigned int Config::OUT_OF_CORE_MEMORY() {
+	return outOfCoreMemory;
+}
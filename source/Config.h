@@ -9,8 +9,23 @@ class Config {
 		static void setHemicubeSide(unsigned int n); // nastavi delku strany hemicube; mela by byt mocninou 2
 		static void setOCLWorkitemsX(unsigned int n); // nastavi horizontalni pocet instanci OpenCL kernelu, ktere budou zpracovavat jeden radek textury; idealne mocnina 2
 		static void setMaxPatchArea(double n); // nastavi nejvyssi moznou plochu patche pro subdivision
-		static void setShootsPerCycle(unsigned int n); // nastavi pocet 'vystrelu' radiosity behem jednoho pruchodu kreslici smycky
+		static void setShootsPerCycle(unsigned int n); // nastavi pevny pocet 'vystrelu' radiosity v jednom kroku vypoctu (pri nulove dobe kroku)
+		static void setFrameBudget(double ms); // nastavi cilovou dobu kroku vypoctu v ms, pocet vystrelu se ji prizpusobi; 0 = pevny pocet
+		static void setMaxThroughput(bool enable); // nastavi rezim maximalni propustnosti (dlouhe kroky, prohlizec kresli jen obcas)
 		static void setHemicubesCount(unsigned int n); // nastavi pocet patchu, ktere se vyzari a soucasne poslou do OpenCL
+		static void setCheckpointInterval(unsigned int n); // nastavi interval ukladani stavu vypoctu v sekundach; 0 = neukladat
+		static void setAccumulation(int n); // nastavi strategii scitani prenesene energie (EnergyAccumulator::Strategy)
+		static void setClustering(double tolerance); // zapne vypocet se shluky patchu (ClusterRadiosity) s danou toleranci form factoru vazeb mezi shluky; 0 = vypnuto
+		static void setStochastic(unsigned int rays); // zapne stochastickou Jacobiho iteraci (StochasticRadiosity) s danym poctem paprsku prvniho kroku; 0 = vypnuto
+		static void setMultigrid(unsigned int levels); // nastavi pocet urovni deleni vicerovnoveho vypoctu (kazda hrubsi uroven ma 4x vetsi obsah patchu); 1 = jen MAX_PATCH_AREA
+		static void setFormFactorCache(unsigned int mb); // nastavi velikost cache radku form factoru opakovanych zdroju v MB; 0 = vypnuto
+		static void setImportance(bool enable); // zapne vyber zdroju a deleni vazeb podle dulezitosti patchu z pohledu (Importance); uvodni pohled kamery se pouzije hned
+		static void setDirectLighting(unsigned int rays); // zapne analyticke prime osvetleni ze svetel (DirectLighting) s danym poctem stinovych paprsku na dvojici prijemce - svetlo; 0 = vypnuto
+		static void setWorkers(unsigned int n); // zapne vypocet radku form factoru v n pracovnich procesech (WorkerPool) misto kresleni hemicube; 0 = vypnuto
+		static void setFinalGather(unsigned int rays); // zapne zaverecny sber (FinalGather) s danym poctem paprsku na roh patche pro zobrazeni po dokonceni vypoctu; 0 = vypnuto
+		static void setEmitterGroups(double threshold); // zapne vystrely skupin podobne natocenych patchu z hemicube zdroje, jakmile ma zdroj energii pod prahem; 0 = vypnuto
+		static void setSpatialOrder(bool enable); // zapne razeni patchu podle polohy (Mortonova krivka) po nacteni a rozdeleni modelu
+		static void setOutOfCoreMemory(unsigned int mb); // nastavi limit pameti vypoctu mimo pamet (OutOfCoreSolver) v MB
 
 		static void freeze(); // zmrazi objekt a naalokuje potrebne struktury
 
@@ -23,7 +38,22 @@ class Config {
 		static unsigned int OCL_WORKITEMS_X();
 		static unsigned int OCL_WORKITEMS_Y();
 		static unsigned int SHOOTS_PER_CYCLE();
+		static double FRAME_BUDGET();
+		static bool MAX_THROUGHPUT();
 		static unsigned int HEMICUBES_CNT();
+		static unsigned int CHECKPOINT_INTERVAL();
+		static int ACCUMULATION();
+		static double CLUSTERING();
+		static unsigned int STOCHASTIC();
+		static unsigned int MULTIGRID();
+		static unsigned int FORM_FACTOR_CACHE();
+		static bool IMPORTANCE();
+		static unsigned int DIRECT_LIGHTING();
+		static unsigned int WORKERS();
+		static unsigned int FINAL_GATHER();
+		static double EMITTER_GROUPS();
+		static bool SPATIAL_ORDER();
+		static unsigned int OUT_OF_CORE_MEMORY();
 
 	private:
 		static bool frozen;
@@ -32,7 +62,22 @@ class Config {
 		static unsigned int oclWorkitemsX;
 		static double maxPatchArea;
 		static unsigned int shootsPerCycle;
+		static double frameBudget;
+		static bool maxThroughput;
 		static unsigned int hemicubesCount;
+		static unsigned int checkpointInterval;
+		static int accumulation;
+		static double clustering;
+		static unsigned int stochastic;
+		static unsigned int multigrid;
+		static unsigned int formFactorCache;
+		static bool importance;
+		static unsigned int directLighting;
+		static unsigned int workers;
+		static unsigned int finalGather;
+		static double emitterGroups;
+		static bool spatialOrder;
+		static unsigned int outOfCoreMemory;
 
 };
 
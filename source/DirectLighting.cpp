@@ -0,0 +1,228 @@
+#include "DirectLighting.h"
+#include "Sampling.h"
+#include <math.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// stinovy paprsek konci kousek pred svetlem, aby nezasahl svetlo samo (v nasobcich delky paprsku)
+static const float SHADOW_END = 0.999f;
+
+// body tesne u roviny prijemce se pri orezani svetla povazuji za body roviny
+static const float CLIP_EPSILON = 1e-6f;
+
+
+DirectLighting::DirectLighting(void) {
+	raysCount = 0;
+}
+
+
+/**
+ * Ctyruhelnik jako dva trojuhelniky ABC a ACD
+ */
+float DirectLighting::patchArea(Patch* p) {
+	Vector3f a = p->getVertex(0);
+	Vector3f c = p->getVertex(2);
+	return 0.5f * ((p->getVertex(1) - a).v_Cross(c - a).f_Length() + (c - a).v_Cross(p->getVertex(3) - a).f_Length());
+}
+
+
+/**
+ * Sutherland-Hodgman s jednou rovinou; ctyruhelnik muze mit po orezani az 5 vrcholu
+ */
+unsigned int DirectLighting::clipPolygon(const Vector3f* polygon, unsigned int n, const Vector3f& point, const Vector3f& normal, Vector3f* clipped) {
+	unsigned int m = 0;
+
+	for (unsigned int k = 0; k < n; k++) {
+		const Vector3f& a = polygon[k];
+		const Vector3f& b = polygon[(k + 1) % n];
+		float da = normal.f_Dot(a - point) - CLIP_EPSILON;
+		float db = normal.f_Dot(b - point) - CLIP_EPSILON;
+
+		if (da > 0)
+			clipped[m++] = a;
+		if ((da > 0) != (db > 0))
+			clipped[m++] = a + (b - a) * (da / (da - db));
+	}
+
+	return m;
+}
+
+
+/**
+ * Lambertuv vzorec - soucet pres hrany mnohouhelniku: uhel hrany videny z bodu krat kosinus mezi normalou
+ * plosky a normalou roviny hrany a bodu. Znamenko zavisi na smyslu obehu vrcholu, proto absolutni hodnota
+ */
+float DirectLighting::pointFormFactor(const Vector3f& point, const Vector3f& normal, const Vector3f* polygon, unsigned int n) {
+	Vector3f dirs[5];
+	for (unsigned int k = 0; k < n; k++) {
+		dirs[k] = polygon[k] - point;
+		float length = dirs[k].f_Length();
+		if (length <= 0)
+			return 0;
+		dirs[k] *= 1 / length;
+	}
+
+	float sum = 0;
+	for (unsigned int k = 0; k < n; k++) {
+		const Vector3f& a = dirs[k];
+		const Vector3f& b = dirs[(k + 1) % n];
+
+		Vector3f gamma = a.v_Cross(b);
+		float length = gamma.f_Length();
+		if (length <= 0)
+			continue;
+
+		float angle = acosf(max(-1.0f, min(1.0f, a.f_Dot(b))));
+		sum += angle * normal.f_Dot(gamma) / length;
+	}
+
+	return fabs(sum) / (2 * f_pi);
+}
+
+
+/**
+ * Bod prijemce lezi ve strate s (mrizka side x side) a stinovy paprsek miri do straty svetla posunute
+ * o nahodny pocet strat - body svetla jsou rovnomerne rozlozene a nezavisle na bodu prijemce
+ */
+Vector3f DirectLighting::gather(unsigned int receiver, Patch** patches, const SceneBvh& scene, unsigned int side, unsigned long long& rays) const {
+	Patch* r = patches[receiver];
+
+	Vector3f normal = r->getNormal();
+	float length = normal.f_Length();
+	if (length <= 0)
+		return Vector3f(0, 0, 0);
+	normal *= 1 / length;
+
+	Vector3f center = r->getCenter();
+	float area = patchArea(r);
+	unsigned int samples = side * side;
+
+	Vector3f energy(0, 0, 0);
+
+	for (unsigned int l = 0; l < lights.size(); l++) {
+		const Light& light = lights[l];
+		if (light.id == receiver || light.area <= 0)
+			continue;
+
+		// svetlo cele za prijemcem nebo prijemce cely za svetlem
+		bool front = false, lit = false;
+		for (unsigned int v = 0; v < 4; v++) {
+			front |= normal.f_Dot(light.vertices[v] - center) > 0;
+			lit |= light.normal.f_Dot(r->getVertex(v) - light.center) > 0;
+		}
+		if (!front || !lit)
+			continue;
+
+		unsigned int index = l * samples;
+		unsigned int offset = min((unsigned int)(Sampling::number(receiver, index, 4) * samples), samples - 1);
+
+		float factor = 0;
+		for (unsigned int s = 0; s < samples; s++) {
+			float u = (s % side + Sampling::number(receiver, index + s, 0)) / side;
+			float v = (s / side + Sampling::number(receiver, index + s, 1)) / side;
+			Vector3f point = Sampling::pointOnPatch(r, u, v);
+
+			// svetlo vyzaruje jen pred sebe
+			if (light.normal.f_Dot(point - light.center) <= 0)
+				continue;
+
+			Vector3f clipped[5];
+			unsigned int n = clipPolygon(light.vertices, 4, point, normal, clipped);
+			if (n < 3)
+				continue;
+
+			float f = pointFormFactor(point, normal, clipped, n);
+			if (f <= 0)
+				continue;
+
+			unsigned int t = (s + offset) % samples;
+			float lu = (t % side + Sampling::number(receiver, index + s, 2)) / side;
+			float lv = (t / side + Sampling::number(receiver, index + s, 3)) / side;
+			Vector3f target = Sampling::pointOnPatch(light.patch, lu, lv);
+
+			rays++;
+			if (!scene.occluded(point, target - point, SHADOW_END))
+				factor += f;
+		}
+
+		// form factor prijemce ke svetlu -> form factor svetla k prijemci (reciprocita)
+		factor *= area / (samples * light.area);
+		energy += light.energy * factor;
+	}
+
+	return energy;
+}
+
+
+/**
+ * Prijata energie se pricte az po vyzareni vsech svetel - svetlo, ktere osvetli jine svetlo, tak
+ * jeho energii neztrati (jako Jacobiho krok)
+ */
+bool DirectLighting::compute(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int raysPerPair) {
+	lights.clear();
+	raysCount = 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (patches[i]->illumination.f_Length2() > 0)
+			return false;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		Patch* p = patches[i];
+		if (p->radiosity.f_Length2() <= 0)
+			continue;
+
+		Light light;
+		light.id = i;
+		light.patch = p;
+		for (unsigned int v = 0; v < 4; v++)
+			light.vertices[v] = p->getVertex(v);
+		light.center = p->getCenter();
+		light.normal = p->getNormal();
+		float length = light.normal.f_Length();
+		if (length > 0)
+			light.normal *= 1 / length;
+		light.area = patchArea(p);
+		light.energy = p->radiosity * p->getColor();
+		lights.push_back(light);
+	}
+
+	if (lights.empty())
+		return false;
+
+	unsigned int side = max(1u, (unsigned int)sqrt(double(raysPerPair)));
+	received.resize(count);
+
+	unsigned long long rays = 0;
+	#pragma omp parallel for schedule(dynamic, 64) reduction(+:rays)
+	for (int i = 0; i < int(count); i++)
+		received[i] = gather(i, patches, scene, side, rays);
+	raysCount = rays;
+
+	// svetla se vyzarila
+	for (unsigned int l = 0; l < lights.size(); l++) {
+		Patch* p = lights[l].patch;
+		p->illumination += p->radiosity;
+		p->radiosity = Vector3f(0, 0, 0);
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < int(count); i++)
+		patches[i]->radiosity += received[i] * patches[i]->getReflectivity();
+
+	received.clear();
+	return true;
+}
+
+
+unsigned int DirectLighting::getLightsCount() const {
+	return lights.size();
+}
+
+unsigned long long DirectLighting::getRaysCount() const {
+	return raysCount;
+}
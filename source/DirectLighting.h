@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "SceneBvh.h"
+#include "Patch.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Prime osvetleni ze svetel spocitane analyticky misto prvnich vystrelu z hemicube. Prvni vystrely
+ * svetel nesou vetsinu energie sceny a diskretizace hemicube v nich zpusobuje nejvetsi aliasing.
+ *
+ * Pro kazdy prijemce a svetlo se v bodech prijemce (stratifikovane) spocita form factor bod - mnohouhelnik
+ * (Lambertuv vzorec pres hrany svetla orezaneho rovinou prijemce) a viditelnost stinovym paprskem
+ * do stratifikovaneho bodu svetla. Prumer dava form factor prijemce ke svetlu; prijemce dostane energii
+ * svetla nasobenou form factorem svetla k prijemci - stejnou velicinu jako z radku hemicube.
+ * Prijemci jsou nezavisli a pocitaji se paralelne, svetla se pak povazuji za vystrelena a vypocet
+ * pokracuje uz jen neprimymi odrazy.
+ *
+ * Svetla jsou patche s nevystrelenou energii ve scene, ze ktere se jeste nestrilelo (zadny patch nema
+ * iluminaci) - po obnoveni vypoctu nebo na jemnejsi urovni deleni se prime osvetleni nepocita znovu.
+ */
+class DirectLighting {
+
+	public:
+		DirectLighting(void);
+
+		// prenese energii svetel do patchu sceny; raysPerPair = stinove paprsky na dvojici prijemce - svetlo
+		// (zaokrouhli se dolu na ctverec); vraci false, pokud se ze sceny uz strilelo nebo v ni neni svetlo
+		bool compute(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int raysPerPair);
+
+		unsigned int getLightsCount() const;	// svetla posledniho vypoctu
+		unsigned long long getRaysCount() const;	// stinove paprsky posledniho vypoctu
+
+	private:
+		struct Light {
+			unsigned int id;
+			Patch* patch;
+			Vector3f vertices[4];
+			Vector3f center;
+			Vector3f normal;	// jednotkova
+			float area;
+			Vector3f energy;	// radiosita * barva
+		};
+
+		static float patchArea(Patch* p);
+		static unsigned int clipPolygon(const Vector3f* polygon, unsigned int n, const Vector3f& point, const Vector3f& normal, Vector3f* clipped);	// cast mnohouhelniku pred rovinou
+		static float pointFormFactor(const Vector3f& point, const Vector3f& normal, const Vector3f* polygon, unsigned int n);	// form factor plosky v bode k mnohouhelniku
+
+		Vector3f gather(unsigned int receiver, Patch** patches, const SceneBvh& scene, unsigned int side, unsigned long long& rays) const;	// energie svetel pro prijemce
+
+		vector<Light> lights;
+		vector<Vector3f> received;
+		unsigned long long raysCount;
+};
@@ -0,0 +1,190 @@
+#include "EmitterGroups.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// hrana bunky mrizky v prumernych hranach patchu (skupina ma nejvyse ~ GROUP_CELL^2 patchu roviny)
+static const float GROUP_CELL = 4;
+
+// krok vzdalenosti roviny patche od pocatku v prumernych hranach patchu - rovnobezne plochy v jedne bunce
+// (deska stolu nad podlahou) tak nepatri do jedne skupiny
+static const float GROUP_PLANE_STEP = 0.25f;
+
+// nejmensi kosinus uhlu mezi normalou clena a zdroje
+static const float GROUP_MIN_COS = 0.9f;
+
+
+EmitterGroups::EmitterGroups(void) {
+	batch = 0;
+	groupedShots = 0;
+	groupedPatches = 0;
+}
+
+
+bool EmitterGroups::Key::operator<(const Key& k) const {
+	if (x != k.x)
+		return x < k.x;
+	if (y != k.y)
+		return y < k.y;
+	if (z != k.z)
+		return z < k.z;
+	if (axis != k.axis)
+		return axis < k.axis;
+	if (plane != k.plane)
+		return plane < k.plane;
+	return id < k.id;
+}
+
+bool EmitterGroups::Key::sameGroup(const Key& k) const {
+	return x == k.x && y == k.y && z == k.z && axis == k.axis && plane == k.plane;
+}
+
+
+/**
+ * Velikost bunky se odvodi z prumerne hrany patchu, skupiny tak maji podobny pocet patchu
+ * pri jakemkoliv deleni sceny. Klic skupiny je bunka, smer normaly se znamenkem (odvracene strany
+ * tenke steny) a zaokrouhlena vzdalenost roviny patche od pocatku (rovnobezne plochy nad sebou)
+ */
+void EmitterGroups::build(Patch** patches, unsigned int count) {
+	clear();
+	if (count == 0)
+		return;
+
+	double edges = 0;
+	#pragma omp parallel for reduction(+:edges)
+	for (int i = 0; i < int(count); i++) {
+		Patch* p = patches[i];
+		edges += 0.5 * ((p->getVertex(1) - p->getVertex(0)).f_Length() + (p->getVertex(3) - p->getVertex(0)).f_Length());
+	}
+
+	float edge = float(edges / count);
+	if (edge <= 0)
+		edge = 1;
+	float cell = GROUP_CELL * edge;
+	float planeStep = GROUP_PLANE_STEP * edge;
+
+	vector<Key> keys(count);
+	#pragma omp parallel for
+	for (int i = 0; i < int(count); i++) {
+		Vector3f center = patches[i]->getCenter();
+		Vector3f c = center * (1 / cell);
+		Vector3f n = patches[i]->getNormal();
+
+		Key& k = keys[i];
+		k.x = int(floor(c.x));
+		k.y = int(floor(c.y));
+		k.z = int(floor(c.z));
+
+		float ax = fabs(n.x), ay = fabs(n.y), az = fabs(n.z);
+		if (ax >= ay && ax >= az)
+			k.axis = n.x >= 0 ? 0 : 1;
+		else if (ay >= az)
+			k.axis = n.y >= 0 ? 2 : 3;
+		else
+			k.axis = n.z >= 0 ? 4 : 5;
+
+		float length = n.f_Length();
+		k.plane = length > 0 ? int(floor(n.f_Dot(center) / (length * planeStep) + 0.5f)) : 0;
+
+		k.id = i;
+	}
+
+	sort(keys.begin(), keys.end());
+
+	groupOf.resize(count);
+	members.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		if (i == 0 || !keys[i].sameGroup(keys[i - 1]))
+			starts.push_back(i);
+
+		members[i] = keys[i].id;
+		groupOf[keys[i].id] = starts.size() - 1;
+	}
+	starts.push_back(count);
+
+	stamps.assign(count, 0);
+	batch = 0;
+}
+
+void EmitterGroups::clear() {
+	groupOf.clear();
+	starts.clear();
+	members.clear();
+	stamps.clear();
+	batch = 0;
+}
+
+bool EmitterGroups::isBuilt(unsigned int count) const {
+	return count > 0 && groupOf.size() == count;
+}
+
+
+void EmitterGroups::beginBatch() {
+	batch++;
+}
+
+bool EmitterGroups::isTaken(unsigned int id) const {
+	return stamps[id] == batch;
+}
+
+void EmitterGroups::take(unsigned int id) {
+	stamps[id] = batch;
+}
+
+
+/**
+ * Zdroj se vraci vzdy (i nad prahem); ostatni clenove jen s energii pod prahem - silne patche
+ * si zaslouzi vlastni hemicube
+ */
+unsigned int EmitterGroups::gather(unsigned int emitter, Patch** patches, float threshold, vector<unsigned int>& members) {
+	members.clear();
+	members.push_back(emitter);
+	take(emitter);
+
+	Vector3f normal = patches[emitter]->getNormal();
+	float length = normal.f_Length();
+	if (length <= 0 || patches[emitter]->radiosity.f_Length() >= threshold)
+		return 1;
+	normal *= 1 / length;
+
+	unsigned int group = groupOf[emitter];
+	for (unsigned int m = starts[group]; m < starts[group + 1]; m++) {
+		unsigned int id = this->members[m];
+		if (isTaken(id))
+			continue;
+
+		Patch* p = patches[id];
+		float energy = p->radiosity.f_Length();
+		if (energy <= 0 || energy >= threshold)
+			continue;
+
+		Vector3f n = p->getNormal();
+		if (n.f_Dot(normal) < GROUP_MIN_COS * n.f_Length())
+			continue;
+
+		members.push_back(id);
+		take(id);
+	}
+
+	if (members.size() > 1) {
+		groupedShots++;
+		groupedPatches += members.size();
+	}
+
+	return members.size();
+}
+
+
+unsigned int EmitterGroups::getGroupsCount() const {
+	return starts.empty() ? 0 : starts.size() - 1;
+}
+
+unsigned long long EmitterGroups::getGroupedShots() const {
+	return groupedShots;
+}
+
+unsigned long long EmitterGroups::getGroupedPatches() const {
+	return groupedPatches;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "Patch.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Skupiny zdroju pro konec vypoctu - pozde zbyvaji tisice patchu s malou nevystrelenou energii a kazdy
+ * by stal celou hemicube. Patche se predem rozdeli do skupin podle bunky mrizky (nekolik patchu na hranu),
+ * prevladajiciho smeru normaly a roviny, ve ktere lezi. Pokud ma vybrany zdroj energii pod prahem,
+ * vystreli se z jeho hemicube i slaba energie ostatnich clenu jeho skupiny, ktere jsou natocene podobne;
+ * prijemci ji dostanou podle form factoru zdroje (zastupce skupiny).
+ *
+ * Patch muze v jedne davce vystrelit jen jednou - clenove skupin davky se oznaci (beginBatch).
+ */
+class EmitterGroups {
+
+	public:
+		EmitterGroups(void);
+
+		void build(Patch** patches, unsigned int count);	// rozdeli patche sceny do skupin
+		void clear();
+		bool isBuilt(unsigned int count) const;
+
+		void beginBatch();	// nova davka zdroju - zadny patch jeste nevystrelil
+		bool isTaken(unsigned int id) const;	// patch uz vystrelil v teto davce (sam nebo ve skupine)
+		void take(unsigned int id);
+
+		// cleny skupiny zdroje (vcetne nej) s nenulovou energii pod prahem, natocene jako zdroj a v davce jeste
+		// nevystrelene; oznaci je a vraci jejich pocet
+		unsigned int gather(unsigned int emitter, Patch** patches, float threshold, vector<unsigned int>& members);
+
+		unsigned int getGroupsCount() const;
+		unsigned long long getGroupedShots() const;	// vystrely z vice nez jednoho patche
+		unsigned long long getGroupedPatches() const;	// patche vystrelene v techto vystrelech
+
+	private:
+		struct Key {
+			int x, y, z;		// bunka mrizky stredu
+			unsigned int axis;	// prevladajici osa normaly a jeji znamenko (0 - 5)
+			int plane;			// vzdalenost roviny od pocatku v krocich GROUP_PLANE_STEP
+			unsigned int id;
+
+			bool operator<(const Key& k) const;
+			bool sameGroup(const Key& k) const;
+		};
+
+		vector<unsigned int> groupOf;	// patch -> skupina
+		vector<unsigned int> starts;	// prvni clen skupiny v members (a konec posledni)
+		vector<unsigned int> members;	// cisla patchu po skupinach
+
+		vector<unsigned int> stamps;	// patch -> davka, ve ktere naposledy vystrelil
+		unsigned int batch;
+
+		unsigned long long groupedShots;
+		unsigned long long groupedPatches;
+};
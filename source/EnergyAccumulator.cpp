@@ -0,0 +1,201 @@
+#include "EnergyAccumulator.h"
+#include <iomanip>
+#include "Timer.h"
+
+
+// pocet useku patchu na jedno vlakno (SPARSE, SHARDED) - vic useku = lepsi rozlozeni prace pri flush
+static const unsigned int SHARDS_PER_THREAD = 4;
+
+
+EnergyAccumulator::EnergyAccumulator(void) {
+	strategy = SHARDED;
+	patchCount = 0;
+	threadCount = 0;
+	shardCount = 1;
+	shardSize = 1;
+}
+
+
+void EnergyAccumulator::setStrategy(int strategy) {
+	if (strategy < ATOMIC || strategy > SHARDED) {
+		cerr << "Unknown accumulation strategy " << strategy << endl;
+		return;
+	}
+
+	this->strategy = strategy;
+	lists.clear();
+	for (unsigned int c = 0; c < 3; c++)
+		vector<float>().swap(channels[c]);
+}
+
+
+int EnergyAccumulator::getStrategy() {
+	return strategy;
+}
+
+
+/**
+ * Pripravi buffery; pri stejnem poctu patchu a vlaken zustane alokovana pamet z minule davky
+ */
+void EnergyAccumulator::begin(unsigned int patchCount, unsigned int threadCount) {
+	this->patchCount = patchCount;
+	this->threadCount = max(threadCount, 1u);
+
+	switch (strategy) {
+		case ATOMIC:
+			// flush pole vynuluje, staci je pri zmene velikosti vytvorit znovu
+			for (unsigned int c = 0; c < 3; c++) {
+				if (channels[c].size() != patchCount)
+					channels[c].assign(patchCount, 0.0f);
+			}
+			break;
+
+		case SPARSE:
+		case SHARDED:
+			shardCount = this->threadCount * SHARDS_PER_THREAD;
+			shardSize = max(1u, (patchCount + shardCount - 1) / shardCount);
+			shardCount = max(1u, (patchCount + shardSize - 1) / shardSize);
+
+			lists.resize(strategy == SPARSE ? this->threadCount : this->threadCount * shardCount);
+			for (unsigned int i = 0; i < lists.size(); i++)
+				lists[i].deltas.clear();
+			break;
+	}
+}
+
+
+int EnergyAccumulator::parseStrategy(const char* name) {
+	for (int s = ATOMIC; s <= SHARDED; s++) {
+		if (strcmp(name, getStrategyName(s)) == 0)
+			return s;
+	}
+	return -1;
+}
+
+
+const char* EnergyAccumulator::getStrategyName(int strategy) {
+	switch (strategy) {
+		case ATOMIC: return "atomic";
+		case SPARSE: return "sparse";
+		case SHARDED: return "sharded";
+		default: return "unknown";
+	}
+}
+
+
+unsigned int EnergyAccumulator::currentThread() {
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+
+unsigned int EnergyAccumulator::maxThreads() {
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+
+/**
+ * Prijemce pro benchmark - secte prispevky do pole (kazdy patch zapisuje jedno vlakno)
+ */
+struct BenchmarkSink {
+	float* sums;
+
+	void operator()(unsigned int id, const Vector3f& energy) {
+		sums[id] += energy.x;
+	}
+};
+
+
+/**
+ * Zmeri vsechny strategie pro ruzne pocty patchu a vlaken. Prispevky jsou bud rovnomerne rozlozene
+ * po cele scene, nebo soustredene do 1024 patchu (silne osvetlena oblast - vysoka kolize pri ATOMIC).
+ * Vysledek je nejlepsi cas ze tri mereni vcetne flush; soucet se kontroluje
+ */
+void EnergyAccumulator::benchmark() {
+#ifndef _OPENMP
+	cout << "The accumulation benchmark needs OpenMP (built without /openmp)" << endl;
+#else
+	static const unsigned int threadCounts[] = { 8, 32, 64 };
+	static const unsigned int patchCounts[] = { 16384, 262144, 4194304 };
+	static const unsigned int ADDS = 1 << 22;	// prispevku v jednom mereni
+	static const unsigned int HOT_PATCHES = 1024;
+	static const unsigned int REPEATS = 3;
+
+	cout << "Accumulation benchmark: " << ADDS << " contributions, best of " << REPEATS << " runs [ms]" << endl;
+	cout << setw(10) << "patches" << setw(10) << "spread" << setw(9) << "threads";
+	for (int s = ATOMIC; s <= SHARDED; s++)
+		cout << setw(10) << getStrategyName(s);
+	cout << endl;
+
+	// pocet vlaken nastaveny uzivatelem se po mereni obnovi
+	int previousThreads = omp_get_max_threads();
+
+	for (unsigned int pc = 0; pc < sizeof(patchCounts) / sizeof(patchCounts[0]); pc++) {
+		unsigned int patches = patchCounts[pc];
+		vector<float> sums(patches);
+
+		for (unsigned int hot = 0; hot < 2; hot++) {
+			for (unsigned int tc = 0; tc < sizeof(threadCounts) / sizeof(threadCounts[0]); tc++) {
+				unsigned int threads = threadCounts[tc];
+				omp_set_num_threads(threads);
+
+				cout << setw(10) << patches << setw(10) << (hot ? "hot" : "uniform") << setw(9) << threads;
+
+				for (int s = ATOMIC; s <= SHARDED; s++) {
+					EnergyAccumulator acc;
+					acc.setStrategy(s);
+
+					double best = 0;
+					bool valid = true;
+
+					for (unsigned int r = 0; r < REPEATS; r++) {
+						fill(sums.begin(), sums.end(), 0.0f);
+						BenchmarkSink sink = { &sums[0] };
+
+						CTimer timer;
+						acc.begin(patches, threads);
+
+						#pragma omp parallel num_threads(threads)
+						{
+							unsigned int t = currentThread();
+							unsigned int n = omp_get_num_threads();
+							unsigned int seed = 2654435761u * (t + 1) + r;
+
+							for (unsigned int i = t; i < ADDS; i += n) {
+								seed = seed * 1664525u + 1013904223u;
+								unsigned int id = (seed >> 8) % (hot ? min(HOT_PATCHES, patches) : patches);
+								acc.add(t, id, Vector3f(1, 1, 1));
+							}
+						}
+
+						acc.flush(sink);
+						double time = timer.f_Time();
+
+						double total = 0;
+						for (unsigned int i = 0; i < patches; i++)
+							total += sums[i];
+						valid &= (total == ADDS);
+
+						if (r == 0 || time < best)
+							best = time;
+					}
+
+					cout << setw(10) << fixed << setprecision(2) << best * 1000;
+					if (!valid)
+						cout << "(!)";
+				}
+				cout << endl;
+			}
+		}
+	}
+
+	omp_set_num_threads(previousThreads);
+#endif
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <windows.h>
+#include <string.h>
+#include <vector>
+#include <iostream>
+#include "Vector.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+
+/**
+ * Soubezne scitani prenesene energie do patchu bez zamku. Prispevky (cislo patche, energie) pridava
+ * libovolny pocet vlaken naraz, flush je pak preda prijemci (sink) tak, ze prispevky jednoho patche
+ * predava vzdy stejne vlakno - prijemce tedy muze do patche zapisovat bez synchronizace. Strategie:
+ *  - ATOMIC:  tri pole floatu (R, G, B) po patchich, pricita se atomicky (CAS); flush projde vsechny patche
+ *  - SPARSE:  kazde vlakno si pise vlastni seznam prispevku; flush je roztridi podle useku patchu
+ *             (pocty + prefixovy soucet + paralelni rozhazeni) a kazdy usek zpracuje jedno vlakno
+ *  - SHARDED: patche jsou rozdelene na useky, kazde vlakno pise prispevek rovnou do seznamu useku;
+ *             pri flush vlastnik useku projde seznamy vsech vlaken
+ * Ktera strategie je nejrychlejsi, zavisi na poctu vlaken, patchu a rozlozeni prispevku (viz benchmark).
+ */
+class EnergyAccumulator {
+
+	public:
+		enum Strategy {
+			ATOMIC,
+			SPARSE,
+			SHARDED
+		};
+
+		EnergyAccumulator(void);
+
+		void setStrategy(int strategy);
+		int getStrategy();
+
+		void begin(unsigned int patchCount, unsigned int threadCount);	// pripravi buffery pro dalsi davku prispevku
+		void add(unsigned int thread, unsigned int id, const Vector3f& energy);	// prida prispevek; 'thread' < threadCount z begin
+
+		template <class Sink>
+		void flush(Sink& sink);	// preda prispevky: sink(unsigned int id, const Vector3f& energy); buffery vyprazdni
+
+		static int parseStrategy(const char* name);	// cislo strategie podle jmena (atomic, sparse, sharded), -1 = nezname
+		static const char* getStrategyName(int strategy);
+		static void benchmark();	// zmeri strategie pri 8, 32 a 64 vlaknech a vypise vysledky
+
+		static unsigned int currentThread();	// cislo aktualniho vlakna v paralelni oblasti
+		static unsigned int maxThreads();		// nejvetsi pocet vlaken paralelni oblasti
+
+	private:
+		struct Delta {
+			unsigned int id;
+			float r, g, b;
+		};
+
+		// seznam s vyplni na radek cache - vlakna si nesdileji radky s hlavickami svych vektoru
+		struct DeltaList {
+			vector<Delta> deltas;
+			char padding[64];
+		};
+
+		static void atomicAdd(volatile float* target, float value);
+
+		unsigned int shardOf(unsigned int id);
+
+		int strategy;
+		unsigned int patchCount;
+		unsigned int threadCount;
+		unsigned int shardCount;	// pocet useku patchu (SPARSE, SHARDED)
+		unsigned int shardSize;		// patchu v jednom useku
+
+		vector<float> channels[3];		// ATOMIC: soucty po patchich
+		vector<DeltaList> lists;		// SPARSE: seznam na vlakno; SHARDED: seznam na (vlakno, usek)
+		vector<Delta> merged;			// SPARSE: prispevky serazene podle useku
+		vector<unsigned int> offsets;	// SPARSE: zacatek (vlakno, usek) v merged
+};
+
+
+inline unsigned int EnergyAccumulator::shardOf(unsigned int id) {
+	return id / shardSize;
+}
+
+
+/**
+ * Atomicke pricteni k floatu pres CAS nad jeho bitovou reprezentaci
+ */
+inline void EnergyAccumulator::atomicAdd(volatile float* target, float value) {
+	volatile LONG* bits = (volatile LONG*)target;
+	LONG oldBits, newBits;
+	do {
+		oldBits = *bits;
+		float f;
+		memcpy(&f, (const void*)&oldBits, sizeof(float));
+		f += value;
+		memcpy(&newBits, &f, sizeof(float));
+	} while (InterlockedCompareExchange(bits, newBits, oldBits) != oldBits);
+}
+
+
+inline void EnergyAccumulator::add(unsigned int thread, unsigned int id, const Vector3f& energy) {
+	switch (strategy) {
+		case ATOMIC:
+			atomicAdd(&channels[0][id], energy.x);
+			atomicAdd(&channels[1][id], energy.y);
+			atomicAdd(&channels[2][id], energy.z);
+			break;
+
+		case SPARSE: {
+			Delta d = { id, energy.x, energy.y, energy.z };
+			lists[thread].deltas.push_back(d);
+			break;
+		}
+
+		case SHARDED: {
+			Delta d = { id, energy.x, energy.y, energy.z };
+			lists[thread * shardCount + shardOf(id)].deltas.push_back(d);
+			break;
+		}
+	}
+}
+
+
+template <class Sink>
+void EnergyAccumulator::flush(Sink& sink) {
+	switch (strategy) {
+		case ATOMIC: {
+			// kazdy patch zpracuje jedno vlakno, prazdne patche se preskoci
+			#pragma omp parallel for schedule(static)
+			for (int i = 0; i < int(patchCount); i++) {
+				if (channels[0][i] == 0 && channels[1][i] == 0 && channels[2][i] == 0)
+					continue;
+
+				sink((unsigned int)i, Vector3f(channels[0][i], channels[1][i], channels[2][i]));
+				channels[0][i] = channels[1][i] = channels[2][i] = 0;
+			}
+			break;
+		}
+
+		case SPARSE: {
+			// 1. pocty prispevku kazdeho vlakna v kazdem useku
+			offsets.assign(threadCount * shardCount + 1, 0);
+
+			#pragma omp parallel for
+			for (int t = 0; t < int(threadCount); t++) {
+				const vector<Delta>& d = lists[t].deltas;
+				unsigned int* counts = &offsets[t * shardCount];
+				for (unsigned int i = 0; i < d.size(); i++)
+					counts[shardOf(d[i].id)]++;
+			}
+
+			// 2. prefixovy soucet v poradi (usek, vlakno) - prispevky useku budou v merged za sebou
+			unsigned int total = 0;
+			for (unsigned int s = 0; s < shardCount; s++) {
+				for (unsigned int t = 0; t < threadCount; t++) {
+					unsigned int c = offsets[t * shardCount + s];
+					offsets[t * shardCount + s] = total;
+					total += c;
+				}
+			}
+			merged.resize(total);
+
+			// 3. kazde vlakno rozhazi sve prispevky na vypoctene pozice (pozice jsou disjunktni)
+			#pragma omp parallel for
+			for (int t = 0; t < int(threadCount); t++) {
+				vector<Delta>& d = lists[t].deltas;
+				unsigned int* pos = &offsets[t * shardCount];
+				for (unsigned int i = 0; i < d.size(); i++)
+					merged[pos[shardOf(d[i].id)]++] = d[i];
+				d.clear();
+			}
+
+			// 4. kazdy usek secte jedno vlakno; po rozhazeni ukazuje pozice posledniho vlakna v useku s na konec useku s
+			#pragma omp parallel for schedule(static)
+			for (int s = 0; s < int(shardCount); s++) {
+				unsigned int from = (s == 0) ? 0 : offsets[(threadCount - 1) * shardCount + s - 1];
+				unsigned int to = offsets[(threadCount - 1) * shardCount + s];
+				for (unsigned int i = from; i < to; i++)
+					sink(merged[i].id, Vector3f(merged[i].r, merged[i].g, merged[i].b));
+			}
+			break;
+		}
+
+		case SHARDED: {
+			// vlastnik useku projde seznamy vsech vlaken pro svuj usek; staticke rozdeleni - souvisle useky
+			// patchu dostanou vlakna stejneho NUMA uzlu jako jejich arena (NumaArena). Seznamy vlaken jineho
+			// uzlu se ctou primo z jejich pameti, zvlastni vymena prispevku mezi uzly neni
+			#pragma omp parallel for schedule(static)
+			for (int s = 0; s < int(shardCount); s++) {
+				for (unsigned int t = 0; t < threadCount; t++) {
+					vector<Delta>& d = lists[t * shardCount + s].deltas;
+					for (unsigned int i = 0; i < d.size(); i++)
+						sink(d[i].id, Vector3f(d[i].r, d[i].g, d[i].b));
+					d.clear();
+				}
+			}
+			break;
+		}
+	}
+}
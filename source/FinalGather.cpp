@@ -0,0 +1,157 @@
+#include "FinalGather.h"
+#include "Sampling.h"
+#include <math.h>
+#include <algorithm>
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// patchu v jedne dlazdici (jednotka prace vlakna)
+static const int GATHER_TILE = 256;
+
+// posun pocatku paprsku od rohu do patche a nad nej - paprsek nesmi zasahnout sousedni stenu v rohu
+static const float CORNER_INSET = 1e-3f;
+
+// kvantovani polohy rohu pro urceni jeho paprsku
+static const float CORNER_QUANTUM = 1e-4f;
+
+// nejvetsi vzdalenost paprsku
+static const float MAX_DISTANCE = 1e30f;
+
+
+FinalGather::FinalGather(void) {
+	raysCount = 0;
+	sceneId = 0;
+	pass = 0;
+}
+
+
+/**
+ * Souradnice zaokrouhlena na nejblizsi nasobek CORNER_QUANTUM - spolecny roh dvou patchu s nepatrne
+ * odlisnymi souradnicemi tak skonci ve stejnem kroku (floor by je u hranice kroku rozdelil); pocita se
+ * v 64 bitech, soucin s konstantou hashe pretece jen v bezznamenkove aritmetice
+ */
+static uint64_t quantizeCoordinate(float v) {
+	return uint64_t(int64_t(floor(double(v) / CORNER_QUANTUM + 0.5)));
+}
+
+
+/**
+ * Zasah rubu patche (paprsek unikl skrz geometrii) ani unik ze sceny nic neprinese
+ */
+Vector3f FinalGather::gatherCorner(Patch* p, unsigned int corner, const Vector3f& normal, Patch** patches, const SceneBvh& scene, unsigned int rays) const {
+	Vector3f vertex = p->getVertex(corner);
+	Vector3f center = p->getCenter();
+	float size = (center - vertex).f_Length();
+	Vector3f origin = vertex + (center - vertex) * CORNER_INSET + normal * (size * CORNER_INSET);
+
+	uint64_t hash = quantizeCoordinate(vertex.x) * 73856093ULL ^
+		quantizeCoordinate(vertex.y) * 19349663ULL ^
+		quantizeCoordinate(vertex.z) * 83492791ULL;
+	unsigned int key = (unsigned int)(hash ^ (hash >> 32));
+
+	// smery stratifikovane mrizkou side x side
+	unsigned int side = max(1u, (unsigned int)sqrt(double(rays)));
+	rays = side * side;
+
+	Vector3f sum(0, 0, 0);
+	for (unsigned int r = 0; r < rays; r++) {
+		float u1 = (r % side + Sampling::number(key, r, 0)) / side;
+		float u2 = (r / side + Sampling::number(key, r, 1)) / side;
+		Vector3f dir = Sampling::cosineDirection(normal, u1, u2);
+
+		float distance = MAX_DISTANCE;
+		int hit = scene.intersect(origin, dir, distance);
+		if (hit < 0)
+			continue;
+
+		Patch* h = patches[hit];
+		if (h->getNormal().f_Dot(dir) >= 0)
+			continue;
+
+		sum += h->getColor() * (h->illumination + h->radiosity);
+	}
+
+	return sum * (1.0f / rays);
+}
+
+
+void FinalGather::compute(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int raysPerCorner, unsigned int sceneId, unsigned int pass) {
+	clear();
+	if (count == 0 || raysPerCorner == 0)
+		return;
+
+	this->sceneId = sceneId;
+	this->pass = pass;
+
+	colors.resize(count * 4 * 3);
+	int tiles = int((count + GATHER_TILE - 1) / GATHER_TILE);
+
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < tiles; t++) {
+		int last = min(int(count), (t + 1) * GATHER_TILE);
+
+		for (int i = t * GATHER_TILE; i < last; i++) {
+			Patch* p = patches[i];
+			Vector3f energy = p->illumination + p->radiosity;
+			Vector3f color = p->getColor();
+			float* out = &colors[i * 12];
+
+			Vector3f normal = p->getNormal();
+			float length = normal.f_Length();
+			if (length <= 0) {
+				for (unsigned int c = 0; c < 12; c += 3) {
+					out[c] = color.x * energy.x;
+					out[c + 1] = color.y * energy.y;
+					out[c + 2] = color.z * energy.z;
+				}
+				continue;
+			}
+			normal *= 1 / length;
+
+			Vector3f irradiance[4];
+			Vector3f mean(0, 0, 0);
+			for (unsigned int c = 0; c < 4; c++) {
+				irradiance[c] = gatherCorner(p, c, normal, patches, scene, raysPerCorner);
+				mean += irradiance[c] * 0.25f;
+			}
+
+			// prumer rohu = radiosita patche z vypoctu
+			for (unsigned int c = 0; c < 4; c++) {
+				Vector3f b = energy + (irradiance[c] - mean) * p->getReflectivity();
+				out[c * 3] = color.x * max(b.x, 0.0f);
+				out[c * 3 + 1] = color.y * max(b.y, 0.0f);
+				out[c * 3 + 2] = color.z * max(b.z, 0.0f);
+			}
+		}
+	}
+
+	unsigned int side = max(1u, (unsigned int)sqrt(double(raysPerCorner)));
+	raysCount = (unsigned long long)count * 4 * side * side;
+}
+
+void FinalGather::clear() {
+	colors.clear();
+	raysCount = 0;
+	sceneId = 0;
+	pass = 0;
+}
+
+
+/**
+ * Sber plati, dokud se nezmeni scena ani energie - po kazdem pruchodu vypoctu je zastaraly
+ */
+bool FinalGather::isComputed(unsigned int sceneId, unsigned int pass) const {
+	return !colors.empty() && sceneId != 0 && this->sceneId == sceneId && this->pass == pass;
+}
+
+const float* FinalGather::getColors() const {
+	return colors.empty() ? NULL : &colors[0];
+}
+
+unsigned long long FinalGather::getRaysCount() const {
+	return raysCount;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include "SceneBvh.h"
+#include "Patch.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Zaverecny sber pro zobrazeni hrube sceny. Po dokonceni vypoctu se v kazdem rohu patche vysle svazek
+ * paprsku do polokoule (podle kosinu) a zprumeruje se vyzarovana energie zasazenych patchu - ozareni rohu
+ * z vysledne radiosity sceny. Zobrazena barva rohu je radiosita patche z vypoctu opravena o odchylku
+ * ozareni rohu od prumeru rohu patche (nasobenou odrazivosti): prumer patche tedy odpovida vypoctu
+ * (vcetne vlastniho vyzarovani svetel) a prubeh uvnitr patche - stiny, prechody v koutech - dava sber,
+ * jako by byl patch jemne rozdeleny.
+ *
+ * Paprsky rohu jsou urcene jeho polohou (ne cislem patche), sousedni patche tehoz natoceni proto ve
+ * spolecnem rohu dostanou stejne ozareni. Patche se zpracuji po dlazdicich paralelne.
+ */
+class FinalGather {
+
+	public:
+		FinalGather(void);
+
+		void compute(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int raysPerCorner, unsigned int sceneId, unsigned int pass);	// spocita barvy rohu patchu sestaveni sceny po danem pruchodu vypoctu; paprsky se zaokrouhli dolu na ctverec
+		void clear();
+
+		bool isComputed(unsigned int sceneId, unsigned int pass) const;	// jsou barvy spocitane pro toto sestaveni sceny (ModelContainer::getSceneId) a pruchod?
+		const float* getColors() const;	// barvy 4 rohu na patch (12 hodnot, poradi vrcholu patche)
+		unsigned long long getRaysCount() const;
+
+	private:
+		Vector3f gatherCorner(Patch* p, unsigned int corner, const Vector3f& normal, Patch** patches, const SceneBvh& scene, unsigned int rays) const;	// ozareni rohu
+
+		vector<float> colors;
+		unsigned long long raysCount;
+		unsigned int sceneId;	// sestaveni sceny a pruchod vypoctu, po kterem se sbiralo
+		unsigned int pass;
+};
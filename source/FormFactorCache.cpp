@@ -0,0 +1,123 @@
+#include "FormFactorCache.h"
+
+
+// rezie jednoho radku (polozka tabulky, seznam pouziti, hlavicka vektoru)
+static const size_t ROW_OVERHEAD = 64;
+
+
+FormFactorCache::FormFactorCache(void) {
+	limit = 0;
+	bytes = 0;
+	hits = 0;
+	misses = 0;
+}
+
+
+void FormFactorCache::setLimit(size_t bytes) {
+	limit = bytes;
+	clear();
+}
+
+bool FormFactorCache::isEnabled() const {
+	return limit > 0;
+}
+
+void FormFactorCache::clear() {
+	rows.clear();
+	uses.clear();
+	bytes = 0;
+}
+
+
+const FormFactorCache::Row* FormFactorCache::find(unsigned int emitter) {
+	if (limit == 0)
+		return NULL;
+
+	unordered_map<unsigned int, Slot>::iterator it = rows.find(emitter);
+	if (it == rows.end()) {
+		misses++;
+		return NULL;
+	}
+
+	hits++;
+	uses.splice(uses.begin(), uses, it->second.use);
+	return &it->second.row;
+}
+
+
+/**
+ * Radek vetsi nez cely limit se neulozi
+ */
+void FormFactorCache::insert(unsigned int emitter, Row& row) {
+	if (limit == 0 || rows.find(emitter) != rows.end()) {
+		row.clear();
+		return;
+	}
+
+	size_t size = bytesOf(row);
+	if (size > limit) {
+		row.clear();
+		return;
+	}
+
+	// uvolnit misto od nejdele nepouzitych
+	while (bytes + size > limit && !uses.empty()) {
+		unordered_map<unsigned int, Slot>::iterator victim = rows.find(uses.back());
+		bytes -= bytesOf(victim->second.row);
+		rows.erase(victim);
+		uses.pop_back();
+	}
+
+	uses.push_front(emitter);
+	Slot& slot = rows[emitter];
+	slot.row.swap(row);
+	slot.row.shrink_to_fit();
+	slot.use = uses.begin();
+	bytes += size;
+
+	row.clear();
+}
+
+
+/**
+ * Kernel vraci pro jeden patch zaznam z kazde skupiny work-items, ktera jej videla - zaznamy se seradi
+ * a form factory stejneho patche sectou
+ */
+void FormFactorCache::merge(Row& entries) {
+	sort(entries.begin(), entries.end(), idLess);
+
+	size_t n = 0;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (n > 0 && entries[n - 1].id == entries[i].id)
+			entries[n - 1].factor += entries[i].factor;
+		else
+			entries[n++] = entries[i];
+	}
+	entries.resize(n);
+}
+
+
+unsigned long long FormFactorCache::getHits() const {
+	return hits;
+}
+
+unsigned long long FormFactorCache::getMisses() const {
+	return misses;
+}
+
+size_t FormFactorCache::getRowsCount() const {
+	return rows.size();
+}
+
+size_t FormFactorCache::getBytes() const {
+	return bytes;
+}
+
+
+bool FormFactorCache::idLess(const Entry& a, const Entry& b) {
+	return a.id < b.id;
+}
+
+size_t FormFactorCache::bytesOf(const Row& row) {
+	return row.size() * sizeof(Entry) + ROW_OVERHEAD;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <stdint.h>
+
+using namespace std;
+
+
+/**
+ * Cache radku form factoru zdroju - pri postupnem zjemnovani se tytez patche (svetla, jasne steny)
+ * vybiraji jako zdroje opakovane a jejich hemicube by se kreslila znovu a znovu. Po prvnim vystrelu se
+ * radek zdroje (cisla zasazenych patchu a jejich form factory, serazene podle cisla) ulozi; dalsi vystrel
+ * tehoz patche je pak jen prenos po radku bez kresleni.
+ *
+ * Velikost je omezena poctem bytu, pri prekroceni se zahodi nejdele nepouzite radky. Radky plati, dokud
+ * se nezmeni geometrie sceny (clear).
+ */
+class FormFactorCache {
+
+	public:
+		struct Entry {
+			uint32_t id;
+			float factor;
+		};
+
+		typedef vector<Entry> Row;
+
+		FormFactorCache(void);
+
+		void setLimit(size_t bytes);	// 0 = cache vypnuta
+		bool isEnabled() const;
+		void clear();	// zahodi radky (statistiky zustanou)
+
+		const Row* find(unsigned int emitter);	// radek zdroje nebo NULL; zapocita zasah/minuti
+		void insert(unsigned int emitter, Row& row);	// ulozi slouceny radek (row se vyprazdni)
+
+		static void merge(Row& entries);	// seradi zaznamy podle cisla patche a slouci zaznamy tehoz patche
+
+		unsigned long long getHits() const;
+		unsigned long long getMisses() const;
+		size_t getRowsCount() const;
+		size_t getBytes() const;	// pamet radku
+
+	private:
+		struct Slot {
+			Row row;
+			list<unsigned int>::iterator use;	// pozice v seznamu pouziti
+		};
+
+		static bool idLess(const Entry& a, const Entry& b);
+		static size_t bytesOf(const Row& row);
+
+		size_t limit;
+		size_t bytes;
+
+		unordered_map<unsigned int, Slot> rows;
+		list<unsigned int> uses;	// od naposledy pouziteho
+
+		unsigned long long hits;
+		unsigned long long misses;
+};
@@ -1,6 +1,7 @@
 #include "FormFactors.h"
+#include <math.h>
 
-#define Pi (3.1415926535897932384626433832795028841931f)
+#define Pi (3.1415926535897932384626433832795028841931)
 
 //#define DO_BMP
 #ifdef DO_BMP
@@ -8,111 +9,8 @@ static float f_hemicube_max = 1;
 #endif
 
 
-static int n_hemicube_size = 0; // = Config::HEMICUBE_W();
-
-float* p_hemicube_tmp_formfactor = NULL;
-float* p_hemicube_tmp_formfactor_side = NULL;
-
-float* p_hemicube_formfactors = NULL;
-
-
-/**
- * Spocita factory pohledu vpred a do strany
- * a naplni jimi p_hemicube_tmp_formfactor a p_hemicube_tmp_formfactor_side
- */
-void Calc_HemicubeFormFactors()
-{	
-	p_hemicube_tmp_formfactor = new float[n_hemicube_size * n_hemicube_size];
-	p_hemicube_tmp_formfactor_side = new float[n_hemicube_size * n_hemicube_size / 2];
-
-    float f_half_pixel_width;
-    float f_pixel_area;
-    float dx, dy;
-    int x, y;
-    float f;
-
-    f_half_pixel_width = (1.0f / n_hemicube_size);
-    //
-    f_pixel_area = (2.0f / n_hemicube_size);
-    f_pixel_area *= f_pixel_area;
-    // 2 je velikost hemicube
-
-    for(x = 0; x < n_hemicube_size; x ++) {
-        for (y = 0; y < n_hemicube_size; y ++) {
-            dx = ((x - n_hemicube_size / 2) / (n_hemicube_size / 2.0f)) +
-                f_half_pixel_width;
-            dy = ((y - n_hemicube_size / 2) / (n_hemicube_size / 2.0f)) +
-                f_half_pixel_width;
-
-            f = (dx * dx + dy * dy + 1);
-            f *= f * Pi;
-
-            p_hemicube_tmp_formfactor[x + y * n_hemicube_size] = f_pixel_area / f;
-        }
-    }
-    // vrchni ...
-
-    for(x = 0; x < n_hemicube_size; x ++) {
-        for(y = 0; y < n_hemicube_size / 2; y ++) {
-            dx = (x - n_hemicube_size / 2) / (n_hemicube_size / 2.0f) +
-                f_half_pixel_width;
-            dy = (n_hemicube_size / 2 - 1 - y) / (n_hemicube_size / 2.0f) +
-                f_half_pixel_width;
-
-            f = (dx * dx + dy * dy + 1);
-            f *= f * Pi;
-
-            p_hemicube_tmp_formfactor_side[x + y * n_hemicube_size] = (f_pixel_area * (dy + f_half_pixel_width)) / f;
-        }
-    }
-    // strana
-
 #ifdef DO_BMP
-    for(x = 0, f_hemicube_max = 0; x < n_hemicube_size; x ++) {
-        for(y = 0; y < n_hemicube_size / 2; y ++) {
-            if(f_hemicube_max < p_hemicube_tmp_formfactor_side[x + y * n_hemicube_size])
-                f_hemicube_max = p_hemicube_tmp_formfactor_side[x + y * n_hemicube_size];
-        }
-    }
-    //
-    for(x = 0; x < n_hemicube_size; x ++) {
-        for(y = 0; y < n_hemicube_size; y ++) {
-            if(f_hemicube_max < p_hemicube_tmp_formfactor[x + y * n_hemicube_size])
-                f_hemicube_max = p_hemicube_tmp_formfactor[x + y * n_hemicube_size];
-        }
-    }
-    // hleda nejvetsi polozku
-#endif
-
-//#define __SUM_TEST
-#ifdef __SUM_TEST
-        float f_sum;
-
-        for(y = 0, f_sum = 0; y < n_hemicube_size; y ++) {
-            for(x = 0; x < n_hemicube_size / 2; x ++)
-                f_sum += p_hemicube_tmp_formfactor_side[y + x * n_hemicube_size];
-        }
-        // strana
-
-        f_sum *= 4;
-        // strany jsou 4
-
-        for(x = 0; x < n_hemicube_size; x ++) {
-            for(y = 0; y < n_hemicube_size; y ++)
-                f_sum += p_hemicube_tmp_formfactor[x + y * n_hemicube_size];
-        }
-        // vrch
-
-        // tady musi byt f_sum == 1, mne to vyjde 1.00435f
-		cout << "ff sum: " << f_sum << endl;
-#endif
-}
-
-
-
-
-#ifdef DO_BMP
-BMP *p_Hemicube_Test()
+BMP *p_Hemicube_Test(const HemicubeFormFactors& table)
 {
 	BMP *p_temp;
 	unsigned int x, y;
@@ -128,9 +26,17 @@ BMP *p_Hemicube_Test()
 	   p_temp->n_Height * sizeof(unsigned __int32))))
 		return 0;
 
+	for(x = 0, f_hemicube_max = 0; x < Config::PATCHVIEW_TEX_W(); x ++) {
+		for(y = 0; y < Config::PATCHVIEW_TEX_H(); y ++) {
+			if(f_hemicube_max < table.lookup(x, y))
+				f_hemicube_max = table.lookup(x, y);
+		}
+	}
+	// hleda nejvetsi polozku
+
 	for(x = 0; x < Config::PATCHVIEW_TEX_W(); x ++) {
 		for(y = 0; y < Config::PATCHVIEW_TEX_H() * Config::HEMICUBES_CNT(); y ++) {
-			n = (int)(p_hemicube_formfactors[x + y * Config::PATCHVIEW_TEX_W()] / f_hemicube_max * 0xff);
+			n = (int)(table.lookup(x, y % Config::PATCHVIEW_TEX_H()) / f_hemicube_max * 0xff);
 			p_temp->bytes[x + y * Config::PATCHVIEW_TEX_W()] = RGB(n, n, n);
 		}
 	}	
@@ -274,66 +180,155 @@ H_H*1.5 * - - - - * - - - - * H_H*1.5
 
 
 /**
- * Zkopiruje form factory pro pohledu vpred a do strany do dynymickeho bufferu o strukture odpovidajici texture a vraci ukazatel na nej
- * Pri lookupu bude pote stacit sahat na stejne misto v bufferu jako ze ktereho se cte textura
+ * Vzdalenost radku/sloupce pohledu od stredu steny v pixelech (0 = pixely u stredu)
  */
-float* precomputeHemicubeFormFactors() {
-	unsigned int HEMICUBE_W = Config::HEMICUBE_W();
-	unsigned int HEMICUBE_H = Config::HEMICUBE_H();
-	unsigned int PATCHVIEW_TEX_RES = Config::PATCHVIEW_TEX_RES();
-	unsigned int PATCHVIEW_TEX_W = Config::PATCHVIEW_TEX_W();
-	unsigned int PATCHVIEW_TEX_H = Config::PATCHVIEW_TEX_H();
-	unsigned int HEMICUBES_CNT = Config::HEMICUBES_CNT();
+static inline unsigned int foldIndex(unsigned int i, unsigned int half) {
+	return i < half ? half - 1 - i : i - half;
+}
 
-	n_hemicube_size = Config::HEMICUBE_W();
-	p_hemicube_formfactors = new float[PATCHVIEW_TEX_RES * HEMICUBES_CNT];
 
-	// predpocita factory pro pohled vpred a do strany
-	Calc_HemicubeFormFactors();
+HemicubeFormFactors::HemicubeFormFactors(void) {
+	side = 0;
+	half = 0;
+	sum = 0;
+}
 
-	// zkopiruje pohledy do jedineho pole
-	for (unsigned int i = 0; i < PATCHVIEW_TEX_RES; i++) {
-		unsigned int x = i % PATCHVIEW_TEX_W;
-		unsigned int y = i / PATCHVIEW_TEX_W;
 
-		// pohled dopredu
-		if (x >= HEMICUBE_W/2 && x < HEMICUBE_W*1.5 && y < HEMICUBE_H)
-			p_hemicube_formfactors[i] = p_hemicube_tmp_formfactor[ y * HEMICUBE_W + (x - HEMICUBE_W/2) ];				
-		// pohled vlevo
-		else if (x < HEMICUBE_W/2 && y < HEMICUBE_H)
-			p_hemicube_formfactors[i] = p_hemicube_tmp_formfactor_side[ (HEMICUBE_H/2 - x) * HEMICUBE_W - y - 1 ];		
-		// pohled vpravo
-		else if (x >= HEMICUBE_W*1.5 && y < HEMICUBE_H)
-			p_hemicube_formfactors[i] = p_hemicube_tmp_formfactor_side[ (x - unsigned int(HEMICUBE_W*1.5)) * HEMICUBE_W + y ];		
-		// pohled nahoru
-		else if (x < HEMICUBE_W && y >= HEMICUBE_H)
-			p_hemicube_formfactors[i] = p_hemicube_tmp_formfactor_side[ (y - HEMICUBE_H) * HEMICUBE_W + x ];
-		// pohled dolu
-		else if (x >= HEMICUBE_W && y >= HEMICUBE_H)
-			p_hemicube_formfactors[i] = p_hemicube_tmp_formfactor_side[ ((HEMICUBE_H/2-1) - (y - HEMICUBE_H)) * HEMICUBE_W + (x - HEMICUBE_W) ];
+/**
+ * Form factor plosky ve stredu hemicube k obdelniku na vrchni stene (ve vzdalenosti 1) mezi stredem steny
+ * a bodem (x, y); funkce je licha v obou souradnicich
+ */
+double HemicubeFormFactors::topIntegral(double x, double y) {
+	double cx = sqrt(1 + x * x);
+	double cy = sqrt(1 + y * y);
+	return (x / cx * atan(y / cx) + y / cy * atan(x / cy)) / (2 * Pi);
+}
+
+
+/**
+ * Bok je stena x = 1, u je souradnice podel zakladny a z vyska nad ni; integrand je z / (pi * (1 + u^2 + z^2)^2),
+ * po integraci podle z zbyde 1 / (2 * pi * (1 + u^2 + z^2)) a podle u arkus tangens
+ */
+double HemicubeFormFactors::sideIntegral(double u, double z) {
+	double c = sqrt(1 + z * z);
+	return -atan(u / c) / (2 * Pi * c);
+}
+
+
+/**
+ * Form factor pixelu je rozdil primitivni funkce v jeho rozich. Soucet se pocita s nasobnostmi pixelu
+ * v hemicube (osmina vrchu 8x, na uhlopricce 4x; pulka boku 8x) a tabulka se jim vydeli - odchylka od 1
+ * je jen zaokrouhleni
+ */
+void HemicubeFormFactors::build(unsigned int side) {
+	clear();
+
+	this->side = side;
+	half = side / 2;
+	if (half == 0)
+		return;
+
+	unsigned int topSize = half * (half + 1) / 2;
+	vector<double> values(topSize + half * half);
+	double step = 1.0 / half;
+
+	// vrch - pixel ve vzdalenostech a >= b od stredu
+	for (unsigned int a = 0; a < half; a++) {
+		for (unsigned int b = 0; b <= a; b++) {
+			double x0 = a * step, x1 = (a + 1) * step;
+			double y0 = b * step, y1 = (b + 1) * step;
+			double f = topIntegral(x1, y1) - topIntegral(x0, y1) - topIntegral(x1, y0) + topIntegral(x0, y0);
+
+			values[a * (a + 1) / 2 + b] = f;
+			sum += f * (a == b ? 4 : 8);
+		}
 	}
 
-	// pokud bude v texture vic pohledu, zkopirovat pod sebe
-	if (HEMICUBES_CNT > 1) {
-		for (unsigned int n = 1; n < HEMICUBES_CNT; n++) {
-			for (unsigned int i = PATCHVIEW_TEX_RES * n; i < PATCHVIEW_TEX_RES * (n + 1); i++) {
-				p_hemicube_formfactors[i] = p_hemicube_formfactors[i % PATCHVIEW_TEX_RES];
-			}
+	// bok - pixel ve vysce k nad zakladnou a ve vzdalenosti b od svisle osy
+	for (unsigned int k = 0; k < half; k++) {
+		for (unsigned int b = 0; b < half; b++) {
+			double u0 = b * step, u1 = (b + 1) * step;
+			double z0 = k * step, z1 = (k + 1) * step;
+			double f = sideIntegral(u1, z1) - sideIntegral(u0, z1) - sideIntegral(u1, z0) + sideIntegral(u0, z0);
+
+			values[topSize + k * half + b] = f;
+			sum += f * 8;
 		}
 	}
 
+	data.resize(values.size());
+	for (unsigned int i = 0; i < values.size(); i++)
+		data[i] = float(values[i] / sum);
+
+//#define __SUM_TEST
+#ifdef __SUM_TEST
+	double f_sum = 0;
+	for (unsigned int y = 0; y < side + half; y++) {
+		for (unsigned int x = 0; x < 2 * side; x++)
+			f_sum += lookup(x, y);
+	}
+	// tady musi byt f_sum == 1
+	cout << "ff sum: " << f_sum << " (" << sum << " before normalization)" << endl;
+#endif
 
 #ifdef DO_BMP
-	// test
-	BMP* img = p_Hemicube_Test();
+	BMP* img = p_Hemicube_Test(*this);
 	Save_TrueColor_BMP("test.bmp", img);
 	free(img->bytes);
 	free(img);
 #endif
-	
+}
 
-	delete[] p_hemicube_tmp_formfactor;
-	delete[] p_hemicube_tmp_formfactor_side;
-	
-	return p_hemicube_formfactors;
-}
\ No newline at end of file
+
+void HemicubeFormFactors::clear() {
+	data.clear();
+	side = 0;
+	half = 0;
+	sum = 0;
+}
+
+
+const float* HemicubeFormFactors::getData() const {
+	return data.empty() ? NULL : &data[0];
+}
+
+unsigned int HemicubeFormFactors::getSize() const {
+	return data.size();
+}
+
+double HemicubeFormFactors::getSum() const {
+	return sum;
+}
+
+
+/**
+ * Stejne rozbaleni jako v kernelu ProcessHemicube (Kernel_ProcessHemicube.h); vyska pixelu boku roste
+ * od vnejsiho okraje pohledu ke stene pred sebou
+ */
+float HemicubeFormFactors::lookup(unsigned int x, unsigned int y) const {
+	if (data.empty() || x >= 2 * side || y >= side + half)
+		return 0;
+
+	const float* sideData = &data[half * (half + 1) / 2];
+
+	if (y < side) {
+		unsigned int b = foldIndex(y, half);
+
+		// pohled vlevo
+		if (x < half)
+			return sideData[x * half + b];
+		// pohled vpravo
+		if (x >= side + half)
+			return sideData[(2 * side - 1 - x) * half + b];
+
+		// pohled dopredu
+		unsigned int a = foldIndex(x - half, half);
+		return a >= b ? data[a * (a + 1) / 2 + b] : data[b * (b + 1) / 2 + a];
+	}
+
+	// pohled nahoru
+	if (x < side)
+		return sideData[(side + half - 1 - y) * half + foldIndex(x, half)];
+	// pohled dolu
+	return sideData[(y - side) * half + foldIndex(x - side, half)];
+}
@@ -1,6 +1,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <vector>
 #include <stdlib.h>
 #include <stdio.h>
 #include <windows.h>
@@ -11,13 +12,36 @@ using namespace std;
 
 
 /**
- * Predpocita form factory a naplni jimi pole p_hemicube_formfactors tak,
- * ze strukturou odpovidaji rozlozeni pohledu v texture (detail v FormFactors.cpp)
- * Rozmery textury jsou pro urychleni vypoctu pevne dane
+ * Tabulka form factoru pixelu hemicube. Form factor pixelu je presny integral pres jeho plochu (ne hodnota
+ * ve stredu pixelu) a tabulka je normovana na soucet 1 pres celou hemicube.
  *
- * Vraci ukazatel na p_hemicube_formfactors
+ * Vrchni stena je symetricka podle obou os i uhlopricky, uklada se jen jeji osmina (trojuhelnik pro
+ * vzdalenosti od stredu a >= b); boky jsou vsechny stejne a symetricke podle svisle osy, uklada se pulka
+ * jednoho boku (vyska x vzdalenost od stredu). Kernel si hodnotu pixelu textury pohledu dopocita
+ * z techto dvou tabulek podle rozlozeni pohledu v texture (detail v FormFactors.cpp), tabulka tedy
+ * nezavisi na rozmerech textury ani na poctu hemicubes.
  */
-float* precomputeHemicubeFormFactors();
+class HemicubeFormFactors {
+
+	public:
+		HemicubeFormFactors(void);
+
+		void build(unsigned int side);	// spocita tabulky pro hemicube o strane side pixelu (sude)
+		void clear();
+
+		const float* getData() const;	// osmina vrchu, za ni pulka boku (h * (h + 1) / 2 + h * h hodnot, h = side / 2)
+		unsigned int getSize() const;	// pocet hodnot v getData
+		float lookup(unsigned int x, unsigned int y) const;	// form factor pixelu textury pohledu (y v ramci jedne hemicube)
+		double getSum() const;	// soucet pres hemicube pred normovanim
+
+	private:
+		static double topIntegral(double x, double y);	// integral vrchu od stredu steny do (x, y)
+		static double sideIntegral(double u, double z);	// neurcity integral boku
+
+		unsigned int side, half;
+		vector<float> data;
+		double sum;
+};
 
 
 void FBO2BMP();
@@ -0,0 +1,58 @@
+#include "Frustum.h"
+
+
+Frustum::Frustum(void) {
+	planeCount = 0;
+}
+
+
+/**
+ * Roviny se ctou primo z radku matice (Gribb, Hartmann): vrchol je uvnitr, pokud -w <= x, y, z <= w
+ * po transformaci. Matice je ulozena po sloupcich, radek r je tedy (m[0][r], m[1][r], m[2][r], m[3][r])
+ */
+void Frustum::setMatrix(const Matrix4f& mvp) {
+	Vector4f rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = Vector4f(mvp[0][r], mvp[1][r], mvp[2][r], mvp[3][r]);
+
+	planes[0] = rows[3] + rows[0];	// leva
+	planes[1] = rows[3] - rows[0];	// prava
+	planes[2] = rows[3] + rows[1];	// dolni
+	planes[3] = rows[3] - rows[1];	// horni
+	planes[4] = rows[3] + rows[2];	// blizka
+	planes[5] = rows[3] - rows[2];	// vzdalena
+	planeCount = 6;
+}
+
+
+void Frustum::addHalfSpace(const Vector3f& point, const Vector3f& normal) {
+	if (planeCount >= MAX_PLANES)
+		return;
+
+	planes[planeCount++] = Vector4f(normal.x, normal.y, normal.z, -normal.f_Dot(point));
+}
+
+
+/**
+ * Pro kazdou rovinu staci otestovat dva rohy kvadru - nejdal ve smeru normaly a nejdal proti nemu
+ */
+int Frustum::classify(const Aabb& box) const {
+	if (box.isEmpty())
+		return OUTSIDE;
+
+	int result = INSIDE;
+
+	for (unsigned int i = 0; i < planeCount; i++) {
+		const Vector4f& p = planes[i];
+
+		Vector3f farthest(p.x >= 0 ? box.max.x : box.min.x, p.y >= 0 ? box.max.y : box.min.y, p.z >= 0 ? box.max.z : box.min.z);
+		if (p.x * farthest.x + p.y * farthest.y + p.z * farthest.z + p.w < 0)
+			return OUTSIDE;
+
+		Vector3f nearest(p.x >= 0 ? box.min.x : box.max.x, p.y >= 0 ? box.min.y : box.max.y, p.z >= 0 ? box.min.z : box.max.z);
+		if (p.x * nearest.x + p.y * nearest.y + p.z * nearest.z + p.w < 0)
+			result = INTERSECTS;
+	}
+
+	return result;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Vector.h"
+#include "Bvh.h"
+
+
+/**
+ * Orezove teleso pohledu - roviny ziskane z matice projekce * pohledu, volitelne doplnene
+ * o dalsi poloprostor (pro pohled z patche poloprostor pred patchem). Slouzi k vyrazeni
+ * shluku patchu, ktere se v pohledu nemohou objevit, jeste pred kreslenim.
+ */
+class Frustum {
+
+	public:
+		enum {
+			OUTSIDE,	// kvadr je cely mimo
+			INTERSECTS,	// kvadr protina nekterou rovinu
+			INSIDE		// kvadr je cely uvnitr
+		};
+
+		Frustum(void);
+
+		void setMatrix(const Matrix4f& mvp);	// nastavi 6 rovin pohledu (zrusi pridany poloprostor)
+		void addHalfSpace(const Vector3f& point, const Vector3f& normal);	// prida poloprostor bodu x, pro ktere (x - point) . normal >= 0
+
+		int classify(const Aabb& box) const;	// poloha kvadru vuci telesu
+
+	private:
+		static const unsigned int MAX_PLANES = 8;
+
+		Vector4f planes[MAX_PLANES];	// roviny (a, b, c, d); uvnitr je a*x + b*y + c*z + d >= 0
+		unsigned int planeCount;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "FormFactorCache.h"
+#include "FormFactors.h"
+#include "Vector.h"
+
+
+// blizka a vzdalena rovina projekce pohledu z patche (jako pri kresleni hemicube v Main)
+static const float HEMICUBE_NEAR = 0.01f;
+static const float HEMICUBE_FAR = 1000.0f;
+
+
+/**
+ * Vzdalenost radku/sloupce steny hemicube od jejiho stredu v pixelech (jako v FormFactors.cpp)
+ */
+inline unsigned int hemicubeFoldIndex(unsigned int i, unsigned int half) {
+	return i < half ? half - 1 - i : i - half;
+}
+
+
+/**
+ * Radek zdroje stejne jako z hemicube: paprsek ze stredu patche stredem kazdeho pixelu sten hemicube
+ * o strane 'side' pixelu (vrch side x side, boky side x side / 2) s vahou form factoru pixelu z tabulky.
+ * Smer se nenormalizuje - slozka podel osy steny je 1, parametr zasahu je tedy hloubka v pohledu steny.
+ * Od nakresleneho radku se lisi jen tam, kde rasterizace rozhodne hranu patche jinak nez stred pixelu.
+ *
+ * Scena: int trace(const Vector3f& origin, const Vector3f& dir) const - cislo nejblizsiho patche privraceneho
+ * k paprsku licem v hloubce (HEMICUBE_NEAR, HEMICUBE_FAR), zadni strany se nevidi; -1 = nic.
+ * 'vertices' jsou 4 vrcholy zdroje 'emitter'
+ */
+template <class Scene>
+void castHemicubeRow(const Scene& scene, const HemicubeFormFactors& table, unsigned int side, unsigned int emitter, const Vector3f* vertices, FormFactorCache::Row& row) {
+	row.clear();
+
+	unsigned int half = side / 2;
+	if (half == 0 || table.getSize() != half * (half + 1) / 2 + half * half)
+		return;
+
+	// soustava pohledu jako Camera::lookFromPatch - normala a kolmy smer "nahoru" (k vrcholu 3)
+	Vector3f normal = (vertices[1] - vertices[0]).v_Cross(vertices[3] - vertices[0]);
+	float length = normal.f_Length();
+	if (length <= 0)
+		return;
+	normal *= 1 / length;
+
+	Vector3f up = vertices[3] - vertices[0];
+	up -= normal * normal.f_Dot(up);
+	if (up.f_Length() <= 0)
+		return;
+	up.Normalize();
+	Vector3f right = normal.v_Cross(up);
+
+	Vector3f origin = (vertices[0] + vertices[1] + vertices[2] + vertices[3]) * 0.25f;
+	const float* topData = table.getData();
+	const float* sideData = topData + half * (half + 1) / 2;
+	float step = 1.0f / half;
+
+	// vrch - pixel ve vzdalenostech a, b od stredu steny
+	for (unsigned int x = 0; x < side; x++) {
+		for (unsigned int y = 0; y < side; y++) {
+			unsigned int a = hemicubeFoldIndex(x, half);
+			unsigned int b = hemicubeFoldIndex(y, half);
+			float weight = a >= b ? topData[a * (a + 1) / 2 + b] : topData[b * (b + 1) / 2 + a];
+
+			Vector3f dir = normal + right * ((x + 0.5f) * step - 1) + up * ((y + 0.5f) * step - 1);
+			int hit = scene.trace(origin, dir);
+			if (hit >= 0 && uint32_t(hit) != emitter) {
+				FormFactorCache::Entry e = { uint32_t(hit), weight };
+				row.push_back(e);
+			}
+		}
+	}
+
+	// boky - osa boku, smer podel jeho zakladny; pixel ve vysce k nad rovinou zdroje
+	const Vector3f axes[4] = { right, -right, up, -up };
+	const Vector3f bases[4] = { up, up, right, right };
+	for (unsigned int s = 0; s < 4; s++) {
+		for (unsigned int k = 0; k < half; k++) {
+			for (unsigned int u = 0; u < side; u++) {
+				float weight = sideData[k * half + hemicubeFoldIndex(u, half)];
+
+				Vector3f dir = axes[s] + bases[s] * ((u + 0.5f) * step - 1) + normal * ((k + 0.5f) * step);
+				int hit = scene.trace(origin, dir);
+				if (hit >= 0 && uint32_t(hit) != emitter) {
+					FormFactorCache::Entry e = { uint32_t(hit), weight };
+					row.push_back(e);
+				}
+			}
+		}
+	}
+
+	// zaznamy pixelu tehoz patche se slouci (jako radek z kernelu)
+	FormFactorCache::merge(row);
+}
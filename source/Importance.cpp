@@ -0,0 +1,166 @@
+#include "Importance.h"
+#include "Sampling.h"
+#include <math.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// mrizka paprsku prime dulezitosti jednoho pohledu
+static const int VIEW_RAYS_X = 160;
+static const int VIEW_RAYS_Y = 120;
+
+// pocet odrazu, o ktere se dulezitost siri
+static const unsigned int BOUNCES = 3;
+
+// paprsky jednoho patche pri sireni dulezitosti
+static const unsigned int GATHER_RAYS = 8;
+
+// nejvetsi vzdalenost paprsku (vzdalena orezova rovina pohledu)
+static const float MAX_DISTANCE = 1000;
+
+
+Importance::Importance(void) {
+	computedScene = 0;
+}
+
+
+/**
+ * Ulozi pohled; modelview je matice kamery (Camera::GetMatrix), pohled smeruje do -z
+ */
+void Importance::addView(const Matrix4f& modelview, float fov, float aspect) {
+	View v;
+	v.toWorld = modelview.t_FastInverse();
+	v.tanY = tanf(fov * f_pi / 360);
+	v.tanX = v.tanY * aspect;
+	views.push_back(v);
+
+	clear();
+}
+
+void Importance::clearViews() {
+	views.clear();
+	clear();
+}
+
+unsigned int Importance::getViewsCount() const {
+	return views.size();
+}
+
+
+/**
+ * Prima dulezitost ze vsech pohledu (kazdy pohled ma celkovou vahu 1) a BOUNCES odrazu
+ */
+void Importance::compute(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int sceneId) {
+	computedScene = sceneId;
+	values.assign(count, 0);
+	current.assign(count, 0);
+	next.assign(count, 0);
+
+	if (count == 0 || views.empty())
+		return;
+
+	for (unsigned int v = 0; v < views.size(); v++)
+		addDirect(views[v], patches, count, scene, 1.0f / (VIEW_RAYS_X * VIEW_RAYS_Y));
+
+	for (unsigned int i = 0; i < count; i++)
+		values[i] = current[i];
+
+	for (unsigned int b = 0; b < BOUNCES; b++) {
+		gather(patches, count, scene, b);
+		current.swap(next);
+
+		for (unsigned int i = 0; i < count; i++)
+			values[i] += current[i];
+	}
+
+	float highest = 0;
+	for (unsigned int i = 0; i < count; i++)
+		highest = max(highest, values[i]);
+	if (highest > 0) {
+		for (unsigned int i = 0; i < count; i++)
+			values[i] /= highest;
+	}
+
+	current.clear();
+	next.clear();
+}
+
+void Importance::clear() {
+	values.clear();
+	computedScene = 0;
+}
+
+/**
+ * Pocet patchu nestaci - jina scena se stejnym poctem patchu by prevzala cizi hodnoty
+ */
+bool Importance::isComputed(unsigned int sceneId) const {
+	return sceneId != 0 && computedScene == sceneId && !values.empty();
+}
+
+const float* Importance::getValues() const {
+	return values.empty() ? NULL : &values[0];
+}
+
+
+/**
+ * Paprsky stredy pixelu pohledu; zasazeny patch ziska vahu paprsku. Zasahy se zapisou po paprscich
+ * a sectou seriove
+ */
+void Importance::addDirect(const View& view, Patch** patches, unsigned int count, const SceneBvh& scene, float weight) {
+	Vector3f origin = view.toWorld.v_Transform_Pos(Vector3f(0, 0, 0));
+	vector<int> hits(VIEW_RAYS_X * VIEW_RAYS_Y);
+
+	#pragma omp parallel for schedule(dynamic, 4)
+	for (int y = 0; y < VIEW_RAYS_Y; y++) {
+		for (int x = 0; x < VIEW_RAYS_X; x++) {
+			float sx = ((x + 0.5f) / VIEW_RAYS_X * 2 - 1) * view.tanX;
+			float sy = ((y + 0.5f) / VIEW_RAYS_Y * 2 - 1) * view.tanY;
+			Vector3f dir = view.toWorld.v_Transform_Dir(Vector3f(sx, sy, -1));
+
+			float t = MAX_DISTANCE;
+			hits[y * VIEW_RAYS_X + x] = scene.intersect(origin, dir, t);
+		}
+	}
+
+	for (unsigned int i = 0; i < hits.size(); i++) {
+		if (hits[i] >= 0 && (unsigned int)hits[i] < count)
+			current[hits[i]] += weight;
+	}
+}
+
+
+/**
+ * Jeden odraz dulezitosti: next[i] = prumer pres paprsky z patche i (podle kosinu) odrazivost * current
+ * zasazeneho patche. Patch bez dulezitosti v okoli tak nic neziska; kazdy patch se zapisuje jen ze sveho
+ * pruchodu smyckou
+ */
+void Importance::gather(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int bounce) {
+	#pragma omp parallel for schedule(dynamic, 256)
+	for (int i = 0; i < int(count); i++) {
+		Patch* p = patches[i];
+		Vector3f n = p->getNormal();
+		float length = n.f_Length();
+		if (length <= 0) {
+			next[i] = 0;
+			continue;
+		}
+		n *= 1 / length;
+
+		Vector3f origin = p->getCenter();
+		float sum = 0;
+
+		for (unsigned int s = 0; s < GATHER_RAYS; s++) {
+			Vector3f dir = Sampling::cosineDirection(n, Sampling::number(bounce, i, 2 * s), Sampling::number(bounce, i, 2 * s + 1));
+
+			float distance = MAX_DISTANCE;
+			int hit = scene.intersect(origin, dir, distance);
+			if (hit >= 0 && (unsigned int)hit < count && hit != i)
+				sum += current[hit] * patches[hit]->getReflectivity();
+		}
+
+		next[i] = sum / GATHER_RAYS;
+	}
+}
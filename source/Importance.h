@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include "SceneBvh.h"
+#include "Patch.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Dulezitost patchu pro zadane pohledy (Smits, Arvo, Salesin) - dualni velicina k radiosite. Prima
+ * dulezitost patchu je podil pixelu pohledu, ve kterych je patch videt; dulezitost se pak siri opacne
+ * nez svetlo: patch, ktery osvetluje dulezity patch, je sam dulezity (umerne form factoru a odrazivosti
+ * osvetleneho patche). Vypocet radiosity pak prednostne strili energii, ktera skonci v pohledech.
+ *
+ * Prima dulezitost se zjisti paprsky z kamer pres mrizku pixelu, sireni sbiranim - kazdy patch vysle
+ * nekolik paprsku do polokoule (rozlozenych podle kosinu, tedy s pravdepodobnosti podle form factoru)
+ * a prevezme prumernou dulezitost zasazenych patchu nasobenou jejich odrazivosti. Hodnoty se normuji
+ * na nejvyssi = 1.
+ */
+class Importance {
+
+	public:
+		Importance(void);
+
+		void addView(const Matrix4f& modelview, float fov, float aspect);	// pohled kamery; fov = svisly uhel ve stupnich (jako CGLTransform::Perspective)
+		void clearViews();
+		unsigned int getViewsCount() const;
+
+		void compute(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int sceneId);	// spocita dulezitost patchu sceny (ModelContainer::getSceneId) ze vsech pohledu
+		void clear();	// zahodi spocitane hodnoty (pohledy zustanou)
+
+		bool isComputed(unsigned int sceneId) const;	// jsou hodnoty spocitane pro dane sestaveni sceny?
+		const float* getValues() const;	// dulezitost po patchich sceny <0, 1>; NULL = nespocitano
+
+	private:
+		struct View {
+			Matrix4f toWorld;	// inverzni modelview - z kamery do sceny
+			float tanX, tanY;	// polovina sirky/vysky obrazu v rovine ve vzdalenosti 1
+		};
+
+		void addDirect(const View& view, Patch** patches, unsigned int count, const SceneBvh& scene, float weight);
+		void gather(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int bounce);
+
+		vector<View> views;
+		vector<float> values;	// celkova dulezitost
+		unsigned int computedScene;	// sestaveni sceny, pro ktere jsou hodnoty spocitane
+		vector<float> current;	// dulezitost posledniho odrazu
+		vector<float> next;
+};
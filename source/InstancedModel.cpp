@@ -0,0 +1,172 @@
+#include "InstancedModel.h"
+#include "SceneBvh.h"
+#include <unordered_map>
+
+
+ModelPrototype::ModelPrototype(Model* source) {
+	this->source = source;
+	patches = NULL;
+	patchArea = -1;
+	generation = 0;
+	refCount = 0;
+}
+
+
+ModelPrototype::~ModelPrototype(void) {
+	delete source;
+}
+
+
+void ModelPrototype::addRef() {
+	refCount++;
+}
+
+
+void ModelPrototype::release() {
+	if (--refCount <= 0)
+		delete this;
+}
+
+
+/**
+ * Zdrojovy model se deli jen pri prvnim dotazu nebo zmene plochy; s rozdelenim se prepocitaji
+ * sousedi (z ukazatelu na cisla patchu) a strom
+ */
+vector<Patch*>* ModelPrototype::getPatches(double area) {
+	if (patches != NULL && area == patchArea)
+		return patches;
+
+	patches = source->getPatches(area);
+	patchArea = area;
+	generation++;
+
+	unsigned int count = patches->size();
+
+	unordered_map<Patch*, unsigned int> ids;
+	ids.reserve(count);
+	for (unsigned int i = 0; i < count; i++)
+		ids[patches->at(i)] = i;
+
+	// neznamy soused (mimo model) = patch sam
+	neighbours.resize(count * 8);
+	for (unsigned int i = 0; i < count; i++) {
+		for (unsigned int n = 0; n < 8; n++) {
+			unordered_map<Patch*, unsigned int>::iterator it = ids.find(patches->at(i)->getNeighbour(n));
+			neighbours[i * 8 + n] = (it != ids.end()) ? it->second : i;
+		}
+	}
+
+	SceneBvh::buildPatchBvh(bvh, count > 0 ? &(*patches)[0] : NULL, count);
+
+	return patches;
+}
+
+
+vector<Patch*>* ModelPrototype::getPatches() {
+	return patches;
+}
+
+
+const vector<unsigned int>& ModelPrototype::getNeighbours() {
+	return neighbours;
+}
+
+
+const Bvh* ModelPrototype::getBvh() {
+	return &bvh;
+}
+
+
+unsigned int ModelPrototype::getGeneration() {
+	return generation;
+}
+
+
+
+InstancedModel::InstancedModel(ModelPrototype* prototype, const Matrix4f& transform) {
+	this->prototype = prototype;
+	instance.transform = transform;
+	instance.patches = NULL;
+	instance.neighbours = NULL;
+	instance.vertices = NULL;
+	block = NULL;
+	generation = 0;
+	built = false;
+
+	prototype->addRef();
+}
+
+
+InstancedModel::~InstancedModel(void) {
+	releasePatches();
+	prototype->release();
+}
+
+
+/**
+ * Patche bloku se nemazou jednotlive (Model::~Model), vektor se proto vyprazdni
+ */
+void InstancedModel::releasePatches() {
+	for (unsigned int i = 0; block != NULL && i < patches->size(); i++)
+		block[i].~Patch();
+	::operator delete(block);
+
+	block = NULL;
+	patches->clear();
+	vector<Vector3f>().swap(vertices);
+	instance.vertices = NULL;
+}
+
+
+/**
+ * Vytvori patche instance - odkazuji na geometrii patchu predlohy a transformaci instance, energie
+ * maji vlastni (pocatecni z predlohy, instance svetla tedy take sviti). Rohy se transformuji do sceny
+ * jednou zde. Patche se obnovuji jen pri novem rozdeleni predlohy
+ */
+vector<Patch*>* InstancedModel::getPatches(double area) {
+	vector<Patch*>* local = prototype->getPatches(area);
+	if (built && generation == prototype->getGeneration())
+		return patches;
+
+	releasePatches();
+
+	int count = int(local->size());
+	block = (Patch*)::operator new(max(count, 1) * sizeof(Patch));
+	patches->resize(count);
+	vertices.resize(count * 4);
+
+	instance.patches = block;
+	instance.neighbours = count > 0 ? &prototype->getNeighbours()[0] : NULL;
+	instance.vertices = count > 0 ? &vertices[0] : NULL;
+
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++) {
+		const Vector3f* source = local->at(i)->getVertices();
+		for (unsigned int v = 0; v < 4; v++)
+			vertices[i * 4 + v] = instance.transform.v_Transform_Pos(source[v]);
+		patches->at(i) = new (&block[i]) Patch(*local->at(i), &instance);
+	}
+
+	generation = prototype->getGeneration();
+	built = true;
+
+	return patches;
+}
+
+
+/**
+ * Listy sdileneho stromu odkazuji na patche predlohy cisly, patche instance proto musi zustat v jejim poradi
+ */
+void InstancedModel::sortPatches() {
+}
+
+
+/**
+ * Strom je sdileny s predlohou - patche predlohy maji stejne poradi jako patche instance
+ */
+const Bvh* InstancedModel::getBvh(vector<Patch*>*& localPatches, Matrix4f& transform, bool& identity) {
+	localPatches = prototype->getPatches();
+	transform = instance.transform;
+	identity = false;
+	return prototype->getBvh();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include "model.h"
+#include "Bvh.h"
+
+using namespace std;
+
+
+/**
+ * Sdilena predloha pro instance modelu (napr. zidle opakovana v cele kancelari). Zdrojovy model se
+ * nacte a rozdeli jen jednou, nad jeho patchi se jednou postavi BVH a spocitaji sousedi jako cisla
+ * patchu. Predlohu vlastni instance - pocita se pocet odkazu, posledni instance ji smaze i se zdrojovym modelem.
+ */
+class ModelPrototype {
+
+	public:
+		ModelPrototype(Model* source);	// prevezme vlastnictvi zdrojoveho modelu
+
+		void addRef();
+		void release();	// pri poslednim odkazu predlohu smaze
+
+		vector<Patch*>* getPatches(double area);	// rozdelene patche predlohy v jejich souradnicich; deli se jen pri zmene plochy
+		vector<Patch*>* getPatches();				// naposledy rozdelene patche (po getPatches(area))
+		const vector<unsigned int>& getNeighbours();	// 8 cisel sousedu na patch (index v getPatches)
+		const Bvh* getBvh();
+		unsigned int getGeneration();	// meni se s kazdym novym rozdelenim - instance podle nej poznaji, ze musi obnovit patche
+
+	private:
+		~ModelPrototype(void);
+
+		Model* source;
+		vector<Patch*>* patches;	// patche zdrojoveho modelu (vlastni je model)
+		double patchArea;			// plocha, se kterou byly patche rozdeleny
+		unsigned int generation;
+		int refCount;
+
+		vector<unsigned int> neighbours;
+		Bvh bvh;
+};
+
+
+/**
+ * Instance predlohy umistena do sceny transformaci. Instance si uklada jen transformaci a blok patchu
+ * s vlastnimi energiemi a rohy patchu ve scene - ostatni geometrii a sousedy sdili s patchi predlohy,
+ * BVH je take sdilene - ve dvouurovnove hierarchii sceny se instance zaradi jen svym kvadrem a transformaci.
+ * Transformace by nemela zrcadlit, jinak se obrati orientace (a normaly) patchu.
+ */
+class InstancedModel : public Model {
+
+	public:
+		InstancedModel(ModelPrototype* prototype, const Matrix4f& transform);
+		~InstancedModel(void);
+
+		vector<Patch*>* getPatches(double area = 0);
+		const Bvh* getBvh(vector<Patch*>*& localPatches, Matrix4f& transform, bool& identity);
+		void sortPatches();	// nic - poradi je dane predlohou (sdileny strom)
+
+	private:
+		void releasePatches();	// znici blok patchu instance
+
+		ModelPrototype* prototype;
+		PatchInstance instance;		// transformace a odkazy pro patche instance
+		Patch* block;				// patche instance v poradi predlohy (jen energie a odkazy)
+		vector<Vector3f> vertices;	// rohy patchu bloku transformovane do sceny (4 na patch)
+		unsigned int generation;	// generace predlohy, ze ktere jsou vytvorene patche instance
+		bool built;
+};
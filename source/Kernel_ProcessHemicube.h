@@ -6,6 +6,29 @@ const char* kernel_processHemicube =
 
 		"#define alloc_block 4\n"
 
+		// form factor pixelu textury pohledu z tabulek HemicubeFormFactors (osmina vrchu, za ni pulka boku);
+		// y je v ramci jedne hemicube, rozlozeni pohledu odpovida 'nakresu' v FormFactors.cpp
+		"int foldIndex(int i, int h) {\n"
+		"	return i < h ? h - 1 - i : i - h;\n"
+		"}\n"
+
+		"float formFactor(__global const float *p_ffactors, int x, int y, int n) {\n"
+		"	int h = n / 2;\n"
+		"	__global const float *p_side = p_ffactors + h * (h + 1) / 2;\n"
+		"	if (y < n) {\n"
+		"		int b = foldIndex(y, h);\n"
+		"		if (x < h)\n"								// vlevo
+		"			return p_side[x * h + b];\n"
+		"		if (x >= n + h)\n"							// vpravo
+		"			return p_side[(2 * n - 1 - x) * h + b];\n"
+		"		int a = foldIndex(x - h, h);\n"					// dopredu
+		"		return a >= b ? p_ffactors[a * (a + 1) / 2 + b] : p_ffactors[b * (b + 1) / 2 + a];\n"
+		"	}\n"
+		"	if (x < n)\n"									// nahoru
+		"		return p_side[(n + h - 1 - y) * h + foldIndex(x, h)];\n"
+		"	return p_side[(y - n) * h + foldIndex(x - n, h)];\n"	// dolu
+		"}\n"
+
 		"__kernel void ProcessHemicube(\n"
 		"		__global uint32_t *p_hemicubes,\n"			// cislo pohledu, ke kteremu se vztahuji p_ids a p_energies; indexovano p_write_index
 		"		__global uint32_t *p_ids,\n"				// patche, kterym nalezi energie, indexovano hodnotami p_write_index
@@ -13,7 +36,7 @@ const char* kernel_processHemicube =
 		"		__global unsigned int *p_write_index,\n"	// index k zapisu do p_ids a p_energies, sdileny mezi instancemi, atomicky posouvany
 		"		__read_only image2d_t t_patchview,\n"		// textura ve ktere je pohled z nejakeho patche
 		"		__read_only sampler_t n_sampler,\n"			// sampler textury patchview
-		"		__global const float *p_ffactors,\n"		// textura form factoru
+		"		__global const float *p_ffactors,\n"		// tabulky form factoru (HemicubeFormFactors)
 		"		const unsigned int n_width,\n"				// sirka textury
 		"		const unsigned int n_height,\n"				// vyska textury
 		"		const unsigned int n_span_length,\n"		// delka jedne scanline, kterou zpracovava jedna instance
@@ -28,8 +51,9 @@ const char* kernel_processHemicube =
 		"	if(y >= n_height * n_hemicubes)\n"
 		"		return;\n"
 		   
-			// posun na aktualni scanline
-		"	p_ffactors += n_width * y;\n" 
+			// radek v ramci hemicube; strana hemicube je polovina sirky textury
+		"	int n_local_y = y % n_height;\n"
+		"	int n_side = n_width / 2;\n"
 
 		"   int space = 0;\n"
 		"	unsigned int n_write_id;\n"
@@ -42,7 +66,7 @@ const char* kernel_processHemicube =
 		"			float4 act_color = read_imagef(t_patchview, n_sampler, (int2)(x0, y));\n"
 		"			uint32_t n_act_patch = 1048576 * (uint32_t)(act_color.z * 1024) + 1024 * (uint32_t)(act_color.y * 1024) + (uint32_t)(act_color.x * 1024);\n"
 		"			if (n_act_patch == n_patch_id) {\n"
-		"				f_energy += p_ffactors[x0];\n" // suma energie pro jeden polygon na jedne scanline
+		"				f_energy += formFactor(p_ffactors, x0, n_local_y, n_side);\n" // suma energie pro jeden polygon na jedne scanline
 		"				++ x0;\n"
 		"			} else\n"
 		"				break;\n"
@@ -1,22 +1,79 @@
 #include "LoadingModel.h"
+#include "NumaArena.h"
 
 
-LoadingModel::LoadingModel(Patch* data, unsigned long count) {
+/**
+ * Pamet pro vsechny patche modelu (a zvlast pro jejich geometrii) jednim blokem - nacteni tak nealokuje
+ * kazdy patch zvlast. Patche z bloku se mazou normalne (Patch::operator delete), blok se uvolni se
+ * smazanim posledniho. Pokud se bloky nepodari alokovat, vraci false a patche se vytvori na halde
+ */
+static bool createArenas(unsigned long count, NumaArena*& arena, NumaArena*& shapeArena) {
+	arena = count > 0 ? NumaArena::create(0, count, sizeof(Patch)) : NULL;
+	shapeArena = count > 0 ? NumaArena::create(0, count, sizeof(PatchShape)) : NULL;
+	if (arena != NULL && shapeArena != NULL)
+		return true;
+
+	NumaArena::discard(arena);
+	NumaArena::discard(shapeArena);
+	arena = NULL;
+	shapeArena = NULL;
+	return false;
+}
+
+
+LoadingModel::LoadingModel(const LegacyPatch* data, unsigned long count) {
+	NumaArena* arena;
+	NumaArena* shapeArena;
+	bool inArena = createArenas(count, arena, shapeArena);
+
 	// zkopirovat dodane patche do vnitrniho uloziste
 	for (unsigned long i = 0; i < count; i++) {
-		patches->push_back(new Patch(data[i]));
+		const LegacyPatch& d = data[i];
+		void* where = inArena ? arena->getItem(i) : Patch::operator new(sizeof(Patch));
+		patches->push_back(new (where) Patch(d.vec1, d.vec2, d.vec3, d.vec4, d.color, d.illumination, d.radiosity, inArena ? shapeArena->getItem(i) : NULL));
 	}
 
 	// nahradit relativni sousedy ukazateli pro rychlejsi pristup pri kresleni
 	for (unsigned long i = 0; i < count; i++) {
 		Patch* p = patches->at(i);
 		for (unsigned int n = 0; n < 8; n++) { // cele osmiokoli			
-			p->neighbours[n] = patches->at( p->relativeNeighbours[n] );
+			unsigned int id = data[i].relativeNeighbours[n];
+			p->setNeighbour(n, (id < count) ? patches->at(id) : p);
 		}
 	}
 }
 
 
+/**
+ * Vytvori patche ze zaznamu namapovanych sekci souboru (kazdy patch je kopie sveho zaznamu) do jednoho
+ * bloku pameti; docasne pole vsech patchu jako u stareho formatu nevznika
+ */
+LoadingModel::LoadingModel(const SceneFile& file) {
+	int count = int(file.getPatchesCount());
+	const uint32_t* fileNeighbours = file.getNeighbours();
+	NumaArena* arena;
+	NumaArena* shapeArena;
+	bool inArena = createArenas(count, arena, shapeArena);
+
+	patches->resize(count);
+
+	// kazdy zaznam je nezavisly, lze vytvaret paralelne
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++) {
+		patches->at(i) = inArena ? file.createPatch(i, arena->getItem(i), shapeArena->getItem(i)) : file.createPatch(i);
+	}
+
+	// sousedi jsou v souboru ulozeni jako cisla patchu
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++) {
+		Patch* p = patches->at(i);
+		for (unsigned int n = 0; n < 8; n++) {
+			uint32_t id = fileNeighbours[i * 8 + n];
+			p->setNeighbour(n, (id < unsigned(count)) ? patches->at(id) : p);
+		}
+	}
+}
+
 
 vector<Patch*>* LoadingModel::getPatches(double area) {
 	//if (area > 0)
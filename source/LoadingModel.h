@@ -1,6 +1,7 @@
 
 #include <vector>
 #include "model.h"
+#include "SceneFile.h"
 
 /**
  * Falesny model, pouzivany pro nacitani sceny ze souboru
@@ -10,7 +11,8 @@
 class LoadingModel : public Model {
 	
 	public:
-		LoadingModel(Patch* data, unsigned long count);
+		LoadingModel(const LegacyPatch* data, unsigned long count);	// z pole patchu ve starem formatu (relativni sousedi)
+		LoadingModel(const SceneFile& file);	// primo z namapovaneho souboru sceny
 
 		vector<Patch*>* getPatches(double area);
 };
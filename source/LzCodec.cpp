@@ -0,0 +1,148 @@
+#include "LzCodec.h"
+#include <string.h>
+
+
+/**
+ * Nacte 4 byty (bez ohledu na zarovnani)
+ */
+static inline uint32_t read32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+
+/**
+ * Zapise prodlouzeni delky (za hodnotou 15 v tokenu) - posloupnost 255 ukoncena mensim bytem
+ */
+void LzCodec::writeLength(vector<uint8_t>& dst, size_t length) {
+	while (length >= 255) {
+		dst.push_back(255);
+		length -= 255;
+	}
+	dst.push_back(uint8_t(length));
+}
+
+
+/**
+ * Zkomprimuje blok 'src' a prida vysledek na konec 'dst'. Shody se hledaji pres hashovaci
+ * tabulku poslednich pozic 4-bytovych posloupnosti (jeden kandidat na pozici - rychle, ne optimalni)
+ */
+void LzCodec::compress(const uint8_t* src, size_t srcSize, vector<uint8_t>& dst) {
+	vector<uint32_t> table(1 << HASH_BITS, 0xFFFFFFFF);
+
+	size_t anchor = 0;	// zacatek dosud nezapsanych literalu
+	size_t pos = 0;
+
+	// posledni byty bloku zustanou vzdy literaly, shoda nesmi precist za konec
+	size_t limit = srcSize > MIN_MATCH ? srcSize - MIN_MATCH : 0;
+
+	while (pos < limit) {
+		uint32_t seq = read32(src + pos);
+		uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+		uint32_t candidate = table[h];
+		table[h] = uint32_t(pos);
+
+		if (candidate == 0xFFFFFFFF || pos - candidate > MAX_OFFSET || read32(src + candidate) != seq) {
+			pos++;
+			continue;
+		}
+
+		// prodlouzit shodu
+		size_t length = MIN_MATCH;
+		while (pos + length < srcSize && src[candidate + length] == src[pos + length])
+			length++;
+
+		// token
+		size_t literals = pos - anchor;
+		size_t matchCode = length - MIN_MATCH;
+		dst.push_back(uint8_t(((literals < 15 ? literals : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+
+		// literaly
+		if (literals >= 15)
+			writeLength(dst, literals - 15);
+		dst.insert(dst.end(), src + anchor, src + pos);
+
+		// offset a prodlouzeni delky shody
+		size_t offset = pos - candidate;
+		dst.push_back(uint8_t(offset & 0xFF));
+		dst.push_back(uint8_t(offset >> 8));
+		if (matchCode >= 15)
+			writeLength(dst, matchCode - 15);
+
+		pos += length;
+		anchor = pos;
+	}
+
+	// zbyvajici literaly
+	size_t literals = srcSize - anchor;
+	dst.push_back(uint8_t((literals < 15 ? literals : 15) << 4));
+	if (literals >= 15)
+		writeLength(dst, literals - 15);
+	dst.insert(dst.end(), src + anchor, src + srcSize);
+}
+
+
+/**
+ * Rozbali blok do pole 'dst' o delce 'dstSize'. Vraci false, pokud jsou data poskozena
+ * (cteni nebo zapis by presahly hranice poli, nebo vysledek nema ocekavanou delku)
+ */
+bool LzCodec::decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < srcSize) {
+		uint8_t token = src[in++];
+
+		// literaly
+		size_t literals = token >> 4;
+		if (literals == 15) {
+			uint8_t b;
+			do {
+				if (in >= srcSize)
+					return false;
+				b = src[in++];
+				literals += b;
+			} while (b == 255);
+		}
+		if (in + literals > srcSize || out + literals > dstSize)
+			return false;
+		memcpy(dst + out, src + in, literals);
+		in += literals;
+		out += literals;
+
+		// posledni sekvence nema shodu
+		if (in >= srcSize)
+			break;
+
+		// shoda
+		if (in + 2 > srcSize)
+			return false;
+		size_t offset = src[in] | (size_t(src[in + 1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > out)
+			return false;
+
+		size_t length = token & 0x0F;
+		if (length == 15) {
+			uint8_t b;
+			do {
+				if (in >= srcSize)
+					return false;
+				b = src[in++];
+				length += b;
+			} while (b == 255);
+		}
+		length += MIN_MATCH;
+		if (out + length > dstSize)
+			return false;
+
+		// kopirovat po bytech - shoda se muze prekryvat s prave zapisovanymi daty
+		const uint8_t* from = dst + out - offset;
+		for (size_t i = 0; i < length; i++)
+			dst[out + i] = from[i];
+		out += length;
+	}
+
+	return out == dstSize;
+}
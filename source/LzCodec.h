@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+
+/**
+ * Jednoduchy LZ77 kompresor bloku dat (format sekvenci podobny LZ4).
+ * Kazdy blok je nezavisly, lze tedy komprimovat i dekomprimovat vice bloku paralelne.
+ *
+ * sekvence: token | [delka literalu 255...] | literaly | offset (2B LE) | [delka shody 255...]
+ *   token - horni 4 bity delka literalu, dolni 4 bity delka shody - 4; hodnota 15 = pokracuje dalsimi byty
+ *   posledni sekvence obsahuje pouze literaly
+ */
+class LzCodec {
+
+	public:
+		static void compress(const uint8_t* src, size_t srcSize, vector<uint8_t>& dst);	// prida zkomprimovany blok na konec dst
+		static bool decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);	// rozbali blok do pole o presne delce dstSize
+
+	private:
+		static const unsigned int MIN_MATCH = 4;		// nejkratsi kodovana shoda
+		static const unsigned int MAX_OFFSET = 65535;	// nejvzdalenejsi shoda (offset se uklada do 2 bytu)
+		static const unsigned int HASH_BITS = 14;		// velikost hashovaci tabulky pozic
+
+		static void writeLength(vector<uint8_t>& dst, size_t length);
+};
@@ -24,16 +24,35 @@ bool InitGLObjects() {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.getIndicesCount() * sizeof(int), scene.getIndices(), GL_STATIC_DRAW);		
 	
 
-	// VBO pro ulozeni barev podle ID patchu - bude obsahovat jeden interval barev (kazda barva zabalena do intu)
+	// svarene vrcholy a indexy pro kresleni pohledu z patchu - sousedni patche sdileji rohy,
+	// takze se kazdy roh transformuje jen jednou
+	glGenBuffers(1, &n_welded_vertex_buffer_object);
+	glBindBuffer(GL_ARRAY_BUFFER, n_welded_vertex_buffer_object);
+	glBufferData(GL_ARRAY_BUFFER, scene.getWeldedVerticesCount() * sizeof(float), scene.getWeldedVertices(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &n_welded_index_buffer_object);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, n_welded_index_buffer_object);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.getIndicesCount() * sizeof(int), scene.getWeldedIndices(), GL_STATIC_DRAW);
+
+	// VBO pro ulozeni barev podle ID patchu - barva patche je na jeho provokujicim vrcholu (kazda barva zabalena do intu);
+	// intervaly zacinaji na nasobcich rozsahu barev, proto barva odpovida poradi patche v ramci intervalu
 	glGenBuffers(1, &n_id_color_buffer_object);	
 	glBindBuffer(GL_ARRAY_BUFFER, n_id_color_buffer_object);	
-	// naplnit unikatnimi barvami
 	{
 		Colors::setNeededColors(scene.getPatchesCount()); // idealni rozsah barev - pro optimalizaci generovani
-		uint32_t* colorData = Colors::getIndicesColors(); // colorRange * 4 indexy
-		unsigned int colorRange = Colors::getColorRange();		
-		glBufferData(GL_ARRAY_BUFFER, colorRange * 4 * sizeof(uint32_t), colorData, GL_STATIC_DRAW);		
+		unsigned int colorRange = Colors::getColorRange();
+		unsigned int weldedCount = scene.getWeldedVerticesCount() / 3;
+		unsigned int* provoking = scene.getProvokingVertices();
+
+		uint32_t* colorData = new uint32_t[weldedCount];
+		fill_n(colorData, weldedCount, 0);
+		for (unsigned int i = 0; i < scene.getPatchesCount(); i++)
+			colorData[provoking[i]] = Colors::color(i % colorRange + 1);
+
+		glBufferData(GL_ARRAY_BUFFER, weldedCount * sizeof(uint32_t), colorData, GL_STATIC_DRAW);		
 		delete[] colorData;	// data jsou uz zkopirovana ve VBO
+
+		cout << "     welded vertices: " << weldedCount << " (" << scene.getPatchesCount() * 4 << " unwelded)" << endl;
 	}
 
 
@@ -151,36 +170,8 @@ bool InitGLObjects() {
 		divided = to;
 	} while (divided < patchCount);
 
-	// inicializovat pole VAO
-	n_color_array_object = new GLuint[patchIntervals.size()];
-
 	cout << "     intervals: " << patchIntervals.size()<< endl;
 
-	// naplnime pole VAO s odpovidajicimi bindy VBO
-	for (unsigned int i = 0; i < patchIntervals.size(); i++) {
-
-		glGenVertexArrays(1, &n_color_array_object[i]);
-		glBindVertexArray(n_color_array_object[i]);
-		{		
-			// rekneme OpenGL odkud si ma brat data; kazdy vrchol ma 3 souradnice,		
-			glBindBuffer(GL_ARRAY_BUFFER, n_vertex_buffer_object);
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, p_OffsetInVBO(3 * 4 * patchIntervals[i].from * sizeof(float)));
-			
-			// rekneme OpenGL odkud si ma brat data pro 1. atribut shaderu; kazda barva ma 3 hodnoty,		
-			glBindBuffer(GL_ARRAY_BUFFER, n_id_color_buffer_object);
-			glEnableVertexAttribArray(1);
-			glVertexAttribPointer(1, 4, GL_UNSIGNED_INT_2_10_10_10_REV, false, 0, p_OffsetInVBO(0));
-
-			// rekneme OpenGL odkud bude brat indexy geometrie pro glDrawElements
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, n_index_buffer_object);		
-
-		} // tento blok se "zapamatuje" ve VAO	
-
-		// vratit VAO 0
-		glBindVertexArray(0);
-	}
-
 	
 	// geometrie a texurovani nahledoveho ctverce pro pohledy z patchu
 	// 3 souradnice vrcholu, 2 souradnice textury
@@ -279,29 +270,10 @@ bool InitGLObjects() {
 	
 
 
-	// vytvorit FBO pro kresleni pohledu z patchu do textury
-	fbo = new CGLFrameBufferObject(
-		Config::PATCHVIEW_TEX_W(), Config::PATCHVIEW_TEX_H() * Config::HEMICUBES_CNT(),
-		1, true,
-		0, 0,
-		true, false,
-		GL_DEPTH_COMPONENT24, 0,
-		false, false, 0, 0);
-
-	if (fbo->b_Status() == false) {
-		cerr << "Unable to create FBO" << endl;
-		return false;
-	}
-	
 
 	// predpocitat form factory
-	p_formfactors = precomputeHemicubeFormFactors();
+	hemicubeFormFactors.build(Config::HEMICUBE_W());
 	
-	// alokovat misto pro vystup formfactoru z kernelu
-	p_tmp_formfactors = new float[patchCount];
-	for (int i = 0; i < patchCount; i++)
-		p_tmp_formfactors[i] = 0;
-
 
 	unsigned int HEMICUBE_W = Config::HEMICUBE_W();
 	unsigned int HEMICUBE_H = Config::HEMICUBE_H();
@@ -309,6 +281,7 @@ bool InitGLObjects() {
 
 	// pripravit misto pro docasne hodnoty radiosit patchu ze kterych se prave strili (v pripade vice hemicubes)
 	p_tmp_radiosities = new Vector3f[HEMICUBES_CNT];
+	p_tmp_shots = new Vector3f[HEMICUBES_CNT];
 
 
 	// 'okna' do kterych se budou kreslit jednotlive pohledy; odpovida 'nakresu' v FormFactors.cpp
@@ -393,6 +366,11 @@ bool InitGLObjects() {
 	p_emitters = new Patch*[Config::HEMICUBES_CNT()];
 	p_emitters_ids = new unsigned int[Config::HEMICUBES_CNT()];
 
+	cachedRows.assign(Config::HEMICUBES_CNT(), NULL);
+	renderedRows.resize(Config::HEMICUBES_CNT());
+	groupMembers.resize(Config::HEMICUBES_CNT());
+	groupRadiosities.resize(Config::HEMICUBES_CNT());
+
 	return true;
 }
 
@@ -451,7 +429,7 @@ bool InitCLObjects() {
 	ocl_arg_patchview = clCreateFromGLTexture2D(ocl_context, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, n_patchlook_texture, &error);
 
 	// data 'textury' form factoru
-	ocl_arg_ffactors = clCreateBuffer(ocl_context, CL_MEM_READ_ONLY, PATCHVIEW_TEX_RES * HEMICUBES_CNT * sizeof(float), NULL, &error);
+	ocl_arg_ffactors = clCreateBuffer(ocl_context, CL_MEM_READ_ONLY, hemicubeFormFactors.getSize() * sizeof(float), NULL, &error);
 
 	_ASSERT(error == CL_SUCCESS);
 	
@@ -573,7 +551,7 @@ bool InitCLObjects() {
 	}
 
 	// naplnit buffer argumentu - pole s formfactory - konstantni po celou dobu
-	error = clEnqueueWriteBuffer(ocl_queue, ocl_arg_ffactors, CL_TRUE, 0, PATCHVIEW_TEX_RES * HEMICUBES_CNT * sizeof(float), p_formfactors,
+	error = clEnqueueWriteBuffer(ocl_queue, ocl_arg_ffactors, CL_TRUE, 0, hemicubeFormFactors.getSize() * sizeof(float), hemicubeFormFactors.getData(),
  					0, NULL, NULL);
 	if (error != CL_SUCCESS) {
 		cerr << "error: can't write to ocl_arg_ffactors buffer" << endl;
@@ -616,10 +594,9 @@ bool InitCLObjects() {
 void CleanupGLObjects()
 {
 	// smaze dynamicky alokovane objekty
-	delete[] n_color_array_object;
-	delete[] p_tmp_formfactors;
-	delete[] p_formfactors;
+	hemicubeFormFactors.clear();
 	delete[] p_tmp_radiosities;
+	delete[] p_tmp_shots;
 
 	for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
 		for (unsigned int i = 0; i < 5; i++) {
@@ -637,15 +614,88 @@ void CleanupGLObjects()
 	// smaze vertex buffer objekty
 	glDeleteBuffers(1, &n_vertex_buffer_object);
 	glDeleteBuffers(1, &n_index_buffer_object);
+	glDeleteBuffers(1, &n_welded_vertex_buffer_object);
+	glDeleteBuffers(1, &n_welded_index_buffer_object);
+	glDeleteBuffers(1, &n_id_color_buffer_object);
 
 	// smaze shadery
 	Shaders::cleanup();
 
 	// smaze textury
 	glDeleteTextures(1, &n_patchlook_texture);
+}
+
+
+/**
+ *	@brief vytvori OpenGL objekty vlakna vypoctu - VAO a FBO se mezi kontexty nesdileji, vlakno si je vytvari
+ *		ve svem kontextu nad sdilenymi buffery a texturou
+ *	@return vraci true pri uspechu, false pri neuspechu
+ */
+bool InitSolverGLObjects() {
+	// stav je v kazdem kontextu vlastni
+	glEnable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+
+	// VAO pro kresleni pohledu z patche - svarene vrcholy s barvami podle ID; interval se vybira offsetem v indexech
+	glGenVertexArrays(1, &n_welded_array_object);
+	glBindVertexArray(n_welded_array_object);
+	{
+		// rekneme OpenGL odkud si ma brat data; kazdy vrchol ma 3 souradnice,		
+		glBindBuffer(GL_ARRAY_BUFFER, n_welded_vertex_buffer_object);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, p_OffsetInVBO(0));
+
+		// rekneme OpenGL odkud si ma brat data pro 1. atribut shaderu; barva je zabalena v jednom intu
+		glBindBuffer(GL_ARRAY_BUFFER, n_id_color_buffer_object);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_INT_2_10_10_10_REV, false, 0, p_OffsetInVBO(0));
+
+		// rekneme OpenGL odkud bude brat indexy geometrie pro glDrawElements
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, n_welded_index_buffer_object);
+
+	} // tento blok se "zapamatuje" ve VAO	
+	glBindVertexArray(0);
+
+	// VAO pro kresleni patchu mimo aktivni interval - pouze pozice, barva se nastavi konstantne pres glVertexAttrib
+	glGenVertexArrays(1, &n_welded_black_array_object);
+	glBindVertexArray(n_welded_black_array_object);
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, n_welded_vertex_buffer_object);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, p_OffsetInVBO(0));
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, n_welded_index_buffer_object);
+	}
+	glBindVertexArray(0);
+
+	// vytvorit FBO pro kresleni pohledu z patchu do textury
+	fbo = new CGLFrameBufferObject(
+		Config::PATCHVIEW_TEX_W(), Config::PATCHVIEW_TEX_H() * Config::HEMICUBES_CNT(),
+		1, true,
+		0, 0,
+		true, false,
+		GL_DEPTH_COMPONENT24, 0,
+		false, false, 0, 0);
+
+	if (fbo->b_Status() == false) {
+		cerr << "Unable to create FBO" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ *	@brief uvolni OpenGL objekty vlakna vypoctu; vola se ve vlakne vypoctu
+ */
+void CleanupSolverGLObjects() {
+	glDeleteVertexArrays(1, &n_welded_array_object);
+	glDeleteVertexArrays(1, &n_welded_black_array_object);
 
 	// smaze render buffer
-	delete fbo;	
+	delete fbo;
+	fbo = NULL;
 }
 
 /**
@@ -683,41 +733,102 @@ void DrawScene() {
 }
 
 /**
- *	@brief vykresli pohled do sceny z patche lookFromPatch s barvami odpovidajicimi ID patchu
+ * Prida rozsah patchu <from, to) do seznamu kreslenych rozsahu; navazujici rozsahy spoji
+ */
+static void AppendDrawRange(vector<interval>& ranges, unsigned int from, unsigned int to) {
+	if (from >= to)
+		return;
+
+	if (!ranges.empty() && ranges.back().to == int(from)) {
+		ranges.back().to = to;
+	} else {
+		interval r = { int(from), int(to) };
+		ranges.push_back(r);
+	}
+}
+
+
+/**
+ * Vykresli rozsahy patchu jednim volanim - 6 indexu na patch
+ */
+static void DrawRanges(const vector<interval>& ranges) {
+	if (ranges.empty())
+		return;
+
+	static vector<GLsizei> counts;
+	static vector<const GLvoid*> offsets;
+	counts.resize(ranges.size());
+	offsets.resize(ranges.size());
+
+	for (unsigned int i = 0; i < ranges.size(); i++) {
+		counts[i] = 6 * (ranges[i].to - ranges[i].from);
+		offsets[i] = p_OffsetInVBO( 6 * ranges[i].from * sizeof(int) );
+	}
+
+	glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT, &offsets[0], ranges.size());
+}
+
+
+/**
+ * Prijemce prenosu davky zdroju - odrazenou cast energie pricte k radiosite patche
+ */
+struct ReceiveEnergy {
+	Patch** patches;
+
+	void operator()(unsigned int id, const Vector3f& energy) {
+		Patch* p = patches[id];
+		p->radiosity += energy * p->getReflectivity();
+	}
+};
+
+
+// kreslene rozsahy patchu v pohledu z patche - barevne (aktivni interval) a cerne
+static vector<interval> colorRanges, blackRanges;
+
+/**
+ *	@brief vykresli pohled do sceny z patche lookFromPatch s barvami odpovidajicimi ID patchu; kresli jen shluky patchu, ktere nejsou cele mimo orezove teleso
  *  @param[in] interval interval ktery se bude kreslit
+ *  @param[in] frustum orezove teleso pohledu vcetne poloprostoru pred vyzarujicim patchem
  */
-void DrawPatchLook(unsigned int interval) {	
+void DrawPatchLook(unsigned int interval, const Frustum& frustum) {	
 
-	int* indices = scene.getIndices();
-	float* vertices = scene.getVertices();
+	// shluky, ktere mohou byt v pohledu videt
+	static vector<unsigned int> visible;
+	scene.cullClusters(frustum, visible);
 
-	// kreslit cernou barvu mimo aktivni interval ve dvou krocich
-	if (patchIntervals.size() > 1) {
-		glBindVertexArray(n_vertex_array_object);
-		glVertexAttrib3f(1, 0.0f, 0.0f, 0.0f); // vse cerne
+	// rozdelit viditelne shluky na cast v aktivnim intervalu a mimo nej
+	colorRanges.clear();
+	blackRanges.clear();
+
+	const vector<ModelContainer::PatchCluster>& clusters = scene.getClusters();
+	unsigned int from = patchIntervals[interval].from;
+	unsigned int to = patchIntervals[interval].to;
+
+	for (unsigned int i = 0; i < visible.size(); i++) {
+		const ModelContainer::PatchCluster& c = clusters[visible[i]];
 
-		// vykreslit cerne vse pred aktivnim intervalem
-		if (interval > 0) {
-			int fromIndex = 0;
-			int count = 6 * patchIntervals[interval - 1].to; // kreslit indexy od 0 az po posledni pred aktivnim intervalem
-			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, p_OffsetInVBO( fromIndex * sizeof(int) ));
+		unsigned int colorFrom = max(c.from, from);
+		unsigned int colorTo = min(c.to, to);
+
+		if (colorFrom < colorTo) {
+			AppendDrawRange(blackRanges, c.from, colorFrom);
+			AppendDrawRange(colorRanges, colorFrom, colorTo);
+			AppendDrawRange(blackRanges, colorTo, c.to);
+		} else {
+			AppendDrawRange(blackRanges, c.from, c.to);
 		}
-			
-		// vykresli cerne vse za aktivnim intervalem
-		if (interval < patchIntervals.size()-1) {
-			int fromIndex = 6 * patchIntervals[interval + 1].from;
-			int count = 6 * (patchIntervals.back().to - patchIntervals[interval + 1].from);
-			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, p_OffsetInVBO( fromIndex * sizeof(int) ));
-		}						
 	}
-		
-	// vykresli jeden interval s barevnymi patchi
-	glBindVertexArray(n_color_array_object[interval]);	
-				
-	// spocitat pocet - vzdy 6 indexu; offset neni treba udavat, VAO uz obsahuje VBO na spravnem offsetu
-	int count = 6 * (patchIntervals[interval].to - patchIntervals[interval].from);
 
-	glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, p_OffsetInVBO(0));	
+	// kreslit cernou barvu mimo aktivni interval
+	if (!blackRanges.empty()) {
+		glBindVertexArray(n_welded_black_array_object);
+		glVertexAttrib3f(1, 0.0f, 0.0f, 0.0f); // vse cerne
+		DrawRanges(blackRanges);
+	}
+		
+	// vykresli jeden interval s barevnymi patchi; barvy ve VBO uz odpovidaji poradi patchu v intervalu
+	glBindVertexArray(n_welded_array_object);	
+	DrawRanges(colorRanges);
 
 	// vratime VAO 0, abychom si nahodne VAO nezmenili (pripadne osetreni 
 	//proti chybe v ovladacich nvidia kde se VAO poskodi pri volani nekterych wgl funkci)		
@@ -765,6 +876,13 @@ int main(int n_arg_num, const char **p_arg_list)
 		return -1;
 	}
 
+	const char* resumeFile = NULL; // checkpoint, ze ktereho se ma pokracovat ve vypoctu
+	const char* workerAddress = NULL; // adresa koordinatora, pokud program bezi jako pracovni proces
+	const char* workerScene = NULL; // soubor sceny pracovniho procesu
+	const char* sceneFile = NULL; // seznam modelu a instanci sceny; jinak vychozi scena
+	const char* outOfCoreScene = NULL; // soubor sceny pro vypocet mimo pamet (bez okna)
+	const char* outOfCoreResult = NULL; // soubor sceny s vysledky vypoctu mimo pamet
+
 	// parsovani parametru
 	for (int i = 1; i < n_arg_num; i += 2) {
 		if (strcmp(p_arg_list[i], "area") == 0) {
@@ -776,13 +894,103 @@ int main(int n_arg_num, const char **p_arg_list)
 		if (strcmp(p_arg_list[i], "shoots") == 0) {
 			Config::setShootsPerCycle( atoi(p_arg_list[i+1]) );
 		}
+		if (strcmp(p_arg_list[i], "budget") == 0) {
+			Config::setFrameBudget( atof(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "throughput") == 0) {
+			Config::setMaxThroughput( atoi(p_arg_list[i+1]) != 0 );
+		}
 		if (strcmp(p_arg_list[i], "hemicubes") == 0) {
 			Config::setHemicubesCount( atoi(p_arg_list[i+1]) );
 		}
+		if (strcmp(p_arg_list[i], "checkpoint") == 0) {
+			Config::setCheckpointInterval( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "resume") == 0) {
+			resumeFile = p_arg_list[i+1];
+		}
+		if (strcmp(p_arg_list[i], "scene") == 0) {
+			sceneFile = p_arg_list[i+1];
+		}
+		if (strcmp(p_arg_list[i], "stochastic") == 0) {
+			Config::setStochastic( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "multigrid") == 0) {
+			Config::setMultigrid( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "ffcache") == 0) {
+			Config::setFormFactorCache( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "importance") == 0) {
+			Config::setImportance( atoi(p_arg_list[i+1]) != 0 );
+		}
+		if (strcmp(p_arg_list[i], "directlight") == 0) {
+			Config::setDirectLighting( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "workers") == 0) {
+			Config::setWorkers( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "worker") == 0) {
+			workerAddress = p_arg_list[i+1];
+		}
+		if (strcmp(p_arg_list[i], "workerscene") == 0) {
+			workerScene = p_arg_list[i+1];
+		}
+		if (strcmp(p_arg_list[i], "finalgather") == 0) {
+			Config::setFinalGather( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "emittergroups") == 0) {
+			Config::setEmitterGroups( atof(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "spatialorder") == 0) {
+			Config::setSpatialOrder( atoi(p_arg_list[i+1]) != 0 );
+		}
+		if (strcmp(p_arg_list[i], "clustering") == 0) {
+			Config::setClustering( atof(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "outofcore") == 0) {
+			outOfCoreScene = p_arg_list[i+1];
+		}
+		if (strcmp(p_arg_list[i], "outofcoreresult") == 0) {
+			outOfCoreResult = p_arg_list[i+1];
+		}
+		if (strcmp(p_arg_list[i], "outofcorememory") == 0) {
+			Config::setOutOfCoreMemory( atoi(p_arg_list[i+1]) );
+		}
+		if (strcmp(p_arg_list[i], "accumulation") == 0) {
+			int strategy = EnergyAccumulator::parseStrategy(p_arg_list[i+1]);
+			if (strategy < 0)
+				cerr << "Unknown accumulation strategy " << p_arg_list[i+1] << " (atomic, sparse, sharded)" << endl;
+			else
+				Config::setAccumulation(strategy);
+		}
+		if (strcmp(p_arg_list[i], "benchmark") == 0) {
+			if (strcmp(p_arg_list[i+1], "accumulation") == 0) {
+				EnergyAccumulator::benchmark();
+				return 0;
+			}
+			cerr << "Unknown benchmark " << p_arg_list[i+1] << endl;
+			return -1;
+		}
+	}
+
+	// pracovni proces nema okno - jen pocita radky form factoru pro koordinatora
+	if (workerAddress != NULL)
+		return WorkerPool::runWorker(workerAddress, workerScene);
+
+	// vypocet mimo pamet nad souborem sceny - bez okna, vysledky se ulozi do noveho souboru sceny
+	if (outOfCoreScene != NULL) {
+		Config::freeze();
+		return OutOfCoreSolver::run(outOfCoreScene, outOfCoreResult);
 	}
 
 	// parametry zname, muzeme zmrazit config a nechat jej dopocitat ostatni hodnoty
 	Config::freeze();
+	accumulator.setStrategy(Config::ACCUMULATION());
+	formFactorCache.setLimit(size_t(Config::FORM_FACTOR_CACHE()) << 20);
+	scheduler.setBudget(Config::FRAME_BUDGET() / 1000);
+	scheduler.setFixedShots(Config::SHOOTS_PER_CYCLE());
+	scheduler.setMaxThroughput(Config::MAX_THROUGHPUT());
 
 	// registruje tridu okna
 	WNDCLASSEX t_wnd_class;
@@ -838,9 +1046,15 @@ int main(int n_arg_num, const char **p_arg_list)
 	}
 	// zkontroluje zda jsou podporovane pozadovane rozsireni
 
-	// nacteme globalni objekt sceny a nastavime limit velikosti patchu
-	scene.load();	
-	scene.maxPatchArea = Config::MAX_PATCH_AREA();
+	// nacteme globalni objekt sceny a nastavime limit velikosti patchu (pri vicerovnovem vypoctu nejhrubsi uroven)
+	if (sceneFile == NULL)
+		scene.load();	
+	else if (!scene.load(sceneFile)) {
+		cerr << "error: failed to load scene " << sceneFile << endl;
+		return -1;
+	}
+	scene.setMaxPatchArea(LevelPatchArea(0));
+	scene.spatialOrder = Config::SPATIAL_ORDER();
 	
 	// vyrobime objekty OpenGL, nutne ke kresleni
 	if(!InitGLObjects()) {
@@ -854,6 +1068,37 @@ int main(int n_arg_num, const char **p_arg_list)
 		return -1;
 	}	
 
+	// zapis checkpointu bezi ve vlastnim vlakne
+	if (Config::CHECKPOINT_INTERVAL() > 0)
+		checkpoint.start(checkpointFile);
+	lastCheckpointTime = timer.f_Time();
+
+	// GL kontext pro vlakno vypoctu, sdili objekty s hlavnim
+	solverContext = driver.CreateSharedContext();
+	if (solverContext == NULL) {
+		cerr << "error: failed to create the solver GL context" << endl;
+		return -1;
+	}
+
+	// dulezitost z uvodniho pohledu kamery
+	if (Config::IMPORTANCE())
+		importance.addView(cam.GetMatrix(), 90, float(n_width) / n_height);
+
+	// pokracovat ve vypoctu z ulozeneho stavu
+	if (resumeFile != NULL && !ResumeFromCheckpoint(resumeFile)) {
+		cerr << "error: failed to resume from " << resumeFile << endl;
+		return -1;
+	}
+
+	// pracovni procesy a vypocet radiosity ve vlastnim vlakne (pri obnoveni checkpointu uz bezi nad nactenou scenou)
+	if (!solver.isRunning()) {
+		StartWorkers();
+		if (!StartSolver()) {
+			cerr << "error: failed to start the solver thread" << endl;
+			return -1;
+		}
+	}
+
 	// skryt kurzor mysi
 	ShowCursor(false);
 	
@@ -898,6 +1143,12 @@ int main(int n_arg_num, const char **p_arg_list)
 	}
 	
 	
+	// dokoncit rozpracovany krok vypoctu a checkpoint - ctou patche sceny
+	solver.stop();
+	checkpoint.stop();
+	workerPool.stop();
+	wglDeleteContext(solverContext);
+
 	// uvolnime OpenGL objekty
 	CleanupGLObjects();	
 
@@ -991,12 +1242,32 @@ LRESULT CALLBACK WndProc(HWND h_wnd, UINT n_msg, WPARAM n_w_param, LPARAM n_l_pa
 				if (n_w_param == KEY_P) 
 					showPatchLook = !showPatchLook;
 
+				// M - prepnout rezim maximalni propustnosti (vypocet bez obsluhy)
+				if (n_w_param == KEY_M) {
+					scheduler.setMaxThroughput(!scheduler.isMaxThroughput());
+					cout << (scheduler.isMaxThroughput() ? "Max throughput mode" : "Interactive mode") << endl;
+				}
+
+				// I - pridat aktualni pohled mezi pohledy dulezitosti, U - pohledy zrusit; vypocet se spusti znovu s novou dulezitosti
+				if (n_w_param == KEY_I || n_w_param == KEY_U) {
+					solver.stop();
+					if (n_w_param == KEY_I)
+						importance.addView(cam.GetMatrix(), 90, float(n_width) / n_height);
+					else
+						importance.clearViews();
+					cout << "Importance views: " << importance.getViewsCount() << endl;
+
+					if (!StartSolver())
+						cerr << "Unable to restart the solver thread!" << endl;
+				}
+
 				// L - spustit/pozastavit sireni energie
 				if (n_w_param == KEY_L) {
 					computeRadiosity = !computeRadiosity;
 					if (computeRadiosity) {
 						cout << "Light emitting continues" << endl;
 						totalTimer.ResetTimer(); // spustit stopky celkove doby vypoctu
+						solver.wake();
 					} else {
 						cout << "Light emitting paused" << endl;
 					}
@@ -1084,297 +1355,597 @@ void handleActiveKeys() {
 #define MARK(n) do { if(n_marker_used < MAX_MARKS) { p_marker_name_list[n_marker_used] = n; p_marker[n_marker_used] = timer.f_Time(); ++ n_marker_used; } } while(false)
 
 /**
- *	@brief tato funkce se vola ve smycce pokazde kdyz nejsou zadne nove zpravy; lze vyuzit ke kresleni animace
- *	@param[in] driver je reference na OpenGL driver
+ *	@brief krok vypoctu ve vlakne vypoctu - vystreli energii z nejnabitejsich patchu (pocet vystrelu voli scheduler
+ *		podle cilove doby kroku) a preda vysledne energie k zobrazeni
+ *	@return vraci false, pokud neni co pocitat (vypocet je pozastaveny, dokonceny nebo neni nactena scena)
  */
-void OnIdle(CGL30Driver &driver)
+bool SolverStep()
 {
-	// spustit stopky fps
+	// spustit stopky kroku
 	double t_start = timer.f_Time();
 
 	size_t n_marker_used = 0;
 	const char *p_marker_name_list[MAX_MARKS] = {0};
 	double p_marker[MAX_MARKS] = {0};
 
-	if(computeRadiosity)
-		MARK("reference");
-
-	// vycistime framebuffer
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
-	
-	// cas pro animaci
-	float f_time = clock() / 1000.0f;
-		
-	// spustit vsechny akce spojene se stiskem klaves
-	// napriklad posun kamery
-	handleActiveKeys();
-	
-	Matrix4f t_mvp;
-
 	Patch** scenePatches = scene.getPatches();
 	unsigned int scenePatchesCount = scene.getPatchesCount();
 
-	// ***********************************************************************************
-	// Vykreslit do FBO pohled z patche
-	// ***********************************************************************************
-
 	// v pripade, ze scena neni nactena, nesnazit se renderovat do textury
 	// ani pocitat radiozitu
-	if (computeRadiosity && scenePatchesCount > 0) {
+	if (!computeRadiosity || scenePatchesCount == 0)
+		return false;
 
-		MARK("starting up");
+	// se shluky se misto vystrelu z hemicube vymeni energie po vazbach mezi shluky
+	if (Config::CLUSTERING() > 0)
+		return ClusterSolverStep();
 
-		// pouzije shader pro pohled z patche a bude kreslit do framebuffer objectu
-		glUseProgram(n_patch_program_object);
-		fbo->Bind();
-		fbo->Bind_ColorTexture2D(0, GL_TEXTURE_2D, n_patchlook_texture);
-		glViewport(0, 0, fbo->n_Width(), fbo->n_Height());
-		glFinish(); // remove me		
+	// stochasticka iterace strili nahodne paprsky ze vsech patchu najednou
+	if (Config::STOCHASTIC() > 0)
+		return StochasticSolverStep();
 
-		MARK("FBO bound");
+	MARK("reference");
 
-		for (unsigned int shoot = 0; shoot < Config::SHOOTS_PER_CYCLE() && computeRadiosity; shoot++) { 
+	Matrix4f t_mvp;
 
-			// najit patche s nejvetsi energii
-			scene.getHighestRadiosityPatchesId(Config::HEMICUBES_CNT(), p_emitters, p_emitters_ids);
+	MARK("starting up");
 
-			MARK("getHighestRadiosityPatchesId");
+	// pouzije shader pro pohled z patche a bude kreslit do framebuffer objectu
+	glUseProgram(n_patch_program_object);
+	fbo->Bind();
+	fbo->Bind_ColorTexture2D(0, GL_TEXTURE_2D, n_patchlook_texture);
+	glViewport(0, 0, fbo->n_Width(), fbo->n_Height());
+	glFinish(); // remove me		
 
-			// pro kazdy interval patchu ve scene
-			for (unsigned int interval = 0; interval < patchIntervals.size(); interval++) {
-				
-				// vycistit fbo
-				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 			
-				glEnable(GL_SCISSOR_TEST);
-				glFinish(); // remove me
+	MARK("FBO bound");
 
-				MARK("glClear");
+	// pocet vystrelu podle zmerene ceny vystrelu a cilove doby kroku
+	unsigned int shots = scheduler.nextShots();
+	unsigned int shotsDone = 0;
+	double deadline = scheduler.getDeadline();
+	double shotsStart = timer.f_Time();
 
-				// pro kazdou hemicube
-				for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
-					// pokud uz neni patch s energii, preskocit - vykresli se cerno
-					if (p_emitters[hi] == NULL)
-						continue;
+	for (unsigned int shoot = 0; shoot < shots && computeRadiosity; shoot++) { 
 
-					// poznacit si puvodni hodnotu radiosity, ta se po uplnem vyzareni patche odecte
-					p_tmp_radiosities[hi] = p_emitters[hi]->radiosity;
+		// najit patche s nejvetsi energii
+		scene.getHighestRadiosityPatchesId(Config::HEMICUBES_CNT(), p_emitters, p_emitters_ids);
 
-					// celkem 5 pohledu
-					for(int i=0; i < 5; i++) {
-				
-						Camera::PatchLook dir = p_patchlook_perm[i];
+		MARK("getHighestRadiosityPatchesId");
 
-						// spocitame modelview - projection matici, kterou potrebujeme k transformaci vrcholu		
-						{
-							// matice perspektivni projekce
-							Matrix4f t_projection;
-							CGLTransform::Perspective(t_projection, 90, 1.0f, 0.01f, 1000);		 // ratio 1.0!
-		
-							// modelview
-							Matrix4f t_modelview;
-							t_modelview.Identity();				
+		// slabe zdroje strileji i za podobne natocene patche sve skupiny
+		bool grouping = Config::EMITTER_GROUPS() > 0 && emitterGroups.isBuilt(scenePatchesCount);
+		if (grouping)
+			emitterGroups.beginBatch();
 
-							// vynasobit pohledem kamery patche
-							patchCam.lookFromPatch(p_emitters[hi], dir);
-							t_modelview *= patchCam.GetMatrix();
+		// zdroje, jejichz radek form factoru je v cache, se nekresli
+		bool render = false;
+		for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
+			cachedRows[hi] = NULL;
+			groupMembers[hi].clear();
+			if (p_emitters[hi] == NULL)
+				continue;
 
-							// matice pohledu kamery
-							t_mvp = t_projection * t_modelview;
-						}
+			// zdroj uz vystrelil ve skupine drivejsiho zdroje davky
+			if (grouping && emitterGroups.isTaken(p_emitters_ids[hi])) {
+				p_emitters[hi] = NULL;
+				continue;
+			}
 
-						// nahrajeme matici do OpenGL jako parametr shaderu
-						glUniformMatrix4fv(n_patchprogram_mvp_matrix_uniform, 1, GL_FALSE, &t_mvp[0][0]);		
+			// poznacit si puvodni hodnotu radiosity, ta se po uplnem vyzareni patche odecte
+			p_tmp_radiosities[hi] = p_emitters[hi]->radiosity;
 
-						// nastavit parametry viewportu a oblast, do ktere je povoleno kreslit
-						glScissor(p_scissors_list[hi][i][0], p_scissors_list[hi][i][1], p_scissors_list[hi][i][2], p_scissors_list[hi][i][3]);
-						glViewport(p_viewport_list[hi][i][0], p_viewport_list[hi][i][1], p_viewport_list[hi][i][2], p_viewport_list[hi][i][3]);
-		
-						// vykreslit do textury (pres FBO)
-						DrawPatchLook(interval);
+			// energie vystrelena z hemicube (pred vynasobenim formfactorem)
+			p_tmp_shots[hi] = p_tmp_radiosities[hi] * p_emitters[hi]->getColor();
 
-					} // pro kazdy pohled
+			// energie ostatnich clenu skupiny se prenese podle form factoru zdroje
+			if (grouping) {
+				emitterGroups.gather(p_emitters_ids[hi], scenePatches, float(Config::EMITTER_GROUPS()), groupMembers[hi]);
+				groupRadiosities[hi].resize(groupMembers[hi].size());
+				for (unsigned int m = 1; m < groupMembers[hi].size(); m++) {
+					Patch* p = scenePatches[groupMembers[hi][m]];
+					groupRadiosities[hi][m] = p->radiosity;
+					p_tmp_shots[hi] += p->radiosity * p->getColor();
+				}
+			}
 
-				} // pro kazdou hemicube
+			cachedRows[hi] = formFactorCache.find(p_emitters_ids[hi]);
+			if (cachedRows[hi] == NULL)
+				render = true;
+		}
 
-				glDisable(GL_SCISSOR_TEST);
+		// radky nekreslenych zdroju spocitaji pracovni procesy; pri chybe spojeni se kresli zde
+		if (render && workerPool.isRunning()) {
+			workerPool.begin();
+			for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
+				if (p_emitters[hi] != NULL && cachedRows[hi] == NULL)
+					workerPool.add(p_emitters_ids[hi], renderedRows[hi]);
+			}
+			render = !workerPool.execute();
 
-				glFinish(); // remove me
-				MARK("hemicubes finished");
-					
-				//FBO2BMP();
-				
-				// priznak chyby pri praci s OCL
-				cl_int error = 0;			
+			MARK("worker rows");
+		}
 
-				// ziskat pristup k OGL texture s pohledem z patche		
-				//glFinish(); // nutne pro sync
-				error |= clEnqueueAcquireGLObjects(ocl_queue, 1, &ocl_arg_patchview, 0, NULL, NULL);
-				
-				clFinish(ocl_queue); // remove me
-				MARK("clEnqueueAcquireGLObjects");
+		// pro kazdy interval patchu ve scene
+		for (unsigned int interval = 0; render && interval < patchIntervals.size(); interval++) {
+			
+			// vycistit fbo
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 			
+			glEnable(GL_SCISSOR_TEST);
+			glFinish(); // remove me
 
-				// vynulovat index na ktery se zapisuje - nutne v kazde iteraci!
-				{
-					unsigned int writeindex = 0;
-					error |= clEnqueueWriteBuffer(ocl_queue, ocl_arg_writeindex, CL_FALSE, 0, sizeof(unsigned int), &writeindex,	0, NULL, NULL);
-				}
-				_ASSERT(error == CL_SUCCESS);
+			MARK("glClear");
 
-				// spustit program!
-				error = clEnqueueNDRangeKernel(ocl_queue, ocl_kernel, 2, NULL, ocl_global_work_size, ocl_local_work_size, 0, NULL, NULL);
-				_ASSERT(error == CL_SUCCESS);
+			// pro kazdou hemicube
+			for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
+				// pokud uz neni patch s energii nebo se vystreli z cache, preskocit - vykresli se cerno
+				if (p_emitters[hi] == NULL || cachedRows[hi] != NULL)
+					continue;
 
-				clFinish(ocl_queue); // remove me
-				MARK("clEnqueueNDRangeKernel");
+				// celkem 5 pohledu
+				for(int i=0; i < 5; i++) {
+			
+					Camera::PatchLook dir = p_patchlook_perm[i];
 
-				// zjistit kolik polygonu*instanci se ulozilo (pocet je vzdy ruzny v zavislosti na pohledu a rozlozeni work-items)
-				unsigned int n_last_index = 0;
-				error = clEnqueueReadBuffer (ocl_queue, ocl_arg_writeindex, CL_TRUE, 0, sizeof(unsigned int), &n_last_index, 0, NULL, NULL);
-				_ASSERT(error == CL_SUCCESS);
+					// spocitame modelview - projection matici, kterou potrebujeme k transformaci vrcholu		
+					{
+						// matice perspektivni projekce
+						Matrix4f t_projection;
+						CGLTransform::Perspective(t_projection, 90, 1.0f, 0.01f, 1000);		 // ratio 1.0!
+	
+						// modelview
+						Matrix4f t_modelview;
+						t_modelview.Identity();				
 
-				// precist data
-				error  = clEnqueueReadBuffer (ocl_queue, ocl_arg_hemicubes, CL_TRUE, 0, n_last_index*sizeof(uint32_t), p_ocl_hemicubes, 0, NULL, NULL);
-				error  = clEnqueueReadBuffer (ocl_queue, ocl_arg_ids, CL_TRUE, 0, n_last_index*sizeof(uint32_t), p_ocl_pids, 0, NULL, NULL);
-				error |= clEnqueueReadBuffer (ocl_queue, ocl_arg_energies, CL_TRUE, 0, n_last_index*sizeof(float), p_ocl_energies, 0, NULL, NULL);		
-				_ASSERT(error == CL_SUCCESS);
-				
-				MARK("data readback");
+						// vynasobit pohledem kamery patche
+						patchCam.lookFromPatch(p_emitters[hi], dir);
+						t_modelview *= patchCam.GetMatrix();
 
-				// uvolnit OGL objekty z drzeni OCL
-				//clFinish(ocl_queue); // nutne pro sync
-				error |= clEnqueueReleaseGLObjects(ocl_queue, 1, &ocl_arg_patchview, 0, NULL, NULL);
-				_ASSERT(error == CL_SUCCESS);				
+						// matice pohledu kamery
+						t_mvp = t_projection * t_modelview;
+					}
 
-				MARK("clEnqueueReleaseGLObjects");
-				
-				for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
-					// jenom pokud se skutecne z patche koukalo
-					if (p_emitters[hi] == NULL)
-						continue;
+					// nahrajeme matici do OpenGL jako parametr shaderu
+					glUniformMatrix4fv(n_patchprogram_mvp_matrix_uniform, 1, GL_FALSE, &t_mvp[0][0]);		
 
-					// secist formfactory do p_tmp_formfactors
-					for (unsigned int i = 0; i < n_last_index; i++) {			
+					// orezove teleso pohledu; za rovinou vyzarujiciho patche neni nic videt
+					Frustum frustum;
+					frustum.setMatrix(t_mvp);
+					frustum.addHalfSpace(p_emitters[hi]->getCenter(), p_emitters[hi]->getNormal());
 
-						if (p_ocl_pids[i] >= scenePatchesCount) {
-							cerr << "Uknown patch id: " << p_ocl_pids[i] << "! Is there a problem with video card?" << endl;
-							continue;
-						}
+					// nastavit parametry viewportu a oblast, do ktere je povoleno kreslit
+					glScissor(p_scissors_list[hi][i][0], p_scissors_list[hi][i][1], p_scissors_list[hi][i][2], p_scissors_list[hi][i][3]);
+					glViewport(p_viewport_list[hi][i][0], p_viewport_list[hi][i][1], p_viewport_list[hi][i][2], p_viewport_list[hi][i][3]);
+	
+					// vykreslit do textury (pres FBO)
+					DrawPatchLook(interval, frustum);
 
-						if (p_ocl_hemicubes[i] != hi)
-							continue;
+				} // pro kazdy pohled
 
-						// jeste nesirit, nejdriv jen sesbirat
-						p_tmp_formfactors[p_ocl_pids[i]] += p_ocl_energies[i];
-					}					
+			} // pro kazdou hemicube
 
-					// prenest energie
-					for (unsigned int i = 0; i < scenePatchesCount; i++) {
-						Patch* p = scenePatches[i];
-						p->radiosity += p_tmp_radiosities[hi] * p_tmp_formfactors[i] * p->getReflectivity() * p_emitters[hi]->getColor();
-					}
-				
-					// vyprazdnit pole pro dalsi pruchod
-					fill_n(p_tmp_formfactors, scenePatchesCount, (float)0);
-				}
+			glDisable(GL_SCISSOR_TEST);
 
-				MARK("energies update");
+			glFinish(); // remove me
+			MARK("hemicubes finished");
 				
-			} // for each interval
+			//FBO2BMP();
+			
+			// priznak chyby pri praci s OCL
+			cl_int error = 0;			
 
+			// ziskat pristup k OGL texture s pohledem z patche		
+			//glFinish(); // nutne pro sync
+			error |= clEnqueueAcquireGLObjects(ocl_queue, 1, &ocl_arg_patchview, 0, NULL, NULL);
+			
+			clFinish(ocl_queue); // remove me
+			MARK("clEnqueueAcquireGLObjects");
 
-			// zdroje se vyzarily
-			Vector3f lastEnergy; // posledni vyzarena energie
-			for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
-				if (p_emitters[hi] == NULL)
+			// vynulovat index na ktery se zapisuje - nutne v kazde iteraci!
+			{
+				unsigned int writeindex = 0;
+				error |= clEnqueueWriteBuffer(ocl_queue, ocl_arg_writeindex, CL_FALSE, 0, sizeof(unsigned int), &writeindex,	0, NULL, NULL);
+			}
+			_ASSERT(error == CL_SUCCESS);
+
+			// spustit program!
+			error = clEnqueueNDRangeKernel(ocl_queue, ocl_kernel, 2, NULL, ocl_global_work_size, ocl_local_work_size, 0, NULL, NULL);
+			_ASSERT(error == CL_SUCCESS);
+
+			clFinish(ocl_queue); // remove me
+			MARK("clEnqueueNDRangeKernel");
+
+			// zjistit kolik polygonu*instanci se ulozilo (pocet je vzdy ruzny v zavislosti na pohledu a rozlozeni work-items)
+			unsigned int n_last_index = 0;
+			error = clEnqueueReadBuffer (ocl_queue, ocl_arg_writeindex, CL_TRUE, 0, sizeof(unsigned int), &n_last_index, 0, NULL, NULL);
+			_ASSERT(error == CL_SUCCESS);
+
+			// precist data
+			error  = clEnqueueReadBuffer (ocl_queue, ocl_arg_hemicubes, CL_TRUE, 0, n_last_index*sizeof(uint32_t), p_ocl_hemicubes, 0, NULL, NULL);
+			error  = clEnqueueReadBuffer (ocl_queue, ocl_arg_ids, CL_TRUE, 0, n_last_index*sizeof(uint32_t), p_ocl_pids, 0, NULL, NULL);
+			error |= clEnqueueReadBuffer (ocl_queue, ocl_arg_energies, CL_TRUE, 0, n_last_index*sizeof(float), p_ocl_energies, 0, NULL, NULL);		
+			_ASSERT(error == CL_SUCCESS);
+			
+			MARK("data readback");
+
+			// uvolnit OGL objekty z drzeni OCL
+			//clFinish(ocl_queue); // nutne pro sync
+			error |= clEnqueueReleaseGLObjects(ocl_queue, 1, &ocl_arg_patchview, 0, NULL, NULL);
+			_ASSERT(error == CL_SUCCESS);				
+
+			MARK("clEnqueueReleaseGLObjects");
+			
+			// zaznamy kernelu do radku form factoru kreslenych zdroju; prenese se az cela davka
+			int unknownIds = 0;
+			for (unsigned int i = 0; i < n_last_index; i++) {
+				uint32_t pid = p_ocl_pids[i];
+				uint32_t hi = p_ocl_hemicubes[i];
+
+				if (pid >= scenePatchesCount) {
+					unknownIds++;
+					continue;
+				}
+
+				// jenom pokud se skutecne z patche koukalo
+				if (hi >= Config::HEMICUBES_CNT() || p_emitters[hi] == NULL || cachedRows[hi] != NULL)
 					continue;
 
-				lastEnergy = p_emitters[hi]->radiosity;
-				p_emitters[hi]->illumination += p_tmp_radiosities[hi];
-				p_emitters[hi]->radiosity -= p_tmp_radiosities[hi];
+				FormFactorCache::Entry e = { pid, p_ocl_energies[i] };
+				renderedRows[hi].push_back(e);
 			}
 
-			// ukoncit, jakmile energie nejnabitejsiho patche ve scene klesne pod danou hranici
-			if (lastEnergy.f_Length() < 0.1) {
-				cout << "Done in " << (timer.f_Time() - t_start) << " seconds, " << (shoot * Config::HEMICUBES_CNT()) << " cycles" << endl;				
-				computeRadiosity = false; 
-			} else if (debugOutput) {
-				cout << "Pass " << passCounter << ", the emitter had " << setprecision(10) << lastEnergy.f_Length2() << " energy" << endl;
-			}	
+			if (unknownIds > 0)
+				cerr << unknownIds << " uknown patch ids! Is there a problem with video card?" << endl;
 
-			MARK("emitters update");
+			MARK("records collected");
+			
+		} // for each interval
 
-			passCounter++;			
+		// davka jako ridka matice - radky form factoru zdroju (nove nakreslene nebo z cache) krat energie zdroju
+		batch.begin(scenePatchesCount);
+		for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
+			if (p_emitters[hi] == NULL)
+				continue;
 
-		} // for 'shoot' times
+			if (cachedRows[hi] != NULL) {
+				batch.addRow(*cachedRows[hi], p_tmp_shots[hi]);
+			} else {
+				FormFactorCache::merge(renderedRows[hi]);
+				batch.addRow(renderedRows[hi], p_tmp_shots[hi]);
+			}
+		}
 
-		// uvolnit fbo
-		fbo->Bind_ColorTexture2D(0, GL_TEXTURE_2D, 0);
-		fbo->Release();
-		
-		glFinish(); // remove me
-		MARK("FBO release");
-				
-		// nabindovat buffer s barvami patchu a updatovat jej
-		{
-			glBindBuffer(GL_ARRAY_BUFFER, n_patch_color_buffer_object);
-			float* buffer = (float*) glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY); // mapovani obou VBO prida cca 5 FPS
+		// prenest energie - kazdy patch dostane soucet od vsech zdroju davky jednou
+		TransferBatch(scenePatches);
 
-			for (unsigned int i = 0; i < scenePatchesCount; i++) {
-				Patch* p = scenePatches[i];
+		// radky nove nakreslenych zdroju ulozit
+		for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
+			if (p_emitters[hi] != NULL && cachedRows[hi] == NULL)
+				formFactorCache.insert(p_emitters_ids[hi], renderedRows[hi]);
+		}
 
-				float newData[4 * 3]; // zde budou nove, vyhlazene barvy (4 vrcholy * 3 slozky)
-				Colors::smoothShadePatch(newData, p);
+		MARK("energies update");
 
-				if (buffer != NULL)
-					memcpy(buffer + i * 4 * 3, newData, 4 * 3 * sizeof(float));
-				else
-					glBufferSubData(GL_ARRAY_BUFFER, i * 4 * 3 * sizeof(float), 4 * 3 * sizeof(float), newData);
-			}
-		
-			if (buffer != NULL) {
-				if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
-					cerr << "Error unmapping VBO" << endl;
+
+		// zdroje se vyzarily
+		Vector3f lastEnergy; // posledni vyzarena energie
+		for (unsigned int hi = 0; hi < Config::HEMICUBES_CNT(); hi++) {
+			if (p_emitters[hi] == NULL)
+				continue;
+
+			lastEnergy = p_emitters[hi]->radiosity;
+			p_emitters[hi]->illumination += p_tmp_radiosities[hi];
+			p_emitters[hi]->radiosity -= p_tmp_radiosities[hi];
+
+			for (unsigned int m = 1; m < groupMembers[hi].size(); m++) {
+				Patch* p = scenePatches[groupMembers[hi][m]];
+				p->illumination += groupRadiosities[hi][m];
+				p->radiosity -= groupRadiosities[hi][m];
 			}
+		}
+
+		// ukoncit, jakmile energie nejnabitejsiho patche ve scene klesne pod danou hranici
+		if (lastEnergy.f_Length() < 0.1) {
+			cout << "Done in " << (timer.f_Time() - t_start) << " seconds, " << (shoot * Config::HEMICUBES_CNT()) << " cycles" << endl;				
+			PrintCacheStats();
+			if (emitterGroups.getGroupedShots() > 0)
+				cout << "Emitter groups: " << emitterGroups.getGroupedShots() << " shots for " << emitterGroups.getGroupedPatches() << " patches" << endl;
+			SolverConverged(); 
+		} else if (debugOutput) {
+			cout << "Pass " << passCounter << ", the emitter had " << setprecision(10) << lastEnergy.f_Length2() << " energy" << endl;
+			PrintCacheStats();
+		}	
+
+		MARK("emitters update");
+
+		passCounter++;			
+		shotsDone++;
+
+		// vystrely nahle zdrazily (jine zdroje, jina viditelnost) - ukoncit krok driv, aby zobrazeni necekalo
+		if (deadline > 0 && timer.f_Time() - shotsStart > deadline)
+			break;
+
+	} // for 'shoot' times
+
+	double shotsTime = timer.f_Time() - shotsStart;
+
+	// ulozit stav vypoctu - po uplynuti intervalu a vzdy po dokonceni
+	if (!computeRadiosity || timer.f_Time() - lastCheckpointTime >= Config::CHECKPOINT_INTERVAL())
+		RequestCheckpoint(!computeRadiosity);
+
+	MARK("checkpoint");
+
+	// uvolnit fbo
+	fbo->Bind_ColorTexture2D(0, GL_TEXTURE_2D, 0);
+	fbo->Release();
+	
+	glFinish(); // remove me
+	MARK("FBO release");
 
-			glBindBuffer(GL_ARRAY_BUFFER, 0); // odbindovat buffer
+	// predat energie k zobrazeni
+	PublishEnergies();
+
+	MARK("energies published");
+
+	// zbytek kroku je rezie, ktera se rozlozi do vystrelu
+	scheduler.record(shotsDone, shotsTime, timer.f_Time() - t_start - shotsTime);
+
+	if(n_marker_used) {
+	for(size_t i = 0; i < n_marker_used; ++ i)
+		printf("mark: \'%s\': %f (%f total)\n", p_marker_name_list[i], p_marker[i] - ((i)? p_marker[i - 1] : t_start), p_marker[i]);
+	}
+
+	return true;
+}
+
+
+/**
+ *	@brief krok vypoctu se shluky patchu - vsechny patche vyzari svou energii po vazbach mezi shluky; vola se ve vlakne vypoctu
+ *	@return vraci true (krok se provedl)
+ */
+bool ClusterSolverStep()
+{
+	double t_start = timer.f_Time();
+
+	// vazby se sestavi pri prvnim kroku nad aktualni scenou
+	if (!clusterSolver.isBuilt()) {
+		clusterSolver.build(scene.getPatches(), scene.getPatchesCount(), scene.getBvh(), float(Config::CLUSTERING()),
+			importance.isComputed(scene.getSceneId()) ? importance.getValues() : NULL);
+		cout << "Clustering: " << clusterSolver.getNodesCount() << " clusters, " << clusterSolver.getLinksCount() << " links, built in " << (timer.f_Time() - t_start) << " seconds" << endl;
+	}
+
+	float remaining = clusterSolver.step();
+	passCounter++;
+
+	// ukoncit, jakmile energie nejnabitejsiho patche klesne pod danou hranici
+	if (remaining < 0.1) {
+		cout << "Done in " << passCounter << " passes" << endl;
+		SolverConverged();
+	} else if (debugOutput) {
+		cout << "Pass " << passCounter << ", the most energetic patch has " << setprecision(10) << remaining << " energy left" << endl;
+	}
+
+	// ulozit stav vypoctu - po uplynuti intervalu a vzdy po dokonceni
+	if (!computeRadiosity || timer.f_Time() - lastCheckpointTime >= Config::CHECKPOINT_INTERVAL())
+		RequestCheckpoint(!computeRadiosity);
+
+	PublishEnergies();
+	return true;
+}
+
+
+/**
+ *	@brief krok stochasticke Jacobiho iterace - vsechny patche vyzari svou energii nahodnymi paprsky; vola se ve vlakne vypoctu
+ *	@return vraci true (krok se provedl)
+ */
+bool StochasticSolverStep()
+{
+	double t_start = timer.f_Time();
+
+	if (!stochasticSolver.isStarted(scene.getSceneId()))
+		stochasticSolver.start(scene.getPatches(), scene.getPatchesCount(), scene.getBvh(), Config::STOCHASTIC(), scene.getSceneId());
+
+	float remaining = stochasticSolver.step(accumulator);
+	passCounter++;
+
+	// ukoncit, jakmile energie nejnabitejsiho patche klesne pod danou hranici
+	if (remaining < 0.1) {
+		cout << "Done in " << passCounter << " passes, " << stochasticSolver.getTotalRaysCount() << " rays" << endl;
+		SolverConverged();
+	} else if (debugOutput) {
+		Vector3f control = stochasticSolver.getControl();
+		cout << "Pass " << passCounter << ", " << stochasticSolver.getLastRaysCount() << " rays in " << (timer.f_Time() - t_start)
+			<< " seconds, control radiosity (" << control.x << ", " << control.y << ", " << control.z << ")"
+			<< ", the most energetic patch has " << setprecision(10) << remaining << " energy left" << endl;
+	}
+
+	// ulozit stav vypoctu - po uplynuti intervalu a vzdy po dokonceni
+	if (!computeRadiosity || timer.f_Time() - lastCheckpointTime >= Config::CHECKPOINT_INTERVAL())
+		RequestCheckpoint(!computeRadiosity);
+
+	PublishEnergies();
+	return true;
+}
+
+
+/**
+ *	@brief prenese energii davky zdroju prijemcum - patchum sceny
+ *	@param[in] scenePatches jsou patche sceny
+ */
+void TransferBatch(Patch** scenePatches)
+{
+	ReceiveEnergy receiver = { scenePatches };
+	batch.execute(receiver);
+}
+
+
+/**
+ *	@brief vypise uspesnost a velikost cache radku form factoru
+ */
+void PrintCacheStats()
+{
+	if (!formFactorCache.isEnabled())
+		return;
+
+	unsigned long long lookups = formFactorCache.getHits() + formFactorCache.getMisses();
+	cout << "Form factor cache: " << formFactorCache.getHits() << " hits of " << lookups << " ("
+		<< setprecision(3) << (lookups > 0 ? 100.0 * formFactorCache.getHits() / lookups : 0.0) << " %), "
+		<< formFactorCache.getRowsCount() << " rows, " << setprecision(4) << formFactorCache.getBytes() / 1048576.0 << " MB" << endl;
+}
+
+
+/**
+ *	@brief pripravi snimek energii patchu pro zobrazeni a preda jej hlavnimu vlaknu; vola se ve vlakne vypoctu
+ */
+void PublishEnergies()
+{
+	Patch** scenePatches = scene.getPatches();
+	int scenePatchesCount = int(scene.getPatchesCount());
+
+	// po dokonceni vypoctu se zobrazene barvy ziskaji sberem z vysledne sceny
+	if (finalGatherPending) {
+		finalGatherPending = false;
+		double t_start = timer.f_Time();
+		finalGather.compute(scenePatches, scenePatchesCount, scene.getBvh(), Config::FINAL_GATHER(), scene.getSceneId(), passCounter);
+		cout << "Final gather: " << finalGather.getRaysCount() << " rays in " << (timer.f_Time() - t_start) << " seconds" << endl;
+	}
+	// po obnoveni vypoctu (L) uz sber neplati; po dalsich pruchodech nebo na jine scene je zastaraly
+	const float* gathered = !computeRadiosity && finalGather.isComputed(scene.getSceneId(), passCounter) ? finalGather.getColors() : NULL;
+
+	EnergySnapshot& snapshot = energySnapshots.getWriteBuffer();
+	snapshot.colors.resize(scenePatchesCount * 4 * 3);
+	snapshot.radiative.resize(scenePatchesCount * 4 * 3);
+
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < scenePatchesCount; i++) {
+		Patch* p = scenePatches[i];
+
+		// vyhlazene barvy (4 vrcholy * 3 slozky)
+		if (gathered != NULL)
+			copy(gathered + i * 12, gathered + i * 12 + 12, &snapshot.colors[i * 4 * 3]);
+		else
+			Colors::smoothShadePatch(&snapshot.colors[i * 4 * 3], p);
+
+		// radiativni energie - stejne ve vsech vrcholech
+		for (unsigned int n = 0; n < 12; n += 3) {
+			snapshot.radiative[i * 12 + n] = p->radiosity.x;
+			snapshot.radiative[i * 12 + n + 1] = p->radiosity.y;
+			snapshot.radiative[i * 12 + n + 2] = p->radiosity.z;
 		}
-		
-		glFinish(); // remove me
-		MARK("VBO update");
-		
+	}
+
+	energySnapshots.publish();
+}
+
+
+/**
+ *	@brief nahraje snimek energii od vlakna vypoctu do VBO s barvami patchu
+ *	@param[in] snapshot posledni zverejneny snimek
+ */
+void UploadEnergies(const EnergySnapshot& snapshot)
+{
+	// snimek muze byt jeste ze stare sceny
+	unsigned int size = scene.getPatchesCount() * 4 * 3;
+	if (snapshot.colors.size() != size || size == 0)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, n_patch_color_buffer_object);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size * sizeof(float), &snapshot.colors[0]);
+
 // pro zobrazovani radiativnich energii
 #define SHOW_RADIATIVE
 #ifdef SHOW_RADIATIVE
-		// nabindovat VBO s radiativnimi energiemi a updatovat jej
-		{
-			glBindBuffer(GL_ARRAY_BUFFER, n_patch_radiative_buffer_object);
-			float* buffer = (float*) glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);		
-
-			for (unsigned int i = 0; i < scenePatchesCount; i++) {				
-				float newData[4 * 3]; 
-				for (unsigned int n = 0; n < 12; n += 3) {
-					newData[n] = scenePatches[i]->radiosity.x;
-					newData[n+1] = scenePatches[i]->radiosity.y;
-					newData[n+2] = scenePatches[i]->radiosity.z;
-				}
+	glBindBuffer(GL_ARRAY_BUFFER, n_patch_radiative_buffer_object);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size * sizeof(float), &snapshot.radiative[0]);
+#endif
 
-				if (buffer != NULL)
-					memcpy(buffer + i*4*3, newData, 4*3*sizeof(float));
-				else
-					glBufferSubData(GL_ARRAY_BUFFER, i * 4 * 3 * sizeof(float), 4 * 3 * sizeof(float), newData);
-			}
+	glBindBuffer(GL_ARRAY_BUFFER, 0); // odbindovat buffer
+}
 
-			if (buffer != NULL) {
-				if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
-					cerr << "Error unmapping VBO" << endl;
-			}
-			
-			glBindBuffer(GL_ARRAY_BUFFER, 0); // odbindovat buffer		
+
+/**
+ *	@brief spusti vlakno vypoctu nad aktualni scenou
+ *	@return vraci true pri uspechu, false pri neuspechu
+ */
+bool StartSolver()
+{
+	// vlakno pouziva buffery naplnene v hlavnim kontextu
+	glFinish();
+	energySnapshots.reset();
+
+	// dulezitost se pocita znovu jen po zmene pohledu nebo sceny
+	if (importance.getViewsCount() > 0 && !importance.isComputed(scene.getSceneId())) {
+		double t_start = timer.f_Time();
+		importance.compute(scene.getPatches(), scene.getPatchesCount(), scene.getBvh(), scene.getSceneId());
+		cout << "Importance computed for " << importance.getViewsCount() << " views in " << (timer.f_Time() - t_start) << " seconds" << endl;
+	}
+	scene.setImportance(importance.isComputed(scene.getSceneId()) ? importance.getValues() : NULL);
+
+	// prime osvetleni analyticky misto prvnich vystrelu svetel; jen dokud se ze sceny nestrilelo
+	if (Config::DIRECT_LIGHTING() > 0) {
+		double t_start = timer.f_Time();
+		if (directLighting.compute(scene.getPatches(), scene.getPatchesCount(), scene.getBvh(), Config::DIRECT_LIGHTING())) {
+			cout << "Direct lighting from " << directLighting.getLightsCount() << " light patches, " << directLighting.getRaysCount()
+				<< " shadow rays in " << (timer.f_Time() - t_start) << " seconds" << endl;
+			finalGather.clear();	// energie se zmenily bez pruchodu
 		}
-#endif		
+	}
+
+	// vazby shluku se sestavi znovu nad aktualni scenou; radky form factoru patri geometrii, nad kterou se kreslily.
+	// Stochasticka iterace pokracuje (jeji cislo kroku urcuje vzorky), znovu zacne az nad novym sestavenim sceny
+	formFactorCache.clear();
+	clusterSolver.clear();
+
+	// skupiny zdroju nad aktualnimi patchi
+	emitterGroups.clear();
+	if (Config::EMITTER_GROUPS() > 0)
+		emitterGroups.build(scene.getPatches(), scene.getPatchesCount());
+
+	return solver.start(driver.GetDevice(), solverContext, InitSolverGLObjects, SolverStep, CleanupSolverGLObjects);
+}
+
+
+/**
+ *	@brief spusti pracovni procesy nad aktualni scenou (jen pro vystrely z hemicube); vola se jednou pro kazdou scenu,
+ *		pri zastavenem vlaknu vypoctu. Pokud se procesy nespusti, hemicube se kresli zde
+ */
+void StartWorkers()
+{
+	workerPool.stop();
+	if (Config::WORKERS() > 0 && Config::CLUSTERING() <= 0 && Config::STOCHASTIC() == 0 &&
+		!workerPool.start(Config::WORKERS(), workerSceneFile, scene.getPatches(), scene.getPatchesCount()))
+		cerr << "Unable to start worker processes, hemicubes will be rendered locally" << endl;
+}
+
+
+
+/**
+ *	@brief tato funkce se vola ve smycce pokazde kdyz nejsou zadne nove zpravy; lze vyuzit ke kresleni animace;
+ *		vypocet bezi ve vlastnim vlakne, zde se jen nahravaji jeho posledni vysledky
+ *	@param[in] driver je reference na OpenGL driver
+ */
+void OnIdle(CGL30Driver &driver)
+{
+	// spustit stopky fps
+	double t_start = timer.f_Time();
+
+	// vycistime framebuffer
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	
+	// spustit vsechny akce spojene se stiskem klaves
+	// napriklad posun kamery
+	handleActiveKeys();
+	
+	Matrix4f t_mvp;
+
+	// vicerovnovy vypocet - dokoncenou uroven jemneji rozdelit a pokracovat zbytkem energie
+	if (levelConverged && !RefineLevel())
+		cerr << "Unable to continue on the next multigrid level!" << endl;
+
+	// nahrat do VBO posledni energie od vlakna vypoctu, pokud od minula nejake pribyly
+	if (energySnapshots.update())
+		UploadEnergies(energySnapshots.getReadBuffer());
 
-	} // if scenePatchesCount > 0
 
 	// ***********************************************************************************
 	// Vykreslit na obrazovku uzivatelsky pohled + nahledovy kriz
@@ -1437,21 +2008,236 @@ void OnIdle(CGL30Driver &driver)
 	// preklopi buffery, zobrazi co jsme nakreslili
 	driver.Blit(); 
 
-	if(n_marker_used) {
-	for(size_t i = 0; i < n_marker_used; ++ i)
-		printf("mark: \'%s\': %f (%f total)\n", p_marker_name_list[i], p_marker[i] - ((i)? p_marker[i - 1] : t_start), p_marker[i]);
-	}
-
 	// spocitat fps
 	glFinish();
 	f_frame_time_average = f_frame_time_average * .9 + (timer.f_Time() - t_start) * .1;
 	double f_fps = 1 / f_frame_time_average;
 	ostringstream winTitle;
 	winTitle << p_s_window_name << ", FPS: " << f_fps;
+	if (computeRadiosity)
+		winTitle << ", shots/step: " << scheduler.getLastShots() << (scheduler.isMaxThroughput() ? " (max throughput)" : "");
 	SetWindowText(h_wnd, winTitle.str().c_str());
+
+	// pri vypoctu bez obsluhy patri GPU vypoctu, prohlizec kresli jen nekolikrat za sekundu
+	if (computeRadiosity && scheduler.isMaxThroughput())
+		Sleep(THROUGHPUT_FRAME_DELAY);
+}
+
+
+
+
+/**
+ * Nahradi scenu jedinym modelem (nactenym ze souboru) a znovu vytvori vsechny GL/CL objekty
+ */
+bool ReconstructScene(Model* model) {
+	// vlakno vypoctu a rozpracovany checkpoint jeste ctou patche stare sceny
+	solver.stop();
+	checkpoint.wait();
+
+	CleanupGLObjects();
+	CleanupCLObjects();
+
+	// zresetovat staticke objekty
+	patchIntervals.clear();
+	importance.clear();
+	finalGather.clear();
+	finalGatherPending = false;
+	stochasticSolver.clear();
+
+	// vytvorit novou scenu; nactene patche uz jsou rozdelene, vicerovnovy vypocet se nepouzije
+	scene = ModelContainer::ModelContainer();
+	scene.setMaxPatchArea(Config::MAX_PATCH_AREA());
+	scene.spatialOrder = Config::SPATIAL_ORDER();
+	multigridLevel = Config::MULTIGRID() - 1;
+	levelConverged = false;
+
+	// vlozit model s nactenymi patchi do sceny
+	scene.addModel(model);
+
+	// nova scena se nepocita, dokud vypocet nespusti uzivatel (L) nebo obnoveni checkpointu
+	computeRadiosity = false;
+
+	// znovu inicializovat GL, naplnit buffery, ... a spustit nad novou scenou pracovni procesy a vlakno vypoctu
+	if (!InitGLObjects() || !InitCLObjects())
+		return false;
+
+	StartWorkers();
+	return StartSolver();
+}
+
+
+/**
+ *	@brief obsah patchu na urovni vicerovnoveho vypoctu - kazda hrubsi uroven ma dvojnasobnou delku hrany
+ *	@param[in] level je cislo urovne, 0 = nejhrubsi, Config::MULTIGRID() - 1 = MAX_PATCH_AREA
+ *	@return vraci nejvetsi obsah patchu urovne
+ */
+double LevelPatchArea(unsigned int level)
+{
+	double area = Config::MAX_PATCH_AREA();
+	for (unsigned int l = level + 1; l < Config::MULTIGRID(); l++)
+		area *= 4;
+	return area;
+}
+
+
+/**
+ *	@brief vypocet dosahl hranice energie; na hrubsi urovni vicerovnoveho vypoctu jej hlavni vlakno (OnIdle)
+ *		prevede na jemnejsi deleni, jinak vypocet skonci (a zobrazeni se pripravi zaverecnym sberem). Vola se ve vlakne vypoctu
+ */
+void SolverConverged()
+{
+	computeRadiosity = false;
+
+	if (multigridLevel + 1 < Config::MULTIGRID())
+		levelConverged = true;
+	else if (Config::FINAL_GATHER() > 0)
+		finalGatherPending = true;
+}
+
+
+/**
+ *	@brief rozdeli patche sceny na dalsi uroven vicerovnoveho vypoctu a vypocet spusti znovu. Rozdelene patche
+ *		preberou iluminativni i zbyvajici radiativni energii rodice (Patch::divide), dopocita se tedy jen zbytek
+ *	@return vraci true pri uspechu, false pri neuspechu
+ */
+bool RefineLevel()
+{
+	levelConverged = false;
+
+	// vlakno vypoctu a rozpracovany checkpoint ctou patche aktualni urovne
+	solver.stop();
+	checkpoint.wait();
+
+	CleanupGLObjects();
+	CleanupCLObjects();
+	patchIntervals.clear();
+
+	unsigned int coarseCount = scene.getPatchesCount();
+	multigridLevel++;
+	scene.setMaxPatchArea(LevelPatchArea(multigridLevel));
+
+	cout << "Multigrid level " << (multigridLevel + 1) << " of " << Config::MULTIGRID() << ", max patch area " << scene.getMaxPatchArea() << endl;
+
+	// GL objekty se plni z nove rozdelene sceny, pracovni procesy dostanou jeji geometrii
+	computeRadiosity = true;
+	if (!InitGLObjects() || !InitCLObjects())
+		return false;
+
+	// jemnejsi uroven musi mit vic patchu, jinak se jen znovu resi hrubsi sit
+	if (scene.getPatchesCount() <= coarseCount)
+		cerr << "Warning: multigrid level " << (multigridLevel + 1) << " did not refine the mesh (" << coarseCount << " patches)" << endl;
+	else
+		cout << "Refined from " << coarseCount << " to " << scene.getPatchesCount() << " patches" << endl;
+
+	StartWorkers();
+	return StartSolver();
 }
 
 
+/**
+ * Preda vlaknu checkpointu snapshot aktualniho stavu vypoctu. Pokud predchozi zapis jeste bezi,
+ * snapshot se vynecha (zkusi se pri dalsim snimku), jen posledni stav po dokonceni vypoctu se vzdy pocka
+ */
+void RequestCheckpoint(bool final) {
+	if (Config::CHECKPOINT_INTERVAL() == 0)
+		return;
+
+	if (final)
+		checkpoint.wait();
+
+	SceneFile::SceneMetadata meta;
+	memset(&meta, 0, sizeof(meta));
+	meta.maxPatchArea = scene.getMaxPatchArea();
+	meta.hemicubeSide = Config::HEMICUBE_W();
+	meta.passCounter = passCounter;
+	meta.stochasticIteration = stochasticSolver.getIteration();
+	meta.stochasticPower = stochasticSolver.getInitialPower();
+
+	if (checkpoint.request(scene.getPatches(), scene.getPatchesCount(), meta)) {
+		lastCheckpointTime = timer.f_Time();
+		if (debugOutput)
+			cout << "Checkpoint after pass " << passCounter << endl;
+	}
+}
+
+
+/**
+ * Nacte scenu z checkpointu (souboru sceny) a pokracuje ve vypoctu tam, kde skoncil
+ */
+bool ResumeFromCheckpoint(const char* filename) {
+	cout << "Resuming from " << filename << endl;
+
+	SceneFile file;
+	if (!file.open(filename) || !ReconstructScene(new LoadingModel(file)))
+		return false;
+
+	const SceneFile::SceneMetadata* meta = file.getMetadata();
+	if (meta != NULL) {
+		passCounter = meta->passCounter;
+		if (meta->hemicubeSide != Config::HEMICUBE_W())
+			cout << "Warning: the checkpoint was computed with hemicube side " << meta->hemicubeSide << endl;
+
+		// stochasticka iterace navaze na ulozeny krok (jinak by opakovala jiz pouzite vzorky)
+		if (Config::STOCHASTIC() > 0) {
+			stochasticSolver.start(scene.getPatches(), scene.getPatchesCount(), scene.getBvh(), Config::STOCHASTIC(), scene.getSceneId());
+			stochasticSolver.restore(meta->stochasticIteration, meta->stochasticPower);
+		}
+	}
+
+	// na rozdil od LoadFromFile vypocet pokracuje
+	computeRadiosity = true;
+	totalTimer.ResetTimer();
+	solver.wake();
+
+	cout << "Resumed at pass " << passCounter << endl;
+	return true;
+}
+
+
+/**
+ * Nacte scenu ze souboru ve starem formatu (primy vypis objektu Patch s relativnimi sousedy)
+ */
+void LoadFromLegacyFile(const char* filename) {
+	FILE* fp = NULL;
+	errno_t err = fopen_s(&fp, filename, "rb");
+	if (err != 0 || fp == NULL) {
+		cerr << "Unable to open the file" << endl;
+		return;
+	}
+
+	bool error = false;
+	size_t read;
+
+	// nacist patche ------------------------------			
+	unsigned long count;
+	read = fread(&count, sizeof(unsigned long), 1, fp);
+	if (read != 1)
+		error = true;
+
+	LegacyPatch* data = NULL;
+	if (!error) {
+		data = new LegacyPatch[count];
+		read = fread(data, sizeof(LegacyPatch), count, fp);
+		if (read != count)
+			error = true;
+	}
+
+	// rekonstruovat scenu ------------------------
+	if (!error)
+		error = !ReconstructScene(new LoadingModel(data, count));
+
+	delete[] data;
+
+	// pokud probihal vypocet, zastavit jej
+	computeRadiosity = false;
+
+	if (!error)
+		cout << "Done!" << endl;
+	else
+		cerr << "An error occured!" << endl;
+
+	fclose(fp);
+}
 
 
 /**
@@ -1481,64 +2267,14 @@ void LoadFromFile() {
 	if (GetOpenFileName(&ofn) == TRUE) {
 		cout << "Loading from " << ofn.lpstrFile << endl;
 
-		FILE* fp = NULL;
-		errno_t err = fopen_s(&fp, ofn.lpstrFile, "rb");
-		if (err != 0 || fp == NULL) {
-			cerr << "Unable to open the file" << endl;
-		} else {
-			bool error = false;
-			size_t read;
-
-			// nacist patche ------------------------------			
-			unsigned long count;
-			read = fread(&count, sizeof(unsigned long), 1, fp);
-			if (read != 1)
-				error = true;
-
-			Patch* data = new Patch[count];
-			read = fread(data, sizeof(Patch), count, fp);
-			if (read != count)
-				error = true;
-			
+		if (SceneFile::isSceneFile(ofn.lpstrFile)) {
+			// soubor se pouze namapuje, patche se vytvori primo z jeho sekci
+			SceneFile file;
+			bool error = !file.open(ofn.lpstrFile);
 
-			// rekonstruovat scenu ------------------------
-			if (!error) {				
-				CleanupGLObjects();
-				CleanupCLObjects();
-
-				// zresetovat staticke objekty
-				patchIntervals.clear();
-
-				// vytvorit novou scenu
-				scene = ModelContainer::ModelContainer();
-				scene.maxPatchArea = Config::MAX_PATCH_AREA();
-
-				// vytvorit z nactenych patchu model, ktery vlozime do sceny
-				Model* dummy = new LoadingModel(data, count);
-				scene.addModel(dummy);
-
-				// znovu inicializovat GL, naplnit buffery, ...
-				if (!InitGLObjects() || !InitCLObjects())
-					error = true;
-
-				delete[] data;
-			}
-			/*
-			// provest vyhlazovani, at je obraz pekny ikdyz se rad. jeste nepocita
-			{
-				Patch** scenePatches = scene.getPatches();
-				glBindBuffer(GL_ARRAY_BUFFER, n_patch_color_buffer_object);
-				for (unsigned int i = 0; i < count; i++) {
-					Patch* p = scenePatches[i];
-			
-					uint32_t newData[4];
-					Colors::smoothShadePatch(newData, p);
+			if (!error)
+				error = !ReconstructScene(new LoadingModel(file));
 
-					glBufferSubData(GL_ARRAY_BUFFER, i * 4 * sizeof(uint32_t), 4 * sizeof(uint32_t), newData);
-				}		
-				glBindBuffer(GL_ARRAY_BUFFER, 0); // odbindovat buffer
-			}
-			*/
 			// pokud probihal vypocet, zastavit jej
 			computeRadiosity = false;
 
@@ -1546,8 +2282,8 @@ void LoadFromFile() {
 				cout << "Done!" << endl;
 			else
 				cerr << "An error occured!" << endl;
-
-			fclose(fp);
+		} else {
+			LoadFromLegacyFile(ofn.lpstrFile);
 		}
 	}
 	
@@ -1583,63 +2319,39 @@ void SaveToFile() {
 
 	if (GetSaveFileName(&ofn)==TRUE) {
 		cout << "Saving to " << szFile << endl;
-		
-		FILE* fp = NULL;
-		errno_t err = fopen_s(&fp, ofn.lpstrFile, "wb");
-		if (err != 0 || fp == NULL) {
-			cerr << "Unable to create the file" << endl;
-		} else {
-
-			bool error = false;
-			size_t written;
 
-			// patche --------------------------------------------
-			{
-				unsigned long count = scene.getPatchesCount();
-				Patch** patches = scene.getPatches();
-				
-				// prevest pole ukazatelu na pole patchu
-				Patch* data = new Patch[count];
-				for (unsigned long i = 0; i < count; i++) {
-					data[i] = (*patches[i]);
-				}
-
-				// v patchich jsou ukazatele na sousedy - prevedeme je na relativni (cisla) ukazatele v ramci sceny
-				for (unsigned long i = 0; i < count; i++) {
-					
-					for (unsigned int n = 0; n < 8; n++) { // pro kazdeho souseda
-						
-						for (unsigned long j = 0; j < count; j++) {
-							if (patches[i]->neighbours[n] == patches[j]) {
-								data[i].relativeNeighbours[n] = j;
-								data[i].neighbours[n] = NULL;
-								break;
-							}
-						}
-
-					}
-
-				}
-
-				// prvni ulozena hodnota je pocet patchu
-				written = fwrite(&count, sizeof(unsigned long), 1, fp);
-				if (written != 1)
-					error = true;
-
-				// nasleduji data
-				written = fwrite(data, sizeof(Patch), count, fp);
-				if (written != count)
-					error = true;
-			}
-			
-			
-			if (!error)
-				cout << "Done!" << endl;
-			else
-				cerr << "An error occured!" << endl;
-
-			fclose(fp);			
-		}
+		// vlakno vypoctu meni energie patchu - behem ukladani stoji
+		solver.stop();
+		
+		SceneFile::SceneMetadata meta;
+		memset(&meta, 0, sizeof(meta));
+		meta.maxPatchArea = scene.getMaxPatchArea();
+		meta.hemicubeSide = Config::HEMICUBE_W();
+		meta.passCounter = passCounter;
+		meta.stochasticIteration = stochasticSolver.getIteration();
+		meta.stochasticPower = stochasticSolver.getInitialPower();
+
+		// sekce se zapisuji postupne, sousedi se prevadi na cisla pres hashovaci tabulku
+		if (SceneFile::save(ofn.lpstrFile, scene.getPatches(), scene.getPatchesCount(), meta))
+			cout << "Done!" << endl;
+		else
+			cerr << "An error occured!" << endl;
+
+		// vedle sceny i kompaktni export vysledku pro prohlizec (stejne jmeno, pripona .rrq)
+		string exportFile(ofn.lpstrFile);
+		size_t dot = exportFile.find_last_of('.');
+		if (dot != string::npos && exportFile.find_first_of("\\/", dot) == string::npos)
+			exportFile.erase(dot);
+		exportFile += ".rrq";
+
+		cout << "Exporting results to " << exportFile << endl;
+		if (!ResultExport::save(exportFile.c_str(), scene.getPatches(), scene.getPatchesCount()))
+			cerr << "Unable to export results!" << endl;
+		else if (!ResultExport::verify(exportFile.c_str(), scene.getPatches(), scene.getPatchesCount()))
+			cerr << "Exported results failed the read-back check!" << endl;
+
+		if (!StartSolver())
+			cerr << "Unable to restart the solver thread!" << endl;
 		
 	}
 	
@@ -22,6 +22,23 @@
 #include "Timer.h"
 #include "FormFactors.h"
 #include "LoadingModel.h"
+#include "SceneFile.h"
+#include "ResultExport.h"
+#include "Checkpoint.h"
+#include "EnergyAccumulator.h"
+#include "OutOfCoreSolver.h"
+#include "ClusterRadiosity.h"
+#include "Importance.h"
+#include "StochasticRadiosity.h"
+#include "FormFactorCache.h"
+#include "BatchTransfer.h"
+#include "EmitterGroups.h"
+#include "DirectLighting.h"
+#include "FinalGather.h"
+#include "WorkerPool.h"
+#include "SolverThread.h"
+#include "ShotScheduler.h"
+#include "TripleBuffer.h"
 #include "Kernel_ProcessHemicube.h"
 #include "Config.h"
 
@@ -71,10 +88,11 @@ static GLuint	n_vertex_buffer_object,				// VBO s geometrii sceny
 				n_tex_buffer_object,				// !!!
 				n_vbo_square,						// VBO pro nahledove okynko
 				n_vao_square,						// VAO pro nahledove okynko
-				n_id_color_buffer_object;			// VBO s jednim intervalem unikatnich barev pro kresleni pohledu z patche
-
-// pole VAO pro kazdy interval vykreslovanych patchu
-static GLuint*	n_color_array_object = NULL; 
+				n_welded_vertex_buffer_object,		// VBO se svarenymi vrcholy sceny (kazdy roh jednou) pro pohledy z patchu
+				n_welded_index_buffer_object,		// VBO s indexy do svarenych vrcholu
+				n_id_color_buffer_object,			// VBO s barvami podle ID patchu na provokujicich svarenych vrcholech
+				n_welded_array_object,				// VAO pro kresleni pohledu z patchu (barvy podle ID)
+				n_welded_black_array_object;		// VAO pro kresleni pohledu z patchu bez barev (cerne patche mimo interval)
 
 // objekt shaderu pro kresleni uzivatelskeho pohledu a jeho parametry
 static GLuint	n_user_program_object, 
@@ -89,8 +107,8 @@ static GLuint	n_patch_program_object,
 static GLuint	n_preview_program_object, 
 				n_preview_mvp_matrix_uniform;
 
-// pole form factoru o velikosti odpovidajici rozliseni textury hemicube
-static float*	p_formfactors = NULL;
+// tabulky form factoru pixelu hemicube (osmina vrchu a pulka boku, rozbaluje je kernel)
+static HemicubeFormFactors	hemicubeFormFactors;
 
 
 
@@ -118,12 +136,56 @@ uint32_t* p_ocl_hemicubes = NULL;
 uint32_t* p_ocl_pids = NULL;
 float* p_ocl_energies = NULL;
 
-// pole souctu formfactoru pro kazdy patch ve scene, pouziva se pro zpracovani vystupu kernelu; indexovano ID patche
-float* p_tmp_formfactors = NULL;
+// soubezne scitani energie prenesene do patchu sceny (stochasticka iterace)
+EnergyAccumulator accumulator;
+
+// prenos energie davky zdroju z hemicube (radky form factoru krat energie zdroju)
+BatchTransfer batch;
 
 // pole radiosit o velikosti rovne poctu soucasne pocitanych hemicube; slouzi k uchovani puvodnich hodnot pri prestrelovani z vice pohledu
 Vector3f* p_tmp_radiosities = NULL;
 
+// energie vystrelena z jednotlivych hemicube v aktualnim intervalu (radiosita * barva zdroje)
+Vector3f* p_tmp_shots = NULL;
+
+// radky form factoru opakovanych zdroju (Config::FORM_FACTOR_CACHE); po hemicube radek zdroje z cache (NULL = kreslit)
+// a zaznamy kernelu kreslenych zdroju, ze kterych se sestavi nove radky
+FormFactorCache formFactorCache;
+vector<const FormFactorCache::Row*> cachedRows;
+vector<FormFactorCache::Row> renderedRows;
+
+// skupiny slabych zdroju vystrelene z hemicube zdroje (Config::EMITTER_GROUPS); po hemicube cisla clenu (prvni je zdroj)
+// a jejich puvodni radiosity
+EmitterGroups emitterGroups;
+vector<vector<unsigned int> > groupMembers;
+vector<vector<Vector3f> > groupRadiosities;
+
+
+// vypocet se shluky patchu (Config::CLUSTERING) - vazby se sestavi v prvnim kroku nad aktualni scenou
+ClusterRadiosity clusterSolver;
+
+// stochasticka Jacobiho iterace (Config::STOCHASTIC) - spusti se v prvnim kroku nad aktualni scenou
+StochasticRadiosity stochasticSolver;
+
+// vicerovnovy vypocet (Config::MULTIGRID) - aktualni uroven deleni (0 = nejhrubsi) a priznak, ze vlakno vypoctu uroven dokoncilo
+unsigned int multigridLevel = 0;
+volatile bool levelConverged = false;
+
+// prime osvetleni ze svetel (Config::DIRECT_LIGHTING) - pocita se pri spusteni vypoctu nad scenou, ze ktere se jeste nestrilelo
+DirectLighting directLighting;
+
+// zaverecny sber pro zobrazeni (Config::FINAL_GATHER) - spocita se ve vlakne vypoctu po dokonceni posledni urovne
+FinalGather finalGather;
+bool finalGatherPending = false;
+
+// pracovni procesy pocitajici radky form factoru (Config::WORKERS); spousti se jednou pro kazdou scenu (start programu,
+// ReconstructScene, RefineLevel), restart vypoctu je nechava bezet
+WorkerPool workerPool;
+const char* workerSceneFile = "scene.workers.rr";
+
+// dulezitost patchu pro pohledy kamery (I prida aktualni pohled, U pohledy zrusi) - pocita se pri spusteni vypoctu
+Importance importance;
+
 // pole ukazatelu a ID patchu s nejvetsimi energiemi
 Patch** p_emitters = NULL;
 unsigned int* p_emitters_ids = NULL;
@@ -140,11 +202,14 @@ static bool b_mouse_controlled = false;
 #define KEY_A 0x41
 #define KEY_D 0x44
 #define KEY_F 0x46
+#define KEY_I 0x49
 #define KEY_L 0x4C
+#define KEY_M 0x4D
 #define KEY_O 0x4F
 #define KEY_P 0x50
 #define KEY_Q 0x51
 #define KEY_S 0x53
+#define KEY_U 0x55
 #define KEY_W 0x57
 #define KEY_TAB 0x09
 
@@ -171,8 +236,30 @@ bool debugOutput = false;
 // kreslit radiativni energie namisto iluminativnich? (TAB)
 bool b_draw_radiative = false;
 
-// spustit/pozastavit vypocet (L)
-bool computeRadiosity = true;
+// spustit/pozastavit vypocet (L); cte a nastavuje i vlakno vypoctu
+volatile bool computeRadiosity = true;
+
+// volba poctu vystrelu v kroku vypoctu podle cilove doby kroku (M prepina maximalni propustnost)
+ShotScheduler scheduler;
+
+// prodleva mezi snimky prohlizece v rezimu maximalni propustnosti [ms]
+static const DWORD THROUGHPUT_FRAME_DELAY = 200;
+
+// vlakno vypoctu radiosity a jeho GL kontext (sdileny s hlavnim)
+SolverThread solver;
+HGLRC solverContext = NULL;
+
+// snimek energii patchu, ktery vlakno vypoctu predava k zobrazeni (obsah VBO s barvami, 4 vrcholy * 3 slozky na patch)
+struct EnergySnapshot {
+	vector<float> colors;		// vyhlazene iluminativni energie
+	vector<float> radiative;	// radiativni energie
+};
+TripleBuffer<EnergySnapshot> energySnapshots;
+
+// prubezne ukladani stavu vypoctu a cas posledniho ulozeni
+Checkpoint checkpoint;
+const char* checkpointFile = "checkpoint.rr";
+static double lastCheckpointTime = 0;
 
 // zobrazit pouze wireframe? (F)
 bool wireframe = false;
@@ -229,6 +316,24 @@ LRESULT CALLBACK WndProc(HWND h_wnd, UINT n_msg, WPARAM n_w_param, LPARAM n_l_pa
 void smoothShadePatch(uint32_t* colors, Patch* p);
 void SaveToFile();
 void LoadFromFile();
+void LoadFromLegacyFile(const char* filename);
+bool ReconstructScene(Model* model);
+double LevelPatchArea(unsigned int level);
+bool RefineLevel();
+void SolverConverged();
+bool ResumeFromCheckpoint(const char* filename);
+void RequestCheckpoint(bool final);
+bool InitSolverGLObjects();
+void CleanupSolverGLObjects();
+bool SolverStep();
+bool ClusterSolverStep();
+bool StochasticSolverStep();
+bool StartSolver();
+void StartWorkers();
+void PublishEnergies();
+void TransferBatch(Patch** scenePatches);
+void PrintCacheStats();
+void UploadEnergies(const EnergySnapshot& snapshot);
 
 
 
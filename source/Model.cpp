@@ -1,4 +1,7 @@
 #include "Model.h"
+#include "SceneBvh.h"
+#include <algorithm>
+#include <stdint.h>
 
 extern vector<Patch*>* divide(double a);
 
@@ -7,6 +10,7 @@ Model::Model(void) {
 	// plosky budou dynamicky alokovany pri generovani (prevod modelu ze zdrojove
 	// formy na plosky) a uvolnovany v destruktoru ~Model
 	patches = new vector<Patch*>();
+	bvh = NULL;
 }
 
 
@@ -16,6 +20,94 @@ Model::~Model(void) {
 		delete (*it);
 
 	delete patches;
+	delete bvh;
+}
+
+
+vector<Patch*>* Model::getCurrentPatches() {
+	return patches;
+}
+
+
+/**
+ * Vychozi model lezi primo v souradnicich sceny, strom se stavi nad jeho vlastnimi patchi
+ */
+const Bvh* Model::getBvh(vector<Patch*>*& localPatches, Matrix4f& transform, bool& identity) {
+	if (bvh == NULL) {
+		bvh = new Bvh();
+		SceneBvh::buildPatchBvh(*bvh, patches->empty() ? NULL : &(*patches)[0], patches->size());
+	}
+
+	localPatches = patches;
+	transform.Identity();
+	identity = true;
+	return bvh;
+}
+
+
+// bitu Mortonova kodu na osu (3 * 21 = 63 bitu)
+static const unsigned int MORTON_BITS = 21;
+
+
+/**
+ * Rozprostre dolnich 21 bitu tak, aby mezi kazdymi dvema byly dva volne
+ */
+static uint64_t spreadBits(uint64_t x) {
+	x &= 0x1FFFFF;
+	x = (x | x << 32) & 0x1F00000000FFFFULL;
+	x = (x | x << 16) & 0x1F0000FF0000FFULL;
+	x = (x | x << 8) & 0x100F00F00F00F00FULL;
+	x = (x | x << 4) & 0x10C30C30C30C30C3ULL;
+	x = (x | x << 2) & 0x1249249249249249ULL;
+	return x;
+}
+
+
+/**
+ * Patche z deleni jdou po puvodnich ploskach, takze prostorove sousedni patche lezi v pameti daleko od sebe.
+ * Po serazeni podle Mortonova kodu stredu (v kvadru stredu modelu) jsou blizke patche blizko i v poli
+ * a s nimi jejich vrcholy, indexy, energie i listy BVH. Sousedi jsou ukazatele, razeni je nezneplatni;
+ * shodne kody zustanou v puvodnim poradi, opakovane razeni poradi nezmeni
+ */
+void Model::sortPatches() {
+	int count = int(patches->size());
+	if (count < 2)
+		return;
+
+	vector<Vector3f> centers(count);
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++)
+		centers[i] = patches->at(i)->getCenter();
+
+	Aabb box;
+	for (int i = 0; i < count; i++)
+		box.extend(centers[i]);
+
+	Vector3f size = box.max - box.min;
+	float cells = float((1 << MORTON_BITS) - 1);
+	Vector3f scale(size.x > 0 ? cells / size.x : 0, size.y > 0 ? cells / size.y : 0, size.z > 0 ? cells / size.z : 0);
+
+	// dvojice (kod, puvodni cislo) - shodne kody zachovaji puvodni poradi
+	vector<pair<uint64_t, unsigned int> > keys(count);
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++) {
+		Vector3f c = centers[i] - box.min;
+		uint64_t x = uint64_t(min(c.x * scale.x, cells));
+		uint64_t y = uint64_t(min(c.y * scale.y, cells));
+		uint64_t z = uint64_t(min(c.z * scale.z, cells));
+		keys[i] = make_pair(spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2, (unsigned int)i);
+	}
+
+	sort(keys.begin(), keys.end());
+
+	vector<Patch*> sorted(count);
+	for (int i = 0; i < count; i++)
+		sorted[i] = patches->at(keys[i].second);
+	patches->swap(sorted);
+
+	// poradi listu stromu odpovida starym cislum patchu
+	delete bvh;
+	bvh = NULL;
 }
 
 
@@ -26,6 +118,10 @@ Model::~Model(void) {
  */
 void Model::subdivide(double area) {
 
+	// patche se nahradi novymi, strom nad nimi uz neplati
+	delete bvh;
+	bvh = NULL;
+
 	// Brat nerozdelene patche a vysledky jejich deleni pripojovat na konec vektoru.
 	// Pokud se patch nerozdeli, proste se zkopiruje. Nakonec se zacatek pole (puvodni patche) odrizne
 	unsigned int n_original_size = patches->size();	
@@ -38,11 +134,10 @@ void Model::subdivide(double area) {
 		if (p_new_patches == NULL) {
 			Patch* n = new Patch(*p);
 
-			// patch se nerozdelil, proto nezna sve sousedy (pouzivane pro interpolaci kreslenych barev); nastavit sebe sama
-			for (unsigned j = 0; j < 8; j++) {
-				if (n->neighbours[j] == NULL) // osetreni pro nacitani, kde jsou patche jiz rozdelene a sousedy znaji
-					n->neighbours[j] = n;
-			}
+			// kopie prevzala ukazatele na puvodni patche (i na p), ty se nize smazou nebo rozdeli; sousedy
+			// pres hrany plosek doplni znovu ModelContainer::buildNeighbours, do te doby je soused patch sam
+			for (unsigned j = 0; j < 8; j++)
+				n->setNeighbour(j, n);
 
 			patches->push_back(n);
 		} else {
@@ -4,19 +4,24 @@
 #include <deque>
 #include "Patch.h"
 #include "Vector.h"
+#include "Bvh.h"
 
 class Model {
 	
 	public:
 		Model(void);
-		~Model(void);
+		virtual ~Model(void);
 				
 		virtual vector<Patch*>* getPatches(double area = 0) = 0;	// vraci vektor patchu
+		virtual const Bvh* getBvh(vector<Patch*>*& localPatches, Matrix4f& transform, bool& identity);	// vraci BVH modelu v jeho souradnicich, patche ve stejnem poradi a transformaci do sceny; volat po getPatches
+		vector<Patch*>* getCurrentPatches();	// patche z posledniho getPatches bez noveho deleni (scena v nich muze nahradit ukazatele)
+		virtual void sortPatches();	// seradi patche podle Mortonovy krivky jejich stredu; volat po getPatches
 
 	protected:	
 
 		void subdivide(double area);	// provede nad modelem subdivision
 
 		vector<Patch*>* patches;	// dynamicky alokovany vektor plosek modelu
+		Bvh* bvh;	// BVH nad patchi, stavi se az pri prvnim dotazu; deleni jej zneplatni
 };
 
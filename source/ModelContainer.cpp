@@ -1,5 +1,160 @@
 
 #include "ModelContainer.h"
+#include <unordered_map>
+#include <map>
+
+
+/**
+ * Vrchol kvantovany do mrizky - bunka pro hledani blizkych vrcholu
+ */
+struct VertexKey {
+	int x, y, z;
+
+	bool operator==(const VertexKey& o) const {
+		return x == o.x && y == o.y && z == o.z;
+	}
+
+	bool operator<(const VertexKey& o) const {
+		if (x != o.x)
+			return x < o.x;
+		if (y != o.y)
+			return y < o.y;
+		return z < o.z;
+	}
+};
+
+/**
+ * Neorientovana hrana - dvojice cisel sloucenych vrcholu serazena tak, aby nezalezelo na smeru
+ */
+struct EdgeKey {
+	unsigned int a, b;
+
+	bool operator==(const EdgeKey& o) const {
+		return a == o.a && b == o.b;
+	}
+};
+
+struct EdgeKeyHash {
+	size_t operator()(const EdgeKey& k) const {
+		return size_t(k.a) * 73856093u ^ size_t(k.b) * 19349663u;
+	}
+};
+
+/**
+ * Zaznam o vyskytu hrany/vrcholu v patchi; zaznamy se stejnym klicem tvori spojovy seznam pres 'next'
+ */
+struct AdjacencyRecord {
+	unsigned int patch;	// poradi patche mezi zpracovavanymi (buildNeighbours)
+	unsigned int slot;	// cislo hrany/vrcholu v patchi (0 - 3)
+	int next;		// dalsi zaznam se stejnym klicem, -1 = konec
+};
+
+/**
+ * Kvantuje bod do mrizky s krokem 'quantum'
+ */
+static VertexKey quantizeVertex(Vector3f v, float quantum) {
+	VertexKey k;
+	k.x = int(floor(v.x / quantum + 0.5f));
+	k.y = int(floor(v.y / quantum + 0.5f));
+	k.z = int(floor(v.z / quantum + 0.5f));
+	return k;
+}
+
+/**
+ * Vraci klic hrany; vrcholy jsou serazene, aby obe orientace hrany daly stejny klic
+ */
+static EdgeKey makeEdgeKey(unsigned int a, unsigned int b) {
+	EdgeKey k;
+	k.a = min(a, b);
+	k.b = max(a, b);
+	return k;
+}
+
+/**
+ * Krok mrizky pro slucovani vrcholu jako podil uhlopricky sceny (kvadru vsech modelu) - absolutni krok by
+ * ve velke scene nesloucil nic a v male sloucil cele plosky. Pri pripojovani modelu tak plati stejny krok
+ * pro nove i drivejsi patche
+ */
+static float sceneQuantum(const vector<ModelContainer::ClusterGroup>& groups, float fraction) {
+	Aabb box;
+	for (unsigned int g = 0; g < groups.size(); g++)
+		box.extend(groups[g].box);
+
+	float diagonal = box.isEmpty() ? 0 : (box.max - box.min).f_Length();
+	return diagonal > 0 ? diagonal * fraction : fraction;
+}
+
+/**
+ * Slouci body blizsi nez 'quantum' a vrati pro kazdy bod cislo slouceneho vrcholu. Bod se porovnava
+ * s body ve sve bunce mrizky i ve vsech sousednich bunkach, takze se najdou i dva temer shodne body
+ * lezici kazdy na jine strane hranice bunky. Kazdy bod (paralelne) najde nejnizsi cislo bodu v dosahu;
+ * ten ma nejnizsi cislo i ve svem okoli, retezec tak konci v jednom korenu a koreny dostanou cisla
+ * vzestupne (prvni vyskyt cisla je jeho koren). Vraci pocet sloucenych vrcholu
+ */
+static unsigned int mergeVertices(const vector<Vector3f>& points, float quantum, vector<unsigned int>& ids) {
+	int count = int(points.size());
+	float limit = quantum * quantum;
+
+	// body serazene podle bunky (a cisla) - bunka je souvisly usek
+	vector<pair<VertexKey, unsigned int> > cells(count);
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++)
+		cells[i] = make_pair(quantizeVertex(points[i], quantum), unsigned(i));
+	sort(cells.begin(), cells.end());
+
+	// nejnizsi cislo bodu v dosahu (nejvyse vlastni)
+	vector<unsigned int> lowest(count);
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++) {
+		VertexKey cell = quantizeVertex(points[i], quantum);
+		unsigned int found = unsigned(i);
+
+		for (int d = 0; d < 27; d++) {
+			VertexKey k = { cell.x + d % 3 - 1, cell.y + (d / 3) % 3 - 1, cell.z + d / 9 - 1 };
+			vector<pair<VertexKey, unsigned int> >::const_iterator it = lower_bound(cells.begin(), cells.end(), make_pair(k, 0u));
+
+			// v bunce jsou body serazene podle cisla, vyssi nez dosavadni nalez uz nepomohou
+			for (; it != cells.end() && it->first == k && it->second < found; ++it) {
+				if ((points[it->second] - points[i]).f_Length2() <= limit) {
+					found = it->second;
+					break;
+				}
+			}
+		}
+
+		lowest[i] = found;
+	}
+
+	// cislovani korenu; nizsi body uz cislo maji
+	unsigned int merged = 0;
+	ids.resize(count);
+	for (int i = 0; i < count; i++)
+		ids[i] = (lowest[i] == unsigned(i)) ? merged++ : ids[lowest[i]];
+
+	return merged;
+}
+
+// sousede pres hrany patche: hrana i vede z vrcholu i do vrcholu i+1 (dolni, prava, horni, leva)
+static const unsigned int edgeNeighbourSlot[4] = { 5, 3, 1, 7 };
+// sousede pres rohy patche: levy dolni, pravy dolni, pravy horni, levy horni
+static const unsigned int cornerNeighbourSlot[4] = { 6, 4, 2, 0 };
+
+// nejmensi vaha energie pri vyberu zdroju podle dulezitosti
+static const float IMPORTANCE_FLOOR = 0.05f;
+
+
+/**
+ * Prekryvaji se kvadry po rozsireni o 'margin'?
+ */
+static bool boxesOverlap(const Aabb& a, const Aabb& b, float margin) {
+	return a.min.x <= b.max.x + margin && b.min.x <= a.max.x + margin &&
+		a.min.y <= b.max.y + margin && b.min.y <= a.max.y + margin &&
+		a.min.z <= b.max.z + margin && b.min.z <= a.max.z + margin;
+}
+
+
+// posledni pridelene cislo sestaveni sceny - spolecne pro vsechny kontejnery, nova scena tak nedostane cislo predchozi
+static unsigned int lastSceneId = 0;
 
 
 ModelContainer::ModelContainer(void) {
@@ -7,13 +162,27 @@ ModelContainer::ModelContainer(void) {
 	indices = NULL;
 	verticesCount = 0;
 	indicesCount = 0;
+
+	weldedVertices = NULL;
+	weldedIndices = NULL;
+	provokingVertices = NULL;
+	weldedVerticesCount = 0;
+	weldedCapacity = 0;
 	
 	patches = NULL;
 	patchesCount = 0;
+	patchesCapacity = 0;
 
 	maxPatchArea = 0; // defaultne bez deleni
+	spatialOrder = false;
+	importance = NULL;
 
 	needRefresh = false;
+	needRebuild = false;
+	updatedModels = 0;
+	updatedPatchArea = 0;
+	updatedSpatialOrder = false;
+	sceneId = 0;
 }
 
 
@@ -26,6 +195,9 @@ ModelContainer::~ModelContainer(void) {
 	delete [] vertices;
 	delete [] indices;
 	delete [] patches;
+	delete [] weldedVertices;
+	delete [] weldedIndices;
+	delete [] provokingVertices;
 }
 
 
@@ -56,6 +228,79 @@ void ModelContainer::load() {
 }
 
 
+/**
+ * Nacte scenu ze seznamu modelu; kazdy radek je jedna polozka, prazdne radky a komentare (#) se preskakuji:
+ *   model <soubor.obj>
+ *   instance <soubor.obj> <matice 3x4 po radcich - 12 cisel>
+ * Vsechny instance stejneho souboru sdileji jednu predlohu - soubor se nacte a rozdeli jen jednou
+ */
+bool ModelContainer::load(const char* filename) {
+	ifstream f(filename, ifstream::in);
+	if (!f.good()) {
+		cerr << "Unable to open scene '" << filename << "'" << endl;
+		return false;
+	}
+
+	map<string, ModelPrototype*> prototypes;
+	bool error = false;
+
+	string buffer;
+	unsigned int line = 0;
+	while (getline(f, buffer)) {
+		line++;
+
+		istringstream str(buffer);
+		string kind, path;
+		if (!(str >> kind) || kind[0] == '#')
+			continue;
+
+		if (!(str >> path)) {
+			cerr << "Scene line " << line << ": missing model file" << endl;
+			error = true;
+			continue;
+		}
+
+		if (kind == "model") {
+			addModel(new WaveFrontModel(path));
+			continue;
+		}
+
+		if (kind != "instance") {
+			cerr << "Scene line " << line << ": unknown entry '" << kind << "'" << endl;
+			error = true;
+			continue;
+		}
+
+		float m[12];
+		unsigned int k = 0;
+		while (k < 12 && str >> m[k])
+			k++;
+		if (k < 12) {
+			cerr << "Scene line " << line << ": instance needs a 3x4 matrix (12 values)" << endl;
+			error = true;
+			continue;
+		}
+
+		// Matrix4f je ulozena po sloupcich
+		Matrix4f transform;
+		transform.Identity();
+		for (unsigned int r = 0; r < 3; r++) {
+			for (unsigned int c = 0; c < 4; c++)
+				transform[c][r] = m[r * 4 + c];
+		}
+
+		ModelPrototype*& prototype = prototypes[path];
+		if (prototype == NULL)
+			prototype = new ModelPrototype(new WaveFrontModel(path));
+
+		addModel(new InstancedModel(prototype, transform));
+	}
+
+	cout << "Scene '" << filename << "': " << models.size() << " models, " << prototypes.size() << " instanced files" << endl;
+	return !error;
+}
+
+
 /**
  * Prida do sceny novy objekt a vraci jeho index
  */
@@ -70,88 +315,701 @@ int ModelContainer::addModel(Model *m) {
  */
 void ModelContainer::removeModel(int i) {
 	needRefresh = true;
+	needRebuild = true;
 	delete models[i];
 	models.erase( models.begin() + i );
 }
 
 
 /**
- * Naplni vnitrni promenne pro pocty a pole vrcholu/indexu aktualnimi hodnotami
+ * Nova hodnota se projevi pri pristim dotazu na data sceny - modely se rozdeli znovu
+ * (jemnejsi uroven deli uz rozdelene patche, ty prevezmou energii rodice)
+ */
+void ModelContainer::setMaxPatchArea(double area) {
+	if (area != maxPatchArea)
+		needRefresh = true;
+	maxPatchArea = area;
+}
+
+double ModelContainer::getMaxPatchArea() const {
+	return maxPatchArea;
+}
+
+
+/**
+ * Naplni vnitrni promenne pro pocty a pole vrcholu/indexu aktualnimi hodnotami.
+ * Nejdriv se zjisti presne pocty patchu, potom se vysledna pole naplni primo (paralelne).
+ * Pokud se od posledni aktualizace modely jen pridavaly, pripoji se na konec pouze data novych modelu
+ * a vsechny dalsi kroky (hierarchie, shluky, umisteni, sousede, svareni) zpracuji jen nove patche
  */
 void ModelContainer::updateData() {	
 
-	// seskladat data z jednotlivych modelu do jedineho (pomocneho) vektoru
-	vector<float>* tmpVertices = new vector<float>();
-	vector<int>* tmpIndices = new vector<int>();
-	vector<Patch*>* tmpPatches = new vector<Patch*>();
+	// dulezitost patchu plati jen pro dosavadni patche
+	importance = NULL;
+
+	// zmena maximalniho obsahu se tyka vsech modelu
+	if (maxPatchArea != updatedPatchArea || spatialOrder != updatedSpatialOrder)
+		needRebuild = true;
+
+	// prvni model, jehoz data se budou do poli vkladat
+	unsigned int firstModel = needRebuild ? 0 : updatedModels;
+	unsigned int oldCount = needRebuild ? 0 : patchesCount;
+
+	// 1. pruchod - ziskat patche (pripadne je rozdelit) a spocitat presne pocty
+	vector<vector<Patch*>*> modelPatches;
+	modelPatches.reserve(models.size() - firstModel);
+
+	unsigned int newCount = oldCount;
+	for (unsigned int m = firstModel; m < models.size(); m++) {
+		vector<Patch*>* p = models[m]->getPatches( maxPatchArea );
+		if (spatialOrder)
+			models[m]->sortPatches();	// vrcholy, indexy, BVH i shluky se pak staveji uz v novem poradi
+		modelPatches.push_back(p);
+		newCount += p->size();
+	}
+
+	// pri prestavbe staci presna velikost, pri pripojovani se vyplati rezerva pro dalsi modely
+	reservePatches(newCount, needRebuild);
+
+	// zkopirovat ukazatele na patche za uz existujici data
+	unsigned int offset = oldCount;
+	for (unsigned int m = 0; m < modelPatches.size(); m++) {
+		copy(modelPatches[m]->begin(), modelPatches[m]->end(), patches + offset);
+		offset += modelPatches[m]->size();
+	}
+
+	// 2. pruchod - vyplnit vrcholy a indexy novych patchu
+	fillPatchData(oldCount, newCount);
 
 	// nove pocty vrcholu, indexu a patchu
-	verticesCount = 0;
-	indicesCount = 0;
-	patchesCount = 0;
+	patchesCount = newCount;
+	verticesCount = patchesCount * 4 * 3; // ctvercove plosky = 4 vrcholy * 3 souradnice
+	indicesCount = patchesCount * 6; // ploska = dva trojuhelniky = 6 indexu
+
+	updatedModels = models.size();
+	updatedPatchArea = maxPatchArea;
+	updatedSpatialOrder = spatialOrder;
+	needRebuild = false;
+	needRefresh = false;
+	sceneId = ++lastSceneId;
+
+	// stromy modelu uz existuji (a instance sdileji strom predlohy), znovu se stavi jen horni uroven
+	buildBvh(firstModel);
+
+	// kvadry pro orezavani pohledu z patchu
+	buildClusters(oldCount);
+
+	// useky novych patchu do pameti NUMA uzlu (podle shluku); pred doplnenim sousedu, ti pak uz ukazuji na kopie
+	placePatches(oldCount);
 
-	int offset = 0; // pocet jiz vlozenych floatu - pro spravne provazani indexu a vrcholu
-
-	for (vector<Model*>::iterator it = models.begin(); it != models.end(); it++) {		
-		vector<Patch*>* patches = (*it)->getPatches( maxPatchArea );
-
-		int ptchCnt = patches->size();
-		patchesCount += ptchCnt;
-		verticesCount += ptchCnt * 4 * 3; // ctvercove plosky = 4 vrcholy * 3 souradnice		
-		indicesCount += ptchCnt * 6; // ploska = dva trojuhelniky = 6 indexu
-		
-		for (vector<Patch*>::iterator itP = patches->begin(); itP != patches->end(); itP++) {
-			
-			// zkopirovat souradnice
-			vector<float> vCoords = (*itP)->getVerticesCoords();
-			tmpVertices->insert(tmpVertices->end(), vCoords.begin(), vCoords.end());
-						
-			int baseOffset = offset;
-
-			// vytvorit indexy
-			tmpIndices->push_back(baseOffset);
-			tmpIndices->push_back(baseOffset + 1);
-			tmpIndices->push_back(baseOffset + 2);
-			tmpIndices->push_back(baseOffset);
-			tmpIndices->push_back(baseOffset + 2);
-			tmpIndices->push_back(baseOffset + 3);
-
-			// overit, zda existuji sousedi
-			for (unsigned j = 0; j < 8; j++) {
-				if ((*itP)->neighbours[j] == NULL) // osetreni pro nacitani, kde jsou patche jiz rozdelene a sousedy znaji
-					(*itP)->neighbours[j] = (*itP);
+	// sousedy zna jen patch vznikly delenim uvnitr jedne puvodni plosky; doplnit je i pres hranice plosek a modelu
+	buildNeighbours(oldCount);
+
+	// sousedni patche sdileji rohy - pro kresleni pohledu z patchu staci kazdy vrchol jednou
+	weldVertices(oldCount);
+}
+
+
+/**
+ * Patche kazdeho modelu rozdeli na souvisle useky po 'clusterSize' - patche vznikle delenim jedne
+ * plosky jsou v poli za sebou, useky jsou tedy prostorove kompaktni a kresli se jedinym rozsahem indexu.
+ * Shluky modelu zacinajicich pred 'from' zustanou, pripoji se jen shluky dalsich modelu
+ */
+void ModelContainer::buildClusters(unsigned int from, unsigned int clusterSize) {
+	if (from == 0) {
+		clusters.clear();
+		clusterGroups.clear();
+	}
+
+	unsigned int firstCluster = clusters.size();
+	unsigned int firstGroup = clusterGroups.size();
+
+	// instance hierarchie odpovidaji modelum ve stejnem poradi
+	const vector<SceneBvh::Instance>& instances = bvh.getInstances();
+	for (unsigned int m = 0; m < instances.size(); m++) {
+		if (instances[m].firstPatch < from)
+			continue;
+
+		ClusterGroup group;
+		group.from = clusters.size();
+
+		unsigned int modelEnd = (m + 1 < instances.size()) ? instances[m + 1].firstPatch : patchesCount;
+		for (unsigned int first = instances[m].firstPatch; first < modelEnd; first += clusterSize) {
+			PatchCluster c;
+			c.from = first;
+			c.to = min(first + clusterSize, modelEnd);
+			clusters.push_back(c);
+		}
+
+		group.to = clusters.size();
+		if (group.to > group.from)
+			clusterGroups.push_back(group);
+	}
+
+	int count = int(clusters.size());
+
+	#pragma omp parallel for
+	for (int c = int(firstCluster); c < count; c++) {
+		for (unsigned int i = clusters[c].from; i < clusters[c].to; i++) {
+			const Vector3f* vertices = patches[i]->getVertices();
+			for (unsigned int v = 0; v < 4; v++)
+				clusters[c].box.extend(vertices[v]);
+		}
+	}
+
+	for (unsigned int g = firstGroup; g < clusterGroups.size(); g++) {
+		for (unsigned int c = clusterGroups[g].from; c < clusterGroups[g].to; c++)
+			clusterGroups[g].box.extend(clusters[c].box);
+	}
+}
+
+
+/**
+ * Model cely mimo teleso se preskoci, model cely uvnitr se prijme bez testovani jeho shluku
+ */
+void ModelContainer::cullClusters(const Frustum& frustum, vector<unsigned int>& visible) {
+	visible.clear();
+
+	for (unsigned int g = 0; g < clusterGroups.size(); g++) {
+		const ClusterGroup& group = clusterGroups[g];
+
+		int groupResult = frustum.classify(group.box);
+		if (groupResult == Frustum::OUTSIDE)
+			continue;
+
+		for (unsigned int c = group.from; c < group.to; c++) {
+			if (groupResult == Frustum::INSIDE || frustum.classify(clusters[c].box) != Frustum::OUTSIDE)
+				visible.push_back(c);
+		}
+	}
+}
+
+
+const vector<ModelContainer::PatchCluster>& ModelContainer::getClusters() {
+	return clusters;
+}
+
+
+/**
+ * Rozdeli patche <from, patchesCount) na souvisle useky po hranicich shluku (prostorove kompaktni oblasti),
+ * jeden na NUMA uzel, a kazdy usek zkopiruje (i s geometrii) do aren sveho uzlu. Kopiruji vlakna pripnuta k uzlu,
+ * stranky se jim tedy pridelí lokalne. Staticky rozdelene paralelni smycky pres patche (a vlakna vypoctu pripnuta
+ * stejne) pak pracuji hlavne s pameti sveho uzlu. Ukazatele v poli sceny, ve vektorech modelu a mezi sousedy se
+ * prepisou na kopie - volat pred buildNeighbours, dokud nove patche odkazuji jen na patche sveho modelu.
+ * Drive umistene patche zustavaji na miste. Patche instanci zustavaji v bloku sve instance (soused se
+ * dopocitava z pozice v bloku), jejich geometrie je sdilena
+ */
+void ModelContainer::placePatches(unsigned int from) {
+	unsigned int nodes = NumaArena::getNodeCount();
+	if (nodes <= 1 || from >= patchesCount)
+		return;
+
+	unsigned int count = patchesCount - from;
+
+	// hranice useku - prvni hranice shluku za rovnomernym delenim
+	vector<unsigned int> ranges(nodes + 1, patchesCount);
+	ranges[0] = from;
+	unsigned int c = 0;
+	while (c < clusters.size() && clusters[c].from < from)
+		c++;
+	for (unsigned int n = 1; n < nodes; n++) {
+		unsigned int target = from + (unsigned int)((unsigned long long)count * n / nodes);
+		while (c < clusters.size() && clusters[c].from < target)
+			c++;
+		ranges[n] = (c < clusters.size()) ? clusters[c].from : patchesCount;
+	}
+
+	// poradi presouvanych patchu v arene useku; arena se uvolni se smazanim posledni polozky, musi jich byt presne tolik
+	vector<unsigned int> slots(count, ~0u);
+	vector<unsigned int> movable(nodes, 0);
+	for (unsigned int n = 0; n < nodes; n++) {
+		for (unsigned int i = ranges[n]; i < ranges[n + 1]; i++) {
+			if (!patches[i]->isInstance())
+				slots[i - from] = movable[n]++;
+		}
+	}
+
+	// usek, pro ktery se areny nepodari alokovat, zustane na halde
+	vector<NumaArena*> arenas(nodes, (NumaArena*)NULL);
+	vector<NumaArena*> shapeArenas(nodes, (NumaArena*)NULL);
+	for (unsigned int n = 0; n < nodes; n++) {
+		if (movable[n] == 0)
+			continue;
+
+		arenas[n] = NumaArena::create(n, movable[n], sizeof(Patch));
+		shapeArenas[n] = NumaArena::create(n, movable[n], sizeof(PatchShape));
+		if (arenas[n] == NULL || shapeArenas[n] == NULL) {
+			cerr << "Unable to allocate patches on NUMA node " << n << endl;
+			NumaArena::discard(arenas[n]);
+			NumaArena::discard(shapeArenas[n]);
+			arenas[n] = NULL;
+			shapeArenas[n] = NULL;
+		}
+	}
+
+	// placed[i - from] je nove misto patche i
+	Patch** placed = new Patch*[count];
+	copy(patches + from, patches + patchesCount, placed);
+
+	#pragma omp parallel
+	{
+#ifdef _OPENMP
+		unsigned int t = omp_get_thread_num();
+		unsigned int threads = omp_get_num_threads();
+#else
+		unsigned int t = 0;
+		unsigned int threads = 1;
+#endif
+		DWORD_PTR previousMask = NumaArena::pinThread(t, threads);
+
+		for (unsigned int n = 0; n < nodes; n++) {
+			if (arenas[n] == NULL)
+				continue;
+
+			// vlakna uzlu n jsou <first, end); uzel bez vlaken zkopiruje jedno vlakno (aspon s preferenci uzlu z alokace)
+			unsigned int first = (unsigned int)(((unsigned long long)n * threads + nodes - 1) / nodes);
+			unsigned int end = (unsigned int)(((unsigned long long)(n + 1) * threads + nodes - 1) / nodes);
+			if (first == end) {
+				first = n % threads;
+				end = first + 1;
 			}
+			if (t < first || t >= end)
+				continue;
 
-			// zkopirovat patch
-			tmpPatches->push_back((*itP));
+			unsigned int length = ranges[n + 1] - ranges[n];
+			unsigned int begin = ranges[n] + (unsigned int)((unsigned long long)length * (t - first) / (end - first));
+			unsigned int to = ranges[n] + (unsigned int)((unsigned long long)length * (t - first + 1) / (end - first));
 
-			offset += 4;
-		}		
-	}		
+			for (unsigned int i = begin; i < to; i++) {
+				unsigned int slot = slots[i - from];
+				if (slot != ~0u)
+					placed[i - from] = new (arenas[n]->getItem(slot)) Patch(*patches[i], shapeArenas[n]->getItem(slot));
+			}
+		}
 
-	// obnovit pole vrcholu, indexu a patchu
-	if (vertices != NULL)
-		delete [] vertices;
-	vertices = new float[verticesCount];
+		NumaArena::unpinThread(previousMask);
+	}
 
-	if (indices != NULL)
-		delete [] indices;
-	indices = new int[indicesCount];
+	// sousede (zatim jen v ramci modelu, tedy mezi novymi patchi) - puvodni ukazatele serazene s cisly patchu
+	vector<pair<Patch*, unsigned int> > order(count);
+	for (unsigned int i = 0; i < count; i++)
+		order[i] = make_pair(patches[from + i], i);
+	sort(order.begin(), order.end());
 
-	if (patches != NULL)
-		delete [] patches;
-	patches = new Patch*[patchesCount];
+	#pragma omp parallel for
+	for (int i = 0; i < int(count); i++) {
+		for (unsigned int j = 0; j < 8; j++) {
+			vector<pair<Patch*, unsigned int> >::iterator it = lower_bound(order.begin(), order.end(), make_pair(placed[i]->getNeighbour(j), 0u));
+			if (it != order.end() && it->first == placed[i]->getNeighbour(j))
+				placed[i]->setNeighbour(j, placed[it->second]);
+		}
+	}
 
-	// presunout data z pomocneho vektoru do pole
-	copy(tmpVertices->begin(), tmpVertices->end(), vertices);
-	copy(tmpIndices->begin(), tmpIndices->end(), indices);
-	copy(tmpPatches->begin(), tmpPatches->end(), patches);
-	
-	delete tmpVertices;
-	delete tmpIndices;
-	delete tmpPatches;
+	// modely maji patche ve stejnem poradi jako scena; upravi se jen modely v novem useku
+	unsigned int offset = 0;
+	for (unsigned int m = 0; m < models.size(); m++) {
+		vector<Patch*>* modelPatches = models[m]->getCurrentPatches();
+		if (offset >= from) {
+			for (unsigned int k = 0; k < modelPatches->size(); k++)
+				modelPatches->at(k) = placed[offset - from + k];
+		}
+		offset += modelPatches->size();
+	}
 
-	needRefresh = false;
+	// puvodni patche uz nikdo neodkazuje
+	for (unsigned int i = 0; i < count; i++) {
+		if (placed[i] != patches[from + i])
+			delete patches[from + i];
+	}
+
+	copy(placed, placed + count, patches + from);
+	delete [] placed;
+
+	cout << "     NUMA nodes: " << nodes << ", placed patches per node:";
+	for (unsigned int n = 0; n < nodes; n++)
+		cout << " " << ranges[n + 1] - ranges[n];
+	cout << endl;
+}
+
+
+/**
+ * Sestavi dvouurovnovou hierarchii - kazdy model prispeje svym stromem a transformaci,
+ * patche modelu jsou v poli sceny za sebou ve stejnem poradi jako ve stromu. Instance modelu pred
+ * 'firstModel' uz v hierarchii jsou, pridaji se jen dalsi modely a znovu se postavi horni uroven
+ */
+void ModelContainer::buildBvh(unsigned int firstModel) {
+	if (firstModel == 0)
+		bvh.clear();
+
+	unsigned int firstPatch = 0;
+	for (unsigned int m = 0; m < firstModel; m++)
+		firstPatch += models[m]->getCurrentPatches()->size();
+
+	for (unsigned int m = firstModel; m < models.size(); m++) {
+		vector<Patch*>* local;
+		Matrix4f transform;
+		bool identity;
+		const Bvh* modelBvh = models[m]->getBvh(local, transform, identity);
+
+		bvh.addInstance(modelBvh, local->empty() ? NULL : &(*local)[0], transform, identity, firstPatch);
+		firstPatch += local->size();
+	}
+
+	bvh.build();
+}
+
+
+const SceneBvh& ModelContainer::getBvh() {
+	return bvh;
+}
+
+
+/**
+ * Sloucit vrcholy patchu blizsi nez 'quantum' (podil uhlopricky sceny; porovnava se i se sousednimi bunkami
+ * mrizky, takze se nerozdeli temer shodne vrcholy na hranici bunky) a vytvorit indexovanou
+ * sit, ve ktere se kazdy sdileny roh transformuje jen jednou. Aby sla kreslit s barvou podle ID patche
+ * (flat interpolace, barva z posledniho vrcholu trojuhelniku), ma kazdy patch svuj "provokujici" vrchol,
+ * kterym oba jeho trojuhelniky konci a ktery nepatri zadnemu jinemu patchi. V pravidelne mrizce je to
+ * pravy horni roh; pri kolizi se zkusi ostatni rohy a teprve nakonec se vrchol zduplikuje.
+ * Patche <from, patchesCount) se svari jen mezi sebou a jejich vrcholy se pripoji za drivejsi - rohy na
+ * hranici s drivejsimi modely se tak zopakuji, ale drivejsi indexy ani provokujici vrcholy se nemeni
+ */
+void ModelContainer::weldVertices(unsigned int from, float relativeQuantum) {
+	if (from == 0)
+		weldedVerticesCount = 0;
+
+	// cislo svareneho vrcholu pro kazdy roh kazdeho noveho patche
+	int corners = int((patchesCount - from) * 4);
+	const float* source = vertices + from * 4 * 3;
+	vector<Vector3f> points(corners);
+	#pragma omp parallel for
+	for (int i = 0; i < corners; i++)
+		points[i] = Vector3f(source[i * 3], source[i * 3 + 1], source[i * 3 + 2]);
+
+	vector<unsigned int> ids;
+	unsigned int mergedCount = mergeVertices(points, sceneQuantum(clusterGroups, relativeQuantum), ids);
+
+	// svareny vrchol ma souradnice sveho korene (prvniho rohu s danym cislem)
+	int base = int(weldedVerticesCount / 3);
+	vector<int> cornerIds(corners);
+	vector<float> welded;
+	welded.reserve(mergedCount * 3 + 12);
+
+	for (int i = 0; i < corners; i++) {
+		cornerIds[i] = base + int(ids[i]);
+		if (ids[i] == welded.size() / 3) {
+			welded.push_back(points[i].x);
+			welded.push_back(points[i].y);
+			welded.push_back(points[i].z);
+		}
+	}
+
+	// priradit kazdemu patchi vlastni provokujici vrchol; poradi rohu: pravy horni, levy horni, levy dolni, pravy dolni
+	static const unsigned int cornerOrder[4] = { 2, 3, 0, 1 };
+	vector<bool> owned(welded.size() / 3, false);
+
+	for (unsigned int i = from; i < patchesCount; i++) {
+		int* c = &cornerIds[(i - from) * 4];
+
+		int k = -1;
+		for (unsigned int o = 0; o < 4 && k < 0; o++) {
+			if (!owned[c[cornerOrder[o]] - base])
+				k = cornerOrder[o];
+		}
+
+		// vsechny rohy uz nekomu patri - zduplikovat pravy horni
+		if (k < 0) {
+			k = 2;
+			const float* v = vertices + (i * 4 + k) * 3;
+			c[k] = base + int(welded.size() / 3);
+			welded.push_back(v[0]);
+			welded.push_back(v[1]);
+			welded.push_back(v[2]);
+			owned.push_back(false);
+		}
+
+		owned[c[k] - base] = true;
+		provokingVertices[i] = c[k];
+
+		// ctyruhelnik se rozdeli uhloprickou z rohu k, oba trojuhelniky konci v k (zachovava orientaci)
+		int* ind = weldedIndices + i * 6;
+		ind[0] = c[(k + 1) % 4];
+		ind[1] = c[(k + 2) % 4];
+		ind[2] = c[k];
+		ind[3] = c[(k + 2) % 4];
+		ind[4] = c[(k + 3) % 4];
+		ind[5] = c[k];
+	}
+
+	// pole svarenych vrcholu roste s rezervou jako pole patchu, drivejsi vrcholy zustanou
+	unsigned int count = weldedVerticesCount + welded.size();
+	if (count > weldedCapacity) {
+		unsigned int capacity = (from == 0) ? count : max(count, weldedCapacity * 2);
+		float* newWelded = new float[capacity];
+		copy(weldedVertices, weldedVertices + weldedVerticesCount, newWelded);
+		delete [] weldedVertices;
+		weldedVertices = newWelded;
+		weldedCapacity = capacity;
+	}
+
+	copy(welded.begin(), welded.end(), weldedVertices + weldedVerticesCount);
+	weldedVerticesCount = count;
+}
+
+
+/**
+ * Doplni sousedy patchu, kteri dosud ukazuji sami na sebe (hranice puvodnich plosek, nerozdelene
+ * plosky z OBJ, hranice mezi modely). Vrcholy blizsi nez 'quantum' (podil uhlopricky sceny) se slouci
+ * (mrizka s probiranim sousednich bunek) a hrany i vrcholy se hashuji, takze cele hledani je linearni. Za souseda se bere jen patch, jehoz normala svira
+ * s normalou patche uhel s kosinem alespon 'minCosAngle' - pres ostre hrany se nevyhlazuje.
+ * Pri pripojeni modelu (from > 0) se berou jen nove patche a drivejsi patche ze shluku, ktere se kvadrem
+ * dotykaji novych shluku - jen ty mohou s novymi patchi sdilet hranu nebo roh.
+ * Lze volat kdykoliv po updateData (po nacteni, deleni i rekonstrukci z LoadingModel)
+ */
+void ModelContainer::buildNeighbours(unsigned int from, float relativeQuantum, float minCosAngle) {
+	if (from >= patchesCount)
+		return;
+
+	float quantum = sceneQuantum(clusterGroups, relativeQuantum);
+
+	// zpracovavane patche (cisla ve scene) - drivejsi patche v dosahu novych, pak vsechny nove
+	vector<unsigned int> candidates;
+	if (from > 0) {
+		unsigned int firstNew = 0;
+		while (firstNew < clusters.size() && clusters[firstNew].from < from)
+			firstNew++;
+
+		Aabb added;
+		for (unsigned int c = firstNew; c < clusters.size(); c++)
+			added.extend(clusters[c].box);
+
+		for (unsigned int c = 0; c < firstNew; c++) {
+			if (!boxesOverlap(clusters[c].box, added, quantum))
+				continue;
+
+			for (unsigned int i = clusters[c].from; i < clusters[c].to; i++)
+				candidates.push_back(i);
+		}
+	}
+	candidates.reserve(candidates.size() + patchesCount - from);
+	for (unsigned int i = from; i < patchesCount; i++)
+		candidates.push_back(i);
+
+	int count = int(candidates.size());
+
+	// jednotkove normaly a vrcholy zpracovavanych patchu
+	vector<Vector3f> normals(count);
+	vector<Vector3f> points(count * 4);
+
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++) {
+		Patch* p = patches[candidates[i]];
+		Vector3f n = p->getNormal();
+		if (n.f_Length2() > 0)
+			n.Normalize();
+		normals[i] = n;
+
+		const Vector3f* vertices = p->getVertices();
+		for (unsigned int v = 0; v < 4; v++)
+			points[i * 4 + v] = vertices[v];
+	}
+
+	// cisla sloucenych vrcholu
+	vector<unsigned int> keys;
+	unsigned int mergedCount = mergeVertices(points, quantum, keys);
+
+	// hashovaci tabulky hran a vrcholu; hodnotou je prvni zaznam spojoveho seznamu
+	unordered_map<EdgeKey, int, EdgeKeyHash> edgeHeads;
+	vector<int> vertexHeads(mergedCount, -1);
+	edgeHeads.reserve(count * 4);
+
+	vector<AdjacencyRecord> edgeRecords;
+	vector<AdjacencyRecord> vertexRecords;
+	edgeRecords.reserve(count * 4);
+	vertexRecords.reserve(count * 4);
+
+	for (int i = 0; i < count; i++) {
+		for (unsigned int v = 0; v < 4; v++) {
+			unsigned int a = keys[i * 4 + v];
+			unsigned int b = keys[i * 4 + (v + 1) % 4];
+
+			// vrchol (u degenerovanych ctyruhelniku z trojuhelniku se opakuje, staci jednou)
+			if (v == 0 || a != keys[i * 4 + v - 1]) {
+				AdjacencyRecord r = { unsigned(i), v, vertexHeads[a] };
+				vertexRecords.push_back(r);
+				vertexHeads[a] = int(vertexRecords.size()) - 1;
+			}
+
+			// hrana (degenerovane hrany nulove delky preskocit)
+			if (a != b) {
+				EdgeKey e = makeEdgeKey(a, b);
+				AdjacencyRecord r = { unsigned(i), v, -1 };
+				unordered_map<EdgeKey, int, EdgeKeyHash>::iterator it = edgeHeads.find(e);
+				if (it != edgeHeads.end())
+					r.next = it->second;
+				edgeRecords.push_back(r);
+				edgeHeads[e] = int(edgeRecords.size()) - 1;
+			}
+		}
+	}
+
+	// doplnit sousedy; kazdy patch zapisuje jen do sveho pole sousedu, tabulky se uz jen ctou
+	#pragma omp parallel for
+	for (int i = 0; i < count; i++) {
+		Patch* p = patches[candidates[i]];
+
+		// patch instance ma sousedy dane predlohou
+		if (p->isInstance())
+			continue;
+
+		// sousede pres hrany
+		for (unsigned int v = 0; v < 4; v++) {
+			unsigned int slot = edgeNeighbourSlot[v];
+			if (p->getNeighbour(slot) != p && p->getNeighbour(slot) != NULL)
+				continue;
+
+			unsigned int a = keys[i * 4 + v];
+			unsigned int b = keys[i * 4 + (v + 1) % 4];
+			if (a == b)
+				continue;
+
+			unordered_map<EdgeKey, int, EdgeKeyHash>::const_iterator it = edgeHeads.find(makeEdgeKey(a, b));
+			if (it == edgeHeads.end())
+				continue;
+
+			Patch* best = NULL;
+			float bestCos = minCosAngle;
+			for (int r = it->second; r >= 0; r = edgeRecords[r].next) {
+				unsigned int q = edgeRecords[r].patch;
+				float c = normals[i].f_Dot(normals[q]);
+				if (q != unsigned(i) && c >= bestCos) {
+					best = patches[candidates[q]];
+					bestCos = c;
+				}
+			}
+
+			if (best != NULL)
+				p->setNeighbour(slot, best);
+		}
+
+		// sousede pres rohy - patch, ktery sdili roh, ale neni sousedem pres zadnou z obou hran u rohu
+		for (unsigned int v = 0; v < 4; v++) {
+			unsigned int slot = cornerNeighbourSlot[v];
+			if (p->getNeighbour(slot) != p && p->getNeighbour(slot) != NULL)
+				continue;
+
+			Patch* edgeA = p->getNeighbour(edgeNeighbourSlot[v]);			// hrana vychazejici z rohu
+			Patch* edgeB = p->getNeighbour(edgeNeighbourSlot[(v + 3) % 4]);	// hrana vchazejici do rohu
+
+			Patch* best = NULL;
+			float bestCos = minCosAngle;
+			for (int r = vertexHeads[keys[i * 4 + v]]; r >= 0; r = vertexRecords[r].next) {
+				unsigned int q = vertexRecords[r].patch;
+				Patch* candidate = patches[candidates[q]];
+				if (q == unsigned(i) || candidate == edgeA || candidate == edgeB)
+					continue;
+
+				float c = normals[i].f_Dot(normals[q]);
+				if (c >= bestCos) {
+					best = candidate;
+					bestCos = c;
+				}
+			}
+
+			if (best != NULL)
+				p->setNeighbour(slot, best);
+		}
+	}
+}
+
+
+/**
+ * Zajisti, aby pole patchu, vrcholu a indexu (i svarenych) pojmula 'count' patchu. Prvnich patchesCount
+ * zaznamu zustane zachovano. Pokud neni 'exact', alokuje se s rezervou (zdvojnasobenim)
+ */
+void ModelContainer::reservePatches(unsigned int count, bool exact) {
+	if (count <= patchesCapacity)
+		return;
+
+	unsigned int capacity = count;
+	if (!exact)
+		capacity = max(count, patchesCapacity * 2);
+
+	// pri prestavbe se stary obsah nepouzije
+	unsigned int keep = exact ? 0 : min(patchesCount, count);
+
+	Patch** newPatches = new Patch*[capacity];
+	float* newVertices = new float[capacity * 4 * 3];
+	int* newIndices = new int[capacity * 6];
+	int* newWeldedIndices = new int[capacity * 6];
+	unsigned int* newProvoking = new unsigned int[capacity];
+
+	if (keep > 0) {
+		copy(patches, patches + keep, newPatches);
+		copy(vertices, vertices + keep * 4 * 3, newVertices);
+		copy(indices, indices + keep * 6, newIndices);
+		copy(weldedIndices, weldedIndices + keep * 6, newWeldedIndices);
+		copy(provokingVertices, provokingVertices + keep, newProvoking);
+	}
+
+	delete [] patches;
+	delete [] vertices;
+	delete [] indices;
+	delete [] weldedIndices;
+	delete [] provokingVertices;
+
+	patches = newPatches;
+	vertices = newVertices;
+	indices = newIndices;
+	weldedIndices = newWeldedIndices;
+	provokingVertices = newProvoking;
+	patchesCapacity = capacity;
+}
+
+
+/**
+ * Naplni vrcholy a indexy patchu s cisly <from, to); kazdy patch zapisuje jen do svych
+ * 12 floatu a 6 indexu, proto lze pole plnit paralelne
+ */
+void ModelContainer::fillPatchData(unsigned int from, unsigned int to) {
+	int n_from = int(from);
+	int n_to = int(to);
+
+	#pragma omp parallel for
+	for (int i = n_from; i < n_to; i++) {
+		Patch* p = patches[i];
+
+		// zkopirovat souradnice
+		p->getVerticesCoords(vertices + i * 4 * 3);
+
+		// vytvorit indexy
+		int baseOffset = i * 4;
+		int* ind = indices + i * 6;
+		ind[0] = baseOffset;
+		ind[1] = baseOffset + 1;
+		ind[2] = baseOffset + 2;
+		ind[3] = baseOffset;
+		ind[4] = baseOffset + 2;
+		ind[5] = baseOffset + 3;
+
+		// overit, zda existuji sousedi
+		for (unsigned j = 0; j < 8; j++) {
+			if (p->getNeighbour(j) == NULL) // osetreni pro nacitani, kde jsou patche jiz rozdelene a sousedy znaji
+				p->setNeighbour(j, p);
+		}
+	}
+}
+
+
+/**
+ * Cislo sestaveni se meni s kazdou zmenou patchu (nova scena, pridani modelu, deleni) - hodnoty
+ * spocitane po patchich (dulezitost, sber) podle nej poznaji, ze patri jine scene
+ */
+unsigned int ModelContainer::getSceneId() {
+	if (needRefresh == true)
+		updateData();
+
+	return sceneId;
 }
 
 
@@ -195,6 +1053,46 @@ unsigned int ModelContainer::getVerticesCount() {
 	return verticesCount;
 }
 
+/**
+ * Vraci ukazatel na prvni prvek pole svarenych vrcholu
+ */
+float* ModelContainer::getWeldedVertices() {
+	if (needRefresh == true)
+		updateData();
+
+	return weldedVertices;
+}
+
+/**
+ * Vraci pocet hodnot v poli svarenych vrcholu
+ */
+unsigned int ModelContainer::getWeldedVerticesCount() {
+	if (needRefresh == true)
+		updateData();
+
+	return weldedVerticesCount;
+}
+
+/**
+ * Vraci ukazatel na prvni prvek pole indexu do svarenych vrcholu (delka getIndicesCount)
+ */
+int* ModelContainer::getWeldedIndices() {
+	if (needRefresh == true)
+		updateData();
+
+	return weldedIndices;
+}
+
+/**
+ * Vraci pole o delce patchesCount s cislem provokujiciho svareneho vrcholu kazdeho patche
+ */
+unsigned int* ModelContainer::getProvokingVertices() {
+	if (needRefresh == true)
+		updateData();
+
+	return provokingVertices;
+}
+
 /**
  * Vraci pole ukazatelu na patche o delce patchesCount
  */
@@ -247,12 +1145,35 @@ bool ModelContainer::compareEnergies(unsigned int a, unsigned int b) {
 
 class Comparator {
 	public:
-		Patch** patches;
+		ModelContainer* scene;
 		bool Comparator::operator()(unsigned int a, unsigned int b) { 
-			return patches[a]->radiosity.f_Length2() < patches[b]->radiosity.f_Length2();
+			return scene->getPriority(a) < scene->getPriority(b);
 		}
 };
 
+
+/**
+ * Nastavi dulezitost patchu (Importance) - zdroje se pak vybiraji podle energie * dulezitosti. Pole musi
+ * mit getPatchesCount() prvku a zit, dokud se nenastavi jine
+ */
+void ModelContainer::setImportance(const float* weights) {
+	importance = weights;
+}
+
+
+/**
+ * Priorita je ctverec velikosti radiativni energie, s dulezitosti vynasobeny ctvercem (dulezitost + IMPORTANCE_FLOOR) -
+ * i energie patchu, ktere z pohledu nikam nevedou, se nakonec vyzari
+ */
+float ModelContainer::getPriority(unsigned int i) {
+	float priority = patches[i]->radiosity.f_Length2();
+	if (importance != NULL) {
+		float w = importance[i] + IMPORTANCE_FLOOR;
+		priority *= w * w;
+	}
+	return priority;
+}
+
 /**
  * Naplni pole ID a ukazatelu daty 'count' patchu s nejvetsi energii
  */
@@ -262,12 +1183,12 @@ void ModelContainer::getHighestRadiosityPatchesId(unsigned int count, Patch** p_
 
 	list<unsigned int> tops;
 	Comparator c = Comparator();
-	c.patches = patches;
+	c.scene = this;
 	
 	for (unsigned int pi = 0; pi < patchesCount; pi++) {
 		if (
 			tops.empty() || 
-			(patches[pi]->radiosity.f_Length2() > 0 && patches[tops.back()]->radiosity.f_Length2() <= patches[pi]->radiosity.f_Length2()) 
+			(patches[pi]->radiosity.f_Length2() > 0 && getPriority(tops.back()) <= getPriority(pi)) 
 		) {
 			tops.push_back(pi);
 			tops.sort(c);
@@ -1,8 +1,15 @@
+#pragma once
+
 #include <vector>
 #include <stdint.h>
 #include <list>
+#include <algorithm>
 #include "PrimitiveModel.h"
 #include "WaveFrontModel.h"
+#include "InstancedModel.h"
+#include "SceneBvh.h"
+#include "Frustum.h"
+#include "NumaArena.h"
 #include "Vector.h"
 #include "Timer.h"
 
@@ -11,14 +18,34 @@ using namespace std;
 class ModelContainer {
 	
 	public:
+		// souvisly usek patchu sceny (v ramci jednoho modelu) s obalovym kvadrem - jednotka orezavani pri kresleni
+		struct PatchCluster {
+			unsigned int from, to;	// patche <from, to)
+			Aabb box;
+		};
+
+		// shluky jednoho modelu - kvadr modelu se testuje driv nez jeho shluky
+		struct ClusterGroup {
+			unsigned int from, to;	// shluky <from, to)
+			Aabb box;
+		};
+
 		ModelContainer(void);
 		~ModelContainer(void);
 
 		void load();	// pomocna funkce pro naplneni sceny; TODO: nahradit obecnym nacitanim + lepe OOP
+		bool load(const char* filename);	// naplni scenu modely a instancemi ze seznamu v souboru
 
 		int addModel(Model* m);	// prida model do sceny a vraci jeho index pro moznost pristupu
 		void removeModel(int i);	// odebere ze sceny model s danym indexem	
 		void updateData();	// naplni vnitrni promenne s vrcholy/idexy aktualnimi hodnotami
+		void buildNeighbours(unsigned int from = 0, float relativeQuantum = 1e-4f, float minCosAngle = 0.7f);	// doplni sousedy patchu <from, konec) pres hrany/rohy sdilene mezi puvodnimi ploskami i modely; krok slucovani je podil uhlopricky sceny
+		void weldVertices(unsigned int from = 0, float relativeQuantum = 1e-5f);	// sloucit shodne vrcholy patchu <from, konec) do kompaktni indexovane site; krok je podil uhlopricky sceny
+		void buildBvh(unsigned int firstModel = 0);	// sestavi dvouurovnovou hierarchii modelu pro dotazy na viditelnost; modely pred firstModel uz v ni jsou
+		void buildClusters(unsigned int from = 0, unsigned int clusterSize = 256);	// rozdeli patche modelu od patche 'from' na souvisle shluky a spocita jejich kvadry
+		void cullClusters(const Frustum& frustum, vector<unsigned int>& visible);	// vrati (vzestupne) cisla shluku, ktere mohou byt v pohledu videt
+		const vector<PatchCluster>& getClusters();
+		void placePatches(unsigned int from = 0);	// na NUMA pocitaci presune useky patchu <from, konec) do pameti uzlu, ktere je zpracovavaji
 
 		float*	getVertices();	// vraci pole vrcholu patchu
 		unsigned int	getVerticesCount();	// vraci delku pole vrcholu
@@ -26,29 +53,65 @@ class ModelContainer {
 		int*	getIndices();	// vraci pole vazeb mezi vrcholy
 		unsigned int	getIndicesCount();	// vraci delku pole vazeb
 
+		float*	getWeldedVertices();	// vraci pole svarenych (neopakujicich se) vrcholu
+		unsigned int	getWeldedVerticesCount();	// vraci delku pole svarenych vrcholu (pocet hodnot)
+		int*	getWeldedIndices();	// vraci indexy do svarenych vrcholu; 6 na patch, ve stejnem poradi jako getIndices
+		unsigned int*	getProvokingVertices();	// vraci pro kazdy patch cislo svareneho vrcholu, ze ktereho se bere jeho (flat) barva
+
+		const SceneBvh&	getBvh(); // vraci hierarchii sceny (cisla prvku = cisla patchu ve scene)
+
 		Patch**	getPatches(); // vraci pole vsech patchu ve scene (pokud je scena frozen, je vzdy konstantni)
 		unsigned int	getPatchesCount(); // vraci pocet patchu ve scene
+		unsigned int	getSceneId();	// cislo aktualniho sestaveni sceny; kazde sestaveni (i nove sceny) dostane jine, 0 = zadne
 		unsigned int	getHighestRadiosityPatchId(); // vraci cislo patche s nejvetsi radiativni energii
 		void			getHighestRadiosityPatchesId(unsigned int count, Patch** p_emitters, unsigned int* p_emitters_ids);
+		void			setImportance(const float* weights);	// dulezitost patchu pro vyber zdroju (po patchich sceny, <0, 1>); NULL = jen podle energie
+		float			getPriority(unsigned int i);	// priorita patche pri vyberu zdroju - energie (nasobena dulezitosti)
+
+		void setMaxPatchArea(double area);	// maximalni obsah plosek (pokud je vetsi nez 0, deli se plosky dokud neni plocha mensi); zmena scenu znovu rozdeli
+		double getMaxPatchArea() const;
 
-		double maxPatchArea; // maximalni obsah plosek (pokud je vetsi nez 0, deli se plosky dokud neni plocha mensi)
+		bool spatialOrder;	// patche modelu seradit podle polohy (Mortonova krivka), aby blizke patche lezely blizko v pameti
 
 		bool ModelContainer::operator()(unsigned int a, unsigned int b);
 
 	protected:		
 		bool compareEnergies(unsigned int a, unsigned int b);
 
+		void reservePatches(unsigned int count, bool exact);	// zajisti kapacitu poli pro 'count' patchu, dosavadni obsah zachova
+		void fillPatchData(unsigned int from, unsigned int to);	// paralelne naplni vrcholy/indexy patchu v intervalu <from, to)
+
 		bool needRefresh;	// pocty vrcholu a indexu a obsahy kontejneru nejsou aktualni
+		bool needRebuild;	// data je nutne sestavit znovu od zacatku (model byl odebran); jinak staci pripojit nove modely
+		unsigned int updatedModels;	// pocet modelu (od zacatku vektoru), jejichz data uz jsou v polich
+		double updatedPatchArea;	// maxPatchArea, se kterou byla data naposledy sestavena
+		bool updatedSpatialOrder;	// spatialOrder, se kterym byla data naposledy sestavena
+		unsigned int sceneId;	// cislo posledniho sestaveni (getSceneId)
+		double maxPatchArea; // maximalni obsah plosek (setMaxPatchArea)
 
 		std::vector<Model *> models; // pole modelu ve scene
 		
 		Patch** patches; // pole ukazatelu na patche ve scene o delce getPatchesCount, indexovano cislem patche
 		unsigned int patchesCount;	// celkovy pocet patchu ve scene
+		unsigned int patchesCapacity;	// pro kolik patchu jsou naalokovana pole patches, vertices a indices
 
 		float* vertices;	// pole vrcholu, dynamicky alokovane
 		unsigned int verticesCount;	// velikost pole vrcholu (pocet hodnot)
 
 		int* indices;	// pole indexu souvisejicich vrcholu, dynamicky alokovane
 		unsigned int indicesCount;	// velikost pole indexu (pocet hodnot)
+
+		float* weldedVertices;	// pole svarenych vrcholu, dynamicky alokovane
+		unsigned int weldedVerticesCount;	// velikost pole svarenych vrcholu (pocet hodnot)
+		unsigned int weldedCapacity;	// pro kolik hodnot je naalokovane pole svarenych vrcholu
+		int* weldedIndices;	// indexy do svarenych vrcholu, 6 na patch (delka indicesCount, kapacita jako pole patchu)
+		unsigned int* provokingVertices;	// pro kazdy patch svareny vrchol, ktery je posledni v obou jeho trojuhelnicich
+
+		SceneBvh bvh;	// horni uroven nad modely, spodni urovne vlastni modely (instance sdileji strom predlohy)
+
+		vector<PatchCluster> clusters;	// shluky patchu pro orezavani pri kresleni
+		vector<ClusterGroup> clusterGroups;	// shluky po modelech
+
+		const float* importance;	// dulezitost patchu pro vyber zdroju; NULL = nepouziva se
 };
 
@@ -0,0 +1,135 @@
+#include "NumaArena.h"
+
+
+vector<NumaArena*> NumaArena::arenas;
+SRWLOCK NumaArena::arenasLock = SRWLOCK_INIT;
+
+
+NumaArena::NumaArena(void) {
+	memory = NULL;
+	size = 0;
+	itemSize = 0;
+	live = 0;
+}
+
+
+NumaArena::~NumaArena(void) {
+	if (memory != NULL)
+		VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+
+unsigned int NumaArena::getNodeCount() {
+	static unsigned int count = 0;
+
+	if (count == 0) {
+		ULONG highest = 0;
+		count = GetNumaHighestNodeNumber(&highest) ? highest + 1 : 1;
+	}
+
+	return count;
+}
+
+
+unsigned int NumaArena::getNodeOfThread(unsigned int thread, unsigned int threadCount) {
+	if (threadCount == 0)
+		return 0;
+
+	return (unsigned int)((unsigned long long)thread * getNodeCount() / threadCount);
+}
+
+
+DWORD_PTR NumaArena::pinThread(unsigned int thread, unsigned int threadCount) {
+	if (getNodeCount() <= 1)
+		return 0;
+
+	ULONGLONG mask = 0;
+	if (!GetNumaNodeProcessorMask((UCHAR)getNodeOfThread(thread, threadCount), &mask) || mask == 0)
+		return 0;
+
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask);
+}
+
+
+void NumaArena::unpinThread(DWORD_PTR previousMask) {
+	if (previousMask != 0)
+		SetThreadAffinityMask(GetCurrentThread(), previousMask);
+}
+
+
+/**
+ * OpenMP vlakna tymu zustavaji mezi paralelnimi oblastmi stejna, pripnuti tedy plati i pro dalsi smycky
+ */
+void NumaArena::pinTeam() {
+	if (getNodeCount() <= 1)
+		return;
+
+#ifdef _OPENMP
+	#pragma omp parallel
+	pinThread(omp_get_thread_num(), omp_get_num_threads());
+#endif
+}
+
+
+/**
+ * Blok se jen rezervuje s preferenci uzlu, stranky se fyzicky prideli az pri prvnim zapisu;
+ * vsechny polozky se pocitaji jako zive - volajici je musi zaplnit
+ */
+NumaArena* NumaArena::create(unsigned int node, unsigned int count, size_t itemSize) {
+	NumaArena* arena = new NumaArena();
+	arena->size = max(count * itemSize, (size_t)1);
+	arena->itemSize = itemSize;
+	arena->live = count;
+	arena->memory = (char*)VirtualAllocExNuma(GetCurrentProcess(), NULL, arena->size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+
+	if (arena->memory == NULL) {
+		delete arena;
+		return NULL;
+	}
+
+	AcquireSRWLockExclusive(&arenasLock);
+	arenas.push_back(arena);
+	ReleaseSRWLockExclusive(&arenasLock);
+	return arena;
+}
+
+
+/**
+ * Vyradi arenu ze seznamu a uvolni ji - nepouzitou hned, jinak po smazani posledniho patche; NULL nic nedela
+ */
+void NumaArena::discard(NumaArena* arena) {
+	if (arena == NULL)
+		return;
+
+	AcquireSRWLockExclusive(&arenasLock);
+	arenas.erase(find(arenas.begin(), arenas.end(), arena));
+	ReleaseSRWLockExclusive(&arenasLock);
+	delete arena;
+}
+
+
+/**
+ * Hleda se se sdilenym zamkem, mazat smi soucasne vic vlaken. Arenu s poslednim zivym patchem uz
+ * zadne jine vlakno nenajde (zadny jeji patch neexistuje), vyradi se tedy az pod vylucnym zamkem
+ */
+bool NumaArena::release(void* p) {
+	NumaArena* found = NULL;
+
+	AcquireSRWLockShared(&arenasLock);
+	for (unsigned int i = 0; i < arenas.size(); i++) {
+		NumaArena* arena = arenas[i];
+		if ((char*)p >= arena->memory && (char*)p < arena->memory + arena->size) {
+			found = arena;
+			break;
+		}
+	}
+	ReleaseSRWLockShared(&arenasLock);
+
+	if (found == NULL)
+		return false;
+
+	if (InterlockedDecrement(&found->live) == 0)
+		discard(found);
+
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+
+/**
+ * Pamet pro patche jednoho NUMA uzlu a pripinani vlaken k uzlum. Arena je jeden blok pameti
+ * alokovany s preferenci uzlu; patche se do ni kopiruji vlakny pripnutymi k uzlu (first touch).
+ * Patch v arene se nemaze jednotlive - Patch::operator delete jen snizi pocet zivych patchu
+ * a blok se uvolni se smazanim posledniho z nich.
+ *
+ * Vlakna se k uzlum pripinaji po souvislych skupinach (vlakno t z T patri uzlu t * N / T), stejne
+ * jako staticke rozdeleni paralelni smycky - usek patchu uzlu n tak zpracovavaji vlakna uzlu n.
+ * Podporuje jen jednu skupinu procesoru (nejvyse 64 logickych procesoru).
+ */
+class NumaArena {
+
+	public:
+		static unsigned int getNodeCount();		// pocet NUMA uzlu; 1 = pocitac bez NUMA
+		static unsigned int getNodeOfThread(unsigned int thread, unsigned int threadCount);
+		static DWORD_PTR pinThread(unsigned int thread, unsigned int threadCount);	// pripne volajici vlakno k jeho uzlu; vraci puvodni masku (0 = nezmeneno)
+		static void unpinThread(DWORD_PTR previousMask);	// vrati volajicimu vlaknu puvodni masku
+		static void pinTeam();		// pripne vsechna vlakna OpenMP tymu volajiciho vlakna
+
+		static NumaArena* create(unsigned int node, unsigned int count, size_t itemSize);	// arena pro 'count' polozek; NULL = nedostatek pameti
+		void* getItem(unsigned int i);	// adresa i-te polozky
+		static void discard(NumaArena* arena);	// vyradi a uvolni arenu (nepouzitou nebo bez zivych polozek)
+		static bool release(void* p);	// pokud p lezi v nektere arene, zapocita smazani polozky a vraci true
+
+	private:
+		NumaArena(void);
+		~NumaArena(void);
+
+		char* memory;
+		size_t size;
+		size_t itemSize;
+		volatile LONG live;	// pocet zivych polozek; pri 0 se blok uvolni
+
+		// patche se mazou i z vlaken vypoctu - seznam se prochazi se sdilenym zamkem, meni s vylucnym
+		static vector<NumaArena*> arenas;
+		static SRWLOCK arenasLock;
+};
+
+
+inline void* NumaArena::getItem(unsigned int i) {
+	return memory + i * itemSize;
+}
@@ -135,6 +135,11 @@ bool CGL30Driver::Init(HWND h_wnd, bool b_forward_compatible,
 	} else
 		m_h_glrc = h_gl_rc; // otherwise just use the dummy context
 
+    m_b_forward_compatible = b_forward_compatible;
+    m_n_opengl_major = n_opengl_major;
+    m_n_opengl_minor = n_opengl_minor;
+    // remembers context parameters for CreateSharedContext()
+
     glViewport(0, 0, n_width, n_height);
     // sets viewport
 
@@ -209,6 +214,32 @@ HGLRC CGL30Driver::GetContext() const
 	return m_h_glrc;
 }
 
+HGLRC CGL30Driver::CreateSharedContext() const
+{
+	if(m_b_forward_compatible) {
+		const int p_params[] = {
+			WGL_CONTEXT_LAYER_PLANE_ARB, 0, // main plane
+			WGL_CONTEXT_MAJOR_VERSION_ARB, m_n_opengl_major,
+			WGL_CONTEXT_MINOR_VERSION_ARB, m_n_opengl_minor,
+			WGL_CONTEXT_FLAGS_ARB, WGL_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB,
+			0
+		};
+		return wglCreateContextAttribsARB(m_h_dc, m_h_glrc, p_params);
+		// the main context is passed as share context
+	}
+
+	HGLRC h_gl_rc;
+	if(!(h_gl_rc = wglCreateContext(m_h_dc)))
+		return 0;
+	if(!wglShareLists(m_h_glrc, h_gl_rc)) {
+		wglDeleteContext(h_gl_rc);
+		return 0;
+	}
+	// the new context is empty, objects can be shared
+
+	return h_gl_rc;
+}
+
 HDC CGL30Driver::GetDevice() const
 {
    return m_h_dc;
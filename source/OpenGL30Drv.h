@@ -45,6 +45,9 @@ private:
     int m_n_height;
 
     bool m_b_status;
+    bool m_b_forward_compatible;
+    int m_n_opengl_major;
+    int m_n_opengl_minor;
 
 	PIXELFORMATDESCRIPTOR m_t_pixel_format;
     GLuint m_n_pixel_format_id;
@@ -182,6 +185,21 @@ public:
 	 */
 	HGLRC GetContext() const;
 
+	/**
+	 *	@brief creates another context, sharing objects with the main one
+	 *
+	 *	Creates context with the same version and flags as passed to Init(), sharing
+	 *		textures, buffers and shaders with the main context (container objects such
+	 *		as VAOs and FBOs are not shared). The context can be made current
+	 *		(with GetDevice()) in another thread, e.g. for rendering in background.
+	 *
+	 *	@return Returns the new context on success, 0 on failure. The caller
+	 *		is responsible for deleting it using wglDeleteContext().
+	 *
+	 *	@note This doesn't explicitly handle case where OpenGL was not initialized.
+	 */
+	HGLRC CreateSharedContext() const;
+
 	/**
 	 *	@brief GL device getter
 	 */
@@ -0,0 +1,798 @@
+#include "OutOfCoreSolver.h"
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include "SceneFile.h"
+#include "HemicubeRays.h"
+#include "BatchTransfer.h"
+#include "EnergyAccumulator.h"
+#include "SceneBvh.h"
+#include "Patch.h"
+#include "Config.h"
+#include "Timer.h"
+
+
+// bitu Mortonova kodu na osu (jako Model::sortPatches) a hornich bitu kodu, podle kterych se patche rozdeli do prihradek
+static const unsigned int MORTON_BITS = 21;
+static const unsigned int BUCKET_BITS = 15;
+
+// nejvice uzlu stromu shluku - kazdy list ma aspon jeden patch
+static const unsigned int CLUSTER_NODES = 2 * OutOfCoreSolver::CLUSTER_SIZE;
+
+// z aktualniho shluku se strili, dokud ma aspon tuto cast nejvetsi energie ostatnich shluku
+static const float SWITCH_RATIO = 0.5f;
+
+// cast limitu pameti pro odlozene prenosy (zbytek pro energie rezidentnich shluku)
+static const size_t PENDING_SHARE = 4;
+
+// po kolika davkach zdroju se vypise stav vypoctu
+static const unsigned int PROGRESS_PASSES = 1000;
+
+// konec vypoctu jako v SolverStep - energie nejsilnejsiho zdroje pod touto hranici
+static const float CONVERGENCE_THRESHOLD = 0.1f;
+
+
+/**
+ * Rozprostre dolnich 21 bitu tak, aby mezi kazdymi dvema byly dva volne (jako v Model.cpp)
+ */
+static uint64_t spreadBits(uint64_t x) {
+	x &= 0x1FFFFF;
+	x = (x | x << 32) & 0x1F00000000FFFFULL;
+	x = (x | x << 16) & 0x1F0000FF0000FFULL;
+	x = (x | x << 8) & 0x100F00F00F00F00FULL;
+	x = (x | x << 4) & 0x10C30C30C30C30C3ULL;
+	x = (x | x << 2) & 0x1249249249249249ULL;
+	return x;
+}
+
+
+static inline Vector3f patchCenter(const float* g) {
+	return Vector3f(g[0] + g[3] + g[6] + g[9], g[1] + g[4] + g[7] + g[10], g[2] + g[5] + g[8] + g[11]) * 0.25f;
+}
+
+
+/**
+ * Mortonuv kod stredu patche v kvadru stredu sceny
+ */
+struct MortonGrid {
+	Vector3f min, scale;
+	float cells;
+
+	MortonGrid(const Aabb& box) {
+		Vector3f size = box.max - box.min;
+		cells = float((1 << MORTON_BITS) - 1);
+		min = box.min;
+		scale = Vector3f(size.x > 0 ? cells / size.x : 0, size.y > 0 ? cells / size.y : 0, size.z > 0 ? cells / size.z : 0);
+	}
+
+	uint64_t code(const float* geometry) const {
+		Vector3f c = patchCenter(geometry) - min;
+		uint64_t x = uint64_t(std::max(0.0f, std::min(c.x * scale.x, cells)));
+		uint64_t y = uint64_t(std::max(0.0f, std::min(c.y * scale.y, cells)));
+		uint64_t z = uint64_t(std::max(0.0f, std::min(c.z * scale.z, cells)));
+		return spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+	}
+};
+
+
+/**
+ * Nejvetsi radiativni energie (velikost vektoru) z 'n' zaznamu energii
+ */
+static float maxRadiosity(const float* energies, unsigned int n) {
+	float m = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		const float* e = energies + size_t(i) * 6;
+		m = max(m, e[3] * e[3] + e[4] * e[4] + e[5] * e[5]);
+	}
+	return sqrt(m);
+}
+
+
+/**
+ * Nejblizsi patch shluku privraceny k paprsku licem; zadni strany se preskoci (jako pri kresleni hemicube)
+ */
+struct OutOfCoreSolver::PatchHit {
+	const Record* records;	// zaznamy shluku
+	const Vector3f& origin;
+	const Vector3f& dir;
+	int item;
+
+	PatchHit(const Record* records, const Vector3f& origin, const Vector3f& dir)
+		: records(records), origin(origin), dir(dir), item(-1) {
+	}
+
+	bool operator()(unsigned int i, float& tmax) {
+		const float* g = records[i].vertices;
+		Vector3f v[4];
+		for (unsigned int k = 0; k < 4; k++)
+			v[k] = Vector3f(g[k * 3], g[k * 3 + 1], g[k * 3 + 2]);
+
+		// normala jako Patch::getNormal
+		if ((v[1] - v[0]).v_Cross(v[3] - v[0]).f_Dot(dir) >= 0)
+			return false;
+
+		float t = SceneBvh::intersectQuad(v[0], v[1], v[2], v[3], origin, dir);
+		if (t > HEMICUBE_NEAR && t < tmax) {
+			tmax = t;
+			item = int(i);
+		}
+		return false;
+	}
+};
+
+
+/**
+ * Shluky zasazene paprskem se projdou vlastnim stromem; tmax zkracuji zasahy ve vsech shlucich
+ */
+struct OutOfCoreSolver::ClusterHit {
+	const OutOfCoreSolver& solver;
+	const Vector3f& origin;
+	const Vector3f& dir;
+	int item;
+
+	ClusterHit(const OutOfCoreSolver& solver, const Vector3f& origin, const Vector3f& dir)
+		: solver(solver), origin(origin), dir(dir), item(-1) {
+	}
+
+	bool operator()(unsigned int c, float& tmax) {
+		const Cluster& cluster = solver.clusters[c];
+		PatchHit hit(solver.records + cluster.from, origin, dir);
+		Bvh::traverseRay(solver.getNodes(c), solver.getItems(c), origin, dir, tmax, hit);
+		if (hit.item >= 0)
+			item = int(cluster.from) + hit.item;
+		return false;
+	}
+};
+
+
+/**
+ * Prijemce prenosu davky - kazdy patch dostane energii jednou, rezidentni shluky se behem prenosu nemeni
+ */
+struct OutOfCoreSolver::Receiver {
+	OutOfCoreSolver* solver;
+
+	void operator()(unsigned int id, const Vector3f& energy) {
+		solver->receive(EnergyAccumulator::currentThread(), id, energy);
+	}
+};
+
+
+/**
+ * Razeni patchu shluku podle radiativni energie (sestupne)
+ */
+struct OutOfCoreSolver::EnergyGreater {
+	const float* energies;
+
+	bool operator()(unsigned int a, unsigned int b) const {
+		const float* ea = energies + size_t(a) * 6 + 3;
+		const float* eb = energies + size_t(b) * 6 + 3;
+		return ea[0] * ea[0] + ea[1] * ea[1] + ea[2] * ea[2] > eb[0] * eb[0] + eb[1] * eb[1] + eb[2] * eb[2];
+	}
+};
+
+
+OutOfCoreSolver::OutOfCoreSolver(void) {
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	sceneView = NULL;
+	records = NULL;
+	nodesOffset = 0;
+	energiesOffset = 0;
+	count = 0;
+	granularity = 0;
+
+	residentLimit = 0;
+	residentSize = 0;
+	useCounter = 0;
+	current = -1;
+
+	pendingCount = 0;
+	pendingLimit = 0;
+
+	passes = 0;
+	side = 0;
+}
+
+
+OutOfCoreSolver::~OutOfCoreSolver(void) {
+	close();
+}
+
+
+bool OutOfCoreSolver::open(const char* sceneFile, const char* workFile, size_t memoryLimit) {
+	close();
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	granularity = info.dwAllocationGranularity;
+
+	file = CreateFileA(workFile, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		cerr << "Unable to create the out-of-core file " << workFile << endl;
+		return false;
+	}
+
+	if (!prepare(sceneFile, memoryLimit)) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Prevod nepotrebuje pamet umernou cele scene: patche se nejdriv rozdeli do prihradek podle hornich bitu
+ * Mortonova kodu (pocty, pak jeden pruchod souborem sceny) a kazda prihradka se seradi zvlast. Teprve
+ * serazene patche se rozdeli na shluky a pro kazdy se postavi strom; uzly a polozky stromu se zapisou
+ * do souboru, v pameti zustane jen tabulka shluku a strom nad nimi
+ */
+bool OutOfCoreSolver::prepare(const char* sceneFile, size_t memoryLimit) {
+	SceneFile scene;
+	if (!scene.open(sceneFile)) {
+		cerr << "Unable to open the scene " << sceneFile << endl;
+		return false;
+	}
+
+	count = scene.getPatchesCount();
+	const float* geometry = scene.getGeometry();
+	const float* colors = scene.getColors();
+	const float* energies = scene.getEnergies();
+	if (count == 0) {
+		cerr << "The scene " << sceneFile << " is empty" << endl;
+		return false;
+	}
+
+	// rozlozeni pracovniho souboru; energie shluku zacinaji na hranici stranek
+	unsigned int clusterCount = (count + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	uint64_t clusterTreeSize = CLUSTER_NODES * sizeof(Bvh::Node) + CLUSTER_SIZE * sizeof(unsigned int);
+	nodesOffset = (uint64_t(count) * sizeof(Record) + granularity - 1) / granularity * granularity;
+	energiesOffset = (nodesOffset + clusterCount * clusterTreeSize + granularity - 1) / granularity * granularity;
+	uint64_t fileSize = energiesOffset + uint64_t(clusterCount) * CLUSTER_SIZE * 6 * sizeof(float);
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, DWORD(fileSize >> 32), DWORD(fileSize & 0xFFFFFFFF), NULL);
+	char* data = (mapping != NULL) ? (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0) : NULL;
+	if (data == NULL) {
+		cerr << "Unable to map the out-of-core file (" << (fileSize >> 20) << " MB)" << endl;
+		return false;
+	}
+
+	Record* target = (Record*)data;
+	float* targetEnergies = (float*)(data + energiesOffset);
+
+	// kvadr stredu patchu
+	Aabb box;
+	for (unsigned int i = 0; i < count; i++)
+		box.extend(patchCenter(geometry + size_t(i) * 12));
+	MortonGrid grid(box);
+
+	// zacatky prihradek v poradi pracovniho souboru
+	unsigned int bucketCount = 1 << BUCKET_BITS;
+	vector<unsigned int> starts(bucketCount + 1, 0);
+	for (unsigned int i = 0; i < count; i++)
+		starts[(grid.code(geometry + size_t(i) * 12) >> (3 * MORTON_BITS - BUCKET_BITS)) + 1]++;
+	for (unsigned int b = 0; b < bucketCount; b++)
+		starts[b + 1] += starts[b];
+
+	// zaznamy do prihradek - v kazde postupne v poradi souboru sceny
+	vector<unsigned int> cursors(starts.begin(), starts.end() - 1);
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int pos = cursors[grid.code(geometry + size_t(i) * 12) >> (3 * MORTON_BITS - BUCKET_BITS)]++;
+		Record& r = target[pos];
+		memcpy(r.vertices, geometry + size_t(i) * 12, sizeof(r.vertices));
+		memcpy(r.color, colors + size_t(i) * 3, sizeof(r.color));
+		r.source = i;
+		memcpy(targetEnergies + size_t(pos) * 6, energies + size_t(i) * 6, 6 * sizeof(float));
+	}
+	scene.close();
+
+	// serazeni uvnitr prihradek; shodne kody zustanou v poradi souboru sceny
+	#pragma omp parallel
+	{
+		vector<pair<uint64_t, unsigned int> > keys;
+		vector<Record> sortedRecords;
+		vector<float> sortedEnergies;
+
+		#pragma omp for schedule(dynamic, 16)
+		for (int b = 0; b < int(bucketCount); b++) {
+			unsigned int from = starts[b], n = starts[b + 1] - starts[b];
+			if (n < 2)
+				continue;
+
+			keys.resize(n);
+			for (unsigned int i = 0; i < n; i++)
+				keys[i] = make_pair(grid.code(target[from + i].vertices), from + i);
+			sort(keys.begin(), keys.end());
+
+			sortedRecords.resize(n);
+			sortedEnergies.resize(n * 6);
+			for (unsigned int i = 0; i < n; i++) {
+				sortedRecords[i] = target[keys[i].second];
+				memcpy(&sortedEnergies[i * 6], targetEnergies + size_t(keys[i].second) * 6, 6 * sizeof(float));
+			}
+			memcpy(target + from, &sortedRecords[0], n * sizeof(Record));
+			memcpy(targetEnergies + size_t(from) * 6, &sortedEnergies[0], n * 6 * sizeof(float));
+		}
+	}
+
+	// shluky a jejich stromy
+	clusters.resize(clusterCount);
+
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int c = 0; c < int(clusterCount); c++) {
+		Cluster& cluster = clusters[c];
+		cluster.from = c * CLUSTER_SIZE;
+		cluster.to = min(cluster.from + CLUSTER_SIZE, count);
+		cluster.pendingEnergy = 0;
+		cluster.energies = NULL;
+		cluster.view = NULL;
+		cluster.viewSize = 0;
+		cluster.lastUse = 0;
+
+		vector<Aabb> boxes(cluster.to - cluster.from);
+		for (unsigned int i = cluster.from; i < cluster.to; i++) {
+			const float* g = target[i].vertices;
+			for (unsigned int v = 0; v < 4; v++)
+				boxes[i - cluster.from].extend(Vector3f(g[v * 3], g[v * 3 + 1], g[v * 3 + 2]));
+		}
+
+		Bvh bvh;
+		bvh.build(boxes);
+		if (!bvh.isEmpty()) {
+			char* tree = data + nodesOffset + c * clusterTreeSize;
+			memcpy(tree, &bvh.getNodes()[0], bvh.getNodes().size() * sizeof(Bvh::Node));
+			memcpy(tree + CLUSTER_NODES * sizeof(Bvh::Node), &bvh.getItems()[0], bvh.getItems().size() * sizeof(unsigned int));
+			cluster.box = bvh.getBounds();
+		}
+
+		cluster.maxEnergy = maxRadiosity(targetEnergies + size_t(cluster.from) * 6, cluster.to - cluster.from);
+	}
+
+	vector<Aabb> clusterBoxes(clusterCount);
+	for (unsigned int c = 0; c < clusterCount; c++)
+		clusterBoxes[c] = clusters[c].box;
+	top.build(clusterBoxes);
+
+	// pro vypocet se geometrie a stromy jen ctou, energie se mapuji po shlucich
+	UnmapViewOfFile(data);
+	sceneView = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size_t(energiesOffset));
+	if (sceneView == NULL) {
+		cerr << "Unable to map the out-of-core scene" << endl;
+		return false;
+	}
+	records = (const Record*)sceneView;
+
+	// aspon dva shluky - aktualni a jeden prijemce
+	size_t clusterBytes = CLUSTER_SIZE * 6 * sizeof(float) + granularity;
+	residentLimit = max(memoryLimit - memoryLimit / PENDING_SHARE, 2 * clusterBytes);
+	pendingLimit = max(memoryLimit / PENDING_SHARE / (2 * sizeof(Delta)), (size_t)1);	// seznamy vlaken + serazena kopie
+
+	cout << "     out-of-core: " << count << " patches in " << clusterCount << " clusters, " << (fileSize >> 20) << " MB file, " <<
+		(residentLimit >> 20) << " MB of energies mapped at most" << endl;
+	return true;
+}
+
+
+void OutOfCoreSolver::close() {
+	while (!resident.empty())
+		evict(resident.back());
+
+	if (sceneView != NULL)
+		UnmapViewOfFile(sceneView);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	sceneView = NULL;
+	records = NULL;
+	count = 0;
+
+	clusters.clear();
+	top.clear();
+	residentSize = 0;
+	useCounter = 0;
+	current = -1;
+
+	lists.clear();
+	listMarks.clear();
+	merged.clear();
+	pendingCount = 0;
+	passes = 0;
+}
+
+
+const Bvh::Node* OutOfCoreSolver::getNodes(unsigned int c) const {
+	uint64_t clusterTreeSize = CLUSTER_NODES * sizeof(Bvh::Node) + CLUSTER_SIZE * sizeof(unsigned int);
+	return (const Bvh::Node*)(sceneView + nodesOffset + c * clusterTreeSize);
+}
+
+const unsigned int* OutOfCoreSolver::getItems(unsigned int c) const {
+	return (const unsigned int*)(getNodes(c) + CLUSTER_NODES);
+}
+
+
+int OutOfCoreSolver::trace(const Vector3f& origin, const Vector3f& dir) const {
+	float distance = HEMICUBE_FAR;
+	ClusterHit hit(*this, origin, dir);
+	top.traverseRay(origin, dir, distance, hit);
+	return hit.item;
+}
+
+
+/**
+ * Pohled musi zacinat na nasobku granularity, namapuje se proto od zacatku stranky pred energiemi shluku
+ */
+float* OutOfCoreSolver::map(unsigned int c, void*& view, size_t& size) {
+	const Cluster& cluster = clusters[c];
+	uint64_t offset = energiesOffset + uint64_t(cluster.from) * 6 * sizeof(float);
+	uint64_t start = offset / granularity * granularity;
+	size = size_t(offset - start) + (cluster.to - cluster.from) * 6 * sizeof(float);
+
+	view = MapViewOfFile(mapping, FILE_MAP_WRITE, DWORD(start >> 32), DWORD(start & 0xFFFFFFFF), size);
+	if (view == NULL) {
+		cerr << "Unable to map energies of the out-of-core cluster " << c << endl;
+		return NULL;
+	}
+	return (float*)((char*)view + (offset - start));
+}
+
+
+/**
+ * Pri prekroceni limitu se odmapuji nejdele nepouzite shluky (krome aktualniho). Odlozene prenosy jsou
+ * v te dobe prictene, rezidentni shluk tedy zadne nema
+ */
+bool OutOfCoreSolver::makeResident(unsigned int c) {
+	Cluster& cluster = clusters[c];
+	cluster.lastUse = ++useCounter;
+	if (cluster.energies != NULL)
+		return true;
+
+	cluster.energies = map(c, cluster.view, cluster.viewSize);
+	if (cluster.energies == NULL)
+		return false;
+	resident.push_back(c);
+	residentSize += cluster.viewSize;
+
+	while (residentSize > residentLimit) {
+		int oldest = -1;
+		for (unsigned int r = 0; r < resident.size(); r++) {
+			if (resident[r] != c && int(resident[r]) != current && (oldest < 0 || clusters[resident[r]].lastUse < clusters[oldest].lastUse))
+				oldest = resident[r];
+		}
+		if (oldest < 0)
+			break;
+		evict(oldest);
+	}
+
+	return true;
+}
+
+
+void OutOfCoreSolver::evict(unsigned int c) {
+	Cluster& cluster = clusters[c];
+	if (cluster.energies == NULL)
+		return;
+
+	UnmapViewOfFile(cluster.view);
+	residentSize -= cluster.viewSize;
+	cluster.energies = NULL;
+	cluster.view = NULL;
+	cluster.viewSize = 0;
+
+	resident.erase(find(resident.begin(), resident.end(), c));
+}
+
+
+void OutOfCoreSolver::updateMaxEnergy(unsigned int c) {
+	Cluster& cluster = clusters[c];
+	if (cluster.energies != NULL)
+		cluster.maxEnergy = maxRadiosity(cluster.energies, cluster.to - cluster.from);
+}
+
+
+/**
+ * Zdroje s nejvetsi energii z aktualniho shluku. Na jiny shluk se prechazi, az energie aktualniho klesne pod
+ * polovinu odhadu ostatnich (nejvetsi energie + odlozene prenosy) - pred vyberem se prictou odlozene prenosy,
+ * aby byly energie shluku presne. Prazdny vyber = vsechny shluky jsou pod prahem
+ */
+bool OutOfCoreSolver::selectEmitters(unsigned int n, float threshold, vector<unsigned int>& emitters) {
+	emitters.clear();
+
+	float other = 0;
+	for (unsigned int c = 0; c < clusters.size(); c++) {
+		if (int(c) != current)
+			other = max(other, clusters[c].maxEnergy + clusters[c].pendingEnergy);
+	}
+
+	if (current < 0 || clusters[current].maxEnergy < threshold || clusters[current].maxEnergy < other * SWITCH_RATIO) {
+		if (!applyPending())
+			return false;
+
+		current = 0;
+		for (unsigned int c = 1; c < clusters.size(); c++) {
+			if (clusters[c].maxEnergy > clusters[current].maxEnergy)
+				current = c;
+		}
+
+		if (clusters[current].maxEnergy < threshold)
+			return true;
+		if (!makeResident(current))
+			return false;
+	}
+
+	// n patchu shluku s nejvetsi energii
+	const Cluster& cluster = clusters[current];
+	unsigned int size = cluster.to - cluster.from;
+	unsigned int best = min(n, size);
+
+	vector<unsigned int> order(size);
+	for (unsigned int i = 0; i < size; i++)
+		order[i] = i;
+	EnergyGreater greater = { cluster.energies };
+	partial_sort(order.begin(), order.begin() + best, order.end(), greater);
+
+	for (unsigned int k = 0; k < best; k++) {
+		const float* e = cluster.energies + size_t(order[k]) * 6;
+		if (e[3] == 0 && e[4] == 0 && e[5] == 0)
+			break;
+		emitters.push_back(cluster.from + order[k]);
+	}
+
+	return true;
+}
+
+
+/**
+ * Prijata energie (pred odrazivosti) - do rezidentniho shluku primo, jinak do seznamu vlakna
+ */
+void OutOfCoreSolver::receive(unsigned int thread, unsigned int id, const Vector3f& energy) {
+	Vector3f reflected = energy * REFLECTIVITY;
+	const Cluster& cluster = clusters[id / CLUSTER_SIZE];
+	DeltaList& list = lists[thread];
+
+	if (cluster.energies != NULL) {
+		float* e = cluster.energies + size_t(id - cluster.from) * 6;
+		e[3] += reflected.x;
+		e[4] += reflected.y;
+		e[5] += reflected.z;
+
+		if (list.touched.empty() || list.touched.back() != id / CLUSTER_SIZE)
+			list.touched.push_back(id / CLUSTER_SIZE);
+		return;
+	}
+
+	Delta d = { id, reflected.x, reflected.y, reflected.z };
+	list.deltas.push_back(d);
+}
+
+
+/**
+ * Po prenosu se prepocitaji energie rezidentnich shluku, do kterych se pricitalo, a odhady odlozenych prenosu
+ */
+void OutOfCoreSolver::endTransfer() {
+	vector<unsigned int> touched;
+
+	for (unsigned int t = 0; t < lists.size(); t++) {
+		DeltaList& list = lists[t];
+		for (size_t i = listMarks[t]; i < list.deltas.size(); i++) {
+			const Delta& d = list.deltas[i];
+			clusters[d.id / CLUSTER_SIZE].pendingEnergy += sqrt(d.r * d.r + d.g * d.g + d.b * d.b);
+		}
+		pendingCount += list.deltas.size() - listMarks[t];
+
+		touched.insert(touched.end(), list.touched.begin(), list.touched.end());
+		list.touched.clear();
+	}
+
+	sort(touched.begin(), touched.end());
+	touched.erase(unique(touched.begin(), touched.end()), touched.end());
+	for (unsigned int i = 0; i < touched.size(); i++)
+		updateMaxEnergy(touched[i]);
+}
+
+
+bool OutOfCoreSolver::deltaLess(const Delta& a, const Delta& b) {
+	return a.id < b.id;
+}
+
+
+/**
+ * Odlozene prenosy se seradi podle cisla patche a prictou v jednom pruchodu souborem - kazdy shluk,
+ * do ktereho nejaky smeruje, se namapuje jen na dobu pricteni
+ */
+bool OutOfCoreSolver::applyPending() {
+	if (pendingCount == 0)
+		return true;
+
+	merged.clear();
+	merged.reserve(pendingCount);
+	for (unsigned int t = 0; t < lists.size(); t++) {
+		merged.insert(merged.end(), lists[t].deltas.begin(), lists[t].deltas.end());
+		lists[t].deltas.clear();
+	}
+	sort(merged.begin(), merged.end(), deltaLess);
+
+	bool ok = true;
+	for (size_t i = 0; i < merged.size() && ok; ) {
+		unsigned int c = merged[i].id / CLUSTER_SIZE;
+		Cluster& cluster = clusters[c];
+
+		void* view = NULL;
+		size_t size = 0;
+		float* energies = (cluster.energies != NULL) ? cluster.energies : map(c, view, size);
+		if (energies == NULL) {
+			ok = false;
+			break;
+		}
+
+		for (; i < merged.size() && merged[i].id / CLUSTER_SIZE == c; i++) {
+			float* e = energies + size_t(merged[i].id - cluster.from) * 6;
+			e[3] += merged[i].r;
+			e[4] += merged[i].g;
+			e[5] += merged[i].b;
+		}
+
+		cluster.maxEnergy = maxRadiosity(energies, cluster.to - cluster.from);
+		cluster.pendingEnergy = 0;
+
+		if (view != NULL)
+			UnmapViewOfFile(view);
+	}
+
+	merged.clear();
+	pendingCount = 0;
+	return ok;
+}
+
+
+/**
+ * Davka zdroju jako v SolverStep - radky se spocitaji paprsky pixely hemicube (paralelne po zdrojich),
+ * energie se prenese jako ridka matice (BatchTransfer) a zdroje se vyzari
+ */
+bool OutOfCoreSolver::solve(float threshold) {
+	if (clusters.empty())
+		return false;
+
+	CTimer timer;
+	double start = timer.f_Time();
+
+	side = Config::HEMICUBE_W();
+	if (side < 2) {
+		cerr << "Out-of-core: the hemicube side is not set (Config::freeze)" << endl;
+		return false;
+	}
+	HemicubeFormFactors table;
+	table.build(side);
+
+	unsigned int batchSize = max(Config::HEMICUBES_CNT(), 1u);
+	vector<FormFactorCache::Row> rows(batchSize);
+	vector<Vector3f> radiosities(batchSize);
+	vector<unsigned int> emitters;
+	BatchTransfer batch;
+
+	lists.resize(EnergyAccumulator::maxThreads());
+	listMarks.resize(lists.size());
+
+	while (true) {
+		if (!selectEmitters(batchSize, threshold, emitters))
+			return false;
+		if (emitters.empty())
+			break;
+
+		#pragma omp parallel for schedule(dynamic, 1)
+		for (int k = 0; k < int(emitters.size()); k++) {
+			const float* g = records[emitters[k]].vertices;
+			Vector3f vertices[4];
+			for (unsigned int v = 0; v < 4; v++)
+				vertices[v] = Vector3f(g[v * 3], g[v * 3 + 1], g[v * 3 + 2]);
+			castHemicubeRow(*this, table, side, emitters[k], vertices, rows[k]);
+		}
+
+		// zdroje lezi v aktualnim shluku, ktery je rezidentni
+		Cluster& cluster = clusters[current];
+		batch.begin(count);
+		for (unsigned int k = 0; k < emitters.size(); k++) {
+			const float* e = cluster.energies + size_t(emitters[k] - cluster.from) * 6;
+			const float* c = records[emitters[k]].color;
+			radiosities[k] = Vector3f(e[3], e[4], e[5]);
+			batch.addRow(rows[k], radiosities[k] * Vector3f(c[0], c[1], c[2]));
+		}
+
+		for (unsigned int t = 0; t < lists.size(); t++)
+			listMarks[t] = lists[t].deltas.size();
+		Receiver receiver = { this };
+		batch.execute(receiver);
+		endTransfer();
+
+		// zdroje se vyzarily - puvodni radiosita (prijata energie davky zustava)
+		for (unsigned int k = 0; k < emitters.size(); k++) {
+			float* e = cluster.energies + size_t(emitters[k] - cluster.from) * 6;
+			e[0] += radiosities[k].x; e[1] += radiosities[k].y; e[2] += radiosities[k].z;
+			e[3] -= radiosities[k].x; e[4] -= radiosities[k].y; e[5] -= radiosities[k].z;
+		}
+		updateMaxEnergy(current);
+
+		if (pendingCount > pendingLimit && !applyPending())
+			return false;
+
+		passes++;
+		if (passes % PROGRESS_PASSES == 0) {
+			cout << "Pass " << passes << ", the emitter had " << radiosities[0].f_Length() << " energy, " << resident.size() << "/" <<
+				clusters.size() << " clusters mapped, " << pendingCount << " pending transfers" << endl;
+		}
+	}
+
+	cout << "Done in " << (timer.f_Time() - start) << " seconds, " << passes << " passes" << endl;
+	return true;
+}
+
+
+/**
+ * Vysledek je kopie souboru sceny (sousedi, metadata) s energiemi z pracovniho souboru; energie se zapisuji
+ * po shlucich na mista puvodnich cisel patchu
+ */
+bool OutOfCoreSolver::save(const char* sceneFile, const char* resultFile) {
+	if (!applyPending())
+		return false;
+
+	if (!CopyFileA(sceneFile, resultFile, FALSE)) {
+		cerr << "Unable to create the result file " << resultFile << endl;
+		return false;
+	}
+
+	SceneFile result;
+	if (!result.open(resultFile, true) || result.getPatchesCount() != count) {
+		cerr << "Unable to write results to " << resultFile << endl;
+		return false;
+	}
+	float* target = result.getWritableEnergies();
+
+	for (unsigned int c = 0; c < clusters.size(); c++) {
+		Cluster& cluster = clusters[c];
+
+		void* view = NULL;
+		size_t size = 0;
+		const float* energies = (cluster.energies != NULL) ? cluster.energies : map(c, view, size);
+		if (energies == NULL)
+			return false;
+
+		for (unsigned int i = cluster.from; i < cluster.to; i++)
+			memcpy(target + size_t(records[i].source) * 6, energies + size_t(i - cluster.from) * 6, 6 * sizeof(float));
+
+		if (view != NULL)
+			UnmapViewOfFile(view);
+	}
+
+	SceneFile::SceneMetadata* meta = result.getWritableMetadata();
+	if (meta != NULL) {
+		meta->hemicubeSide = side;
+		meta->passCounter += passes;
+	}
+
+	cout << "Saved the results to " << resultFile << endl;
+	return true;
+}
+
+
+/**
+ * Pracovni soubor lezi vedle vysledku (predpoklada se disk s dostatkem mista)
+ */
+int OutOfCoreSolver::run(const char* sceneFile, const char* resultFile) {
+	if (sceneFile == NULL || resultFile == NULL) {
+		cerr << "Out-of-core: expected outofcore <scene> outofcoreresult <file>" << endl;
+		return -1;
+	}
+
+	string workFile = string(resultFile) + ".work";
+
+	OutOfCoreSolver solver;
+	if (!solver.open(sceneFile, workFile.c_str(), size_t(Config::OUT_OF_CORE_MEMORY()) << 20) ||
+		!solver.solve(CONVERGENCE_THRESHOLD) || !solver.save(sceneFile, resultFile))
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "Bvh.h"
+#include "FormFactorCache.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Vypocet radiozity mimo pamet primo nad souborem sceny (SceneFile) - pro sceny, jejichz patche se do RAM
+ * nevejdou. Patche (Patch) ani OpenGL se nepouzivaji. Scena se prevede do pracovniho souboru mapovaneho do
+ * pameti, ve kterem jsou patche serazene podle Mortonovy krivky stredu a rozdelene na shluky po CLUSTER_SIZE.
+ * Shluk je tedy prostorove kompaktni a v kazde sekci souboru zabira souvisly usek stranek:
+ *
+ *  geometrie (Record) | stromy shluku | energie (6 floatu na patch, shluk zarovnany na stranky)
+ *
+ * Geometrie a stromy shluku se ctou z jednoho pohledu jen pro cteni - ciste stranky souboru, ktere system
+ * pri nedostatku pameti jen zahodi. Viditelnost se pocita vrhanim paprsku pixely hemicube (castHemicubeRow)
+ * pres strom nad kvadry shluku a stromy zasazenych shluku. Energie se mapuji po shlucich a namapovanych
+ * (rezidentnich) je jen tolik shluku, kolik dovoli limit pameti; nejdele nepouzite se odmapuji.
+ *
+ * Zdroje se vybiraji po shlucich - vypocet strili z jednoho shluku, dokud jeho nejvetsi energie neklesne
+ * pod polovinu odhadu ostatnich. Prijata energie rezidentnich shluku se pricte hned, prenosy do ostatnich
+ * se odlozi a prictou davkove - serazene podle cisla patche, v jednom pruchodu souborem.
+ */
+class OutOfCoreSolver {
+
+	public:
+		static const unsigned int CLUSTER_SIZE = 8192;	// patchu ve shluku (energie shluku = 3 * 64 kB)
+
+		OutOfCoreSolver(void);
+		~OutOfCoreSolver(void);
+
+		bool open(const char* sceneFile, const char* workFile, size_t memoryLimit);	// prevede scenu do pracovniho souboru (smaze se pri zavreni)
+		bool solve(float threshold);	// strili, dokud energie nejsilnejsiho zdroje neklesne pod prah
+		bool save(const char* sceneFile, const char* resultFile);	// kopie souboru sceny s vypocitanymi energiemi
+		void close();
+
+		int trace(const Vector3f& origin, const Vector3f& dir) const;	// nejblizsi zasazeny patch (pro castHemicubeRow); -1 = zadny
+
+		static int run(const char* sceneFile, const char* resultFile);	// cely vypocet bez okna podle Config; vraci navratovy kod programu
+
+	private:
+		// patch v pracovnim souboru (64 bytu)
+		struct Record {
+			float vertices[12];
+			float color[3];
+			uint32_t source;	// cislo patche v souboru sceny
+		};
+
+		struct Cluster {
+			unsigned int from, to;	// patche <from, to) v poradi pracovniho souboru
+			Aabb box;
+			float maxEnergy;		// nejvetsi radiativni energie patchu shluku (velikost vektoru)
+			float pendingEnergy;	// horni odhad odlozene energie jednoho patche
+			float* energies;		// namapovane energie shluku; NULL = shluk neni rezidentni
+			void* view;
+			size_t viewSize;
+			unsigned int lastUse;
+		};
+
+		// odlozeny prenos do shluku, ktery neni rezidentni (energie uz po odrazu)
+		struct Delta {
+			unsigned int id;
+			float r, g, b;
+		};
+
+		// seznam vlakna s vyplni na radek cache
+		struct DeltaList {
+			vector<Delta> deltas;
+			vector<unsigned int> touched;	// rezidentni shluky, do kterych vlakno pricitalo
+			char padding[64];
+		};
+
+		struct PatchHit;	// navstevnik stromu shluku
+		struct ClusterHit;	// navstevnik stromu nad shluky
+		struct Receiver;	// prijemce BatchTransfer
+		struct EnergyGreater;
+
+		static bool deltaLess(const Delta& a, const Delta& b);
+
+		bool prepare(const char* sceneFile, size_t memoryLimit);
+		const Bvh::Node* getNodes(unsigned int c) const;
+		const unsigned int* getItems(unsigned int c) const;
+
+		float* map(unsigned int c, void*& view, size_t& size);	// namapuje energie shluku
+		bool makeResident(unsigned int c);
+		void evict(unsigned int c);
+		void updateMaxEnergy(unsigned int c);
+
+		bool selectEmitters(unsigned int n, float threshold, vector<unsigned int>& emitters);	// prazdny vyber = vypocet konverguje; false = chyba mapovani
+		void receive(unsigned int thread, unsigned int id, const Vector3f& energy);
+		void endTransfer();
+		bool applyPending();
+
+		HANDLE file;
+		HANDLE mapping;
+		const char* sceneView;	// geometrie a stromy shluku, jen pro cteni
+		const Record* records;
+		uint64_t nodesOffset;	// zacatky sekci v souboru
+		uint64_t energiesOffset;
+		unsigned int count;
+		unsigned int granularity;	// zarovnani pohledu do souboru
+
+		vector<Cluster> clusters;
+		Bvh top;	// strom nad kvadry shluku
+
+		vector<unsigned int> resident;	// rezidentni shluky
+		size_t residentLimit;	// nejvice namapovanych bytu energii
+		size_t residentSize;
+		unsigned int useCounter;
+		int current;			// shluk, ze ktereho se strili; -1 = zadny
+
+		vector<DeltaList> lists;	// odlozene prenosy po vlaknech
+		vector<size_t> listMarks;	// delky seznamu pred aktualnim prenosem
+		vector<Delta> merged;		// odlozene prenosy serazene podle cisla patche
+		size_t pendingCount;
+		size_t pendingLimit;
+
+		unsigned int passes;	// provedene davky zdroju
+		unsigned int side;		// strana hemicube vypoctu
+};
@@ -1,40 +1,173 @@
 #include "Patch.h"
+#include "NumaArena.h"
 
-Patch::Patch() {
+
+PatchShape::PatchShape() {
 	for (int i = 0; i < 8; i++)
 		neighbours[i] = NULL;
 }
 
+
+void* PatchShape::operator new(size_t size) {
+	return ::operator new(size);
+}
+
+
+void* PatchShape::operator new(size_t size, void* where) {
+	return where;
+}
+
+
+void PatchShape::operator delete(void* p) {
+	if (p != NULL && !NumaArena::release(p))
+		::operator delete(p);
+}
+
+
+void PatchShape::operator delete(void* p, void* where) {
+}
+
+
+/**
+ * Geometrie do pripravene pameti, pripadne na haldu
+ */
+static PatchShape* createShape(void* where) {
+	return where != NULL ? new (where) PatchShape() : new PatchShape();
+}
+
+
+Patch::Patch() {
+	shape = createShape(NULL);
+	instance = NULL;
+}
+
 Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4)
-		: vec1(vec1), vec2(vec2), vec3(vec3), vec4(vec4), 
-			color(Vector3f(0.0f, 0.0f, 0.0f)), radiosity(Vector3f(0.0f, 0.0f, 0.0f)), illumination(Vector3f(0.0f, 0.0f, 0.0f))  {
-	for (int i = 0; i < 8; i++)
-		neighbours[i] = NULL;
+		: radiosity(Vector3f(0.0f, 0.0f, 0.0f)), illumination(Vector3f(0.0f, 0.0f, 0.0f))  {
+	shape = createShape(NULL);
+	shape->vertices[0] = vec1;
+	shape->vertices[1] = vec2;
+	shape->vertices[2] = vec3;
+	shape->vertices[3] = vec4;
+	shape->color = Vector3f(0.0f, 0.0f, 0.0f);
+	instance = NULL;
 }
 
 Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color)
-		: vec1(vec1), vec2(vec2), vec3(vec3), vec4(vec4), 
-			color(color), radiosity(Vector3f(0.0f, 0.0f, 0.0f)), illumination(Vector3f(0.0f, 0.0f, 0.0f)) {
-	for (int i = 0; i < 8; i++)
-		neighbours[i] = NULL;
+		: radiosity(Vector3f(0.0f, 0.0f, 0.0f)), illumination(Vector3f(0.0f, 0.0f, 0.0f)) {
+	shape = createShape(NULL);
+	shape->vertices[0] = vec1;
+	shape->vertices[1] = vec2;
+	shape->vertices[2] = vec3;
+	shape->vertices[3] = vec4;
+	shape->color = color;
+	instance = NULL;
 }
 
 Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color, Vector3f illumination)
-		: vec1(vec1), vec2(vec2), vec3(vec3), vec4(vec4), 
-			color(color), illumination(illumination), radiosity(Vector3f(0.0f, 0.0f, 0.0f)) {
-	for (int i = 0; i < 8; i++)
-		neighbours[i] = NULL;
+		: illumination(illumination), radiosity(Vector3f(0.0f, 0.0f, 0.0f)) {
+	shape = createShape(NULL);
+	shape->vertices[0] = vec1;
+	shape->vertices[1] = vec2;
+	shape->vertices[2] = vec3;
+	shape->vertices[3] = vec4;
+	shape->color = color;
+	instance = NULL;
 }
 
-Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color, Vector3f illumination, Vector3f radiosity)
-		: vec1(vec1), vec2(vec2), vec3(vec3), vec4(vec4), 
-			color(color), illumination(illumination), radiosity(radiosity) {
-	for (int i = 0; i < 8; i++)
-		neighbours[i] = NULL;
+/**
+ * 'shapeWhere' je pamet pro geometrii (napr. polozka areny); NULL = halda
+ */
+Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color, Vector3f illumination, Vector3f radiosity, void* shapeWhere)
+		: illumination(illumination), radiosity(radiosity) {
+	shape = createShape(shapeWhere);
+	shape->vertices[0] = vec1;
+	shape->vertices[1] = vec2;
+	shape->vertices[2] = vec3;
+	shape->vertices[3] = vec4;
+	shape->color = color;
+	instance = NULL;
+}
+
+/**
+ * Kopie ma vlastni geometrii. Z patche instance vznikne patch s rohy v souradnicich sceny;
+ * jeho sousede (patche instance) se neprebiraji, nova kopie je nezna
+ */
+Patch::Patch(const Patch& p, void* shapeWhere)
+		: illumination(p.illumination), radiosity(p.radiosity) {
+	shape = createShape(shapeWhere);
+	instance = NULL;
+	copyShape(p);
+}
+
+/**
+ * Patch instance ma jen energie a odkazy; 'source' (patch predlohy) musi zit dele nez on
+ */
+Patch::Patch(const Patch& source, const PatchInstance* instance)
+		: illumination(source.illumination), radiosity(source.radiosity) {
+	shape = source.shape;
+	this->instance = instance;
 }
 
 
 Patch::~Patch(void) {
+	if (instance == NULL)
+		delete shape;
+}
+
+
+/**
+ * Prirazeni udela z patche instance samostatny patch (stejne jako kopie)
+ */
+Patch& Patch::operator =(const Patch& p) {
+	if (this == &p)
+		return *this;
+
+	if (instance != NULL) {
+		shape = createShape(NULL);
+		instance = NULL;
+	}
+
+	radiosity = p.radiosity;
+	illumination = p.illumination;
+	copyShape(p);
+	return *this;
+}
+
+
+/**
+ * Prevezme geometrii patche 'p' do vlastni geometrie (rohy v souradnicich sceny)
+ */
+void Patch::copyShape(const Patch& p) {
+	const Vector3f* vertices = const_cast<Patch&>(p).getVertices();
+	for (unsigned int i = 0; i < 4; i++)
+		shape->vertices[i] = vertices[i];
+	shape->color = p.shape->color;
+
+	for (unsigned int n = 0; n < 8; n++)
+		shape->neighbours[n] = (p.instance == NULL) ? p.shape->neighbours[n] : NULL;
+}
+
+
+void* Patch::operator new(size_t size) {
+	return ::operator new(size);
+}
+
+
+void* Patch::operator new(size_t size, void* where) {
+	return where;
+}
+
+
+/**
+ * Patch z areny jen snizi jeji pocet zivych patchu, ostatni se uvolni normalne
+ */
+void Patch::operator delete(void* p) {
+	if (p != NULL && !NumaArena::release(p))
+		::operator delete(p);
+}
+
+
+void Patch::operator delete(void* p, void* where) {
 }
 
 
@@ -49,10 +182,10 @@ vector<Patch*>* Patch::divide(double area) {
 	//cout << "====================" << endl;
 	//cout << "Deleni do plochy " << area << endl;
 
-	Vector3f A = vec1;
-	Vector3f B = vec2;
-	Vector3f C = vec3;
-	Vector3f D = vec4;
+	Vector3f A = getVertex(0);
+	Vector3f B = getVertex(1);
+	Vector3f C = getVertex(2);
+	Vector3f D = getVertex(3);
 	
 	/*
 	cout << "A: " << A.x << "\t" << A.y << "\t" << A.z << endl;
@@ -118,7 +251,7 @@ vector<Patch*>* Patch::divide(double area) {
 			
 			Patch* p = new Patch( 							
 							nA, nB, nC, nD,						
-							this->color, this->illumination, this->radiosity 
+							getColor(), this->illumination, this->radiosity 
 						);
 			
 			patches->push_back(p);		
@@ -135,86 +268,86 @@ vector<Patch*>* Patch::divide(double area) {
 		// 0 - levy horni
 		if ( row + 1 >= ky ) { // prekroceni nahoru
 			if (col > 0) { 
-				p->neighbours[0] = patches->at( row * kx + (col - 1)); 				
+				p->setNeighbour(0, patches->at( row * kx + (col - 1))); 				
 			} else { 
-				p->neighbours[0] = p; 
+				p->setNeighbour(0, p); 
 			}
 		} 
 		else if ( col == 0 ) { // prekroceni doleva
 			if ( row + 1 < ky ) { 
-				p->neighbours[0] = patches->at( (row + 1) * kx + col ); 
+				p->setNeighbour(0, patches->at( (row + 1) * kx + col )); 
 			} else { 
-				p->neighbours[0] = p; 
+				p->setNeighbour(0, p); 
 			}
 		}
-		else { p->neighbours[0] = patches->at( (row + 1) * kx + (col - 1) ); }
+		else { p->setNeighbour(0, patches->at( (row + 1) * kx + (col - 1) )); }
 
 		// 1 - horni
-		if ( row + 1 >= ky ) { p->neighbours[1] = p; }
-		else { p->neighbours[1] = patches->at( (row + 1) * kx + col ); }
+		if ( row + 1 >= ky ) { p->setNeighbour(1, p); }
+		else { p->setNeighbour(1, patches->at( (row + 1) * kx + col )); }
 
 		// 2 - pravy horni
 		if ( row + 1 >= ky ) { // prekroceni nahoru
 			if ( col + 1 < kx ) { 
-				p->neighbours[2] = patches->at( row * kx + (col + 1) ); 
+				p->setNeighbour(2, patches->at( row * kx + (col + 1) )); 
 			} else { 
-				p->neighbours[2] = p; 
+				p->setNeighbour(2, p); 
 			}
 		} 
 		else if ( col + 1 >= kx ) { // prekroceni doprava
 			if ( row + 1 < ky ) { 
-				p->neighbours[2] = patches->at( (row + 1) * kx + col ); 
+				p->setNeighbour(2, patches->at( (row + 1) * kx + col )); 
 			} else { 
-				p->neighbours[2] = p;
+				p->setNeighbour(2, p);
 			}
 		} 
-		else { p->neighbours[2] = patches->at( (row + 1) * kx + (col + 1) ); }
+		else { p->setNeighbour(2, patches->at( (row + 1) * kx + (col + 1) )); }
 
 		// 3 - pravy
-		if (col + 1 >= kx) { p->neighbours[3] = p; }
-		else { p->neighbours[3] = patches->at( row * kx + (col + 1) ); }
+		if (col + 1 >= kx) { p->setNeighbour(3, p); }
+		else { p->setNeighbour(3, patches->at( row * kx + (col + 1) )); }
 
 		// 4 - pravy dolni
 		if (row == 0) { // prekroceni dolu
 			if ( col + 1 < kx ) { 
-				p->neighbours[4] = patches->at( row * kx + (col + 1) ); 
+				p->setNeighbour(4, patches->at( row * kx + (col + 1) )); 
 			} else { 
-				p->neighbours[4] = p; 
+				p->setNeighbour(4, p); 
 			}
 		}
 		else if ( col + 1 >= kx ) { // prekroceni doprava
 			if ( row > 0 ) { 
-				p->neighbours[4] = patches->at( (row - 1) * kx + col ); 
+				p->setNeighbour(4, patches->at( (row - 1) * kx + col )); 
 			} else { 
-				p->neighbours[4] = p;
+				p->setNeighbour(4, p);
 			}
 		}
-		else { p->neighbours[4] = patches->at( (row - 1) * kx + (col + 1) ); }
+		else { p->setNeighbour(4, patches->at( (row - 1) * kx + (col + 1) )); }
 
 		// 5 - dolni
-		if (row == 0) { p->neighbours[5] = p; }
-		else { p->neighbours[5] = patches->at( (row - 1) * kx + col ); }
+		if (row == 0) { p->setNeighbour(5, p); }
+		else { p->setNeighbour(5, patches->at( (row - 1) * kx + col )); }
 
 		// 6 - levy dolni
 		if (row == 0) { // prekroceni dolu
 			if ( col > 0 ) { 
-				p->neighbours[6] = patches->at( row * kx + (col - 1) ); 
+				p->setNeighbour(6, patches->at( row * kx + (col - 1) )); 
 			} else { 
-				p->neighbours[6] = p; 
+				p->setNeighbour(6, p); 
 			}
 		}
 		else if ( col == 0 ) { // prekroceni doleva
 			if ( row > 0 ) { 
-				p->neighbours[6] = patches->at( (row - 1) * kx + col ); 
+				p->setNeighbour(6, patches->at( (row - 1) * kx + col )); 
 			} else { 
-				p->neighbours[6] = p; 
+				p->setNeighbour(6, p); 
 			}
 		}
-		else { p->neighbours[6] = patches->at( (row - 1) * kx + (col - 1) ); }
+		else { p->setNeighbour(6, patches->at( (row - 1) * kx + (col - 1) )); }
 
 		// 7 - levy
-		if (col == 0) { p->neighbours[7] = p; }
-		else { p->neighbours[7] = patches->at( row * kx + (col - 1) ); }
+		if (col == 0) { p->setNeighbour(7, p); }
+		else { p->setNeighbour(7, patches->at( row * kx + (col - 1) )); }
 	}
 
 
@@ -223,35 +356,24 @@ vector<Patch*>* Patch::divide(double area) {
 
 
 /**
- * Vraci souradnice vrcholu patche nasypane v jedinem vektoru
+ * Zapise souradnice vrcholu patche do pole 'coords' o delce alespon 12 floatu;
+ * nic nealokuje, aby slo plnit primo vysledne pole sceny
  */
-vector<float> Patch::getVerticesCoords() {
-	vector<float> v;
-
-	v.push_back(vec1.x);
-	v.push_back(vec1.y);
-	v.push_back(vec1.z);
-
-	v.push_back(vec2.x);
-	v.push_back(vec2.y);
-	v.push_back(vec2.z);
-
-	v.push_back(vec3.x);
-	v.push_back(vec3.y);
-	v.push_back(vec3.z);
-
-	v.push_back(vec4.x);
-	v.push_back(vec4.y);
-	v.push_back(vec4.z);
-
-	return v;
+void Patch::getVerticesCoords(float* coords) {
+	const Vector3f* vertices = getVertices();
+	for (unsigned int i = 0; i < 4; i++) {
+		coords[i * 3] = vertices[i].x;
+		coords[i * 3 + 1] = vertices[i].y;
+		coords[i * 3 + 2] = vertices[i].z;
+	}
 }
 
 /**
  * Vraci Up vektor
  */
 Vector3f Patch::getUp() {
-	return Vector3f(vec4 - vec1);
+	const Vector3f* vertices = getVertices();
+	return Vector3f(vertices[3] - vertices[0]);
 }
 
 
@@ -259,6 +381,8 @@ Vector3f Patch::getUp() {
  * Vraci stred patche
  */
 Vector3f Patch::getCenter() {
+	const Vector3f* vertices = getVertices();
+	Vector3f vec1 = vertices[0], vec2 = vertices[1], vec3 = vertices[2], vec4 = vertices[3];
 	return Vector3f(
 		(vec1.x + vec2.x + vec3.x + vec4.x) / 4.0f,
 		(vec1.y + vec2.y + vec3.y + vec4.y) / 4.0f,
@@ -270,7 +394,8 @@ Vector3f Patch::getCenter() {
  * Vraci normalu patche
  */
 Vector3f Patch::getNormal() {
-	Vector3f A = vec2 - vec1;
-	Vector3f B = vec4 - vec1;
+	const Vector3f* vertices = getVertices();
+	Vector3f A = vertices[1] - vertices[0];
+	Vector3f B = vertices[3] - vertices[0];
 	return A.Cross(B);
 }
@@ -13,6 +13,41 @@ using namespace std;
 #define REFLECTIVITY 0.3f
 
 
+class Patch;
+
+
+/**
+ * Geometrie patche - rohy, barva a sousedi. Patch sceny ma vlastni; patche instanci modelu sdileji
+ * geometrii patchu predlohy (v jejich souradnicich), takze se pro kazdou kopii neuklada znovu
+ */
+struct PatchShape {
+	PatchShape();
+
+	// muze lezet v arene jako patch (LoadingModel, ModelContainer::placePatches)
+	static void* operator new(size_t size);
+	static void* operator new(size_t size, void* where);
+	static void operator delete(void* p);
+	static void operator delete(void* p, void* where);
+
+	Vector3f vertices[4];	// 0 = levy dolni, 1 = pravy dolni, 2 = pravy horni, 3 = levy horni
+	Vector3f color;		// vychozi barva povrchu - pouzita pro color bleeding
+	Patch* neighbours[8];	// ukazatele na sousedici patche - plni se az pri skladani sceny; cislovano z leveho horniho rohu; pokud soused neni, ukazuje na sebe
+};
+
+
+/**
+ * Umisteni instance modelu ve scene (InstancedModel). Patche instance lezi v souvislem bloku
+ * v poradi patchu predlohy - soused patche se z cisel sousedu predlohy dopocita primo. Rohy patchu
+ * ve scene se transformuji jednou pri vytvoreni bloku, ne pri kazdem cteni vrcholu
+ */
+struct PatchInstance {
+	Matrix4f transform;		// z predlohy do sceny
+	Patch* patches;			// patche instance
+	const unsigned int* neighbours;	// 8 cisel sousedu na patch predlohy
+	const Vector3f* vertices;	// 4 rohy ve scene na patch
+};
+
+
 class Patch {
 	
 	/*
@@ -30,29 +65,54 @@ class Patch {
 		Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4);
 		Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color);
 		Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color, Vector3f illumination);
-		Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color, Vector3f illumination, Vector3f radiosity);
+		Patch::Patch(Vector3f vec1, Vector3f vec2, Vector3f vec3, Vector3f vec4, Vector3f color, Vector3f illumination, Vector3f radiosity, void* shapeWhere = NULL);
+		Patch::Patch(const Patch& p, void* shapeWhere = NULL);	// kopie patche instance je samostatny patch v souradnicich sceny
+		Patch::Patch(const Patch& source, const PatchInstance* instance);	// patch instance - sdili geometrii patche predlohy 'source'
 		~Patch(void);
 
+		Patch& operator =(const Patch& p);
+
+		// patch muze lezet i v NUMA arene sceny (ModelContainer::placePatches), kde se nemaze jednotlive
+		static void* operator new(size_t size);
+		static void* operator new(size_t size, void* where);
+		static void operator delete(void* p);
+		static void operator delete(void* p, void* where);
+
 		vector<Patch*>* divide(double area);	// rozdeli sam sebe na mensi plosky a vraci jejich vektor
-		vector<float> getVerticesCoords();	// vraci vsechny souradnice vrcholu nasypane v jedinem poli
+		void getVerticesCoords(float* coords);	// zapise vsechny souradnice vrcholu (12 hodnot) do pripraveneho pole
 
+		Vector3f getVertex(unsigned int i);	// vraci i-ty vrchol patche (0 - 3, proti smeru hodinovych rucicek od leveho dolniho)
+		const Vector3f* getVertices();	// vsechny 4 vrcholy patche ve scene najednou (pro smycky pres patche)
 		Vector3f getCenter();	// vraci bod v prostredu patche (pro umisteni kamery)
 		Vector3f getNormal();	// vraci normalu
 		Vector3f getUp();		// vraci pomocny Up vector; slouzi jako referencni bod pri otaceni pohledu
 		Vector3f getColor();	// vraci vlastni barvu patche
 		float    getReflectivity();	// vraci odrazivost povrchu
-		Patch**  getNeighbours(); // vraci pole ukazatelu na sousedici patche
+		Patch*   getNeighbour(unsigned int n);	// vraci n-teho souseda (0 - 7, z leveho horniho rohu); NULL = zatim neznamy
+		void     setNeighbour(unsigned int n, Patch* p);	// u patche instance nic - sousedy dava predloha
+		bool     isInstance();	// patch instance - geometrii sdili s predlohou a nelze jej presunout
 
 		Vector3f radiosity;	// radiozita - energie vyzarena z povrchu
 		Vector3f illumination;	// osvetlenost plosky (zde se scitaji svetla ktera dopadla na plosku)
 
-		unsigned int relativeNeighbours[8]; // relativni odkazy na sousedici patche, cislovano v ramci sceny; pouziva se pouze pri ulozeni jako nahrada ukazatelu
-		Patch* neighbours[8]; // ukazatele na sousedici patche - plni se az pri skladani sceny; cislovano z leveho horniho rohu; pokud soused neni, ukazuje na sebe		
-
 	protected:
-		Vector3f vec1, vec2, vec3, vec4;
-		Vector3f color;		// vychozi barva povrchu - pouzita pro color bleeding
-		//float reflectivity;	// odrazivost plosky - pro vypocet kolik energie se pohlti/odrazi				
+		void copyShape(const Patch& p);	// prevezme geometrii 'p' v souradnicich sceny do vlastni
+
+		PatchShape* shape;	// vlastni geometrie, u instance geometrie patche predlohy
+		const PatchInstance* instance;	// NULL = patch sceny
+};
+
+
+/**
+ * Zaznam patche ve starem formatu .rr - puvodni rozlozeni tridy Patch (relativni sousedi misto ukazatelu)
+ */
+struct LegacyPatch {
+	Vector3f radiosity;
+	Vector3f illumination;
+	unsigned int relativeNeighbours[8];
+	Patch* neighbours[8];
+	Vector3f vec1, vec2, vec3, vec4;
+	Vector3f color;
 };
 
 
@@ -68,5 +128,39 @@ inline float Patch::getReflectivity() {
  * Vraci vlastni barvu patche
  */
 inline Vector3f Patch::getColor() {
-	return color;
+	return shape->color;
+}
+
+/**
+ * Vraci i-ty vrchol patche; 0 = levy dolni, 1 = pravy dolni, 2 = pravy horni, 3 = levy horni
+ */
+inline Vector3f Patch::getVertex(unsigned int i) {
+	return getVertices()[i < 3 ? i : 3];
+}
+
+/**
+ * Vraci pole 4 vrcholu patche ve scene; patch instance je ma predpocitane v bloku instance
+ */
+inline const Vector3f* Patch::getVertices() {
+	if (instance == NULL)
+		return shape->vertices;
+	return instance->vertices + unsigned(this - instance->patches) * 4;
+}
+
+/**
+ * Soused patche instance je patch stejne instance s cislem souseda v predloze
+ */
+inline Patch* Patch::getNeighbour(unsigned int n) {
+	if (instance == NULL)
+		return shape->neighbours[n];
+	return instance->patches + instance->neighbours[unsigned(this - instance->patches) * 8 + n];
+}
+
+inline void Patch::setNeighbour(unsigned int n, Patch* p) {
+	if (instance == NULL)
+		shape->neighbours[n] = p;
+}
+
+inline bool Patch::isInstance() {
+	return instance != NULL;
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "ResultExport.h"
+#include <string.h>
+#include <math.h>
+
+
+// pocet bloku kodovanych najednou - omezuje pamet pro zkomprimovana data pred zapisem
+static const unsigned int CHUNKS_PER_BATCH = 64;
+
+
+/**
+ * Zapise cislo se znamenkem jako varint (zigzag: 0, -1, 1, -2, ... => 0, 1, 2, 3, ...)
+ */
+static inline void writeVarint(vector<uint8_t>& out, int32_t value) {
+	uint32_t v = (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+	while (v >= 0x80) {
+		out.push_back(uint8_t(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(uint8_t(v));
+}
+
+/**
+ * Precte varint zapsany writeVarint; vraci false pri cteni za konec dat
+ */
+static inline bool readVarint(const uint8_t*& p, const uint8_t* end, int32_t& value) {
+	uint32_t v = 0;
+	for (unsigned int shift = 0; shift < 35; shift += 7) {
+		if (p >= end)
+			return false;
+		uint8_t b = *p++;
+		v |= uint32_t(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			value = int32_t(v >> 1) ^ -int32_t(v & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/**
+ * Radiance - to, co se zobrazuje: vlastni barva * (iluminativni + radiativni energie); nevystrelena
+ * radiativni energie uz na patch dopadla a v iluminativni jeste neni, soucet ji tedy nepocita dvakrat
+ */
+Vector3f ResultExport::getRadiance(Patch* p) {
+	return p->getColor() * (p->illumination + p->radiosity);
+}
+
+
+/**
+ * Zakoduje a zkomprimuje jeden blok patchu
+ */
+void ResultExport::encodeChunk(Patch** patches, unsigned int count, float quantum, vector<uint8_t>& out, uint32_t& rawSize) {
+	vector<uint8_t> raw;
+	raw.reserve(count * (4 + 12 * 2));
+	raw.resize(count * 4);
+
+	for (unsigned int i = 0; i < count; i++) {
+		uint32_t packed = Colors::packRGB9E5(getRadiance(patches[i]));
+		memcpy(&raw[i * 4], &packed, 4);
+	}
+
+	// souradnice - rozdily kvantovanych hodnot od predchoziho vrcholu v bloku
+	int32_t prev[3] = { 0, 0, 0 };
+	float coords[12];
+	for (unsigned int i = 0; i < count; i++) {
+		patches[i]->getVerticesCoords(coords);
+		for (unsigned int c = 0; c < 12; c++) {
+			int32_t q = int32_t(floor(coords[c] / quantum + 0.5f));
+			writeVarint(raw, q - prev[c % 3]);
+			prev[c % 3] = q;
+		}
+	}
+
+	rawSize = uint32_t(raw.size());
+	out.clear();
+	LzCodec::compress(raw.empty() ? NULL : &raw[0], raw.size(), out);
+}
+
+
+/**
+ * Rozbali a dekoduje jeden blok do vystupnich poli (uz posunutych na prvni patch bloku)
+ */
+bool ResultExport::decodeChunk(const uint8_t* data, const Chunk& chunk, float quantum, float* vertices, float* radiance) {
+	if (chunk.rawSize < uint64_t(chunk.patchCount) * 4)
+		return false;
+
+	vector<uint8_t> raw(chunk.rawSize);
+	if (raw.empty())
+		return true;
+
+	if (!LzCodec::decompress(data, chunk.compressedSize, &raw[0], raw.size()))
+		return false;
+
+	for (unsigned int i = 0; i < chunk.patchCount; i++) {
+		uint32_t packed;
+		memcpy(&packed, &raw[i * 4], 4);
+		Vector3f c = Colors::unpackRGB9E5(packed);
+		radiance[i * 3] = c.x;
+		radiance[i * 3 + 1] = c.y;
+		radiance[i * 3 + 2] = c.z;
+	}
+
+	const uint8_t* p = &raw[0] + chunk.patchCount * 4;
+	const uint8_t* end = &raw[0] + raw.size();
+	int32_t prev[3] = { 0, 0, 0 };
+	for (unsigned int i = 0; i < chunk.patchCount * 12; i++) {
+		int32_t delta;
+		if (!readVarint(p, end, delta))
+			return false;
+		prev[i % 3] += delta;
+		vertices[i] = prev[i % 3] * quantum;
+	}
+
+	return true;
+}
+
+
+/**
+ * Ulozi geometrii a radianci patchu do kompaktniho souboru. Bloky se koduji paralelne
+ * po davkach, tabulka bloku se dopise nakonec
+ */
+bool ResultExport::save(const char* filename, Patch** patches, unsigned int count, float quantum) {
+	FILE* fp = NULL;
+	if (fopen_s(&fp, filename, "wb") != 0 || fp == NULL)
+		return false;
+
+	unsigned int chunkCount = (count + PATCHES_PER_CHUNK - 1) / PATCHES_PER_CHUNK;
+
+	Header h;
+	memset(&h, 0, sizeof(Header));
+	memcpy(h.magic, "RRQX", 4);
+	h.endianTag = 0x01020304;
+	h.version = VERSION;
+	h.chunkCount = chunkCount;
+	h.patchCount = count;
+	h.patchesPerChunk = PATCHES_PER_CHUNK;
+	h.quantum = quantum;
+
+	vector<Chunk> chunks(chunkCount);
+	unsigned int patchesPerChunk = PATCHES_PER_CHUNK;
+
+	bool error = false;
+	error |= fwrite(&h, sizeof(Header), 1, fp) != 1;
+	// tabulka zatim jen zabere misto, skutecne hodnoty se zapisi po zakodovani bloku
+	if (chunkCount > 0)
+		error |= fwrite(&chunks[0], sizeof(Chunk), chunkCount, fp) != chunkCount;
+
+	uint64_t offset = sizeof(Header) + uint64_t(chunkCount) * sizeof(Chunk);
+	vector<vector<uint8_t> > encoded(min(chunkCount, CHUNKS_PER_BATCH));
+
+	for (unsigned int batch = 0; batch < chunkCount && !error; batch += CHUNKS_PER_BATCH) {
+		int batchSize = int(min(CHUNKS_PER_BATCH, chunkCount - batch));
+
+		#pragma omp parallel for
+		for (int c = 0; c < batchSize; c++) {
+			Chunk& chunk = chunks[batch + c];
+			chunk.firstPatch = (batch + c) * patchesPerChunk;
+			chunk.patchCount = min(patchesPerChunk, count - chunk.firstPatch);
+			encodeChunk(patches + chunk.firstPatch, chunk.patchCount, quantum, encoded[c], chunk.rawSize);
+			chunk.compressedSize = uint32_t(encoded[c].size());
+		}
+
+		for (int c = 0; c < batchSize && !error; c++) {
+			chunks[batch + c].offset = offset;
+			if (!encoded[c].empty())
+				error |= fwrite(&encoded[c][0], 1, encoded[c].size(), fp) != encoded[c].size();
+			offset += encoded[c].size();
+		}
+	}
+
+	// dopsat tabulku bloku
+	if (!error && chunkCount > 0) {
+		error |= fseek(fp, sizeof(Header), SEEK_SET) != 0;
+		error |= fwrite(&chunks[0], sizeof(Chunk), chunkCount, fp) != chunkCount;
+	}
+
+	fclose(fp);
+	return !error;
+}
+
+
+/**
+ * Nacte soubor a paralelne rozbali vsechny bloky
+ */
+bool ResultExport::load(const char* filename, vector<float>& vertices, vector<float>& radiance) {
+	FILE* fp = NULL;
+	if (fopen_s(&fp, filename, "rb") != 0 || fp == NULL)
+		return false;
+
+	Header h;
+	if (fread(&h, sizeof(Header), 1, fp) != 1 || memcmp(h.magic, "RRQX", 4) != 0) {
+		cerr << "Not a result export file" << endl;
+		fclose(fp);
+		return false;
+	}
+	if (h.endianTag != 0x01020304 || h.version != VERSION) {
+		cerr << "Unsupported result export file (version " << h.version << ")" << endl;
+		fclose(fp);
+		return false;
+	}
+
+	vector<Chunk> chunks(h.chunkCount);
+	if (h.chunkCount > 0 && fread(&chunks[0], sizeof(Chunk), h.chunkCount, fp) != h.chunkCount) {
+		fclose(fp);
+		return false;
+	}
+
+	// zbytek souboru najednou - bloky se pak rozbaluji primo z pameti
+	uint64_t dataStart = sizeof(Header) + uint64_t(h.chunkCount) * sizeof(Chunk);
+	_fseeki64(fp, 0, SEEK_END);
+	uint64_t fileSize = uint64_t(_ftelli64(fp));
+	if (fileSize < dataStart) {
+		fclose(fp);
+		return false;
+	}
+	vector<uint8_t> data(size_t(fileSize - dataStart));
+	_fseeki64(fp, dataStart, SEEK_SET);
+	bool readError = !data.empty() && fread(&data[0], 1, data.size(), fp) != data.size();
+	fclose(fp);
+
+	if (readError)
+		return false;
+
+	vertices.resize(size_t(h.patchCount) * 12);
+	radiance.resize(size_t(h.patchCount) * 3);
+
+	int chunkCount = int(h.chunkCount);
+	int errors = 0;
+
+	// bloky jsou nezavisle - kazdy se rozbali do sveho useku vystupnich poli
+	#pragma omp parallel for reduction(+:errors)
+	for (int c = 0; c < chunkCount; c++) {
+		const Chunk& chunk = chunks[c];
+		if (chunk.offset < dataStart || chunk.offset - dataStart + chunk.compressedSize > data.size() ||
+			uint64_t(chunk.firstPatch) + chunk.patchCount > h.patchCount) {
+			errors++;
+			continue;
+		}
+
+		if (chunk.patchCount > 0 && !decodeChunk(&data[0] + size_t(chunk.offset - dataStart), chunk, h.quantum,
+			&vertices[0] + size_t(chunk.firstPatch) * 12, &radiance[0] + size_t(chunk.firstPatch) * 3))
+			errors++;
+	}
+
+	return errors == 0;
+}
+
+
+/**
+ * Radiance se smi lisit o zaokrouhleni RGB9E5 - krok sdileneho exponentu je nejvyse 1/256 nejvetsi slozky,
+ * nejmene vsak 2^-24 (hodnoty mimo rozsah formatu se orezou); souradnice o polovinu kroku kvantovani
+ */
+bool ResultExport::verify(const char* filename, Patch** patches, unsigned int count, float quantum) {
+	vector<float> vertices;
+	vector<float> radiance;
+	if (!load(filename, vertices, radiance) || radiance.size() != size_t(count) * 3) {
+		cerr << "Unable to read back exported results" << endl;
+		return false;
+	}
+
+	const float maxValue = 65408.0f;	// nejvetsi hodnota RGB9E5
+	const float minStep = 5.9604645e-8f;	// 2^-24 - krok pri nejmensim exponentu
+	int mismatches = 0;
+
+	#pragma omp parallel for reduction(+:mismatches)
+	for (int i = 0; i < int(count); i++) {
+		Vector3f expected = getRadiance(patches[i]);
+		float e[3] = { expected.x, expected.y, expected.z };
+		float largest = 0;
+		for (unsigned int c = 0; c < 3; c++) {
+			e[c] = min(max(e[c], 0.0f), maxValue);
+			largest = max(largest, e[c]);
+		}
+
+		bool same = true;
+		for (unsigned int c = 0; c < 3; c++)
+			same &= fabs(radiance[i * 3 + c] - e[c]) <= max(largest / 256, minStep);
+
+		float coords[12];
+		patches[i]->getVerticesCoords(coords);
+		for (unsigned int c = 0; c < 12; c++)
+			same &= fabs(vertices[i * 12 + c] - coords[c]) <= quantum * 0.5f + fabs(coords[c]) * 1e-6f;
+
+		if (!same)
+			mismatches++;
+	}
+
+	if (mismatches > 0)
+		cerr << "Exported results differ from the scene in " << mismatches << " patches" << endl;
+
+	return mismatches == 0;
+}
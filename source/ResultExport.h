@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "Patch.h"
+#include "Colors.h"
+#include "LzCodec.h"
+
+using namespace std;
+
+
+/**
+ * Kompaktni export vysledku vypoctu pro prohlizece (*.rrq). Neni nahradou souboru sceny - obsahuje
+ * jen geometrii a vyslednou (zobrazovanou) radianci patchu ve snizene presnosti:
+ *  - radiance jako RGB9E5 (sdileny exponent, 4 byty na patch); radiance je vlastni barva * (illumination + radiosity),
+ *    tedy vsechna energie, ktera na patch dopadla - jiz vystrelena (illumination) i dosud nevystrelena (radiosity).
+ *    Zadna energie v souctu neni dvakrat, export uprostred vypoctu odpovida prave zobrazenemu stavu
+ *  - souradnice vrcholu kvantovane s krokem 'quantum', ulozene jako rozdily od predchoziho vrcholu (zigzag + varint)
+ *  - patche rozdelene do bloku, kazdy blok samostatne zkomprimovany LzCodec => bloky lze kodovat i dekodovat paralelne
+ *
+ *  hlavicka | tabulka bloku | blok 0 | blok 1 | ...
+ *  rozbaleny blok: radiance (uint32 * n) | rozdily souradnic (varinty, 12 na patch)
+ *
+ * Prohlizec cte soubor pres load (bloky se rozbaluji paralelne, kazdy samostatne); program po zapisu
+ * soubor nacte zpet a porovna s patchi (verify).
+ */
+class ResultExport {
+
+	public:
+		static const uint32_t VERSION = 1;
+		static const uint32_t PATCHES_PER_CHUNK = 16384;
+
+		static bool save(const char* filename, Patch** patches, unsigned int count, float quantum = 0.0001f);	// ulozi vysledky sceny
+		static bool load(const char* filename, vector<float>& vertices, vector<float>& radiance);	// nacte vysledky - 12 floatu souradnic a 3 floaty radiance na patch
+		static bool verify(const char* filename, Patch** patches, unsigned int count, float quantum = 0.0001f);	// nacte export (ulozeny se stejnym 'quantum') a porovna ho s patchi v mezich presnosti formatu
+
+	private:
+		struct Header {
+			char magic[4];			// "RRQX"
+			uint32_t endianTag;		// 0x01020304
+			uint32_t version;
+			uint32_t chunkCount;
+			uint64_t patchCount;
+			uint32_t patchesPerChunk;
+			float quantum;			// krok kvantovani souradnic
+			uint64_t reserved[2];
+		};
+
+		struct Chunk {
+			uint64_t offset;		// pozice zkomprimovanych dat od zacatku souboru
+			uint32_t compressedSize;
+			uint32_t rawSize;		// delka po rozbaleni
+			uint32_t firstPatch;
+			uint32_t patchCount;
+		};
+
+		static Vector3f getRadiance(Patch* p);	// exportovana radiance patche
+		static void encodeChunk(Patch** patches, unsigned int count, float quantum, vector<uint8_t>& out, uint32_t& rawSize);
+		static bool decodeChunk(const uint8_t* data, const Chunk& chunk, float quantum, float* vertices, float* radiance);
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <math.h>
+#include "Patch.h"
+#include "Vector.h"
+
+
+/**
+ * Nahodne vzorky pro vypocty s paprsky. Cisla jsou urcena citacem (klic, poradi vzorku, dimenze) misto
+ * stavu generatoru - kazdy paprsek ma vlastni posloupnost a vysledek nezavisi na poctu vlaken ani na
+ * tom, ktere vlakno paprsek zpracuje.
+ */
+class Sampling {
+
+	public:
+		static float number(unsigned int key, unsigned int index, unsigned int dimension);	// cislo z <0, 1)
+		static Vector3f cosineDirection(const Vector3f& normal, float u1, float u2);	// smer v polokouli jednotkove normaly s hustotou podle kosinu
+		static Vector3f pointOnPatch(Patch* p, float u, float v);	// bod ctyruhelniku (bilinearne mezi vrcholy)
+		static Vector3f pointOnPatch(const Vector3f* vertices, float u, float v);	// totez pro ctyri vrcholy v poli
+};
+
+
+/**
+ * Promichani citace (hash s plnym lavinovym efektem), hornich 24 bitu je mantisa vysledku
+ */
+inline float Sampling::number(unsigned int key, unsigned int index, unsigned int dimension) {
+	unsigned int h = index * 0x9E3779B1u ^ key * 0x85EBCA77u ^ dimension * 0xC2B2AE3Du;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+inline Vector3f Sampling::cosineDirection(const Vector3f& normal, float u1, float u2) {
+	Vector3f t = normal.v_Cross((fabs(normal.x) > 0.5f) ? Vector3f(0, 1, 0) : Vector3f(1, 0, 0));
+	t *= 1 / t.f_Length();
+	Vector3f b = normal.v_Cross(t);
+
+	float r = sqrtf(u1);
+	float phi = 2 * f_pi * u2;
+	return t * (r * cosf(phi)) + b * (r * sinf(phi)) + normal * sqrtf(1 - u1);
+}
+
+inline Vector3f Sampling::pointOnPatch(Patch* p, float u, float v) {
+	return pointOnPatch(p->getVertices(), u, v);
+}
+
+inline Vector3f Sampling::pointOnPatch(const Vector3f* vertices, float u, float v) {
+	return vertices[0] * ((1 - u) * (1 - v)) + vertices[1] * (u * (1 - v)) +
+		vertices[2] * (u * v) + vertices[3] * ((1 - u) * v);
+}
@@ -0,0 +1,148 @@
+#include "SceneBvh.h"
+
+
+// posun zacatku paprsku - aby patch, ze ktereho paprsek vychazi, nezasahl sam sebe
+static const float RAY_EPSILON = 1e-4f;
+
+
+/**
+ * Navstevnik spodni urovne - testuje patche v souradnicich instance
+ */
+struct PatchHit {
+	Patch* const* patches;
+	const Vector3f& origin;
+	const Vector3f& dir;
+	bool anyHit;	// staci libovolny zasah (stin)
+	int item;		// nejblizsi zasazeny prvek
+
+	PatchHit(Patch* const* patches, const Vector3f& origin, const Vector3f& dir, bool anyHit)
+		: patches(patches), origin(origin), dir(dir), anyHit(anyHit), item(-1) {
+	}
+
+	bool operator()(unsigned int i, float& tmax) {
+		float t = SceneBvh::intersectPatch(patches[i], origin, dir);
+		if (t > RAY_EPSILON && t < tmax) {
+			tmax = t;
+			item = int(i);
+			return anyHit;
+		}
+		return false;
+	}
+};
+
+
+/**
+ * Navstevnik horni urovne - paprsek prevede do souradnic instance a projde jeji strom.
+ * Transformace je afinni, parametr t je proto v obou soustavach stejny (smer se nenormalizuje)
+ */
+struct InstanceHit {
+	const vector<SceneBvh::Instance>& instances;
+	const Vector3f& origin;
+	const Vector3f& dir;
+	bool anyHit;
+	int patch;		// nejblizsi zasazeny patch ve scene
+
+	InstanceHit(const vector<SceneBvh::Instance>& instances, const Vector3f& origin, const Vector3f& dir, bool anyHit)
+		: instances(instances), origin(origin), dir(dir), anyHit(anyHit), patch(-1) {
+	}
+
+	bool operator()(unsigned int i, float& tmax) {
+		const SceneBvh::Instance& inst = instances[i];
+
+		Vector3f o = inst.identity ? origin : inst.toLocal.v_Transform_Pos(origin);
+		Vector3f d = inst.identity ? dir : inst.toLocal.v_Transform_Dir(dir);
+
+		PatchHit hit(inst.patches, o, d, anyHit);
+		bool stop = inst.bvh->traverseRay(o, d, tmax, hit);
+		if (hit.item >= 0)
+			patch = int(inst.firstPatch) + hit.item;
+
+		return stop;
+	}
+};
+
+
+void SceneBvh::clear() {
+	instances.clear();
+	topLevel.clear();
+}
+
+
+void SceneBvh::addInstance(const Bvh* bvh, Patch* const* patches, const Matrix4f& transform, bool identity, unsigned int firstPatch) {
+	Instance inst;
+	inst.bvh = bvh;
+	inst.patches = patches;
+	inst.toWorld = transform;
+	inst.toLocal = transform.t_FastInverse();	// transformace instanci jsou afinni
+	inst.identity = identity;
+	inst.firstPatch = firstPatch;
+	instances.push_back(inst);
+}
+
+
+/**
+ * Horni uroven - kvadr kazde instance je kvadr jejiho stromu prevedeny do sceny
+ */
+void SceneBvh::build() {
+	vector<Aabb> boxes(instances.size());
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		const Aabb& local = instances[i].bvh->getBounds();
+		boxes[i] = instances[i].identity ? local : local.transformed(instances[i].toWorld);
+	}
+
+	topLevel.build(boxes);
+}
+
+
+int SceneBvh::intersect(const Vector3f& origin, const Vector3f& dir, float& tmax) const {
+	InstanceHit hit(instances, origin, dir, false);
+	topLevel.traverseRay(origin, dir, tmax, hit);
+	return hit.patch;
+}
+
+
+bool SceneBvh::occluded(const Vector3f& origin, const Vector3f& dir, float tmax) const {
+	InstanceHit hit(instances, origin, dir, true);
+	return topLevel.traverseRay(origin, dir, tmax, hit);
+}
+
+
+const Bvh& SceneBvh::getTopLevel() const {
+	return topLevel;
+}
+
+
+const vector<SceneBvh::Instance>& SceneBvh::getInstances() const {
+	return instances;
+}
+
+
+void SceneBvh::buildPatchBvh(Bvh& bvh, Patch* const* patches, unsigned int count) {
+	vector<Aabb> boxes(count);
+
+	#pragma omp parallel for
+	for (int i = 0; i < int(count); i++) {
+		const Vector3f* vertices = patches[i]->getVertices();
+		for (unsigned int v = 0; v < 4; v++)
+			boxes[i].extend(vertices[v]);
+	}
+
+	bvh.build(boxes);
+}
+
+
+float SceneBvh::intersectPatch(Patch* p, const Vector3f& origin, const Vector3f& dir) {
+	const Vector3f* v = p->getVertices();
+	return intersectQuad(v[0], v[1], v[2], v[3], origin, dir);
+}
+
+
+/**
+ * Ctyruhelnik ABCD se testuje jako dva trojuhelniky ABC a ACD
+ */
+float SceneBvh::intersectQuad(const Vector3f& a, const Vector3f& b, const Vector3f& c, const Vector3f& d, const Vector3f& origin, const Vector3f& dir) {
+	float t = intersectTriangle(origin, dir, a, b, c);
+	if (t >= 0)
+		return t;
+	return intersectTriangle(origin, dir, a, c, d);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include "Bvh.h"
+#include "Patch.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Dvouurovnova hierarchie pro dotazy na viditelnost ve scene. Spodni uroven tvori BVH jednotlivych
+ * modelu v jejich vlastnich souradnicich (instance jednoho prototypu sdileji jeden strom), horni uroven
+ * je BVH nad kvadry instanci ve scene. Prvek spodniho stromu je poradove cislo patche v modelu,
+ * cislo patche ve scene je tedy firstPatch instance + cislo prvku.
+ */
+class SceneBvh {
+
+	public:
+		struct Instance {
+			const Bvh* bvh;			// strom modelu v jeho souradnicich
+			Patch* const* patches;	// patche, nad kterymi je strom postaveny (ve stejnych souradnicich)
+			Matrix4f toWorld;		// transformace modelu do sceny
+			Matrix4f toLocal;		// inverzni transformace - paprsky se prevadi do souradnic modelu
+			bool identity;			// model je primo v souradnicich sceny
+			unsigned int firstPatch;	// cislo prvniho patche modelu ve scene
+		};
+
+		void clear();
+		void addInstance(const Bvh* bvh, Patch* const* patches, const Matrix4f& transform, bool identity, unsigned int firstPatch);
+		void build();	// postavi horni uroven nad pridanymi instancemi
+
+		int intersect(const Vector3f& origin, const Vector3f& dir, float& tmax) const;	// nejblizsi zasazeny patch (cislo ve scene) nebo -1; tmax se zkrati na vzdalenost zasahu
+		bool occluded(const Vector3f& origin, const Vector3f& dir, float tmax) const;	// zasahne paprsek cokoliv v intervalu (0, tmax)?
+
+		const Bvh& getTopLevel() const;
+		const vector<Instance>& getInstances() const;
+
+		static void buildPatchBvh(Bvh& bvh, Patch* const* patches, unsigned int count);	// postavi BVH nad patchi (prvek = index v poli)
+		static float intersectPatch(Patch* p, const Vector3f& origin, const Vector3f& dir);	// vzdalenost zasahu ctyruhelniku nebo zaporne cislo
+		static float intersectQuad(const Vector3f& a, const Vector3f& b, const Vector3f& c, const Vector3f& d, const Vector3f& origin, const Vector3f& dir);	// totez pro ctyruhelnik zadany vrcholy
+
+	private:
+		vector<Instance> instances;
+		Bvh topLevel;
+};
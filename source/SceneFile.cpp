@@ -0,0 +1,348 @@
+#include "SceneFile.h"
+#include <string.h>
+#include <vector>
+#include <unordered_map>
+
+
+// pocet patchu zapisovanych najednou - data sekci se skladaji po blocich, ne pro celou scenu
+static const unsigned int WRITE_CHUNK = 4096;
+
+
+SceneFile::SceneFile(void) {
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	data = NULL;
+	dataSize = 0;
+	writable = false;
+
+	header = NULL;
+	geometry = NULL;
+	colors = NULL;
+	energies = NULL;
+	neighbours = NULL;
+	metadata = NULL;
+}
+
+
+SceneFile::~SceneFile(void) {
+	close();
+}
+
+
+/**
+ * Zapise do souboru 'count' nulovych bytu (zarovnani sekci)
+ */
+static bool writePadding(FILE* fp, uint64_t count) {
+	static const char zeros[64] = {0};
+	while (count > 0) {
+		size_t n = size_t(count < sizeof(zeros) ? count : sizeof(zeros));
+		if (fwrite(zeros, 1, n, fp) != n)
+			return false;
+		count -= n;
+	}
+	return true;
+}
+
+
+/**
+ * Ulozi patche sceny do souboru. Cisla sousedu se zjisti jednim pruchodem pres hashovaci tabulku
+ * ukazatel => cislo patche, cely zapis je tedy linearni s poctem patchu.
+ * Pokud je zadano pole 'energies', energie se berou z nej misto z patchu (snapshot pri checkpointu)
+ */
+bool SceneFile::save(const char* filename, Patch** patches, unsigned int count, const SceneMetadata& meta, const float* energies) {
+	FILE* fp = NULL;
+	if (fopen_s(&fp, filename, "wb") != 0 || fp == NULL)
+		return false;
+
+	// rozlozeni sekci v souboru
+	const unsigned int sectionCount = 5;
+	Section sections[sectionCount] = {
+		{ SECTION_GEOMETRY, 12 * sizeof(float), 0, 0 },
+		{ SECTION_COLORS, 3 * sizeof(float), 0, 0 },
+		{ SECTION_ENERGIES, 6 * sizeof(float), 0, 0 },
+		{ SECTION_NEIGHBOURS, 8 * sizeof(uint32_t), 0, 0 },
+		{ SECTION_METADATA, sizeof(SceneMetadata), 0, 0 }
+	};
+
+	uint64_t offset = sizeof(Header) + sectionCount * sizeof(Section);
+	for (unsigned int s = 0; s < sectionCount; s++) {
+		offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		sections[s].offset = offset;
+		sections[s].size = (sections[s].id == SECTION_METADATA) ? sizeof(SceneMetadata) : uint64_t(count) * sections[s].elementSize;
+		offset += sections[s].size;
+	}
+
+	Header h;
+	memset(&h, 0, sizeof(Header));
+	memcpy(h.magic, "RRSC", 4);
+	h.endianTag = ENDIAN_TAG;
+	h.version = VERSION;
+	h.sectionCount = sectionCount;
+	h.patchCount = count;
+
+	bool error = false;
+	uint64_t written = 0;	// aktualni pozice v souboru
+
+	error |= fwrite(&h, sizeof(Header), 1, fp) != 1;
+	error |= fwrite(sections, sizeof(Section), sectionCount, fp) != sectionCount;
+	written = sizeof(Header) + sectionCount * sizeof(Section);
+
+	// cisla patchu podle ukazatelu - pro prevod sousedu
+	unordered_map<Patch*, uint32_t> ids;
+	ids.reserve(count);
+	for (unsigned int i = 0; i < count; i++)
+		ids[patches[i]] = i;
+
+	vector<char> buffer;
+
+	for (unsigned int s = 0; s < sectionCount && !error; s++) {
+		error |= !writePadding(fp, sections[s].offset - written);
+		written = sections[s].offset;
+
+		if (sections[s].id == SECTION_METADATA) {
+			error |= fwrite(&meta, sizeof(SceneMetadata), 1, fp) != 1;
+			written += sizeof(SceneMetadata);
+			continue;
+		}
+
+		buffer.resize(WRITE_CHUNK * sections[s].elementSize);
+
+		for (unsigned int from = 0; from < count && !error; from += WRITE_CHUNK) {
+			unsigned int to = min(from + WRITE_CHUNK, count);
+
+			for (unsigned int i = from; i < to; i++) {
+				Patch* p = patches[i];
+				char* dst = &buffer[(i - from) * sections[s].elementSize];
+
+				switch (sections[s].id) {
+					case SECTION_GEOMETRY:
+						p->getVerticesCoords((float*)dst);
+						break;
+
+					case SECTION_COLORS: {
+						float* f = (float*)dst;
+						Vector3f c = p->getColor();
+						f[0] = c.x; f[1] = c.y; f[2] = c.z;
+						break;
+					}
+
+					case SECTION_ENERGIES: {
+						float* f = (float*)dst;
+						if (energies != NULL) {
+							memcpy(f, energies + size_t(i) * 6, 6 * sizeof(float));
+							break;
+						}
+						f[0] = p->illumination.x; f[1] = p->illumination.y; f[2] = p->illumination.z;
+						f[3] = p->radiosity.x; f[4] = p->radiosity.y; f[5] = p->radiosity.z;
+						break;
+					}
+
+					case SECTION_NEIGHBOURS: {
+						uint32_t* n = (uint32_t*)dst;
+						for (unsigned int j = 0; j < 8; j++) {
+							unordered_map<Patch*, uint32_t>::iterator it = ids.find(p->getNeighbour(j));
+							n[j] = (it != ids.end()) ? it->second : i; // neznamy soused = patch sam
+						}
+						break;
+					}
+				}
+			}
+
+			size_t bytes = (to - from) * sections[s].elementSize;
+			error |= fwrite(&buffer[0], 1, bytes, fp) != bytes;
+			written += bytes;
+		}
+	}
+
+	fclose(fp);
+	return !error;
+}
+
+
+/**
+ * Overi, zda soubor zacina hlavickou tohoto formatu
+ */
+bool SceneFile::isSceneFile(const char* filename) {
+	FILE* fp = NULL;
+	if (fopen_s(&fp, filename, "rb") != 0 || fp == NULL)
+		return false;
+
+	char magic[4];
+	bool result = fread(magic, 1, 4, fp) == 4 && memcmp(magic, "RRSC", 4) == 0;
+	fclose(fp);
+
+	return result;
+}
+
+
+/**
+ * Namapuje soubor do pameti (jen pro cteni, nebo pro zapis vysledku na misto - napr. OutOfCoreSolver) a overi
+ * hlavicku a rozsahy sekci. Vraci false, pokud soubor neni ve spravnem formatu, ma jinou verzi nebo endianitu
+ */
+bool SceneFile::open(const char* filename, bool writable) {
+	close();
+
+	DWORD access = writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+	file = CreateFileA(filename, access, writable ? 0 : FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		cerr << "Unable to open the file" << endl;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || uint64_t(size.QuadPart) < sizeof(Header)) {
+		cerr << "The file is too short" << endl;
+		close();
+		return false;
+	}
+	dataSize = size.QuadPart;
+
+	mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+	if (mapping != NULL)
+		data = (const char*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		cerr << "Unable to map the file" << endl;
+		close();
+		return false;
+	}
+
+	header = (const Header*)data;
+	if (memcmp(header->magic, "RRSC", 4) != 0) {
+		cerr << "Not a scene file" << endl;
+		close();
+		return false;
+	}
+	if (header->endianTag != ENDIAN_TAG) {
+		cerr << "The scene file was written on a machine with different endianness" << endl;
+		close();
+		return false;
+	}
+	if (header->version != VERSION) {
+		cerr << "Unsupported scene file version " << header->version << endl;
+		close();
+		return false;
+	}
+	if (sizeof(Header) + uint64_t(header->sectionCount) * sizeof(Section) > dataSize) {
+		cerr << "Corrupted section table" << endl;
+		close();
+		return false;
+	}
+
+	geometry = (const float*)findSection(SECTION_GEOMETRY, 12 * sizeof(float));
+	colors = (const float*)findSection(SECTION_COLORS, 3 * sizeof(float));
+	energies = (const float*)findSection(SECTION_ENERGIES, 6 * sizeof(float));
+	neighbours = (const uint32_t*)findSection(SECTION_NEIGHBOURS, 8 * sizeof(uint32_t));
+	metadata = (const SceneMetadata*)findSection(SECTION_METADATA, sizeof(SceneMetadata));
+
+	if (geometry == NULL || colors == NULL || energies == NULL || neighbours == NULL) {
+		cerr << "Missing or corrupted section in the scene file" << endl;
+		close();
+		return false;
+	}
+
+	this->writable = writable;
+	return true;
+}
+
+
+/**
+ * Najde sekci v tabulce a overi, ze lezi cela uvnitr souboru a odpovida velikosti zaznamu.
+ * Neznama sekce neni chyba - novejsi verze mohou pridavat dalsi
+ */
+const void* SceneFile::findSection(uint32_t id, uint32_t elementSize) const {
+	const Section* table = (const Section*)(data + sizeof(Header));
+
+	for (uint32_t s = 0; s < header->sectionCount; s++) {
+		if (table[s].id != id)
+			continue;
+
+		uint64_t expected = (id == SECTION_METADATA) ? elementSize : header->patchCount * elementSize;
+		if (table[s].elementSize != elementSize || table[s].size < expected ||
+			table[s].offset > dataSize || table[s].size > dataSize - table[s].offset)
+			return NULL;
+
+		return data + table[s].offset;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Zrusi mapovani a zavre soubor
+ */
+void SceneFile::close() {
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	data = NULL;
+	dataSize = 0;
+	writable = false;
+
+	header = NULL;
+	geometry = NULL;
+	colors = NULL;
+	energies = NULL;
+	neighbours = NULL;
+	metadata = NULL;
+}
+
+
+unsigned int SceneFile::getPatchesCount() const {
+	return header != NULL ? (unsigned int)header->patchCount : 0;
+}
+
+const float* SceneFile::getGeometry() const {
+	return geometry;
+}
+
+const float* SceneFile::getColors() const {
+	return colors;
+}
+
+const float* SceneFile::getEnergies() const {
+	return energies;
+}
+
+const uint32_t* SceneFile::getNeighbours() const {
+	return neighbours;
+}
+
+const SceneFile::SceneMetadata* SceneFile::getMetadata() const {
+	return metadata;
+}
+
+float* SceneFile::getWritableEnergies() {
+	return writable ? const_cast<float*>(energies) : NULL;
+}
+
+SceneFile::SceneMetadata* SceneFile::getWritableMetadata() {
+	return writable ? const_cast<SceneMetadata*>(metadata) : NULL;
+}
+
+
+/**
+ * Vytvori novy patch z i-teho zaznamu namapovanych sekci; sousedy je nutne doplnit zvlast
+ */
+Patch* SceneFile::createPatch(unsigned int i, void* where, void* shapeWhere) const {
+	const float* g = geometry + i * 12;
+	const float* c = colors + i * 3;
+	const float* e = energies + i * 6;
+
+	if (where == NULL)
+		where = Patch::operator new(sizeof(Patch));
+
+	return new (where) Patch(
+		Vector3f(g[0], g[1], g[2]), Vector3f(g[3], g[4], g[5]), Vector3f(g[6], g[7], g[8]), Vector3f(g[9], g[10], g[11]),
+		Vector3f(c[0], c[1], c[2]),
+		Vector3f(e[0], e[1], e[2]),
+		Vector3f(e[3], e[4], e[5]),
+		shapeWhere
+	);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <iostream>
+#include "Patch.h"
+
+using namespace std;
+
+
+/**
+ * Binarni soubor sceny (*.rr). Soubor je rozdeleny na sekce (geometrie, barvy, energie, sousedi, metadata),
+ * kazda sekce je souvisle pole hodnot zarovnane na 64 bytu, takze po namapovani do pameti lze jednotlive
+ * sekce cist primo jako pole (napr. geometrii v pracovnich procesech). Scena se ale z patchu (Patch) -
+ * LoadingModel je vytvori z namapovanych zaznamu, jejich geometrie i energie jsou tedy kopie.
+ * Hlavicka nese verzi formatu a znacku endianity.
+ *
+ *  hlavicka | tabulka sekci | sekce 0 | sekce 1 | ...
+ */
+class SceneFile {
+
+	public:
+		static const uint32_t VERSION = 1;		// aktualni verze formatu
+		static const uint32_t ENDIAN_TAG = 0x01020304;	// na stroji s opacnou endianitou se precte jako 0x04030201
+
+		// identifikatory sekci
+		enum {
+			SECTION_GEOMETRY = 1,	// 4 vrcholy * 3 floaty na patch
+			SECTION_COLORS,			// 3 floaty (vlastni barva) na patch
+			SECTION_ENERGIES,		// 6 floatu na patch - iluminativni a radiativni energie
+			SECTION_NEIGHBOURS,		// 8 uint32 na patch - cisla sousedu v ramci sceny
+			SECTION_METADATA		// jedna struktura SceneMetadata
+		};
+
+		// volne informace o scene
+		struct SceneMetadata {
+			double maxPatchArea;	// maximalni obsah plosek, se kterym byla scena rozdelena
+			uint32_t hemicubeSide;	// strana hemicube pouzita pri vypoctu
+			uint32_t passCounter;	// pocet provedenych pruchodu distribuce energie
+			double stochasticPower;	// energie sceny v prvnim kroku stochasticke iterace (0 = nespustena)
+			uint32_t stochasticIteration;	// cislo dalsiho kroku stochasticke iterace
+			uint32_t reserved[9];
+		};
+
+		SceneFile(void);
+		~SceneFile(void);
+
+		static bool save(const char* filename, Patch** patches, unsigned int count, const SceneMetadata& meta, const float* energies = NULL);	// ulozi patche do souboru; energie volitelne z pole (6 floatu na patch)
+
+		bool open(const char* filename, bool writable = false);	// namapuje soubor do pameti a zkontroluje hlavicku; writable = energie a metadata lze prepsat na miste
+		void close();						// zrusi mapovani
+
+		static bool isSceneFile(const char* filename);	// test, zda soubor zacina hlavickou tohoto formatu (jinak jde o stary vypis patchu)
+
+		unsigned int getPatchesCount() const;
+		const float* getGeometry() const;		// 12 floatu na patch
+		const float* getColors() const;			// 3 floaty na patch
+		const float* getEnergies() const;		// 6 floatu na patch: illumination, radiosity
+		const uint32_t* getNeighbours() const;	// 8 indexu na patch
+		const SceneMetadata* getMetadata() const;
+		float* getWritableEnergies();			// jen u souboru otevreneho pro zapis, jinak NULL
+		SceneMetadata* getWritableMetadata();
+
+		Patch* createPatch(unsigned int i, void* where = NULL, void* shapeWhere = NULL) const;	// vytvori patch s daty i-teho zaznamu (bez sousedu); where/shapeWhere = pamet pro patch a jeho geometrii, NULL = halda
+
+	private:
+		// hlavicka souboru
+		struct Header {
+			char magic[4];			// "RRSC"
+			uint32_t endianTag;		// ENDIAN_TAG
+			uint32_t version;		// VERSION
+			uint32_t sectionCount;	// pocet zaznamu v tabulce sekci
+			uint64_t patchCount;	// pocet patchu ve scene
+			uint64_t reserved[5];
+		};
+
+		// zaznam v tabulce sekci
+		struct Section {
+			uint32_t id;			// SECTION_*
+			uint32_t elementSize;	// velikost zaznamu pro jeden patch v bytech (u metadat velikost struktury)
+			uint64_t offset;		// pozice zacatku sekce od zacatku souboru
+			uint64_t size;			// delka sekce v bytech
+		};
+
+		static const uint64_t ALIGNMENT = 64;
+
+		const void* findSection(uint32_t id, uint32_t elementSize) const;
+
+		HANDLE file;
+		HANDLE mapping;
+		const char* data;	// namapovany obsah souboru
+		uint64_t dataSize;
+		bool writable;
+
+		const Header* header;
+		const float* geometry;
+		const float* colors;
+		const float* energies;
+		const uint32_t* neighbours;
+		const SceneMetadata* metadata;
+};
@@ -239,7 +239,7 @@ GLuint Shaders::getPatchViewProgram() {
 		"\n"
 		"uniform mat4 t_modelview_projection_matrix;\n" // parametr shaderu - transformacni matice
 		"\n"
-		"out vec3 v_color;\n"		
+		"flat out vec3 v_color;\n"	// barva podle ID patche se bere z posledniho (provokujiciho) vrcholu trojuhelniku
 		"\n"
 		"void main()\n"
 		"{\n"
@@ -250,7 +250,7 @@ GLuint Shaders::getPatchViewProgram() {
 
 	const char *p_s_fragment_shader =
 		"#version 330\n"
-		"in vec3 v_color;\n" // vstupy z vertex shaderu
+		"flat in vec3 v_color;\n" // vstupy z vertex shaderu
 		"\n"
 		"out vec4 frag_color;\n" // vystup do framebufferu
 		"\n"
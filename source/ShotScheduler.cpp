@@ -0,0 +1,107 @@
+#include "ShotScheduler.h"
+#include <algorithm>
+
+using namespace std;
+
+
+// vaha noveho mereni v klouzavem prumeru
+static const double SMOOTHING = 0.2;
+
+// cilova doba kroku v rezimu maximalni propustnosti
+static const double THROUGHPUT_BUDGET = 1.0;
+
+// krok se ukonci predcasne, pokud vystrely trvaji vic nez tolikrat cilovou dobu (nahle zdrazeni vystrelu)
+static const double DEADLINE_FACTOR = 1.5;
+
+// pocet vystrelu smi mezi kroky nejvyse zdvojnasobit - jedno levne mereni nezpusobi dlouhy krok
+static const unsigned int MAX_GROWTH = 2;
+static const unsigned int MAX_SHOTS = 100000;
+
+
+ShotScheduler::ShotScheduler(void) {
+	budget = 0;
+	fixedShots = 1;
+	maxThroughput = false;
+
+	shotCost = 0;
+	overhead = 0;
+	lastShots = 1;
+}
+
+
+void ShotScheduler::setBudget(double seconds) {
+	budget = max(seconds, 0.0);
+}
+
+
+void ShotScheduler::setFixedShots(unsigned int n) {
+	fixedShots = max(n, 1u);
+}
+
+
+void ShotScheduler::setMaxThroughput(bool enable) {
+	maxThroughput = enable;
+}
+
+
+bool ShotScheduler::isMaxThroughput() const {
+	return maxThroughput;
+}
+
+
+double ShotScheduler::getTarget() const {
+	return maxThroughput ? max(budget, THROUGHPUT_BUDGET) : budget;
+}
+
+
+/**
+ * Pocet vystrelu, ktere se vejdou do cilove doby po odecteni rezie; prvni krok jen meri jeden vystrel
+ */
+unsigned int ShotScheduler::nextShots() {
+	double target = getTarget();
+
+	if (target <= 0) {
+		lastShots = fixedShots;
+	} else if (shotCost <= 0) {
+		lastShots = 1;
+	} else {
+		double available = target - overhead;
+		double shots = available / shotCost;
+		shots = min(shots, double(lastShots * MAX_GROWTH));
+		shots = min(shots, double(MAX_SHOTS));
+		shots = max(shots, 1.0);
+		lastShots = max((unsigned int)shots, 1u);
+	}
+
+	return lastShots;
+}
+
+
+double ShotScheduler::getDeadline() const {
+	return getTarget() * DEADLINE_FACTOR;
+}
+
+
+void ShotScheduler::record(unsigned int shots, double shotTime, double overheadTime) {
+	if (shots == 0)
+		return;
+
+	double cost = shotTime / shots;
+	if (shotCost <= 0) {
+		shotCost = cost;
+		overhead = overheadTime;
+	} else {
+		shotCost += (cost - shotCost) * SMOOTHING;
+		overhead += (overheadTime - overhead) * SMOOTHING;
+	}
+}
+
+
+unsigned int ShotScheduler::getLastShots() const {
+	return lastShots;
+}
+
+
+double ShotScheduler::getShotCost() const {
+	return shotCost;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+
+/**
+ * Volba poctu vystrelu v jednom kroku vypoctu. Cena jednoho vystrelu (a rezie kroku - predani energii
+ * k zobrazeni) se prubezne meri a pocet vystrelu se voli tak, aby krok trval priblizne zadany cas;
+ * zobrazeni pak dostava nove energie zhruba s kazdym snimkem. V rezimu maximalni propustnosti je cilovy
+ * cas kroku dlouhy, rezie se rozlozi do mnoha vystrelu. Pri nulovem casu se pouziva pevny pocet vystrelu.
+ */
+class ShotScheduler {
+
+	public:
+		ShotScheduler(void);
+
+		void setBudget(double seconds);			// cilova doba kroku; 0 = pevny pocet vystrelu
+		void setFixedShots(unsigned int n);		// pocet vystrelu pri nulove dobe kroku
+		void setMaxThroughput(bool enable);		// dlouhe kroky pro vypocet bez obsluhy
+		bool isMaxThroughput() const;
+
+		unsigned int nextShots();		// pocet vystrelu pro dalsi krok
+		double getDeadline() const;		// nejdelsi doba vystrelu v kroku, po ktere se krok ukonci predcasne; 0 = bez omezeni
+		void record(unsigned int shots, double shotTime, double overheadTime);	// zapocita zmerene casy kroku
+
+		unsigned int getLastShots() const;
+		double getShotCost() const;		// odhad doby jednoho vystrelu v sekundach; 0 = jeste nezmereno
+
+	private:
+		double getTarget() const;
+
+		double budget;
+		unsigned int fixedShots;
+		volatile bool maxThroughput;	// prepina hlavni vlakno, cte vlakno vypoctu
+
+		double shotCost;	// klouzavy prumer doby vystrelu
+		double overhead;	// klouzavy prumer rezie kroku
+		unsigned int lastShots;
+};
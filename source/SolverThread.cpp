@@ -0,0 +1,120 @@
+#include "SolverThread.h"
+#include "NumaArena.h"
+
+
+SolverThread::SolverThread(void) {
+	thread = NULL;
+	wakeEvent = NULL;
+	readyEvent = NULL;
+	quit = false;
+	initialized = false;
+
+	device = NULL;
+	context = NULL;
+	init = NULL;
+	step = NULL;
+	cleanup = NULL;
+}
+
+
+SolverThread::~SolverThread(void) {
+	stop();
+}
+
+
+/**
+ * Spusti vlakno a pocka, az si v kontextu vytvori sve objekty; pri chybe vlakno hned skonci
+ */
+bool SolverThread::start(HDC device, HGLRC context, InitFunc init, StepFunc step, CleanupFunc cleanup) {
+	stop();
+
+	this->device = device;
+	this->context = context;
+	this->init = init;
+	this->step = step;
+	this->cleanup = cleanup;
+	quit = false;
+	initialized = false;
+
+	wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);	// automaticky reset - jedno probuzeni
+	readyEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (wakeEvent != NULL && readyEvent != NULL)
+		thread = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+
+	if (thread == NULL) {
+		cerr << "Unable to start the solver thread" << endl;
+		stop();
+		return false;
+	}
+
+	WaitForSingleObject(readyEvent, INFINITE);
+	if (!initialized) {
+		stop();
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Pocka na dokonceni rozpracovaneho kroku a ukonci vlakno
+ */
+void SolverThread::stop() {
+	if (thread != NULL) {
+		quit = true;
+		SetEvent(wakeEvent);
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+	if (wakeEvent != NULL)
+		CloseHandle(wakeEvent);
+	if (readyEvent != NULL)
+		CloseHandle(readyEvent);
+
+	thread = NULL;
+	wakeEvent = NULL;
+	readyEvent = NULL;
+}
+
+
+void SolverThread::wake() {
+	if (thread != NULL)
+		SetEvent(wakeEvent);
+}
+
+
+bool SolverThread::isRunning() const {
+	return thread != NULL;
+}
+
+
+DWORD WINAPI SolverThread::threadProc(LPVOID param) {
+	((SolverThread*)param)->run();
+	return 0;
+}
+
+
+void SolverThread::run() {
+	if (!wglMakeCurrent(device, context)) {
+		cerr << "Unable to activate the solver GL context" << endl;
+		SetEvent(readyEvent);
+		return;
+	}
+
+	// tym OpenMP tohoto vlakna po skupinach k NUMA uzlum - stejne jako pri umisteni patchu
+	NumaArena::pinTeam();
+
+	initialized = init();
+	SetEvent(readyEvent);
+
+	if (initialized) {
+		while (!quit) {
+			if (!step())
+				WaitForSingleObject(wakeEvent, INFINITE);
+		}
+	}
+
+	cleanup();
+	wglMakeCurrent(NULL, NULL);
+}
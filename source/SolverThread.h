@@ -0,0 +1,45 @@
+#pragma once
+
+#include <windows.h>
+#include <iostream>
+
+using namespace std;
+
+
+/**
+ * Vlakno, ve kterem bezi vypocet radiosity nezavisle na kreslici smycce. Vlakno ma vlastni GL kontext
+ * sdileny s hlavnim (textury, buffery a shadery jsou spolecne; VAO a FBO si musi vytvorit samo v init).
+ * Opakovane vola step, dokud vraci true; pri false (neni co pocitat) spi, dokud ho neprobudi wake.
+ * Funkce init, step a cleanup se volaji vzdy ve vlakne vypoctu s aktivnim sdilenym kontextem.
+ */
+class SolverThread {
+
+	public:
+		typedef bool (*InitFunc)();		// vytvori objekty kontextu vlakna; false = chyba
+		typedef bool (*StepFunc)();		// provede cast vypoctu; false = neni co pocitat
+		typedef void (*CleanupFunc)();	// uvolni objekty kontextu vlakna
+
+		SolverThread(void);
+		~SolverThread(void);
+
+		bool start(HDC device, HGLRC context, InitFunc init, StepFunc step, CleanupFunc cleanup);	// spusti vlakno a pocka na init
+		void stop();			// dokonci rozpracovany krok a ukonci vlakno
+		void wake();			// probudi vlakno cekajici na dalsi vypocet
+		bool isRunning() const;
+
+	private:
+		static DWORD WINAPI threadProc(LPVOID param);
+		void run();
+
+		HANDLE thread;
+		HANDLE wakeEvent;		// signalizuje, ze je znovu co pocitat (nebo konec)
+		HANDLE readyEvent;		// signalizuje dokonceni init
+		volatile bool quit;
+		bool initialized;		// vysledek init
+
+		HDC device;
+		HGLRC context;
+		InitFunc init;
+		StepFunc step;
+		CleanupFunc cleanup;
+};
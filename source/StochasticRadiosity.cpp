@@ -0,0 +1,270 @@
+#include "StochasticRadiosity.h"
+#include "Sampling.h"
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// nejmensi pocet paprsku kroku
+static const size_t MIN_RAYS = 10000;
+
+// nejvetsi vzdalenost paprsku
+static const float MAX_DISTANCE = 1e30f;
+
+// paprsky patche pro odhad souctu jeho form factoru ke scene
+static const unsigned int CLOSURE_RAYS = 16;
+
+
+/**
+ * Vazeny median - hodnota, pod kterou lezi polovina vahy; pole se seradi
+ */
+static float weightedMedian(vector<pair<float, float> >& values) {
+	if (values.empty())
+		return 0;
+
+	sort(values.begin(), values.end());
+
+	double weight = 0;
+	for (size_t k = 0; k < values.size(); k++)
+		weight += values[k].second;
+
+	double sum = 0;
+	for (size_t k = 0; k < values.size(); k++) {
+		sum += values[k].second;
+		if (sum >= weight / 2)
+			return values[k].first;
+	}
+	return values.back().first;
+}
+
+
+StochasticRadiosity::StochasticRadiosity(void) {
+	patches = NULL;
+	count = 0;
+	scene = NULL;
+	raysPerStep = 0;
+	sceneId = 0;
+	initialPower = 0;
+	control = Vector3f(0, 0, 0);
+	iteration = 0;
+	lastRays = 0;
+	totalRays = 0;
+}
+
+
+/**
+ * Obsahy patchu a podily paprsku, ktere ze sceny neuniknou (F_j kontrolni promenne); odhad pouziva
+ * stejne vzorkovani jako kroky a vlastni dimenze vzorku
+ */
+void StochasticRadiosity::start(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int raysPerStep, unsigned int sceneId) {
+	clear();
+
+	this->patches = patches;
+	this->count = count;
+	this->scene = &scene;
+	this->raysPerStep = raysPerStep;
+	this->sceneId = sceneId;
+
+	area.resize(count);
+	closure.resize(count);
+	unshot.resize(count);
+	power.resize(count);
+	rayStarts.resize(count + 1);
+	rayEnergy.resize(count);
+
+	#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < int(count); i++) {
+		Patch* p = patches[i];
+		Vector3f d1 = p->getVertex(2) - p->getVertex(0);
+		Vector3f d2 = p->getVertex(3) - p->getVertex(1);
+		area[i] = d1.v_Cross(d2).f_Length() / 2;
+		closure[i] = 0;
+
+		Vector3f normal = p->getNormal();
+		float length = normal.f_Length();
+		if (length <= 0)
+			continue;
+		normal *= 1 / length;
+
+		unsigned int hits = 0;
+		for (unsigned int r = 0; r < CLOSURE_RAYS; r++) {
+			Vector3f origin = Sampling::pointOnPatch(p, Sampling::number(r, i, 5), Sampling::number(r, i, 6));
+			Vector3f dir = Sampling::cosineDirection(normal, Sampling::number(r, i, 7), Sampling::number(r, i, 8));
+
+			float distance = MAX_DISTANCE;
+			int hit = scene.intersect(origin, dir, distance);
+			if (hit >= 0 && hit != i)
+				hits++;
+		}
+		closure[i] = float(hits) / CLOSURE_RAYS;
+	}
+}
+
+/**
+ * Cislo kroku urcuje vzorky, pocatecni energie pocty paprsku - po obnoveni navazou kroky na ulozeny vypocet
+ */
+void StochasticRadiosity::restore(unsigned int iteration, double initialPower) {
+	this->iteration = iteration;
+	this->initialPower = initialPower;
+}
+
+void StochasticRadiosity::clear() {
+	area.clear();
+	closure.clear();
+	unshot.clear();
+	power.clear();
+	ratios.clear();
+	rayStarts.clear();
+	rayEnergy.clear();
+
+	patches = NULL;
+	count = 0;
+	scene = NULL;
+	sceneId = 0;
+	initialPower = 0;
+	control = Vector3f(0, 0, 0);
+	iteration = 0;
+	lastRays = 0;
+	totalRays = 0;
+}
+
+bool StochasticRadiosity::isStarted(unsigned int sceneId) const {
+	return patches != NULL && this->sceneId == sceneId;
+}
+
+
+/**
+ * Patch s ocekavanym poctem paprsku x dostane floor(x) nebo floor(x) + 1 paprsku a kazdy nese energii / x;
+ * patch bez paprsku svou energii ztrati - v prumeru se energie zachova. Vsechny zdroje vyzari naraz
+ * (Jacobi), prijata energie se pricte az po vystrelu vsech paprsku pres akumulator. Dil kontrolni
+ * promenne dostane kazdy patch primo, paprsky nesou jen odchylku energie zdroje od nej
+ */
+float StochasticRadiosity::step(EnergyAccumulator& accumulator) {
+	if (count == 0)
+		return 0;
+
+	// nevystrelena energie patchu a sceny
+	double total = 0;
+	#pragma omp parallel for schedule(static) reduction(+:total)
+	for (int i = 0; i < int(count); i++) {
+		unshot[i] = patches[i]->radiosity * patches[i]->getColor();
+		total += unshot[i].x + unshot[i].y + unshot[i].z;
+	}
+
+	if (total <= 0)
+		return 0;
+	if (initialPower <= 0)
+		initialPower = total;
+
+	// kontrolni radiosita po slozkach
+	for (int c = 0; c < 3; c++) {
+		ratios.clear();
+		for (unsigned int i = 0; i < count; i++) {
+			if (area[i] > 0)
+				ratios.push_back(make_pair(unshot[i][c] / area[i], area[i]));
+		}
+		control[c] = weightedMedian(ratios);
+	}
+
+	// paprsky nesou odchylku od kontrolni promenne
+	double shot = 0;
+	#pragma omp parallel for schedule(static) reduction(+:shot)
+	for (int i = 0; i < int(count); i++) {
+		unshot[i] -= control * area[i];
+		power[i] = fabs(unshot[i].x) + fabs(unshot[i].y) + fabs(unshot[i].z);
+		shot += power[i];
+	}
+
+	// paprsku ubyva se zbyvajici energii
+	size_t rays = max(size_t(raysPerStep * min(total / initialPower, 1.0)), MIN_RAYS);
+
+	// rozdeleni paprsku mezi patche
+	unsigned int next = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		rayStarts[i] = next;
+
+		if (power[i] <= 0) {
+			rayEnergy[i] = Vector3f(0, 0, 0);
+			continue;
+		}
+
+		double expected = rays * (power[i] / shot);
+		unsigned int n = (unsigned int)expected;
+		if (Sampling::number(iteration, i, 0) < expected - n)
+			n++;
+
+		rayEnergy[i] = unshot[i] * float(1 / expected);
+		next += n;
+	}
+	rayStarts[count] = next;
+
+	// zdroje vyzari vsechnu energii, kazdy patch prijme dil kontrolni promenne (beta * A_j * F_j)
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < int(count); i++) {
+		Patch* p = patches[i];
+		p->illumination += p->radiosity;
+		p->radiosity = control * (area[i] * closure[i]) * p->getReflectivity();
+	}
+
+	accumulator.begin(count, EnergyAccumulator::maxThreads());
+
+	#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < int(count); i++) {
+		if (rayStarts[i] == rayStarts[i + 1])
+			continue;
+
+		Patch* p = patches[i];
+		Vector3f normal = p->getNormal();
+		float length = normal.f_Length();
+		if (length <= 0)
+			continue;
+		normal *= 1 / length;
+
+		unsigned int thread = EnergyAccumulator::currentThread();
+
+		for (unsigned int r = rayStarts[i]; r < rayStarts[i + 1]; r++) {
+			Vector3f origin = Sampling::pointOnPatch(p, Sampling::number(iteration, r, 1), Sampling::number(iteration, r, 2));
+			Vector3f dir = Sampling::cosineDirection(normal, Sampling::number(iteration, r, 3), Sampling::number(iteration, r, 4));
+
+			float distance = MAX_DISTANCE;
+			int hit = scene->intersect(origin, dir, distance);
+			if (hit >= 0 && hit != i)
+				accumulator.add(thread, hit, rayEnergy[i]);
+		}
+	}
+
+	Receiver receiver = { patches };
+	accumulator.flush(receiver);
+
+	iteration++;
+	lastRays = next;
+	totalRays += next;
+
+	float highest = 0;
+	for (unsigned int i = 0; i < count; i++)
+		highest = max(highest, patches[i]->radiosity.f_Length());
+	return highest;
+}
+
+
+unsigned int StochasticRadiosity::getIteration() const {
+	return iteration;
+}
+
+double StochasticRadiosity::getInitialPower() const {
+	return initialPower;
+}
+
+Vector3f StochasticRadiosity::getControl() const {
+	return control;
+}
+
+size_t StochasticRadiosity::getLastRaysCount() const {
+	return lastRays;
+}
+
+unsigned long long StochasticRadiosity::getTotalRaysCount() const {
+	return totalRays;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include "SceneBvh.h"
+#include "EnergyAccumulator.h"
+#include "Patch.h"
+#include "Vector.h"
+
+using namespace std;
+
+
+/**
+ * Stochasticka Jacobiho iterace (Neumann, Bekaert). Krok vyzari nevystrelenou energii vsech patchu
+ * najednou: paprsky se rozdeli mezi patche umerne jejich energii, kazdy paprsek vychazi z nahodneho
+ * bodu patche ve smeru podle kosinu a nese stejny dil energie zdroje; zasazeny patch energii prijme.
+ * Form factory se nikde neukladaji - pamet je O(pocet patchu) a vypocet se hodi i pro nejvetsi sceny.
+ *
+ * Kontrolni promenna (Bekaert): z energie patche Q_i se odecte kontrolni radiosita beta * A_i a paprsky
+ * nesou jen rozdil (muze byt i zaporny). Odecteny dil dopadne na prijemce j presne - soucet A_i * F_ij
+ * pres zdroje je A_j * F_j, kde F_j je podil paprsku z j, ktere zasahnou scenu (odhadne se jednou
+ * pri startu). Beta (po slozkach) je vazeny median Q_i / A_i, ktery minimalizuje soucet |Q_i - beta * A_i|
+ * a tedy energii nesenou paprsky. Nejvic pomaha v pozdnich krocich, kdy je nevystrelena energie
+ * rozlozena po cele scene.
+ *
+ * Pocet paprsku kroku klesa umerne zbyvajici energii sceny (nejmene MIN_RAYS). Necele pocty paprsku
+ * patchu se zaokrouhluji nahodne, odhad je nestranny.
+ *
+ * Vzorky jsou urcene cislem kroku a paprsku (Sampling), ne stavem generatoru vlakna - pri pokracovani
+ * (restore) se cislo kroku obnovi, aby se vzorky neopakovaly.
+ */
+class StochasticRadiosity {
+
+	public:
+		StochasticRadiosity(void);
+
+		void start(Patch** patches, unsigned int count, const SceneBvh& scene, unsigned int raysPerStep, unsigned int sceneId);	// raysPerStep = paprsky prvniho kroku
+		void restore(unsigned int iteration, double initialPower);	// pokracovani ulozeneho vypoctu (po start)
+		void clear();
+		bool isStarted(unsigned int sceneId) const;	// spusteno nad danym sestavenim sceny
+
+		float step(EnergyAccumulator& accumulator);	// jedna iterace; vraci nejvetsi zbyvajici radiativni energii patchu
+
+		unsigned int getIteration() const;
+		double getInitialPower() const;
+		Vector3f getControl() const;	// kontrolni radiosita posledniho kroku
+		size_t getLastRaysCount() const;	// paprsky posledniho kroku
+		unsigned long long getTotalRaysCount() const;
+
+	private:
+		// prijemce prispevku - energie po odrazu je nova nevystrelena energie patchu
+		struct Receiver {
+			Patch** patches;
+
+			void operator()(unsigned int id, const Vector3f& energy) {
+				Patch* p = patches[id];
+				p->radiosity += energy * p->getReflectivity();
+			}
+		};
+
+		Patch** patches;
+		unsigned int count;
+		const SceneBvh* scene;
+		unsigned int raysPerStep;
+		unsigned int sceneId;
+		double initialPower;	// energie sceny v prvnim kroku
+		Vector3f control;		// kontrolni radiosita (beta)
+
+		unsigned int iteration;
+		size_t lastRays;
+		unsigned long long totalRays;
+
+		vector<float> area;				// obsah patche
+		vector<float> closure;			// odhad souctu form factoru patche ke scene (F_j)
+		vector<Vector3f> unshot;		// nevystrelena energie patchu
+		vector<float> power;			// energie nesena paprsky patchu (soucet absolutnich hodnot slozek)
+		vector<pair<float, float> > ratios;	// (Q_i / A_i, A_i) pro vazeny median
+		vector<unsigned int> rayStarts;	// prvni paprsek patche v kroku (a konec posledniho)
+		vector<Vector3f> rayEnergy;		// energie jednoho paprsku patche
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <windows.h>
+
+
+/**
+ * Trojity buffer pro predavani snimku z jednoho zapisujiciho vlakna jednomu ctoucimu bez zamku.
+ * Zapisujici vlakno plni svuj buffer a publish() jej vymeni se sdilenym; ctouci vlakno si v update()
+ * vymeni sdileny buffer za svuj, pokud je ve sdilenem novy snimek. Zadne z vlaken na druhe neceka,
+ * ctouci vzdy dostane posledni dokonceny snimek (snimky, ktere nestihlo precist, se prepisou).
+ */
+template <class T>
+class TripleBuffer {
+
+	public:
+		TripleBuffer(void);
+
+		T& getWriteBuffer();	// buffer zapisujiciho vlakna
+		void publish();			// zverejni zapsany snimek, zapisujici vlakno dostane jiny buffer
+
+		bool update();			// prevezme posledni zverejneny snimek; false, pokud od minula zadny neni
+		T& getReadBuffer();		// buffer ctouciho vlakna
+
+		void reset();			// zahodi nezpracovany snimek; jen pokud zadne z vlaken s bufferem nepracuje
+
+	private:
+		static const LONG INDEX_MASK = 3;
+		static const LONG FRESH = 4;	// ve sdilenem bufferu je neprecteny snimek
+
+		T buffers[3];
+		LONG writeIndex;
+		LONG readIndex;
+		volatile LONG shared;	// cislo sdileneho bufferu | FRESH
+};
+
+
+template <class T>
+TripleBuffer<T>::TripleBuffer(void) {
+	writeIndex = 0;
+	shared = 1;
+	readIndex = 2;
+}
+
+
+template <class T>
+inline T& TripleBuffer<T>::getWriteBuffer() {
+	return buffers[writeIndex];
+}
+
+
+template <class T>
+inline void TripleBuffer<T>::publish() {
+	writeIndex = InterlockedExchange(&shared, writeIndex | FRESH) & INDEX_MASK;
+}
+
+
+template <class T>
+inline bool TripleBuffer<T>::update() {
+	if ((shared & FRESH) == 0)
+		return false;
+
+	readIndex = InterlockedExchange(&shared, readIndex) & INDEX_MASK;
+	return true;
+}
+
+
+template <class T>
+inline T& TripleBuffer<T>::getReadBuffer() {
+	return buffers[readIndex];
+}
+
+
+template <class T>
+void TripleBuffer<T>::reset() {
+	shared &= INDEX_MASK;
+}
@@ -0,0 +1,403 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+#include <algorithm>
+#include "WorkerPool.h"
+#include "SceneFile.h"
+#include "SceneBvh.h"
+#include "HemicubeRays.h"
+#include "Config.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+
+// jak dlouho koordinator ceka na pripojeni procesu (ms) - procesy si nejdriv postavi BVH
+static const DWORD CONNECT_TIMEOUT = 60000;
+
+// jak dlouho se ceka na ukonceni procesu, nez se ukonci nasilne (ms)
+static const DWORD QUIT_TIMEOUT = 5000;
+
+/**
+ * Vrcholy patche z namapovane geometrie sceny
+ */
+static inline void readVertices(const float* geometry, unsigned int i, Vector3f* vertices) {
+	const float* g = geometry + size_t(i) * 12;
+	for (unsigned int v = 0; v < 4; v++)
+		vertices[v] = Vector3f(g[v * 3], g[v * 3 + 1], g[v * 3 + 2]);
+}
+
+
+/**
+ * Navstevnik BVH nad namapovanou geometrii - nejblizsi zasazeny patch, ktery je k paprsku privraceny
+ * licem; zadni strany se preskoci (pri kresleni hemicube je zapnute GL_CULL_FACE) a paprsek jde dal
+ */
+struct MappedHit {
+	const float* geometry;
+	const Vector3f& origin;
+	const Vector3f& dir;
+	int item;
+
+	MappedHit(const float* geometry, const Vector3f& origin, const Vector3f& dir)
+		: geometry(geometry), origin(origin), dir(dir), item(-1) {
+	}
+
+	bool operator()(unsigned int i, float& tmax) {
+		Vector3f v[4];
+		readVertices(geometry, i, v);
+
+		// normala jako Patch::getNormal
+		if ((v[1] - v[0]).v_Cross(v[3] - v[0]).f_Dot(dir) >= 0)
+			return false;
+
+		float t = SceneBvh::intersectQuad(v[0], v[1], v[2], v[3], origin, dir);
+		if (t > HEMICUBE_NEAR && t < tmax) {
+			tmax = t;
+			item = int(i);
+		}
+		return false;
+	}
+};
+
+
+/**
+ * Scena pracovniho procesu pro castHemicubeRow - BVH nad namapovanou geometrii
+ */
+struct MappedScene {
+	const float* geometry;
+	const Bvh& bvh;
+
+	MappedScene(const float* geometry, const Bvh& bvh)
+		: geometry(geometry), bvh(bvh) {
+	}
+
+	int trace(const Vector3f& origin, const Vector3f& dir) const {
+		float distance = HEMICUBE_FAR;
+		MappedHit hit(geometry, origin, dir);
+		bvh.traverseRay(origin, dir, distance, hit);
+		return hit.item;
+	}
+};
+
+
+WorkerPool::WorkerPool(void) {
+	listener = INVALID_SOCKET;
+	networking = false;
+}
+
+
+WorkerPool::~WorkerPool(void) {
+	stop();
+}
+
+
+/**
+ * Procesy se spusti s parametry "worker <adresa> workerscene <soubor>"; po nacteni sceny se pripoji
+ * a ohlasi pocet patchu, podle ktereho koordinator overi, ze pracuji nad stejnou scenou
+ */
+bool WorkerPool::start(unsigned int workers, const char* sceneFile, Patch** patches, unsigned int count) {
+	stop();
+
+	if (workers == 0 || count == 0)
+		return false;
+
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+		cerr << "Unable to initialize sockets" << endl;
+		return false;
+	}
+	networking = true;
+
+	// scena pro procesy - jen geometrie, energie drzi koordinator
+	SceneFile::SceneMetadata meta;
+	memset(&meta, 0, sizeof(meta));
+	if (!SceneFile::save(sceneFile, patches, count, meta)) {
+		cerr << "Unable to write the worker scene " << sceneFile << endl;
+		stop();
+		return false;
+	}
+	this->sceneFile = sceneFile;
+
+	// naslouchat na volnem portu lokalni adresy
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	int length = sizeof(address);
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+		listen(listener, workers) != 0 || getsockname(listener, (sockaddr*)&address, &length) != 0) {
+		cerr << "Unable to listen for workers" << endl;
+		stop();
+		return false;
+	}
+
+	char executable[MAX_PATH];
+	if (GetModuleFileNameA(NULL, executable, MAX_PATH) == 0) {
+		cerr << "Unable to find the program executable" << endl;
+		stop();
+		return false;
+	}
+
+	char commandLine[3 * MAX_PATH];
+	_snprintf_s(commandLine, sizeof(commandLine), _TRUNCATE, "\"%s\" worker 127.0.0.1:%d workerscene \"%s\"", executable, int(ntohs(address.sin_port)), sceneFile);
+
+	for (unsigned int w = 0; w < workers; w++) {
+		STARTUPINFOA startup;
+		PROCESS_INFORMATION process;
+		memset(&startup, 0, sizeof(startup));
+		startup.cb = sizeof(startup);
+
+		if (!CreateProcessA(NULL, commandLine, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &process)) {
+			cerr << "Unable to start a worker process" << endl;
+			stop();
+			return false;
+		}
+
+		CloseHandle(process.hThread);
+		processes.push_back(process.hProcess);
+	}
+
+	// pripojeni procesu (v libovolnem poradi)
+	for (unsigned int w = 0; w < workers; w++) {
+		fd_set set;
+		FD_ZERO(&set);
+		FD_SET(listener, &set);
+		timeval timeout = { CONNECT_TIMEOUT / 1000, 0 };
+
+		SOCKET s = INVALID_SOCKET;
+		if (select(0, &set, NULL, NULL, &timeout) == 1)
+			s = accept(listener, NULL, NULL);
+
+		uint32_t patchesCount = 0;
+		if (s == INVALID_SOCKET || !receiveAll(s, &patchesCount, sizeof(patchesCount)) || patchesCount != count) {
+			cerr << "A worker process did not connect" << endl;
+			if (s != INVALID_SOCKET)
+				closesocket(s);
+			stop();
+			return false;
+		}
+
+		BOOL noDelay = TRUE;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		sockets.push_back(s);
+	}
+
+	cout << "Started " << workers << " worker processes" << endl;
+	return true;
+}
+
+
+void WorkerPool::stop() {
+	Request quit = { QUIT, 0 };
+	for (unsigned int w = 0; w < sockets.size(); w++) {
+		sendAll(sockets[w], &quit, sizeof(quit));
+		closesocket(sockets[w]);
+	}
+	sockets.clear();
+
+	for (unsigned int w = 0; w < processes.size(); w++) {
+		if (WaitForSingleObject(processes[w], QUIT_TIMEOUT) != WAIT_OBJECT_0)
+			TerminateProcess(processes[w], 1);
+		CloseHandle(processes[w]);
+	}
+	processes.clear();
+
+	if (listener != INVALID_SOCKET)
+		closesocket(listener);
+	listener = INVALID_SOCKET;
+
+	if (networking)
+		WSACleanup();
+	networking = false;
+
+	// procesy uz soubor nemapuji
+	if (!sceneFile.empty())
+		DeleteFileA(sceneFile.c_str());
+	sceneFile.clear();
+
+	emitters.clear();
+	rows.clear();
+}
+
+
+bool WorkerPool::isRunning() const {
+	return !sockets.empty();
+}
+
+unsigned int WorkerPool::getWorkersCount() const {
+	return sockets.size();
+}
+
+
+void WorkerPool::begin() {
+	emitters.clear();
+	rows.clear();
+}
+
+void WorkerPool::add(unsigned int emitter, FormFactorCache::Row& row) {
+	emitters.push_back(emitter);
+	rows.push_back(&row);
+}
+
+
+/**
+ * Zdroje se rozdeli mezi procesy postupne (k-ty zdroj procesu k mod N) a nejdriv se rozeslou vsechny,
+ * procesy tedy pocitaji soubezne. Proces odpovida v poradi pozadavku, odpovedi se ctou ve stejnem poradi
+ */
+bool WorkerPool::execute() {
+	unsigned int workers = sockets.size();
+	if (workers == 0)
+		return false;
+
+	bool ok = true;
+	for (unsigned int k = 0; k < emitters.size() && ok; k++) {
+		Request request = { emitters[k], Config::HEMICUBE_W() };
+		ok = sendAll(sockets[k % workers], &request, sizeof(request));
+	}
+
+	for (unsigned int k = 0; k < emitters.size() && ok; k++) {
+		Reply reply;
+		ok = receiveAll(sockets[k % workers], &reply, sizeof(reply)) && reply.emitter == emitters[k];
+		if (!ok)
+			break;
+
+		rows[k]->resize(reply.count);
+		if (reply.count > 0)
+			ok = receiveAll(sockets[k % workers], &(*rows[k])[0], reply.count * sizeof(FormFactorCache::Entry));
+	}
+
+	if (!ok) {
+		cerr << "Lost connection to a worker process" << endl;
+		for (unsigned int k = 0; k < rows.size(); k++)
+			rows[k]->clear();
+		stop();
+	}
+
+	return ok;
+}
+
+
+bool WorkerPool::sendAll(uintptr_t socket, const void* data, size_t size) {
+	const char* p = (const char*)data;
+	while (size > 0) {
+		int n = send(SOCKET(socket), p, int(size), 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool WorkerPool::receiveAll(uintptr_t socket, void* data, size_t size) {
+	char* p = (char*)data;
+	while (size > 0) {
+		int n = recv(SOCKET(socket), p, int(size), 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+
+/**
+ * Proces namapuje soubor sceny, pripoji se a pocita radky, dokud jej koordinator neukonci nebo se spojeni
+ * nepreprusi. Geometrie se cte primo z mapovani (stranky sdili vsechny procesy), vlastni pamet procesu
+ * je jen BVH
+ */
+int WorkerPool::runWorker(const char* address, const char* sceneFile) {
+	string host(address);
+	size_t colon = host.find_last_of(':');
+	if (colon == string::npos || sceneFile == NULL) {
+		cerr << "Worker: expected worker <host:port> workerscene <file>" << endl;
+		return -1;
+	}
+	int port = atoi(host.c_str() + colon + 1);
+	host.erase(colon);
+
+	// scena jen pro cteni, zustane namapovana po celou dobu behu procesu; strom si proces postavi sam
+	SceneFile file;
+	if (!file.open(sceneFile)) {
+		cerr << "Worker: unable to open the scene " << sceneFile << endl;
+		return -1;
+	}
+
+	const float* geometry = file.getGeometry();
+	uint32_t count = file.getPatchesCount();
+
+	Bvh bvh;
+	{
+		vector<Aabb> boxes(count);
+
+		#pragma omp parallel for
+		for (int i = 0; i < int(count); i++) {
+			Vector3f v[4];
+			readVertices(geometry, i, v);
+			for (unsigned int k = 0; k < 4; k++)
+				boxes[i].extend(v[k]);
+		}
+
+		bvh.build(boxes);
+	}
+
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return -1;
+
+	sockaddr_in target;
+	memset(&target, 0, sizeof(target));
+	target.sin_family = AF_INET;
+	target.sin_port = htons(u_short(port));
+	inet_pton(AF_INET, host.c_str(), &target.sin_addr);
+
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET || connect(s, (sockaddr*)&target, sizeof(target)) != 0) {
+		cerr << "Worker: unable to connect to " << address << endl;
+		WSACleanup();
+		return -1;
+	}
+
+	BOOL noDelay = TRUE;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+	bool ok = sendAll(s, &count, sizeof(count));
+
+	MappedScene scene(geometry, bvh);
+	HemicubeFormFactors table;
+	unsigned int tableSide = 0;
+	FormFactorCache::Row row;
+	Request request;
+
+	while (ok && receiveAll(s, &request, sizeof(request)) && request.emitter != QUIT) {
+		// tabulka form factoru pixelu pro stranu hemicube koordinatora
+		if (request.side != tableSide) {
+			table.build(request.side);
+			tableSide = request.side;
+		}
+
+		// radek ze stredu zdroje paprsky pixely hemicube
+		if (request.emitter < count) {
+			Vector3f vertices[4];
+			readVertices(geometry, request.emitter, vertices);
+			castHemicubeRow(scene, table, request.side, request.emitter, vertices, row);
+		} else {
+			row.clear();
+		}
+
+		Reply reply = { request.emitter, uint32_t(row.size()) };
+		ok = sendAll(s, &reply, sizeof(reply));
+		if (ok && !row.empty())
+			ok = sendAll(s, &row[0], row.size() * sizeof(FormFactorCache::Entry));
+	}
+
+	closesocket(s);
+	WSACleanup();
+	return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "FormFactorCache.h"
+#include "Bvh.h"
+#include "Patch.h"
+
+using namespace std;
+
+/**
+ * Vypocet radku form factoru ve vice procesech. Koordinator (program s oknem) ulozi scenu do souboru a spusti
+ * N pracovnich procesu tehoz programu; kazdy soubor jen namapuje pro cteni (SceneFile), postavi BVH primo
+ * nad namapovanou geometrii (patche nevytvari, mapovani sdili vsechny procesy) a pripoji se ke koordinatorovi soketem. Koordinator dal vybira zdroje, davku rozdeli mezi procesy a od kazdeho
+ * dostane ridke radky zdroju (cisla zasazenych patchu a form factory, serazene) spocitane vrhanim paprsku
+ * pixely hemicube (castHemicubeRow) - se stejnymi vahami pixelu i orezavanim jako kreslene radky, oba zdroje se tak v cache radku
+ * smi michat.
+ * Prenos energie, cache radku i vyber dalsich zdroju zustavaji u koordinatora.
+ *
+ * Spojeni je TCP na lokalni adrese (Winsock), stejny protokol pujde pouzit i pro procesy na jinych uzlech.
+ * Sokety a procesy jsou ulozene jako cisla, hlavicka tak nevyzaduje winsock2.h pred windows.h.
+ */
+class WorkerPool {
+
+	public:
+		WorkerPool(void);
+		~WorkerPool(void);
+
+		bool start(unsigned int workers, const char* sceneFile, Patch** patches, unsigned int count);	// ulozi scenu, spusti procesy a pocka na jejich pripojeni
+		void stop();	// ukonci procesy a smaze soubor sceny
+		bool isRunning() const;
+		unsigned int getWorkersCount() const;
+
+		void begin();	// nova davka zdroju
+		void add(unsigned int emitter, FormFactorCache::Row& row);	// radek se naplni v execute
+		bool execute();	// rozesle zdroje davky procesum a prijme radky; pri chybe spojeni pool zastavi a radky vyprazdni
+
+		static int runWorker(const char* address, const char* sceneFile);	// hlavni smycka pracovniho procesu; vraci navratovy kod programu
+
+	private:
+		struct Request {
+			uint32_t emitter;	// QUIT = ukoncit proces
+			uint32_t side;		// strana hemicube v pixelech (Config::HEMICUBE_W koordinatora)
+		};
+
+		struct Reply {
+			uint32_t emitter;
+			uint32_t count;		// pocet nasledujicich FormFactorCache::Entry
+		};
+
+		static const uint32_t QUIT = 0xFFFFFFFF;
+
+		static bool sendAll(uintptr_t socket, const void* data, size_t size);
+		static bool receiveAll(uintptr_t socket, void* data, size_t size);
+
+		uintptr_t listener;
+		vector<uintptr_t> sockets;	// spojeni s procesy
+		vector<void*> processes;	// HANDLE procesu
+		string sceneFile;
+		bool networking;	// probehl WSAStartup
+
+		vector<unsigned int> emitters;	// zdroje davky
+		vector<FormFactorCache::Row*> rows;
+};